@@ -5,6 +5,8 @@
 
 #include <sys/syscall.h>
 #include <linux/futex.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "spinlock.h"
 
@@ -36,37 +38,84 @@ static inline void cv_init_shared(cv_t* cv)
 	*cv = CV_INITIALIZER_PUBLIC;
 }
 
+/* Lock-agnostic halves of cv_wait(). The caller holds its lock over
+   cv_prepare() and cv_finish(), and drops it (a memory barrier) before
+   cv_block(). */
+static inline seq_t cv_prepare(cv_t* cv)
+{
+	++cv->waiters;
+	return cv->seq;
+}
+
+static inline int cv_block(cv_t* cv, seq_t seq, const struct timespec* timeout)
+{
+	int wait_mode = (cv->mode == CV_PRIVATE) ? FUTEX_WAIT_PRIVATE : FUTEX_WAIT;
+	return syscall(SYS_futex, &cv->seq, wait_mode, seq, timeout, NULL, 0);
+}
+
+static inline void cv_finish(cv_t* cv)
+{
+	--cv->waiters;
+}
+
+#if PGM_SYNC_METHOD == 1
 static inline int cv_wait(cv_t* cv, spinlock_t* l)
 {
 	int ret;
-	int wait_mode = (cv->mode == CV_PRIVATE) ? FUTEX_WAIT_PRIVATE : FUTEX_WAIT;
-	seq_t seq = cv->seq;
+	seq_t seq = cv_prepare(cv);
 
-	++cv->waiters;
 	spin_unlock(l); /* memory barrier */
-	ret = syscall(SYS_futex, &cv->seq, wait_mode, seq, NULL, NULL, 0);
+	ret = cv_block(cv, seq, NULL);
 	spin_lock(l);
-	--cv->waiters;
+	cv_finish(cv);
+
+	return ret;
+}
+
+/* As cv_wait(), but give up after 'timeout' (relative) elapses.
+   Return: 0 if woken. -1 (errno = ETIMEDOUT) on timeout. */
+static inline int cv_wait_timed(cv_t* cv, spinlock_t* l, const struct timespec* timeout)
+{
+	int ret;
+	seq_t seq = cv_prepare(cv);
+
+	spin_unlock(l); /* memory barrier */
+	ret = cv_block(cv, seq, timeout);
+	spin_lock(l);
+	cv_finish(cv);
 
 	return ret;
 }
 
 #ifndef PGM_PREEMPTIVE
+static inline int cv_wait_timed_np(cv_t* cv, spinlock_t* l, unsigned long *flags,
+	const struct timespec* timeout)
+{
+	int ret;
+	seq_t seq = cv_prepare(cv);
+
+	spin_unlock_np(l, *flags); /* memory barrier */
+	ret = cv_block(cv, seq, timeout);
+	spin_lock_np(l, flags);
+	cv_finish(cv);
+
+	return ret;
+}
+
 static inline int cv_wait_np(cv_t* cv, spinlock_t* l, unsigned long *flags)
 {
 	int ret;
-	int wait_mode = (cv->mode == CV_PRIVATE) ? FUTEX_WAIT_PRIVATE : FUTEX_WAIT;
-	seq_t seq = cv->seq;
+	seq_t seq = cv_prepare(cv);
 
-	++cv->waiters;
 	spin_unlock_np(l, *flags); /* memory barrier */
-	ret = syscall(SYS_futex, &cv->seq, wait_mode, seq, NULL, NULL, 0);
+	ret = cv_block(cv, seq, NULL);
 	spin_lock_np(l, flags);
-	--cv->waiters;
+	cv_finish(cv);
 
 	return ret;
 }
 #endif
+#endif /* end PGM_SYNC_METHOD == 1 */
 
 static inline int cv_signal(cv_t* cv)
 {
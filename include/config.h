@@ -6,9 +6,13 @@
 #define PGM_CONFIG
 
 /*
- Select the primative to use for synchronization.
+ Select the default primative to use for synchronization.
  - For pthread sleeping-mutex + condition variables = 0
  - For PGM spinlock + PGM condition variables       = 1
+
+ All primatives are compiled in. The default may be
+ overridden per graph or per node at runtime (see
+ pgm_set_graph_lock_type()).
  */
 #ifndef _USE_LITMUS
 	#define PGM_SYNC_METHOD		0
@@ -22,10 +26,10 @@
 #endif
 
 /*
- Select the spinlock type. ticketlock_t is simple,
- but queuelock_t is more cache efficient on systems
- with large distributed caches (less bouncing of
- cache lines).
+ Select the default spinlock type. ticketlock_t is
+ simple, but queuelock_t is more cache efficient on
+ systems with large distributed caches (less bouncing
+ of cache lines). tools/lockbench compares them.
  - ticketlock_t = 0
  - queuelock_t  = 1
  */
@@ -65,6 +69,55 @@
 */
 #define PGM_SYNC_SCOPE		0
 
+/*
+ Select the method used to move data over FIFO and
+ sock_stream edges.
+ - Per-edge non-blocking read()/write() + select() = 0
+ - Batched submission through io_uring            = 1
+
+ io_uring (Linux 5.6+) posts the reads for all in-edges
+ (and writes for all out-edges) of a node with a single
+ system call. PGM falls back to method 0 at runtime if
+ the kernel refuses to set up a ring.
+*/
+#define PGM_IO_METHOD		0
+
+/*
+ Select whether nodes and edges keep runtime statistics
+ (see pgm_get_node_stats()).
+ - Disabled = 0
+ - Enabled  = 1
+
+ Counters are only written by the threads that own the
+ nodes. They are updated with relaxed atomic stores, which
+ compile to plain loads and stores. Each invocation reads
+ the clock when pgm_wait() returns and again in
+ pgm_complete(), plus twice more whenever a node blocks.
+*/
+#define PGM_STATS_METHOD	0
+
+/*
+ Select whether the event tracer (see pgm_trace_start())
+ is compiled in.
+ - Disabled = 0
+ - Enabled  = 1
+
+ While no trace is being recorded, each trace point
+ costs one load and a branch.
+*/
+#define PGM_TRACE_METHOD	0
+
+/*
+ Select whether end-to-end latency is tracked (see
+ pgm_set_origin()).
+ - Disabled = 0
+ - Enabled  = 1
+
+ Each production stamps its out-edges with the origin
+ time of the job. Sinks read the clock once per job, and
+ only if an origin was set.
+*/
+#define PGM_LATENCY_METHOD	0
 
 /*** VALIDATE CONFGURATION ***/
 
@@ -104,3 +157,35 @@
 #else
 	#error "Unknown synchronization scope."
 #endif
+
+#if (PGM_STATS_METHOD == 0)
+	/* nothing to do */
+#elif (PGM_STATS_METHOD == 1)
+	#define PGM_STATS
+#else
+	#error "Unknown statistics method."
+#endif
+
+#if (PGM_TRACE_METHOD == 0)
+	/* nothing to do */
+#elif (PGM_TRACE_METHOD == 1)
+	#define PGM_TRACE
+#else
+	#error "Unknown trace method."
+#endif
+
+#if (PGM_LATENCY_METHOD == 0)
+	/* nothing to do */
+#elif (PGM_LATENCY_METHOD == 1)
+	#define PGM_LATENCY
+#else
+	#error "Unknown latency method."
+#endif
+
+#if (PGM_IO_METHOD == 0)
+	/* nothing to do */
+#elif (PGM_IO_METHOD == 1)
+	#define PGM_USE_IO_URING
+#else
+	#error "Unknown I/O method."
+#endif
@@ -5,6 +5,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 
 #include "config.h"
 
@@ -26,6 +29,16 @@
 #define __PGM_EDGE_MQ          0x00000004
 #define __PGM_EDGE_RING        0x00000008
 #define __PGM_EDGE_SOCK_STREAM 0x00000010
+#define __PGM_EDGE_CUSTOM      0x00000100
+
+/* edge types of custom transports carry the transport's id in these bits */
+#define __PGM_EDGE_CUSTOM_SHIFT 16
+#define __PGM_EDGE_CUSTOM_MASK  0x00ff0000
+
+#define PGM_MAX_TRANSPORTS		16        /* per process */
+#define PGM_EDGE_STATE_SIZE		64        /* bytes of per-edge transport state */
+#define PGM_MAX_REPLICAS		16        /* per node */
+#define PGM_MAX_INFLIGHT		16        /* jobs per node */
 
 typedef enum
 {
@@ -58,6 +71,35 @@ typedef enum
 typedef unsigned char pgm_command_t;
 const pgm_command_t PGM_TERMINATE = 0x80;
 
+/* Locks that protect the wait state of a node (the condition its
+   signaled in-edges are waited on). */
+typedef enum
+{
+	/* selected by PGM_SYNC_METHOD and PGM_SPINLOCK_TYPE in config.h */
+	PGM_LOCK_DEFAULT = 0,
+	/* pthread mutex and condition variable */
+	PGM_LOCK_PTHREAD,
+	/* ticket spinlock and futex-based condition variable */
+	PGM_LOCK_TICKET,
+	/* MCS queue spinlock and futex-based condition variable.
+	   Not available with PGM_SYNC_SCOPE 1 (shared). */
+	PGM_LOCK_MCS,
+} pgm_lock_type_t;
+
+/* How the invocations of a replicated node are handed out to its
+   replicas. See pgm_set_replicas(). */
+typedef enum
+{
+	/* to whichever replica asks first (idle replicas take work) */
+	PGM_REPLICA_DYNAMIC = 0,
+	/* to replicas 0, 1, ..., K-1, 0, ... in turn, numbered by the
+	   order in which they claimed the node */
+	PGM_REPLICA_ROUND_ROBIN,
+} pgm_replica_policy_t;
+
+/* A job of a node with several jobs in flight. See pgm_set_concurrency(). */
+typedef int pgm_inv_t;
+
 /* Graph handle (opaque type) */
 typedef int graph_t;
 
@@ -119,10 +161,168 @@ typedef struct pgm_edge_attr
 			const char* node;
 			/* producer's socket descriptor */
 			int fd_prod_socket;
+
+			/* Optional tuning. Zero keeps the system default. */
+
+			/* Disable Nagle's algorithm (TCP_NODELAY) on both ends. */
+			int nodelay;
+			/* Socket buffer sizes in bytes (SO_SNDBUF of the producer,
+			   SO_RCVBUF of the consumer). */
+			int sndbuf;
+			int rcvbuf;
+			/* Busy-poll the consumer's socket for up to this many
+			   microseconds before sleeping (SO_BUSY_POLL). */
+			int busy_poll;
+			/* Send messages of at least this many bytes with MSG_ZEROCOPY.
+			   The producer still waits for the kernel to release its
+			   buffer before pgm_complete() returns. */
+			size_t zerocopy_min;
+			/* Coalesce small messages that are produced within this many
+			   microseconds of each other into one send. Staged messages
+			   are sent when the producer would block in pgm_wait(), when
+			   the staging buffer fills, or by the first pgm_complete()
+			   after the oldest has waited 'coalesce_us'. Ignored if the
+			   producer is a source node (it never waits). Rejected if the
+			   producer is replicated or has several jobs in flight. */
+			int coalesce_us;
 		};
 	};
 } edge_attr_t;
 
+/*
+   Runtime statistics of a node. See pgm_get_node_stats().
+ */
+typedef struct pgm_node_stats
+{
+	/* Number of times pgm_wait() (or a variant) consumed inputs. */
+	uint64_t nr_invocations;
+	/* Number of calls to pgm_complete(). */
+	uint64_t nr_completions;
+	/* Total and longest time spent blocked waiting for inputs (ns). */
+	uint64_t wait_ns;
+	uint64_t max_wait_ns;
+	/* Total and longest execution time (ns), from the return of
+	   pgm_wait() to the following pgm_complete(). Not measured for
+	   sources, which do not call pgm_wait(). */
+	uint64_t exec_ns;
+	uint64_t max_exec_ns;
+	/* CLOCK_MONOTONIC time of the first and of the most recent call
+	   to pgm_complete() (ns). 0 if the node has never completed. */
+	uint64_t first_complete_ns;
+	uint64_t last_complete_ns;
+} pgm_node_stats_t;
+
+/*
+   Runtime statistics of an edge. See pgm_get_edge_stats().
+ */
+typedef struct pgm_edge_stats
+{
+	/* Tokens produced and consumed. */
+	uint64_t nr_produced;
+	uint64_t nr_consumed;
+	/* Bytes sent and received. (Data-passing edges only.) */
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	/* Largest number of tokens ever queued on the edge, as seen by
+	   the producer. */
+	uint64_t max_pending;
+} pgm_edge_stats_t;
+
+/*
+   End-to-end latency observed by a sink. See pgm_get_latency_stats().
+   Percentiles are read from a log-linear histogram, so they are
+   reported as the upper bound of a bucket (within 1% of the true value).
+ */
+typedef struct pgm_latency_stats
+{
+	/* Number of jobs that completed with a known origin. */
+	uint64_t count;
+	/* Number of jobs whose origin was lost because a consumer on the
+	   way fell too far behind its producer. These are not included
+	   in the other fields. */
+	uint64_t nr_lost;
+	uint64_t min_ns;
+	uint64_t mean_ns;
+	uint64_t max_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t p9999_ns;
+} pgm_latency_stats_t;
+
+/*
+   Release statistics of a periodic node. See pgm_set_periodic().
+ */
+typedef struct pgm_release_stats
+{
+	/* Number of releases that started a job. */
+	uint64_t nr_releases;
+	/* Number of releases that were already due when pgm_wait() was
+	   called, because the previous job completed too late. */
+	uint64_t nr_overruns;
+	/* Number of releases that were skipped because they were a full
+	   period or more in the past. */
+	uint64_t nr_missed;
+	/* Longest time from a release until pgm_wait() returned (ns). */
+	uint64_t max_lateness_ns;
+} pgm_release_stats_t;
+
+/*
+   Operations of a custom edge transport. See pgm_register_transport().
+
+   Custom edges use the same framing as FIFO and sock_stream edges:
+   PGM writes (and reads) a one-byte tag ahead of each message, so
+   read() and write() see a byte stream. Every callback gets the edge's
+   opaque 'state' area (PGM_EDGE_STATE_SIZE bytes, 16-byte aligned,
+   zeroed when the edge is created). In multi-process graphs, the state
+   lives in shared memory.
+
+   Callbacks marked (optional) may be NULL.
+ */
+typedef struct pgm_edge_transport
+{
+	/* Name shown in diagnostics and by pgm_print_graph(). (optional) */
+	const char* name;
+
+	/* If non-zero, producers signal consumers the way they do over
+	   pgm_fast_fifo_edge edges, and consumers read once enough tokens
+	   have arrived. Otherwise, consumers wait on the descriptor
+	   returned by read_fd(). */
+	int signaled;
+
+	/* Called when the edge is created / when its graph is destroyed.
+	   (optional) Return: 0 on success. -1 on error. */
+	int (*init)(edge_t edge, void* state);
+	int (*destroy)(edge_t edge, void* state);
+
+	/* Called by the threads that claim/release the consumer and the
+	   producer. (optional) Return: 0 on success. -1 on error. */
+	int (*open_consumer)(edge_t edge, void* state);
+	int (*open_producer)(edge_t edge, void* state);
+	int (*close_consumer)(edge_t edge, void* state);
+	int (*close_producer)(edge_t edge, void* state);
+
+	/* Move up to 'nbytes' bytes. Must not block. Return: number of bytes
+	   moved. -1 on error, with errno set to EAGAIN if nothing could be
+	   moved yet. */
+	ssize_t (*read)(void* state, void* buf, size_t nbytes);
+	ssize_t (*write)(void* state, const void* buf, size_t nbytes);
+
+	/* Descriptor that select() reports readable when read() can make
+	   progress. Called after open_consumer(). Required if 'signaled'
+	   is zero. */
+	int (*read_fd)(void* state);
+
+	/* Zero-copy hooks. (optional, but both or neither) If provided, edge
+	   buffers are allocated from the transport, and read()/write() are
+	   handed pointers into that memory (just past the one-byte tag).
+	   Transports that can move data in place, such as out of registered
+	   memory, can then skip a copy. alloc_buf() must return 'nbytes'
+	   bytes aligned to 16 bytes, or NULL. */
+	void* (*alloc_buf)(void* state, size_t nbytes, int is_producer);
+	void  (*free_buf)(void* buf);
+} pgm_edge_transport_t;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -184,6 +384,21 @@ int pgm_init_graph(graph_t* graph, const char* graph_name);
  */
 int pgm_print_graph(graph_t graph, FILE* out);
 
+/*
+   Prints the graph in dot format, annotated with runtime statistics
+   (see pgm_get_node_stats()). Nodes are labeled with utilization,
+   mean/p99 execution time, and firing rate, and are colored from
+   green (idle) to red (never blocked). Edges are labeled with
+   throughput and maximum backlog. Pen width scales with throughput,
+   and color with backlog. Requires PGM_STATS_METHOD to be enabled in
+   config.h. Call from the process that ran the graph, so that p99
+   execution times are available.
+     [in] graph: Graph
+     [in] file: File descriptor
+   Return: 0 on success. -1 on error.
+ */
+int pgm_print_graph_stats(graph_t graph, FILE* out);
+
 /*
    Destroy a graph.
      [in] graph: Graph
@@ -200,6 +415,97 @@ int pgm_destroy_graph(graph_t graph);
  */
 int pgm_init_node(node_t* node, graph_t graph, const char* name);
 
+/*
+   Select the lock used by nodes added to a graph from now on.
+   Spinlocks (PGM_LOCK_TICKET, PGM_LOCK_MCS) should only be chosen if
+   nodes do not share CPUs or PGM_NP_METHOD makes lock holders
+   non-preemptive: waiters spin while a preempted holder is off-CPU.
+     [in] graph: Graph
+     [in] type: Lock type
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_graph_lock_type(graph_t graph, pgm_lock_type_t type);
+
+/*
+   Select the lock of a single node. The node must not be claimed, and
+   none of its producers may be running.
+     [in] node: Node
+     [in] type: Lock type
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_node_lock_type(node_t node, pgm_lock_type_t type);
+
+/*
+   Get the lock type of a node.
+     [in] node: Node
+   Return: Lock type (never PGM_LOCK_DEFAULT). PGM_LOCK_DEFAULT
+     if the node is invalid.
+ */
+pgm_lock_type_t pgm_get_node_lock_type(node_t node);
+
+/*
+   Release a node periodically. pgm_wait() (and its variants) return
+   no earlier than the next release of the node, at time zero +
+   'phase_ns' + k*'period_ns'. Time zero is the first call to
+   pgm_wait() of any periodic node of the graph, so the releases of
+   its periodic nodes stay aligned. A node with in-edges still waits
+   for its tokens after each release. A node without in-edges (a
+   source) is released by time alone, and pgm_wait() then returns 0
+   without terminating the node. (With PGM_LATENCY_METHOD, the origin
+   of a source job is its release time.) If pgm_wait() is called after
+   the next release, that release is counted as an overrun and takes
+   place at once; releases a full period or more in the past are
+   skipped and counted as missed. The node must not be claimed.
+     [in] node: Node
+     [in] period_ns: Period. 0 to release the node by tokens only.
+     [in] phase_ns: Time from time zero to the first release
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_periodic(node_t node, uint64_t period_ns, uint64_t phase_ns);
+
+/*
+   Replicate a node whose jobs are independent of one another, so that
+   up to 'nr_replicas' of its jobs run in parallel. Each replica is a
+   thread that claims the node (all replicas must be in the same
+   process) and then calls pgm_wait() and pgm_complete() as usual.
+   Jobs are handed out to the replicas one at a time, in the order in
+   which their inputs arrive. pgm_complete() blocks until the jobs
+   handed out earlier have completed, so successors see the outputs in
+   order, as if the node were not replicated. Every replica has its
+   own buffers of the node's data-passing edges; pgm_get_edge_buf_c()
+   and pgm_get_edge_buf_p() return those of the calling replica. Once
+   the node is signaled to terminate, pgm_wait() returns PGM_TERMINATE
+   to every replica. With PGM_REPLICA_ROUND_ROBIN, all 'nr_replicas'
+   replicas must claim the node. Replicas may not swap edge buffers or
+   use pgm_get_ready_fd(), and the node may not have coalesced
+   out-edges. The node must have in-edges and may not be claimed.
+     [in] node: Node descriptor
+     [in] nr_replicas: Number of replicas, at most PGM_MAX_REPLICAS.
+                       1 to stop replicating the node.
+     [in] policy: How jobs are handed out to the replicas
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_replicas(node_t node, int nr_replicas, pgm_replica_policy_t policy);
+
+/*
+   Let a node whose jobs are independent of one another have up to
+   'nr_inflight' jobs in flight, so that, e.g., the inputs of job k+1
+   are received while job k computes or sends its outputs. The node is
+   claimed by one thread, and its jobs are run with pgm_wait_inv() and
+   pgm_complete_inv() instead of pgm_wait() and pgm_complete(). Each
+   job has its own buffers of the node's data-passing edges (see
+   pgm_get_inv_buf_c() and pgm_get_inv_buf_p()). Jobs may complete in
+   any order, but their outputs are sent in the order in which the jobs
+   started, so successors see them as if the node ran one job at a
+   time. Same restrictions as pgm_set_replicas(), and a node may not be
+   replicated as well.
+     [in] node: Node descriptor
+     [in] nr_inflight: Jobs in flight, at most PGM_MAX_INFLIGHT. 1 for
+                       one job at a time.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_concurrency(node_t node, int nr_inflight);
+
 /*
    Add an edge between two nodes in the same graph.
      [out] edge: Pointer to edge
@@ -215,6 +521,17 @@ int pgm_init_node(node_t* node, graph_t graph, const char* name);
 int pgm_init_edge5(edge_t* edge, node_t producer, node_t consumer,
 	const char* name, const edge_attr_t* attr);
 
+/*
+   Register a custom edge transport with this process. Processes that
+   share a graph must register the same transports in the same order.
+     [in]  transport: Transport operations. Copied by PGM.
+     [out] type: Edge type to use in edge_attr_t::type for edges
+                 of this transport.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_register_transport(const pgm_edge_transport_t* transport,
+	pgm_edge_type_t* type);
+
 /*
    Add an back-edge between two nodes in the same graph. It is assumed
    that the producer will be a child of the consumer. The 'nr_skip' parameter
@@ -236,6 +553,64 @@ int pgm_init_backedge6(edge_t* edge, size_t nr_skips,
 	node_t producer, node_t consumer,
 	const char* name, const edge_attr_t* attr);
 
+/*
+   An edge of a graph description. See pgm_build_graph().
+ */
+typedef struct pgm_edge_desc
+{
+	/* Indices of the producer and consumer in pgm_graph_desc_t::nodes */
+	int producer;
+	int consumer;
+	/* Name of the edge. If NULL, "edge_<producer name>_<consumer name>". */
+	const char* name;
+	edge_attr_t attr;
+	/* Non-zero for a back-edge (see pgm_init_backedge6()) */
+	int is_backedge;
+	size_t nr_skips;
+} pgm_edge_desc_t;
+
+/*
+   A complete graph structure. See pgm_build_graph().
+ */
+typedef struct pgm_graph_desc
+{
+	/* Node names. Nodes are created in this order, and must be unique. */
+	int nr_nodes;
+	const char* const* nodes;
+	/* Edges. Edges are created in this order. */
+	int nr_edges;
+	const pgm_edge_desc_t* edges;
+} pgm_graph_desc_t;
+
+/*
+   Create all the nodes and edges of a new, empty graph at once. The
+   whole description is validated before the graph is touched. Nodes
+   and edges are then created under a single acquisition of the graph
+   lock, and the topology analyses behind pgm_is_dag2(graph, 1) and
+   unweighted pgm_get_{min,max}_depth3() are computed up front.
+   On error, the graph is left empty.
+     [in] graph: Graph descriptor of an empty graph
+     [in]  desc: Graph description
+   Return: 0 on success. -1 on error.
+ */
+int pgm_build_graph(graph_t graph, const pgm_graph_desc_t* desc);
+
+/*
+   Like pgm_build_graph(), but from a text description of the form
+     [<name>[.produce]:<name>[.consume[.threshold]],]+
+   Each "<producer>:<consumer>" entry is an edge, named
+   "edge_<producer>_<consumer>". A lone "<name>" or "<name>:" only
+   creates a node. Nodes are created in order of first appearance.
+     [in] graph: Graph descriptor of an empty graph
+     [in]  desc: Graph description
+     [in]  attr: Type and other parameters of every edge. Produce and
+                 consume amounts default to 1, and the threshold to the
+                 consume amount, unless given in 'desc'. If NULL, edges
+                 are CV edges.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_build_graph_str(graph_t graph, const char* desc, const edge_attr_t* attr);
+
 /*
    Find a graph by its name. (Graph is found within the namespace
    defined by the 'dir' parameter of pgm_init()).
@@ -381,6 +756,48 @@ int pgm_get_degree_out2(node_t node, int ignore_backedges);
  */
 const char* pgm_get_name(node_t node);
 
+/*
+   Get the name of an edge.
+     [in] edge: Edge descriptor
+   Return: Name of the edge. NULL on error.
+ */
+const char* pgm_get_edge_name(edge_t edge);
+
+/*
+   Get the number of nodes in a graph.
+     [in] graph: Graph
+   Return: Number of nodes. -1 on error.
+ */
+int pgm_get_nr_nodes(graph_t graph);
+
+/*
+   Get the number of edges in a graph.
+     [in] graph: Graph
+   Return: Number of edges. -1 on error.
+ */
+int pgm_get_nr_edges(graph_t graph);
+
+/*
+   Get node descriptors of all nodes in a graph. Useful to
+   processes that attach to a graph created by another.
+     [in]     graph: Graph
+     [in/out] nodes: Buffer for returning nodes
+     [in]     len: Number of node descriptors that 'nodes' can hold.
+                   Must be >= number of nodes in graph.
+   Return: Number of nodes returned. -1 on error.
+ */
+int pgm_get_nodes(graph_t graph, node_t* nodes, int len);
+
+/*
+   Get edge descriptors of all edges in a graph.
+     [in]     graph: Graph
+     [in/out] edges: Buffer for returning edges
+     [in]     len: Number of edge descriptors that 'edges' can hold.
+                   Must be >= number of edges in graph.
+   Return: Number of edges returned. -1 on error.
+ */
+int pgm_get_edges(graph_t graph, edge_t* edges, int len);
+
 /*
    Get the producer of an edge.
      [in] edge: Edge descriptor
@@ -438,6 +855,110 @@ int pgm_get_nr_consume(edge_t edge);
  */
 int pgm_get_nr_threshold(edge_t edge);
 
+/*
+   Get the runtime statistics of a node. Counters are updated without
+   synchronization by the thread that owns the node, so they may be
+   read at any time, by any thread or process attached to the graph.
+   (Counters are read individually, so a snapshot taken while the node
+   runs may not be consistent across fields.) Requires PGM_STATS_METHOD
+   to be enabled in config.h.
+     [in]  node: Node descriptor
+     [out] stats: Pointer to where statistics are to be stored
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_node_stats(node_t node, pgm_node_stats_t* stats);
+
+/*
+   Get the runtime statistics of an edge. Same caveats as
+   pgm_get_node_stats().
+     [in]  edge: Edge descriptor
+     [out] stats: Pointer to where statistics are to be stored
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_edge_stats(edge_t edge, pgm_edge_stats_t* stats);
+
+/*
+   Get the release statistics of a periodic node (see
+   pgm_set_periodic()). Same caveats as pgm_get_node_stats(), but
+   always available.
+     [in]  node: Node descriptor
+     [out] stats: Pointer to where statistics are to be stored
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_release_stats(node_t node, pgm_release_stats_t* stats);
+
+/*
+   Get a percentile of the execution time of a node (see
+   pgm_node_stats_t::exec_ns). Histograms are kept in the memory of
+   the process that owns the node, so this may only be called from
+   that process.
+     [in]  node: Node descriptor
+     [in]  percentile: Percentile to report, in [0.0, 100.0].
+     [out] exec_ns: Pointer to where the execution time is to be
+                    stored. 0 if nothing has been recorded.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_exec_percentile(node_t node, double percentile, uint64_t* exec_ns);
+
+/*
+   Set the origin time of the current job of a node, typically the
+   release time of a source job. When the job completes, the origin
+   travels over each out-edge with the tokens produced. A successful
+   pgm_wait() sets the origin of the consuming job to the oldest origin
+   among the tokens consumed. When a sink (a node without out-edges)
+   completes a job with an origin, CLOCK_MONOTONIC minus the origin is
+   recorded in the latency histogram of the sink. The origin is cleared
+   by pgm_complete(), so sources must set it for every job. Origins
+   are kept for the last few productions on each edge. If a consumer
+   falls further behind, the origins of its jobs (and of all jobs that
+   follow from them) are lost and only counted. Requires
+   PGM_LATENCY_METHOD to be enabled in config.h.
+     [in] node: Node descriptor (must be owned by the caller)
+     [in] origin_ns: CLOCK_MONOTONIC time in nanoseconds. 0 to clear.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_origin(node_t node, uint64_t origin_ns);
+
+/*
+   Get the origin time of the current job of a node. See pgm_set_origin().
+     [in]  node: Node descriptor
+     [out] origin_ns: Pointer to where the origin is to be stored.
+                      0 if the origin of the job is not known.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_origin(node_t node, uint64_t* origin_ns);
+
+/*
+   Get the end-to-end latency observed by a sink. Histograms are kept
+   in the memory of the process that owns the sink, so this may only
+   be called from that process (or after the sink is released, by the
+   process that owned it last). Requires PGM_LATENCY_METHOD to be
+   enabled in config.h; fails otherwise.
+     [in]  node: Node descriptor of a sink
+     [out] stats: Pointer to where statistics are to be stored.
+                  All zero if no latency has been recorded.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_latency_stats(node_t node, pgm_latency_stats_t* stats);
+
+/*
+   Get an arbitrary percentile of the end-to-end latency observed by
+   a sink. Same caveats as pgm_get_latency_stats().
+     [in]  node: Node descriptor of a sink
+     [in]  percentile: Percentile to report, in [0.0, 100.0].
+     [out] latency_ns: Pointer to where the latency is to be stored.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_latency_percentile(node_t node, double percentile, uint64_t* latency_ns);
+
+/*
+   Discard the latency recorded by a sink (e.g., after warm-up).
+   Must be called by the thread that owns the node.
+     [in] node: Node descriptor of a sink
+   Return: 0 on success. -1 on error.
+ */
+int pgm_reset_latency_stats(node_t node);
+
 /*
    Query to see if 'query' is a child of 'node'.
      [in] node:  possible parent of 'query'
@@ -560,8 +1081,248 @@ double pgm_get_max_depth1(node_t node);
 double pgm_get_max_depth2(node_t node, pgm_weight_func_t w);
 
 double pgm_get_max_depth3(node_t node, pgm_weight_func_t w, void* user);
+
+/*
+   Compute the repetition vector of a graph, treating it as synchronous
+   dataflow: the smallest positive number of invocations of each node
+   after which every edge (including back-edges) holds as many tokens as
+   it started with. That is, q[producer] * nr_produce equals
+   q[consumer] * nr_consume for every edge. Each weakly connected
+   component is solved separately.
+     [in]  graph: Graph descriptor
+     [out]  reps: reps[i] is the number of invocations of the i-th node,
+                  in the order of pgm_get_nodes()
+     [in]    len: Number of elements 'reps' can hold. Must be >= number
+                  of nodes.
+   Return: 0 on success. -1 on error, or if the rates of the graph are
+           inconsistent (some edge would accumulate tokens without
+           bound, or run dry).
+ */
+int pgm_get_repetition_vector(graph_t graph, uint64_t* reps, int len);
+
+/*
+   Get the smallest capacity of an edge with which its producer can
+   always complete an invocation while the consumer waits for tokens
+   (i.e., the edge cannot deadlock on its own). Back-edges start with
+   nr_skips * nr_consume tokens. The capacity is a sufficient bound for
+   each edge in isolation; it does not account for rates that are
+   inconsistent across the graph (see pgm_get_repetition_vector()).
+     [in]       edge: Edge descriptor
+     [out] nr_tokens: Capacity in tokens (units of nr_produce)
+     [out]   nr_msgs: Capacity in ring buffer elements (nmemb) or message
+                      queue messages (mq_maxmsg). 0 for other edge types,
+                      whose capacity is not an edge attribute. May be NULL.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_get_min_buffer_size(edge_t edge, size_t* nr_tokens, size_t* nr_msgs);
+
+/*
+   Resize the ring buffer and message queue edges of a graph to their
+   capacity from pgm_get_min_buffer_size(). Fails if the rates of the graph
+   are inconsistent. Must be called before any node of the graph is
+   claimed. Note that ring buffers round their capacity up to a power of
+   two, and message queues with mq_maxmsg > 10 may require privileges.
+     [in] graph: Graph descriptor
+   Return: 0 on success. -1 on error.
+ */
+int pgm_set_min_buffer_sizes(graph_t graph);
+
+/*
+   Real-time parameters and analysis results of a node. See pgm_analyze_rt().
+ */
+typedef struct pgm_rt_node
+{
+	/* [in] Rate of a source node: 'nr_releases' jobs every 'interval_us'
+	   microseconds. Ignored for other nodes. */
+	uint64_t nr_releases;
+	uint64_t interval_us;
+	/* [in] Worst-case execution time of a job (us) */
+	double wcet_us;
+	/* [in] Cluster that runs the node (index into the clusters) */
+	int cluster;
+
+	/* [out] Rate of the node: 'rate_releases' jobs every
+	   'rate_interval_us' microseconds, propagated from the sources */
+	uint64_t rate_releases;
+	uint64_t rate_interval_us;
+	/* [out] Average time between releases (us), and wcet_us / period_us */
+	double period_us;
+	double utilization;
+	/* [out] Bound on the time from the release of a source job until the
+	   first job of this node that depends on it may start (us) */
+	double offset_us;
+	/* [out] Bounds on how late a job completes after its deadline, and on
+	   the time from its release to its completion (us). HUGE_VAL if the
+	   node's cluster is overloaded. */
+	double tardiness_us;
+	double response_us;
+} pgm_rt_node_t;
+
+/*
+   A cluster of CPUs, scheduled by G-EDF. See pgm_analyze_rt().
+ */
+typedef struct pgm_rt_cluster
+{
+	/* [in] Number of CPUs */
+	int nr_cpus;
+	/* [out] Total utilization of the nodes in the cluster */
+	double utilization;
+	/* [out] Non-zero if the utilization exceeds 'nr_cpus', or that of a
+	   node exceeds 1. Tardiness is then unbounded. */
+	int overloaded;
+} pgm_rt_cluster_t;
+
+/*
+   Analyze the schedulability of a graph (ignoring back-edges) whose
+   source nodes are released at given rates. Rates propagate to the
+   other nodes through the produce and consume amounts of their in-edges
+   (Liu and Anderson). Each cluster is assumed to run its nodes under
+   G-EDF with deadlines equal to periods; tardiness is bounded by the
+   results of Devi and Anderson. A node's jobs start at most 'offset_us'
+   after the sources, once its producers' jobs up to the threshold
+   have completed.
+     [in]      graph: Graph descriptor. Must be acyclic.
+     [in/out]  nodes: Parameters and results of every node, in the
+                      order of pgm_get_nodes()
+     [in]   nr_nodes: Number of nodes in the graph
+     [in/out] clusters: Parameters and results of every cluster
+     [in] nr_clusters: Number of clusters
+     [out]   etoe_us: Bound on the end-to-end response time of the graph
+                      (largest offset_us + response_us). May be NULL.
+   Return: 0 if all tardiness is bounded. 1 if a cluster is overloaded.
+           -1 on error, e.g., rates that differ between the producers
+           of a node.
+ */
+int pgm_analyze_rt(graph_t graph, pgm_rt_node_t* nodes, int nr_nodes,
+	pgm_rt_cluster_t* clusters, int nr_clusters, double* etoe_us);
+
+/*
+   Assign the nodes of a graph to CPUs. Nodes joined by the edges with
+   the most data are grouped to run on the same CPU, as long as the
+   load of a group does not exceed 1 and there remain at least as many
+   groups as CPUs. Groups are then placed, heaviest first, on the CPU
+   with the best cache affinity (shared L2, then L3, then package, as
+   read from /sys/devices/system/cpu) to the groups they exchange data
+   with. A CPU only receives more than the average load (or the load of
+   the heaviest group) if no other CPU can take a group.
+     [in]     graph: Graph descriptor
+     [in]      load: load[i] is the utilization of the i-th node (in the
+                     order of pgm_get_nodes()), e.g., WCET / period
+     [in]    volume: volume[i] is the amount of data passed over the
+                     i-th edge (in the order of pgm_get_edges()), e.g.,
+                     its working set size. If NULL, every edge weighs 1.
+     [in]      cpus: CPUs to use. If NULL, all online CPUs.
+     [in]   nr_cpus: Number of CPUs in 'cpus'. Ignored if 'cpus' is NULL.
+     [out] placement: placement[i] receives the CPU of the i-th node
+   Return: 0 on success. 1 if the load of some CPU exceeds 1. -1 on error.
+ */
+int pgm_place_nodes(graph_t graph, const double* load, const double* volume,
+	const int* cpus, int nr_cpus, int* placement);
+
+/* A static schedule of an SDF (sub)graph. See pgm_init_static_schedule(). */
+typedef struct pgm_schedule* pgm_schedule_t;
+
+/*
+   Signature of a function that performs one invocation of a node in a
+   static schedule.
+     [in] node: Node being invoked
+     [in]   in: in[i] points to the data of the node's i-th in-edge
+                (in the order of pgm_get_edges_in4(node, ..., 0)):
+                nr_threshold readable bytes, of which nr_consume are
+                consumed. NULL for edges that do not pass data.
+     [in]  out: out[i] points to nr_produce bytes to fill for the node's
+                i-th out-edge (in the order of pgm_get_edges_out3(node,
+                ..., 0)). NULL for edges that do not pass data.
+     [in] user: User data given to pgm_run_static_schedule().
+   Return: 0 to continue. Non-zero to stop after this invocation.
+ */
+typedef int (*pgm_fire_func_t)(node_t node, void* const* in, void* const* out,
+	void* user);
+
+/*
+   Compute a static schedule for a set of nodes with consistent rates (see
+   pgm_get_repetition_vector()). The schedule is one period of admissible
+   invocations: each node runs as many times as its entry in the repetition
+   vector, and always with enough tokens on its in-edges. Every edge of a
+   scheduled node must connect two scheduled nodes. Back-edges start with
+   the tokens of the invocations their consumer skips, zero-filled.
+   The nodes are claimed by the calling thread until the schedule is
+   destroyed, and their edge transports are not used.
+     [out] sched: Pointer to where the schedule is stored
+     [in]  graph: Graph descriptor
+     [in]  nodes: Nodes to schedule. If NULL, all nodes of the graph.
+     [in] nr_nodes: Number of nodes in 'nodes'
+   Return: 0 on success. -1 on error, or if the nodes would deadlock.
+ */
+int pgm_init_static_schedule(pgm_schedule_t* sched, graph_t graph,
+	const node_t* nodes, int nr_nodes);
+
+/*
+   Destroy a static schedule and release its nodes.
+     [in] sched: Schedule
+   Return: 0 on success. -1 on error.
+ */
+int pgm_destroy_static_schedule(pgm_schedule_t sched);
+
+/*
+   Get the invocations of one period of a static schedule, in order.
+     [in]  sched: Schedule
+     [out]   seq: Buffer for the invocations. May be NULL.
+     [in]    len: Number of node descriptors 'seq' can hold.
+   Return: Number of invocations per period. -1 on error.
+ */
+int pgm_get_static_schedule(pgm_schedule_t sched, node_t* seq, int len);
+
+/*
+   Run a static schedule on the calling thread. Data moves between nodes
+   through in-memory buffers; there is no locking or signaling. If 'fire'
+   stops the schedule, the next call resumes with the following
+   invocation.
+     [in]      sched: Schedule
+     [in]       fire: Function that performs an invocation
+     [in]       user: Passed to 'fire'. May be NULL.
+     [in] nr_periods: Number of periods to run
+   Return: Number of periods completed. -1 on error.
+ */
+int64_t pgm_run_static_schedule(pgm_schedule_t sched, pgm_fire_func_t fire,
+	void* user, uint64_t nr_periods);
+
+/*
+   Save the structure of a graph (nodes, edges, edge attributes, node
+   lock types, and node release, replica and concurrency settings) to
+   a binary snapshot file. The DAG property of the graph and the
+   unweighted depth of every node are computed and saved too. The file
+   is replaced atomically.
+     [in]    graph: Graph descriptor
+     [in] filename: Path of the snapshot
+   Return: 0 on success. -1 on error.
+ */
+int pgm_save_graph(graph_t graph, const char* filename);
+
+/*
+   Create a graph from a snapshot written by pgm_save_graph(). Edges are
+   initialized as by pgm_init_edge(). Until nodes or edges are added,
+   pgm_is_dag2(graph, 1) and pgm_get_{min,max}_depth3() without a weight
+   function answer from the saved analysis. That is the only saving:
+   loading costs about as much as building the graph call by call, since
+   every edge is still initialized and the snapshot is checksummed.
+   Snapshots are specific to the limits and ABI of the PGM build that
+   wrote them; a snapshot from a different build, or a corrupt one, is
+   rejected.
+   Only the graph master may load snapshots.
+     [out]      graph: Pointer to where the graph descriptor is stored
+     [in]    filename: Path of the snapshot
+     [in]  graph_name: Name of the new graph. If NULL, the saved name.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_load_graph(graph_t* graph, const char* filename, const char* graph_name);
+
 /*
    Establish exclusive ownership of a node by a thread of execution.
+   The node's edges are opened concurrently. The caller blocks until
+   all are open, or until 60 seconds pass without a peer showing up.
+   A replicated node (see pgm_set_replicas()) may be claimed once by
+   each of its replicas.
      [in] node: Node descriptor
      [in]  tid: Thread descriptor. (optional)
    Return: 0 on success. -1 on error.
@@ -582,7 +1343,8 @@ int pgm_claim_any_node2(graph_t graph, node_t* node);
 int pgm_claim_any_node3(graph_t graph, node_t* node, pid_t tid);
 
 /*
-   Free a node previously claimed by a thread of execution.
+   Free a node previously claimed by a thread of execution. The edges of
+   a replicated node are closed once its last replica releases it.
      [in] node: Node descriptor
      [in]  tid: Thread descriptor of the owner. Must match the 'tid' that was
                 used to establish the ownership.
@@ -601,6 +1363,61 @@ int pgm_release_node2(node_t node, pid_t tid);
  */
 int pgm_wait(node_t node);
 
+/*
+   Like pgm_wait(), but never block. Nothing is consumed unless all
+   requisite tokens are already available.
+     [in] node: Node descriptor
+   Return: 0 on success. PGM_TERMINATE if node was signaled to exit.
+           -1 on error. (-1 with errno = EAGAIN if the node is not ready.)
+ */
+int pgm_try_wait(node_t node);
+
+/*
+   Like pgm_wait(), but give up if tokens are not available within
+   'timeout'. Nothing is consumed on timeout. (Once all inputs are
+   available, the time to copy data off of data-passing edges is not
+   bounded by 'timeout'.)
+     [in] node: Node descriptor
+     [in] timeout: Relative timeout. NULL to wait forever.
+   Return: 0 on success. PGM_TERMINATE if node was signaled to exit.
+           -1 on error. (-1 with errno = ETIMEDOUT on timeout.)
+ */
+int pgm_wait_timed(node_t node, const struct timespec* timeout);
+
+/*
+   Get a descriptor that an event loop may poll()/select()/epoll for
+   readability to learn when the node may be ready to run. The
+   descriptor may report spurious readiness, so call pgm_try_wait()
+   until it fails with EAGAIN before polling again. Must be called by
+   the thread that claimed the node. The descriptor is owned by PGM
+   and is closed when the node is released. Not supported for graphs
+   in shared memory.
+     [in] node: Node descriptor
+   Return: Descriptor on success. -1 on error.
+ */
+int pgm_get_ready_fd(node_t node);
+
+/*
+   Start a job of a node with several jobs in flight (see
+   pgm_set_concurrency()): like pgm_wait(), but consume inbound tokens
+   into the buffers of a job that is not in flight. May be called from
+   any thread of the process that claimed the node; one call waits at
+   a time.
+     [in]  node: Node descriptor
+     [out] inv: Pointer to where the job is stored
+   Return: 0 on success. PGM_TERMINATE if node was signaled to exit.
+           (Termination is passed on once the jobs in flight have
+           completed.) -1 on error. (-1 with errno = EBUSY if
+           'nr_inflight' jobs are already in flight.)
+ */
+int pgm_wait_inv(node_t node, pgm_inv_t* inv);
+
+/*
+   Like pgm_wait_inv(), but never block. (-1 with errno = EAGAIN if the
+   node is not ready.)
+ */
+int pgm_try_wait_inv(node_t node, pgm_inv_t* inv);
+
 /*
    Generate tokens on all outbound edges.
      [in] node: Node descriptor
@@ -608,6 +1425,18 @@ int pgm_wait(node_t node);
  */
 int pgm_complete(node_t node);
 
+/*
+   Complete a job started by pgm_wait_inv(). Its outputs are sent once
+   the jobs started before it have completed, but the caller does not
+   wait for that: the call that completes the oldest job in flight
+   sends its outputs, and those of the completed jobs after it.
+     [in] node: Node descriptor
+     [in]  inv: Job to complete
+   Return: 0 on success. -1 on error (including an error sending the
+           outputs of another job).
+ */
+int pgm_complete_inv(node_t node, pgm_inv_t inv);
+
 /*
    Tell a node that execution is stopping. Termination message is automatically
    passed on to successor nodes. Node cannot produce or consume tokens after
@@ -658,6 +1487,24 @@ void* pgm_get_edge_buf_p(edge_t edge);
  */
 void* pgm_get_edge_buf_c(edge_t edge);
 
+/*
+   Get the producer buffer of a job of a node with several jobs in
+   flight (see pgm_set_concurrency()).
+     [in] edge: Edge descriptor
+     [in]  inv: Job of the producer of 'edge'
+   Return: Pointer to memory of the job's producer buffer.
+ */
+void* pgm_get_inv_buf_p(edge_t edge, pgm_inv_t inv);
+
+/*
+   Get the consumer buffer of a job of a node with several jobs in
+   flight (see pgm_set_concurrency()).
+     [in] edge: Edge descriptor
+     [in]  inv: Job of the consumer of 'edge'
+   Return: Pointer to memory of the job's consumer buffer.
+ */
+void* pgm_get_inv_buf_c(edge_t edge, pgm_inv_t inv);
+
 /*
    Get the edge from an assigned buffer's pointer.
      [in] buf: Pointer to memory buffer
@@ -704,6 +1551,24 @@ void* pgm_swap_edge_buf_c(edge_t edge, void* buf);
  */
 int pgm_swap_edge_bufs(void* a, void* b);
 
+/*
+   Start recording wait, complete, terminate, and edge send/receive
+   events of all nodes in this process to 'file' (see pgmtrace.h for
+   the format, and tools/pgmtrace for conversion to Chrome's trace
+   format). Events are buffered per thread and written out by a
+   background thread. Requires PGM_TRACE_METHOD to be enabled in
+   config.h.
+     [in] file: Path of trace file. Overwritten if it exists.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_trace_start(const char* file);
+
+/*
+   Stop recording, flush any buffered events, and close the trace file.
+   Return: 0 on success. -1 on error.
+ */
+int pgm_trace_stop(void);
+
 /*
  Convenience functions to allow number-based names instead of
  string-based names.
@@ -0,0 +1,56 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+// On-disk format of traces recorded by pgm_trace_start().
+
+#pragma once
+
+#include <stdint.h>
+
+#define PGM_TRACE_MAGIC		"PGMTRC01"
+#define PGM_TRACE_MAGIC_LEN	8
+
+typedef enum pgm_trace_type
+{
+	/* node events. 'node' is set. 'edge' is -1. */
+	PGM_TRACE_WAIT_BEGIN = 1,  /* entered pgm_wait() (or a variant) */
+	PGM_TRACE_WAIT_END,        /* left pgm_wait(). 'arg' is the return value
+	                              (-2 for timeouts of pgm_try_wait()/pgm_wait_timed()) */
+	PGM_TRACE_COMPLETE,        /* left pgm_complete() */
+	PGM_TRACE_TERMINATE,       /* left pgm_terminate() */
+
+	/* edge events. 'node' and 'edge' are set. */
+	PGM_TRACE_SEND,            /* producer 'node' produced on 'edge'. 'arg' is the
+	                              number of times it has done so (from 1). */
+	PGM_TRACE_RECV,            /* consumer 'node' consumed from 'edge'. 'arg' is the
+	                              matching 'arg' of the SEND that completed the
+	                              tokens consumed. 0 if they were initial tokens. */
+
+	/* 'arg' events were lost by thread 'tid' because its buffer was full. */
+	PGM_TRACE_DROPPED,
+
+	/* name records. followed by PGM_TRACE_NAME_LEN bytes holding the
+	   NUL-terminated name. */
+	PGM_TRACE_NAME_GRAPH,      /* 'node' and 'edge' are -1 */
+	PGM_TRACE_NAME_NODE,       /* 'node' is set */
+	PGM_TRACE_NAME_EDGE,       /* 'edge' is set, 'node' is the producer,
+	                              and 'tid' is the consumer */
+} pgm_trace_type_t;
+
+#define PGM_TRACE_NAME_LEN	96
+
+/*
+   A trace file is PGM_TRACE_MAGIC followed by a sequence of records.
+   Events of one thread appear in order, but events of different threads
+   are interleaved in the order they were flushed. Sort by 'ts'.
+ */
+typedef struct pgm_trace_event
+{
+	uint16_t type;
+	uint16_t graph;
+	uint32_t tid;   /* Linux thread ID of the recording thread */
+	int32_t  node;
+	int32_t  edge;
+	uint64_t ts;    /* CLOCK_MONOTONIC, in nanoseconds */
+	uint64_t arg;
+} pgm_trace_event_t;
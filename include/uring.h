@@ -0,0 +1,238 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+// A minimal, single-issuer wrapper around the Linux io_uring
+// interface. Only what PGM needs to batch reads/writes on edge
+// descriptors is provided (no liburing dependency).
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct uring
+{
+	int fd;
+
+	/* submission queue */
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned  sq_entries;
+	unsigned  sq_local_tail;
+	struct io_uring_sqe* sqes;
+
+	/* completion queue */
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+
+	/* mappings (sq_ring and cq_ring may be the same) */
+	void*  sq_ring;
+	size_t sq_ring_sz;
+	void*  cq_ring;
+	size_t cq_ring_sz;
+	size_t sqes_sz;
+};
+
+/*
+   Initialize an io_uring instance.
+     [in] u: Pointer to uring instance.
+     [in] entries: Number of submission queue entries.
+   Return: 0 on success. -1 on error (e.g., kernel lacks io_uring).
+ */
+static inline int init_uring(struct uring* u, unsigned entries)
+{
+	struct io_uring_params p;
+	char* sq;
+	char* cq;
+
+	memset(u, 0, sizeof(*u));
+	memset(&p, 0, sizeof(p));
+
+	u->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if(u->fd < 0)
+		return -1;
+
+	u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(u->cq_ring_sz > u->sq_ring_sz)
+			u->sq_ring_sz = u->cq_ring_sz;
+		u->cq_ring_sz = u->sq_ring_sz;
+	}
+
+	u->sq_ring = mmap(0, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if(u->sq_ring == MAP_FAILED)
+		goto err_close;
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		u->cq_ring = u->sq_ring;
+	}
+	else
+	{
+		u->cq_ring = mmap(0, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if(u->cq_ring == MAP_FAILED)
+			goto err_unmap_sq;
+	}
+
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = (struct io_uring_sqe*)mmap(0, u->sqes_sz, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if(u->sqes == MAP_FAILED)
+		goto err_unmap_cq;
+
+	sq = (char*)u->sq_ring;
+	cq = (char*)u->cq_ring;
+
+	u->sq_head    = (unsigned*)(sq + p.sq_off.head);
+	u->sq_tail    = (unsigned*)(sq + p.sq_off.tail);
+	u->sq_mask    = (unsigned*)(sq + p.sq_off.ring_mask);
+	u->sq_array   = (unsigned*)(sq + p.sq_off.array);
+	u->sq_entries = p.sq_entries;
+	u->sq_local_tail = *u->sq_tail;
+
+	u->cq_head = (unsigned*)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	u->cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	return 0;
+
+err_unmap_cq:
+	if(u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_sz);
+err_unmap_sq:
+	munmap(u->sq_ring, u->sq_ring_sz);
+err_close:
+	close(u->fd);
+	u->fd = -1;
+	return -1;
+}
+
+/*
+   Free io_uring resources.
+ */
+static inline void free_uring(struct uring* u)
+{
+	if(!u || u->fd < 0)
+		return;
+
+	munmap(u->sqes, u->sqes_sz);
+	if(u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_sz);
+	munmap(u->sq_ring, u->sq_ring_sz);
+	close(u->fd);
+	u->fd = -1;
+}
+
+/*
+   Get the next free submission queue entry.
+   Return: Zeroed SQE. NULL if the submission queue is full.
+ */
+static inline struct io_uring_sqe* uring_get_sqe(struct uring* u)
+{
+	struct io_uring_sqe* sqe;
+	unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+	if(u->sq_local_tail - head >= u->sq_entries)
+		return NULL;
+
+	sqe = &u->sqes[u->sq_local_tail & *u->sq_mask];
+	u->sq_array[u->sq_local_tail & *u->sq_mask] = u->sq_local_tail & *u->sq_mask;
+	++u->sq_local_tail;
+
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static inline void uring_prep_rw(struct io_uring_sqe* sqe, int op, int fd,
+	const void* addr, unsigned len, uint64_t user_data)
+{
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)addr;
+	sqe->len = len;
+	sqe->user_data = user_data;
+}
+
+/* Wait for 'events' on 'fd'. Link to a read/write to perform
+   the operation only once the descriptor is ready. */
+static inline void uring_prep_poll(struct io_uring_sqe* sqe, int fd,
+	short events, uint64_t user_data)
+{
+	uring_prep_rw(sqe, IORING_OP_POLL_ADD, fd, 0, 0, user_data);
+	sqe->poll_events = events;
+	sqe->flags |= IOSQE_IO_LINK;
+}
+
+static inline void uring_prep_read(struct io_uring_sqe* sqe, int fd,
+	void* buf, unsigned nbytes, uint64_t user_data)
+{
+	uring_prep_rw(sqe, IORING_OP_READ, fd, buf, nbytes, user_data);
+	sqe->off = (uint64_t)-1; /* use (and update) the file position */
+}
+
+static inline void uring_prep_write(struct io_uring_sqe* sqe, int fd,
+	const void* buf, unsigned nbytes, uint64_t user_data)
+{
+	uring_prep_rw(sqe, IORING_OP_WRITE, fd, buf, nbytes, user_data);
+	sqe->off = (uint64_t)-1;
+}
+
+static inline void uring_prep_recv(struct io_uring_sqe* sqe, int fd,
+	void* buf, unsigned nbytes, int flags, uint64_t user_data)
+{
+	uring_prep_rw(sqe, IORING_OP_RECV, fd, buf, nbytes, user_data);
+	sqe->msg_flags = flags;
+}
+
+static inline void uring_prep_send(struct io_uring_sqe* sqe, int fd,
+	const void* buf, unsigned nbytes, int flags, uint64_t user_data)
+{
+	uring_prep_rw(sqe, IORING_OP_SEND, fd, buf, nbytes, user_data);
+	sqe->msg_flags = flags;
+}
+
+/*
+   Submit all prepared SQEs and wait for at least 'wait_nr' completions.
+   Return: Number of SQEs consumed by the kernel. -1 on error.
+ */
+static inline int uring_submit_and_wait(struct uring* u, unsigned wait_nr)
+{
+	unsigned to_submit = u->sq_local_tail - *u->sq_tail;
+	unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+	__atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+	return syscall(__NR_io_uring_enter, u->fd, to_submit, wait_nr, flags, NULL, 0);
+}
+
+/*
+   Get the next available completion, if any.
+   Return: Pointer to CQE. NULL if the completion queue is empty.
+ */
+static inline struct io_uring_cqe* uring_peek_cqe(struct uring* u)
+{
+	unsigned head = *u->cq_head;
+	if(head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &u->cqes[head & *u->cq_mask];
+}
+
+/* Mark the CQE returned by uring_peek_cqe() as consumed. */
+static inline void uring_cqe_seen(struct uring* u)
+{
+	__atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
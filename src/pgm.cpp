@@ -1,20 +1,37 @@
 #include "pgm.h"
+#include "pgmtrace.h"
 
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <pthread.h>
 #include <mqueue.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <limits.h>
 
 #include <sys/socket.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
 
 #include <sys/syscall.h>
 
 #include <set>
+#include <map>
+#include <algorithm>
+#include <functional>
 #include <queue>
+#include <limits>
 #include <string>
 #include <sstream>
 
@@ -29,22 +46,51 @@
 #include <boost/graph/bellman_ford_shortest_paths.hpp>
 #include <boost/property_map/property_map.hpp>
 
-#if defined(PGM_USE_PTHREAD_SYNC)
-typedef pthread_mutex_t pgm_lock_t;
-typedef pthread_cond_t  pgm_cv_t;
-#elif defined(PGM_USE_PGM_SYNC)
-#include "spinlock.h"
+// All lock types are compiled in. config.h only selects the default.
+#include "ticketlock.h"
+#include "queuelock.h"
 #include "condvar.h"
-typedef spinlock_t      pgm_lock_t;
-typedef cv_t            pgm_cv_t;
 
-#if PGM_SPINLOCK_TYPE == 1
 __thread queuenode_t thread_qnode;
+
+#if defined(PGM_USE_PTHREAD_SYNC)
+#define PGM_LOCK_BUILTIN PGM_LOCK_PTHREAD
+#elif PGM_SPINLOCK_TYPE == 0
+#define PGM_LOCK_BUILTIN PGM_LOCK_TICKET
+#else
+#define PGM_LOCK_BUILTIN PGM_LOCK_MCS
 #endif
-#endif
+
+// Lock and condition variable of a node. The members in use
+// depend on the node's lock type.
+struct pgm_node_sync
+{
+	union
+	{
+		struct
+		{
+			pthread_mutex_t lock;
+			pthread_cond_t  cv;
+		} pthread;
+		struct
+		{
+			ticketlock_t lock;
+			cv_t         cv;
+		} ticket;
+		struct
+		{
+			queuelock_t  lock;
+			cv_t         cv;
+		} mcs;
+	};
+};
 
 #include "ring.h"
 
+#if defined(PGM_USE_IO_URING)
+#include "uring.h"
+#endif
+
 using namespace std;
 using namespace boost;
 using namespace boost::interprocess;
@@ -76,6 +122,36 @@ static inline pid_t pgm_gettid(void)
 	return p;
 }
 
+static inline uint64_t pgm_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static inline int64_t pgm_now_ms(void)
+{
+	return (int64_t)(pgm_now_ns() / 1000000);
+}
+
+// Timestamp for measuring blocking time. Free if stats are disabled.
+static inline uint64_t pgm_stats_clock(void)
+{
+#if defined(PGM_STATS)
+	return pgm_now_ns();
+#else
+	return 0;
+#endif
+}
+
+static inline struct timespec pgm_ns_to_timespec(uint64_t ns)
+{
+	struct timespec ts;
+	ts.tv_sec = ns / 1000000000ull;
+	ts.tv_nsec = ns % 1000000000ull;
+	return ts;
+}
+
 // Used to report system FAILUREs.
 #define F(fmt, ...) \
 do { \
@@ -122,6 +198,27 @@ typedef int (*close_t)(struct pgm_edge* e);
 typedef ssize_t (*read_t)(struct pgm_edge* e, void* buf, size_t nbytes);
 typedef ssize_t (*write_t)(struct pgm_edge* e, const void* buf, size_t nbytes);
 
+// Returned by open operations that could not complete without blocking.
+// The open is then driven to completion by the matching resume operation.
+#define PGM_OPEN_PENDING 1
+
+// State of an edge that is being opened without blocking.
+struct pgm_open_ctx
+{
+	// Descriptor and events to wait upon before calling resume again.
+	// fd is -1 if resume should be retried after a short delay instead.
+	struct pollfd pfd;
+	// private to the edge type
+	int step;
+};
+
+// Return: 0 when open. PGM_OPEN_PENDING if not yet open. -1 on error.
+typedef int (*resume_t)(struct pgm_graph* g, struct pgm_edge* e,
+				struct pgm_open_ctx* ctx);
+
+// Push out any data the edge has held back.
+typedef int (*flush_t)(struct pgm_edge* e);
+
 struct pgm_edge_ops
 {
 	init_t init;
@@ -132,7 +229,203 @@ struct pgm_edge_ops
 	destroy_t destroy;
 	read_t read;
 	write_t write;
+
+	// only needed if open_consumer/open_producer may return PGM_OPEN_PENDING
+	resume_t resume_consumer;
+	resume_t resume_producer;
+
+	// only needed if writes may be held back by the edge
+	flush_t flush;
+};
+
+#define PGM_CACHE_LINE_SIZE 64
+
+#if defined(PGM_TRACE) || defined(PGM_LATENCY)
+#define PGM_TRACK_TOKENS
+#endif
+
+#if defined(PGM_STATS) || defined(PGM_TRACK_TOKENS)
+// Edge counters are split by writer so that the producer and
+// consumer never write to the same cache line.
+struct pgm_edge_pstats
+{
+#if defined(PGM_STATS)
+	uint64_t nr_produced;
+	uint64_t bytes_sent;
+	uint64_t max_pending;
+#endif
+#if defined(PGM_TRACK_TOKENS)
+	uint64_t nr_sent;  // number of invocations that produced on the edge
+#endif
+} __attribute__((aligned(PGM_CACHE_LINE_SIZE)));
+
+struct pgm_edge_cstats
+{
+#if defined(PGM_STATS)
+	uint64_t nr_consumed;
+	uint64_t bytes_received;
+#endif
+#if defined(PGM_TRACK_TOKENS)
+	uint64_t nr_recv;  // number of invocations that consumed from the edge
+#endif
+} __attribute__((aligned(PGM_CACHE_LINE_SIZE)));
+#endif
+
+#if defined(PGM_LATENCY)
+// Origins of the most recent productions on an edge, indexed by
+// nr_sent. A consumer that falls further behind than this loses the
+// origins of the tokens it consumes.
+#define PGM_LATENCY_SLOTS 8
+
+// Origin of jobs that consumed tokens of lost origin.
+#define PGM_ORIGIN_LOST (~0ull)
+
+struct pgm_edge_origins
+{
+	struct
+	{
+		uint64_t seq;  // nr_sent of the production. written last.
+		uint64_t ns;
+	} slot[PGM_LATENCY_SLOTS];
+} __attribute__((aligned(PGM_CACHE_LINE_SIZE)));
+
+#endif
+
+#if defined(PGM_STATS) || defined(PGM_LATENCY)
+#define PGM_HISTOGRAMS
+
+// Log-linear histogram of durations (ns). Values below
+// 2^(PGM_HIST_SUB_BITS+1) have their own buckets. Above that, each
+// power of two is split into 2^PGM_HIST_SUB_BITS buckets.
+#define PGM_HIST_SUB_BITS 7
+#define PGM_HIST_MAX_BITS 42  // ~73 minutes. larger values are clamped.
+#define PGM_HIST_BUCKETS \
+	((PGM_HIST_MAX_BITS - PGM_HIST_SUB_BITS + 1) << PGM_HIST_SUB_BITS)
+
+struct pgm_hist
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[PGM_HIST_BUCKETS];
+};
+
+// Histograms are too large to embed in every node. They are allocated
+// by the owner of a node on first use, in the memory of process 'pid'.
+struct pgm_hist_ref
+{
+	struct pgm_hist* h;
+	pid_t pid;
 };
+#endif
+
+#if defined(PGM_STATS)
+struct pgm_node_cstats
+{
+	pgm_node_stats_t s;
+	uint64_t job_start;  // when pgm_wait() last returned (0 if unknown)
+	struct pgm_hist_ref exec;
+} __attribute__((aligned(PGM_CACHE_LINE_SIZE)));
+#endif
+
+// Counters have a single writer. Relaxed atomics keep readers in
+// other threads (or processes) from seeing torn values.
+#define pgm_stat_add(field, val) \
+	__atomic_store_n(&(field), (field) + (val), __ATOMIC_RELAXED)
+#define pgm_stat_max(field, val) \
+	do { if((val) > (field)) __atomic_store_n(&(field), (val), __ATOMIC_RELAXED); } while(0)
+#define pgm_stat_read(field) \
+	__atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+#if defined(PGM_HISTOGRAMS)
+static inline unsigned int pgm_hist_bucket(uint64_t ns)
+{
+	const uint64_t max = (1ull << PGM_HIST_MAX_BITS) - 1;
+	if(ns > max)
+		ns = max;
+	if(ns < (1ull << (PGM_HIST_SUB_BITS + 1)))
+		return ns;
+	unsigned int msb = 63 - __builtin_clzll(ns);
+	unsigned int shift = msb - PGM_HIST_SUB_BITS;
+	return ((shift + 1) << PGM_HIST_SUB_BITS) +
+		((ns >> shift) & ((1ull << PGM_HIST_SUB_BITS) - 1));
+}
+
+// Largest value that falls into bucket 'b'.
+static inline uint64_t pgm_hist_bucket_max(unsigned int b)
+{
+	if(b < (1u << (PGM_HIST_SUB_BITS + 1)))
+		return b;
+	unsigned int shift = (b >> PGM_HIST_SUB_BITS) - 1;
+	uint64_t sub = b & ((1u << PGM_HIST_SUB_BITS) - 1);
+	return (((1ull << PGM_HIST_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+// Only called by the owner of the node that holds 'ref'.
+static void pgm_hist_add(struct pgm_hist_ref* ref, uint64_t ns)
+{
+	struct pgm_hist* h = ref->h;
+
+	if(!h)
+	{
+		h = (struct pgm_hist*)calloc(1, sizeof(*h));
+		if(!h)
+			return;
+		ref->pid = getpid();
+		__atomic_store_n(&ref->h, h, __ATOMIC_RELEASE);
+	}
+
+	if(h->count == 0 || ns < h->min)
+		__atomic_store_n(&h->min, ns, __ATOMIC_RELAXED);
+	if(ns > h->max)
+		__atomic_store_n(&h->max, ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, h->sum + ns, __ATOMIC_RELAXED);
+	unsigned int b = pgm_hist_bucket(ns);
+	__atomic_store_n(&h->buckets[b], h->buckets[b] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+// Histograms of other processes cannot be read.
+static struct pgm_hist* pgm_hist_get(struct pgm_hist_ref* ref)
+{
+	struct pgm_hist* h = __atomic_load_n(&ref->h, __ATOMIC_ACQUIRE);
+	return (h && ref->pid == getpid()) ? h : 0;
+}
+
+static void pgm_hist_free(struct pgm_hist_ref* ref)
+{
+	struct pgm_hist* h = pgm_hist_get(ref);
+	if(h)
+		free(h);
+	ref->h = 0;
+}
+
+static uint64_t pgm_hist_percentile(const struct pgm_hist* h, double percentile)
+{
+	uint64_t rank, seen = 0;
+	uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	if(count == 0)
+		return 0;
+	if(percentile < 0.0)
+		percentile = 0.0;
+	rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+	if(rank < 1)
+		rank = 1;
+	if(rank >= count)
+		return max;
+
+	for(unsigned int b = 0; b < PGM_HIST_BUCKETS; ++b)
+	{
+		seen += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+		if(seen >= rank)
+			return std::min(pgm_hist_bucket_max(b), max);
+	}
+	return max;
+}
+#endif
 
 struct pgm_edge
 {
@@ -172,6 +465,21 @@ struct pgm_edge
 			// counter for determining location of the message
 			// header contained within received data.
 			size_t next_tag;
+
+			union
+			{
+				// staging area of sock_stream producers that
+				// coalesce small messages.
+				struct
+				{
+					char* stage_buf;
+					size_t stage_len;
+					uint64_t stage_start; // when the oldest staged msg was produced (ns)
+					uint64_t last_write;  // when the last msg was produced (ns)
+				};
+				// opaque state of custom transports
+				char transport_state[PGM_EDGE_STATE_SIZE] __attribute__((aligned(16)));
+			};
 		};
 		// fields for ring buffer IPC
 		struct
@@ -186,6 +494,15 @@ struct pgm_edge
 
 	// buffer for receiving data
 	struct pgm_memory_hdr* buf_in;
+
+#if defined(PGM_STATS) || defined(PGM_TRACK_TOKENS)
+	struct pgm_edge_pstats pstats;
+	struct pgm_edge_cstats cstats;
+#endif
+#if defined(PGM_LATENCY)
+	// written by the producer
+	struct pgm_edge_origins origins;
+#endif
 };
 
 static inline bool is_signal_driven(const struct pgm_edge_attr* attr)
@@ -198,6 +515,12 @@ static inline bool is_data_passing(const struct pgm_edge_attr* attr)
 	return (attr->type & __PGM_DATA_PASSING);
 }
 
+// (coalesce_us is only meaningful for sock_stream edges)
+static inline bool is_coalesced(const struct pgm_edge_attr* attr)
+{
+	return (attr->type & __PGM_EDGE_SOCK_STREAM) && attr->coalesce_us > 0;
+}
+
 static inline bool is_signal_driven(const struct pgm_edge* e)
 {
 	return is_signal_driven(&e->attr);
@@ -209,6 +532,58 @@ static inline bool is_data_passing(const struct pgm_edge* e)
 }
 
 
+// What pgm_wait() hands to pgm_complete() about a job of a replica or
+// an invocation. (Other nodes keep this in pgm_node.)
+struct pgm_job
+{
+	uint64_t origin_ns;  // PGM_LATENCY
+	uint64_t start_ns;   // PGM_STATS
+};
+
+// A replica of a replicated node (see pgm_set_replicas()), or an
+// invocation of a node with several jobs in flight (see
+// pgm_set_concurrency()).
+struct pgm_replica
+{
+	pid_t tid;     // 0 if the slot is free. (replicas only)
+	uint64_t seq;  // of the current job
+	bool running;  // between pgm_wait() and pgm_complete()
+	bool done;     // completed, but outputs not yet sent. (invocations only)
+	struct pgm_job job;
+
+	// buffers of the node's data-passing edges, indexed as
+	// pgm_node::in and pgm_node::out (NULL for other edges)
+	struct pgm_memory_hdr* buf_in[PGM_MAX_IN_DEGREE];
+	struct pgm_memory_hdr* buf_out[PGM_MAX_OUT_DEGREE];
+};
+
+// Replicas (or invocations) of a node. Allocated by the first claim of
+// the node and kept in the memory of its process. Jobs are numbered in
+// the order in which they are handed out: next_in is the number of the
+// next job, and next_out of the next job to complete.
+struct pgm_replicas
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+
+	int nr_owners;
+	int opened;      // 1 once the edges are open, -1 if that failed
+	bool in_busy;    // a replica is waiting for inputs
+	bool out_busy;   // a thread is sending outputs of invocations
+	bool terminated;
+	bool terminate_sent;
+	uint64_t next_in;
+	uint64_t next_out;
+
+	// buffers that the edges were opened with. edges are closed with
+	// these in place.
+	struct pgm_memory_hdr* orig_in[PGM_MAX_IN_DEGREE];
+	struct pgm_memory_hdr* orig_out[PGM_MAX_OUT_DEGREE];
+
+	struct pgm_replica r[(PGM_MAX_REPLICAS > PGM_MAX_INFLIGHT) ?
+				PGM_MAX_REPLICAS : PGM_MAX_INFLIGHT];
+};
+
 struct pgm_node
 {
 	char name[PGM_NODE_NAME_LEN];
@@ -233,6 +608,9 @@ struct pgm_node
 	// bit is set if edge is a singaling edge.
 	pgm_fd_mask_t signal_edge_mask;
 
+	// number of outbound edges that may hold back data
+	int nr_out_coalesced;
+
 	// number of termination signals received
 	int nr_terminate_signals;
 	int nr_terminate_msgs;
@@ -240,15 +618,63 @@ struct pgm_node
 	// Linux thread ID of thread claiming ownership
 	pid_t owner;
 
+	// Readiness notification (see pgm_get_ready_fd()). -1 if unused.
+	// ready_efd is signaled by producers; ready_epfd also watches the
+	// descriptors of data-passing in-edges.
+	int ready_efd;
+	int ready_epfd;
+
 	// Pointer to user-attached user data
 	void* userdata;
 
 	// only used if inbound edges are signal-based
-	pgm_lock_t	lock;
-	pgm_cv_t	wait;
+	pgm_lock_type_t lock_type;
+	struct pgm_node_sync sync;
+
+	// unit-weight depths (see pgm_graph::analysis_valid)
+	int min_depth;
+	int max_depth;
+
+	// periodic release (see pgm_set_periodic()). period_ns is 0 if the
+	// node is released by its tokens alone. The rest is written by the
+	// owner: next_release_ns is 0 until the first release is set, and
+	// release_checked is set once lateness of next_release_ns has been
+	// counted (a timed out wait may retry the same release).
+	uint64_t period_ns;
+	uint64_t phase_ns;
+	uint64_t next_release_ns;
+	int release_checked;
+	pgm_release_stats_t release_stats;
+
+	// replication (see pgm_set_replicas()) and jobs in flight (see
+	// pgm_set_concurrency()). not used unless nr_replicas > 1 or
+	// nr_inflight > 1. replicas is only valid in process replicas_pid.
+	int nr_replicas;
+	pgm_replica_policy_t replica_policy;
+	int nr_inflight;
+	pid_t replicas_pid;
+	struct pgm_replicas* replicas;
+
+#if defined(PGM_STATS)
+	// written only by the owner
+	struct pgm_node_cstats stats;
+#endif
 
+#if defined(PGM_LATENCY)
+	// origin of the current job (0 if unknown)
+	uint64_t origin_ns;
+	// end-to-end latency observed by sinks
+	struct pgm_hist_ref latency;
+	uint64_t nr_latency_lost;
+#endif
 };
 
+// Does node 'n' run more than one job at a time?
+static inline bool is_multi_job(const struct pgm_node* n)
+{
+	return n->nr_replicas > 1 || n->nr_inflight > 1;
+}
+
 struct pgm_graph
 {
 	int in_use;
@@ -256,6 +682,20 @@ struct pgm_graph
 
 	pthread_mutex_t lock;
 
+	// lock type of nodes added from now on
+	pgm_lock_type_t node_lock_type;
+
+	// set when the graph is loaded from a snapshot, which carries
+	// precomputed analysis: whether the graph is a DAG (ignoring
+	// back-edges) and, if so, the unit-weight depth of every node.
+	// cleared when nodes or edges are added.
+	int analysis_valid;
+	int is_dag;
+
+	// time zero of periodic releases. 0 until the first pgm_wait() of
+	// a periodic node.
+	uint64_t release_epoch_ns;
+
 	int nr_nodes;
 	int nr_edges;
 
@@ -289,6 +729,10 @@ static inline int is_valid_graph(graph_t graph)
 // forward decl. needed for allocating edge buffers
 struct pgm_memory_hdr* __pgm_malloc_edge_buf(struct pgm_graph* g,
 				struct pgm_edge* e, bool is_producer);
+void __pgm_free_edge_buf(struct pgm_memory_hdr* mem);
+// forward decl. needed for edge buffers of replicated nodes
+static struct pgm_memory_hdr* pgm_callers_edge_buf(struct pgm_graph* g,
+				struct pgm_edge* e, bool is_producer);
 
 /************* DUMMY IPC ROUTINES ****************/
 
@@ -351,14 +795,14 @@ static int ring_open_producer(pgm_graph* g,
 
 static int ring_close_consumer(pgm_edge* edge)
 {
-	free(edge->buf_in);
+	__pgm_free_edge_buf(edge->buf_in);
 	edge->buf_in = 0;
 	return 0;
 }
 
 static int ring_close_producer(pgm_edge* edge)
 {
-	free(edge->buf_out);
+	__pgm_free_edge_buf(edge->buf_out);
 	edge->buf_out = 0;
 	return 0;
 }
@@ -523,53 +967,44 @@ static int fifo_open_producer(pgm_graph* g,
 		path fifoPath(gGraphPath);
 		fifoPath /= fifo_name(g, producer, consumer, edge);
 
-		const int timeout = 60;
-		const int start_time = time(0);
 		__sync_synchronize();
-		do
-		{
-			edge->fd_out = open(fifoPath.string().c_str(),
-				O_WRONLY | O_NONBLOCK);
-			if(edge->fd_out == -1)
-			{
-				if(errno != ENXIO)
-				{
-					F("Could not open outbound edge %s/%s (FIFO)\n",
-					  g->name, edge->name);
-					break;
-				}
-				else
-				{
-					if(time(0) - start_time > timeout)
-					{
-						F("Could not open outbound edge %s/%s (FIFO)\n",
-						   g->name, edge->name);
-						break;
-					}
-					usleep(1000); // wait for a millisecond
-				}
-			}
-			else
-			{
-				ret = 0;
-			}
-		}while(ret == -1);
-
-		if(!ret)
+		edge->fd_out = open(fifoPath.string().c_str(),
+			O_WRONLY | O_NONBLOCK);
+		if(edge->fd_out != -1)
 		{
 			edge->buf_out = __pgm_malloc_edge_buf(g, edge, true);
+			ret = 0;
+		}
+		else if(errno == ENXIO)
+		{
+			// the consumer has not opened its end yet
+			ret = PGM_OPEN_PENDING;
+		}
+		else
+		{
+			F("Could not open outbound edge %s/%s (FIFO)\n",
+			  g->name, edge->name);
 		}
 	}
 	return ret;
 }
 
+static int fifo_resume_producer(pgm_graph* g, pgm_edge* edge,
+				struct pgm_open_ctx* ctx)
+{
+	// there is nothing to poll() on. just try again later.
+	ctx->pfd.fd = -1;
+	return fifo_open_producer(g, &g->nodes[edge->producer],
+				&g->nodes[edge->consumer], edge);
+}
+
 static int fifo_close_consumer(pgm_edge* edge)
 {
 	int ret = close(edge->fd_in);
 	if(!ret)
 	{
 		edge->fd_in = 0;
-		free(edge->buf_in);
+		__pgm_free_edge_buf(edge->buf_in);
 		edge->buf_in = 0;
 	}
 	return ret;
@@ -581,7 +1016,7 @@ static int fifo_close_producer(pgm_edge* edge)
 	if(!ret)
 	{
 		edge->fd_out = 0;
-		free(edge->buf_out);
+		__pgm_free_edge_buf(edge->buf_out);
 		edge->buf_out = 0;
 	}
 	return ret;
@@ -641,6 +1076,8 @@ static const struct pgm_edge_ops pgm_fifo_edge_ops =
 	.destroy = fifo_destroy,
 	.read = fifo_read,
 	.write = fifo_write,
+	.resume_consumer = 0,
+	.resume_producer = fifo_resume_producer,
 };
 
 
@@ -729,7 +1166,7 @@ static int mq_close_consumer(pgm_edge* edge)
 	if(!ret)
 	{
 		edge->fd_in = 0;
-		free(edge->buf_in);
+		__pgm_free_edge_buf(edge->buf_in);
 		edge->buf_in = 0;
 	}
 
@@ -742,7 +1179,7 @@ static int mq_close_producer(pgm_edge* edge)
 	if(!ret)
 	{
 		edge->fd_out = 0;
-		free(edge->buf_out);
+		__pgm_free_edge_buf(edge->buf_out);
 		edge->buf_out = 0;
 	}
 	return ret;
@@ -796,71 +1233,51 @@ static const struct pgm_edge_ops pgm_mq_edge_ops =
 
 /************* TCP IPC ROUTINES *****************/
 
-static int sock_stream_create(pgm_graph* g,
-				pgm_node* producer, pgm_node* consumer,
-				pgm_edge* edge)
-{
-	return 0;
-}
+// Size of the staging area of coalescing sock_stream producers,
+// and the largest message that may be staged.
+#define PGM_STAGE_SIZE		(16*1024)
+#define PGM_STAGE_MAX_MSG	(PGM_STAGE_SIZE/8)
 
-static int sock_stream_open_consumer(pgm_graph* g,
-				pgm_node* producer, pgm_node* consumer,
-				pgm_edge* edge)
+// Apply the optional tuning given in the edge's attributes to a socket.
+static void sock_stream_tune(pgm_edge* edge, int sfd, bool is_producer)
 {
-	int ret = -1;
-	int s;
-	int sfd = -1;
-	struct addrinfo hints;
-	struct addrinfo *result, *rp;
-	char portnum[32] = {0};
-
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_flags = 0;
-	hints.ai_protocol = 0;
-
-	snprintf(portnum, sizeof(portnum), "%d", edge->attr.port);
+	int one = 1;
 
-	s = getaddrinfo(edge->attr.node, portnum, &hints, &result);
-	if(s)
-	{
-		F("getaddrinfo() failed. err: %d\n", s);
-		goto out;
-	}
+	if(edge->attr.nodelay &&
+	   setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0)
+		W("Could not set TCP_NODELAY on edge %s.\n", edge->name);
 
-	for(rp = result; rp != 0; rp = rp->ai_next)
+	if(is_producer)
 	{
-		sfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-		if(sfd == -1)
-			continue;
-		if(connect(sfd, rp->ai_addr, rp->ai_addrlen) != -1)
-			break;
-		close(sfd);
+		if(edge->attr.sndbuf &&
+		   setsockopt(sfd, SOL_SOCKET, SO_SNDBUF, &edge->attr.sndbuf, sizeof(int)) != 0)
+			W("Could not set SO_SNDBUF on edge %s.\n", edge->name);
+		if(edge->attr.zerocopy_min &&
+		   setsockopt(sfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0)
+		{
+			W("MSG_ZEROCOPY is not supported. Disabled on edge %s.\n", edge->name);
+			edge->attr.zerocopy_min = 0;
+		}
 	}
-	if(rp == 0)
+	else
 	{
-		F("socket() or connect() failed.\n");
-		goto out;
+		// (set before connect() so the window scale is picked accordingly)
+		if(edge->attr.rcvbuf &&
+		   setsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &edge->attr.rcvbuf, sizeof(int)) != 0)
+			W("Could not set SO_RCVBUF on edge %s.\n", edge->name);
+		if(edge->attr.busy_poll &&
+		   setsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL, &edge->attr.busy_poll, sizeof(int)) != 0)
+			W("Could not set SO_BUSY_POLL on edge %s.\n", edge->name);
 	}
-
-	freeaddrinfo(result);
-
-	edge->fd_in = sfd;
-	edge->buf_in = __pgm_malloc_edge_buf(g, edge, false);
-	ret = 0;
-
-out:
-	return ret;
 }
 
-static int sock_stream_open_producer(pgm_graph* g,
-				pgm_node* producer, pgm_node* consumer,
-				pgm_edge* edge)
+// Set up the producer's non-blocking listen socket.
+static int sock_stream_listen(pgm_graph* g, pgm_edge* edge)
 {
 	int ret = -1;
 	int s;
 	int sfd = -1;
+	int reuse = 1;
 	char portnum[32] = {0};
 
 	struct addrinfo hints;
@@ -882,1064 +1299,3971 @@ static int sock_stream_open_producer(pgm_graph* g,
 
 	for(rp = result; rp != 0; rp = rp->ai_next)
 	{
-		sfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		sfd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK, rp->ai_protocol);
 		if (sfd == -1)
 			continue;
+		// don't let connections of a prior run (in TIME_WAIT) block the port
+		setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 		if (bind(sfd, rp->ai_addr, rp->ai_addrlen) == 0)
 			break;
 		close(sfd);
 	}
+
+	freeaddrinfo(result);
+
 	if(rp == 0)
 	{
 		F("socket() or bind() failed.\n");
 		goto out;
 	}
 
-	freeaddrinfo(result);
-
 	ret = listen(sfd, 1);
 	if(ret < 0)
 	{
 		F("listen() failed\n");
+		close(sfd);
 		goto out;
 	}
 
-	ret = accept(sfd, 0, 0);
-	if(ret < 0)
-	{
-		F("accept() failed\n");
-		goto out;
-	}
-
-	edge->fd_out = ret;
 	edge->attr.fd_prod_socket = sfd;
-	edge->buf_out = __pgm_malloc_edge_buf(g, edge, true);
 	ret = 0;
 out:
 	return ret;
 }
 
-static int sock_stream_close_consumer(pgm_edge* edge)
+static int sock_stream_create(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
 {
-	int ret;
-	ret = close(edge->fd_in);
-	if(!ret)
-	{
-		edge->fd_in = 0;
-		free(edge->buf_in);
-		edge->buf_in = 0;
-	}
-	return ret;
+	// Listen now if the producer will run in this process, so consumers
+	// can connect before the producer is claimed. Otherwise, the producer
+	// listens when it is claimed.
+	if(gGraphSharedMem)
+		return 0;
+	return sock_stream_listen(g, edge);
 }
 
-static int sock_stream_close_producer(pgm_edge* edge)
+static int sock_stream_finish_consumer(pgm_graph* g, pgm_edge* edge, int sfd)
 {
-	int ret;
-	ret = close(edge->fd_out);
-	ret |= close(edge->attr.fd_prod_socket);
-	if(!ret)
-	{
-		edge->fd_out = 0;
-		edge->attr.fd_prod_socket = 0;
-		free(edge->buf_out);
-		edge->buf_out = 0;
-	}
-	return ret;
-}
+	// reads are made with MSG_DONTWAIT, so go back to a blocking socket
+	int flags = fcntl(sfd, F_GETFL);
+	fcntl(sfd, F_SETFL, flags & ~O_NONBLOCK);
 
-static int sock_stream_destroy(pgm_graph* g,
-				pgm_node* producer, pgm_node* consumer,
-				pgm_edge* edge)
-{
+	edge->fd_in = sfd;
+	edge->buf_in = __pgm_malloc_edge_buf(g, edge, false);
 	return 0;
 }
 
-static ssize_t sock_stream_read(struct pgm_edge* e, void* buf, size_t nbytes)
+static inline bool sock_stream_should_retry(int err)
 {
-	int flags = MSG_DONTWAIT;
-	return recv(e->fd_in, buf, nbytes, flags);
+	// the producer may not be listening yet
+	return (err == ECONNREFUSED || err == ETIMEDOUT ||
+			err == ENETUNREACH || err == EHOSTUNREACH || err == ECONNRESET);
 }
 
-static ssize_t sock_stream_write(struct pgm_edge* e, const void* buf, size_t nbytes)
+// Start a non-blocking connect() to the next address of the producer.
+// ctx->step is the index of the address to try.
+static int sock_stream_connect(pgm_graph* g, pgm_edge* edge, struct pgm_open_ctx* ctx)
 {
-	int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
-	return send(e->fd_out, buf, nbytes, flags);
-}
-
-static const struct pgm_edge_ops pgm_sock_stream_edge_ops =
-{
-	.init = sock_stream_create,
-	.open_consumer = sock_stream_open_consumer,
-	.open_producer = sock_stream_open_producer,
-	.close_consumer = sock_stream_close_consumer,
-	.close_producer = sock_stream_close_producer,
-	.destroy = sock_stream_destroy,
-	.read = sock_stream_read,
-	.write = sock_stream_write,
-};
+	int ret = -1;
+	int s, i;
+	int sfd = -1;
+	struct addrinfo hints;
+	struct addrinfo *result, *rp;
+	char portnum[32] = {0};
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = 0;
+	hints.ai_protocol = 0;
 
+	snprintf(portnum, sizeof(portnum), "%d", edge->attr.port);
 
-/************* CV IPC ROUTINES *****************/
+	s = getaddrinfo(edge->attr.node, portnum, &hints, &result);
+	if(s)
+	{
+		F("getaddrinfo() failed. err: %d\n", s);
+		goto out;
+	}
 
-static int cv_create(pgm_graph* g,
+	for(rp = result, i = 0; rp != 0 && i < ctx->step; rp = rp->ai_next, ++i);
+	if(rp == 0)
+	{
+		// tried every address. back off and start over.
+		ctx->step = 0;
+		ctx->pfd.fd = -1;
+		ret = PGM_OPEN_PENDING;
+		goto out_free;
+	}
+	++ctx->step;
+
+	sfd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK, rp->ai_protocol);
+	if(sfd == -1)
+	{
+		F("socket() failed.\n");
+		goto out_free;
+	}
+	sock_stream_tune(edge, sfd, false);
+
+	if(connect(sfd, rp->ai_addr, rp->ai_addrlen) == 0)
+	{
+		ret = sock_stream_finish_consumer(g, edge, sfd);
+	}
+	else if(errno == EINPROGRESS)
+	{
+		ctx->pfd.fd = sfd;
+		ctx->pfd.events = POLLOUT;
+		ret = PGM_OPEN_PENDING;
+	}
+	else if(sock_stream_should_retry(errno))
+	{
+		close(sfd);
+		ctx->pfd.fd = -1;
+		ret = PGM_OPEN_PENDING;
+	}
+	else
+	{
+		F("connect() failed.\n");
+		close(sfd);
+	}
+
+out_free:
+	freeaddrinfo(result);
+out:
+	return ret;
+}
+
+static int sock_stream_open_consumer(pgm_graph* g,
 				pgm_node* producer, pgm_node* consumer,
 				pgm_edge* edge)
 {
-	edge->nr_pending = edge->attr.nr_init;
-	return 0;
+	// connections are made by sock_stream_resume_consumer()
+	edge->fd_in = -1;
+	return PGM_OPEN_PENDING;
 }
 
-static const struct pgm_edge_ops pgm_cv_edge_ops =
+static int sock_stream_resume_consumer(pgm_graph* g, pgm_edge* edge,
+				struct pgm_open_ctx* ctx)
 {
-	.init = cv_create,
-	.open_consumer = dummy_edge_op,
-	.open_producer = dummy_edge_op,
-	.close_consumer = dummy_edge_close,
-	.close_producer = dummy_edge_close,
-	.destroy = dummy_edge_op,
-	.read = dummy_edge_read,
-	.write = dummy_edge_write,
-};
+	int ret = -1;
+	int err = 0;
+	socklen_t len = sizeof(err);
 
+	if(ctx->pfd.fd < 0)
+	{
+		ret = sock_stream_connect(g, edge, ctx);
+		goto out;
+	}
 
-///////////////////////////////////////////////////
-//         Memory Management Routines            //
-///////////////////////////////////////////////////
+	// a connect() is in progress
+	if(!ctx->pfd.revents)
+	{
+		ret = PGM_OPEN_PENDING;
+		goto out;
+	}
 
-#define PGM_COOKIE 0x00100100
-#define PGM_USERMEM_ALIGNMENT  16
-#define PGM_USERMEM_PADDING   (size_t(PGM_USERMEM_ALIGNMENT - 1))
-#define PGM_USERMEM_EXTRA     (sizeof(pgm_memory_hdr_t) + sizeof(pgm_offset_t) + PGM_USERMEM_PADDING)
-#define PGM_TRANSMISSION_TAGS (sizeof(pgm_command_t))
+	if(getsockopt(ctx->pfd.fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+	{
+		F("getsockopt() failed.\n");
+		close(ctx->pfd.fd);
+		goto out;
+	}
 
-//////////////////////////////////////////////////////////////////////
-// Memory Layout:                                                   //
-//                                                                  //
-//  +------------------------------------------------------------+  //
-//  | hdr | pad. | off. | trans. tag | 16-byte aligned user data |  //
-//  +------------------------------------------------------------+  //
-//                                                                  //
-//  hdr: Allocation header information.                             //
-//  pad: 0 to 15 bytes of padding. Variable.                        //
-//  off: Offset from userpointer to hdr (i.e., hdr == user - off)   //
-//  trans. tags: Space used by data-passing edges to pass extra     //
-//               informataion (e.g., termination)                   //
-//  data: User data (16-byte aligned).                              //
-//                                                                  //
-//////////////////////////////////////////////////////////////////////
+	if(err == 0)
+	{
+		ret = sock_stream_finish_consumer(g, edge, ctx->pfd.fd);
+	}
+	else
+	{
+		close(ctx->pfd.fd);
+		ctx->pfd.fd = -1;
+		if(sock_stream_should_retry(err))
+		{
+			ret = PGM_OPEN_PENDING;
+		}
+		else
+		{
+			errno = err;
+			F("connect() failed.\n");
+		}
+	}
 
-static const edge_t BAD_EDGE =
-{
-	.graph = -1,
-	.edge = -1,
-};
+out:
+	return ret;
+}
 
-typedef struct pgm_memory_hdr
+static int sock_stream_open_producer(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
 {
-	size_t usersize;
-	edge_t assigned_edge;
-	unsigned int cookie;
-	char producer_flag:1; // valid iff assigned_edge != BAD_EDGE
-} pgm_memory_hdr_t;
-
-typedef pgm_command_t pgm_offset_t;
+	int ret = 0;
 
-static inline pgm_memory_hdr_t* pgm_get_mem_header(void* userptr)
-{
-	pgm_offset_t off = ((pgm_offset_t*)userptr)[-2];
-	if(off > PGM_USERMEM_EXTRA)
-		return 0; // offset is too big to be valid
-	pgm_memory_hdr_t* ptr = (pgm_memory_hdr_t*)((char*)userptr - off);
-	return ptr;
+	// connections are accepted by sock_stream_resume_producer()
+	edge->fd_out = -1;
+	if(edge->attr.fd_prod_socket <= 0)
+		ret = sock_stream_listen(g, edge);
+	if(ret == 0)
+		ret = PGM_OPEN_PENDING;
+	return ret;
 }
 
-static inline pgm_memory_hdr_t* pgm_get_mem_header_safe(void* userptr)
+static int sock_stream_resume_producer(pgm_graph* g, pgm_edge* edge,
+				struct pgm_open_ctx* ctx)
 {
-	pgm_memory_hdr_t* ptr = pgm_get_mem_header(userptr);
-	if(!ptr || ptr->cookie != PGM_COOKIE)
-		return 0;
-	return ptr;
-}
+	int ret = accept(edge->attr.fd_prod_socket, 0, 0);
+	if(ret >= 0)
+	{
+		struct pgm_node* producer = &g->nodes[edge->producer];
 
-static inline void* pgm_get_user_ptr(pgm_memory_hdr_t* mem)
-{
-	return (void*)(((size_t)mem + PGM_USERMEM_EXTRA) & ~PGM_USERMEM_PADDING);
-}
+		edge->fd_out = ret;
+		sock_stream_tune(edge, edge->fd_out, true);
 
-static inline int is_producer_buf(void* userptr)
-{
-	pgm_memory_hdr_t* ptr = pgm_get_mem_header_safe(userptr);
-	if(!ptr)
-		return 0;
-	if(ptr->assigned_edge.graph == BAD_EDGE.graph &&
-	   ptr->assigned_edge.edge == BAD_EDGE.edge)
-		return 0;
-	return (ptr->producer_flag == 1);
-}
+		// sources never block in pgm_wait(), so they would never flush.
+		// a node that runs several jobs at once may flush from one job
+		// while it stages output of another.
+		if(edge->attr.coalesce_us > 0 && producer->nr_in > 0 &&
+		   !is_multi_job(producer))
+		{
+			edge->stage_buf = (char*)malloc(PGM_STAGE_SIZE);
+			edge->stage_len = 0;
+			edge->last_write = 0;
+			if(edge->stage_buf)
+				producer->nr_out_coalesced++;
+		}
 
-static inline int is_consumer_buf(void* userptr)
-{
-	pgm_memory_hdr_t* ptr = pgm_get_mem_header_safe(userptr);
-	if(!ptr)
-		return 0;
-	if(ptr->assigned_edge.graph == BAD_EDGE.graph &&
-	   ptr->assigned_edge.edge == BAD_EDGE.edge)
-		return 0;
-	return (ptr->producer_flag == 0);
+		edge->buf_out = __pgm_malloc_edge_buf(g, edge, true);
+		ret = 0;
+	}
+	else if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	{
+		ctx->pfd.fd = edge->attr.fd_prod_socket;
+		ctx->pfd.events = POLLIN;
+		ret = PGM_OPEN_PENDING;
+	}
+	else
+	{
+		F("accept() failed\n");
+		ret = -1;
+	}
+	return ret;
 }
 
-static inline int is_buf_assigned(void* userptr, edge_t* e = NULL)
+static ssize_t sock_stream_read(struct pgm_edge* e, void* buf, size_t nbytes)
 {
-	pgm_memory_hdr_t* ptr = pgm_get_mem_header_safe(userptr);
-	if(!ptr)
-		return 0;
-	if(ptr->assigned_edge.graph == BAD_EDGE.graph &&
-	   ptr->assigned_edge.edge == BAD_EDGE.edge)
-		return 0;
-	if(e)
-		*e = ptr->assigned_edge;
-	return 1;
+	int flags = MSG_DONTWAIT;
+	return recv(e->fd_in, buf, nbytes, flags);
 }
 
-static void* pgm_malloc(size_t nbytes)
+// Wait for the kernel to release the buffer of the last MSG_ZEROCOPY send.
+static int sock_stream_wait_zerocopy(struct pgm_edge* e)
 {
-	char* buf;
-
-	// ensure the header is not to big to be tracked by offset
-	assert(PGM_USERMEM_EXTRA <= (size_t)~((pgm_offset_t)0));
-
-	buf = (char*)malloc(nbytes + PGM_TRANSMISSION_TAGS + PGM_USERMEM_EXTRA);
-
-	if(!buf)
-		return 0;
-
-	// record header information
-	pgm_memory_hdr_t* hdr = (pgm_memory_hdr_t*)buf;
-	hdr->usersize = nbytes;
-	hdr->assigned_edge = BAD_EDGE;
-	hdr->cookie = PGM_COOKIE;
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr* cm;
+	struct pollfd pfd;
 
-	char* ptr = (char*)pgm_get_user_ptr(hdr);
+	while(1)
+	{
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
 
-	// record an offset to the head of the allocated memory
-	((pgm_offset_t*)ptr)[-2] = ptr - buf;
+		if(recvmsg(e->fd_out, &msg, MSG_ERRQUEUE) != -1)
+		{
+			for(cm = CMSG_FIRSTHDR(&msg); cm != 0; cm = CMSG_NXTHDR(&msg, cm))
+			{
+				struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cm);
+				if(serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+					return 0;
+			}
+			continue;
+		}
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			F("Could not reap zero-copy completion on edge %s\n", e->name);
+			return -1;
+		}
 
-	return ptr;
+		// error queue readiness is always reported as POLLERR
+		pfd.fd = e->fd_out;
+		pfd.events = 0;
+		poll(&pfd, 1, -1);
+	}
 }
 
-void pgm_free(void* userptr)
+static ssize_t sock_stream_send(struct pgm_edge* e, const void* buf, size_t nbytes)
 {
-	pgm_memory_hdr_t* hdr;
-
-	if(!userptr)
-		return;
-
-	hdr = pgm_get_mem_header_safe(userptr);
+	int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+	ssize_t bytes;
 
-	if(!hdr)
+	if(e->attr.zerocopy_min && nbytes >= e->attr.zerocopy_min)
 	{
-		E("Bad pointer!\n");
-		return;
+		bytes = send(e->fd_out, buf, nbytes, flags | MSG_ZEROCOPY);
+		if(bytes > 0)
+			return (sock_stream_wait_zerocopy(e) == 0) ? bytes : -1;
+		if(!(bytes == -1 && errno == ENOBUFS))
+			return bytes;
+		// out of option memory. send a copy instead.
 	}
 
-	if(is_buf_assigned(userptr))
+	return send(e->fd_out, buf, nbytes, flags);
+}
+
+static int sock_stream_flush(struct pgm_edge* e)
+{
+	int ret = 0;
+	char* buf = e->stage_buf;
+	size_t len = e->stage_len;
+
+	while(len)
 	{
-		W("Buffer %p may still be in use by an edge!\n", userptr);
+		ssize_t bytes = sock_stream_send(e, buf, len);
+		if(bytes > 0)
+		{
+			buf += bytes;
+			len -= bytes;
+		}
+		else if(bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			// just keep looping
+		}
+		else
+		{
+			F("Failed to send data on edge %s\n", e->name);
+			ret = -1;
+			break;
+		}
 	}
 
-	free(hdr);
+	e->stage_len = 0;
+	return ret;
 }
 
-pgm_memory_hdr_t* __pgm_malloc_edge_buf(struct pgm_graph* g, struct pgm_edge* e, bool is_producer)
+static ssize_t sock_stream_write(struct pgm_edge* e, const void* buf, size_t nbytes)
 {
-	pgm_memory_hdr_t* mem = 0;
-	size_t usernbytes = (is_producer) ? e->attr.nr_produce : e->attr.nr_consume;
-	void* uptr = pgm_malloc(usernbytes);
-
-	if(!uptr)
-		goto out;
-
-	mem = pgm_get_mem_header(uptr);
-	mem->assigned_edge.graph = g - gGraphs;
-	mem->assigned_edge.edge = e - g->edges;
-	mem->producer_flag = is_producer;
+	if(e->stage_buf)
+	{
+		uint64_t now = pgm_now_ns();
+		uint64_t window = (uint64_t)e->attr.coalesce_us * 1000;
+		bool in_burst = (now - e->last_write < window);
 
-out:
-	return mem;
-}
+		e->last_write = now;
 
-void* pgm_malloc_edge_buf_p(edge_t edge)
-{
-	void* mem = 0;
-	struct pgm_graph* g;
-	struct pgm_edge*  e;
+		if(e->stage_len &&
+		   (e->stage_len + nbytes > PGM_STAGE_SIZE || now - e->stage_start >= window))
+		{
+			if(sock_stream_flush(e) != 0)
+				return -1;
+		}
 
-	if(!is_valid_graph(edge.graph))
-		goto out;
+		// Stage small messages that arrive in a burst. The first message
+		// of a burst is sent right away.
+		if(nbytes <= PGM_STAGE_MAX_MSG && (in_burst || e->stage_len))
+		{
+			if(!e->stage_len)
+				e->stage_start = now;
+			memcpy(e->stage_buf + e->stage_len, buf, nbytes);
+			e->stage_len += nbytes;
+			return nbytes;
+		}
 
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
+		if(e->stage_len && sock_stream_flush(e) != 0)
+			return -1;
+	}
 
-	mem = pgm_malloc(e->attr.nr_produce);
-out:
-	return mem;
+	return sock_stream_send(e, buf, nbytes);
 }
 
-void* pgm_malloc_edge_buf_c(edge_t edge)
+static int sock_stream_close_consumer(pgm_edge* edge)
 {
-	void* mem = 0;
-	struct pgm_graph* g;
-	struct pgm_edge*  e;
-
-	if(!is_valid_graph(edge.graph))
-		goto out;
-
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
-
-	mem = pgm_malloc(e->attr.nr_consume);
-out:
-	return mem;
+	int ret;
+	ret = close(edge->fd_in);
+	if(!ret)
+	{
+		edge->fd_in = 0;
+		__pgm_free_edge_buf(edge->buf_in);
+		edge->buf_in = 0;
+	}
+	return ret;
 }
 
-void* pgm_get_edge_buf_p(edge_t edge)
+static int sock_stream_close_producer(pgm_edge* edge)
 {
-	void* mem = 0;
-	struct pgm_graph* g;
-	struct pgm_edge*  e;
-
-	if(!is_valid_graph(edge.graph))
-		goto out;
-
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
-
-	if(!is_data_passing(e))
+	int ret;
+	if(edge->stage_buf)
 	{
-//		W("Requested buffer of non-data-passing edge.\n");
-		goto out;
+		sock_stream_flush(edge);
+		free(edge->stage_buf);
+		edge->stage_buf = 0;
 	}
+	ret = close(edge->fd_out);
+	ret |= close(edge->attr.fd_prod_socket);
+	if(!ret)
+	{
+		edge->fd_out = 0;
+		edge->attr.fd_prod_socket = 0;
+		__pgm_free_edge_buf(edge->buf_out);
+		edge->buf_out = 0;
+	}
+	return ret;
+}
 
-	mem = pgm_get_user_ptr(e->buf_out);
-
-out:
-	return mem;
+static int sock_stream_destroy(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
+{
+	// the producer never claimed the edge (or never released it)
+	if(!gGraphSharedMem && edge->attr.fd_prod_socket > 0)
+	{
+		close(edge->attr.fd_prod_socket);
+		edge->attr.fd_prod_socket = 0;
+	}
+	return 0;
 }
 
-void* pgm_get_edge_buf_c(edge_t edge)
+static const struct pgm_edge_ops pgm_sock_stream_edge_ops =
 {
-	void* mem = 0;
-	struct pgm_graph* g;
-	struct pgm_edge*  e;
+	.init = sock_stream_create,
+	.open_consumer = sock_stream_open_consumer,
+	.open_producer = sock_stream_open_producer,
+	.close_consumer = sock_stream_close_consumer,
+	.close_producer = sock_stream_close_producer,
+	.destroy = sock_stream_destroy,
+	.read = sock_stream_read,
+	.write = sock_stream_write,
+	.resume_consumer = sock_stream_resume_consumer,
+	.resume_producer = sock_stream_resume_producer,
+	.flush = sock_stream_flush,
+};
 
-	if(!is_valid_graph(edge.graph))
-		goto out;
 
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
+/************* CUSTOM IPC ROUTINES *****************/
 
-	if(!is_data_passing(e))
-	{
-//		W("Requested buffer of non-data-passing edge.\n");
-		goto out;
-	}
+static pgm_edge_transport_t gTransports[PGM_MAX_TRANSPORTS];
+static int gNrTransports = 0;
+static pthread_mutex_t gTransportLock = PTHREAD_MUTEX_INITIALIZER;
 
-	mem = pgm_get_user_ptr(e->buf_in);
+static inline int transport_id(const struct pgm_edge_attr* attr)
+{
+	return (attr->type & __PGM_EDGE_CUSTOM_MASK) >> __PGM_EDGE_CUSTOM_SHIFT;
+}
 
-out:
-	return mem;
+static inline const pgm_edge_transport_t* edge_transport(const struct pgm_edge* e)
+{
+	return &gTransports[transport_id(&e->attr)];
 }
 
-edge_t pgm_get_edge_from_buf(void* uptr)
+static inline edge_t edge_handle(const struct pgm_edge* e)
 {
 	edge_t edge;
-	if(is_buf_assigned(uptr, &edge))
-		return edge;
-	return BAD_EDGE;
+	edge.graph = ((const char*)e - (const char*)gGraphs) / sizeof(struct pgm_graph);
+	edge.edge = e - gGraphs[edge.graph].edges;
+	return edge;
 }
 
-int pgm_is_buf_in_use(void* uptr)
+static int custom_create(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
 {
-	return is_buf_assigned(uptr);
+	const pgm_edge_transport_t* t = edge_transport(edge);
+	return (t->init) ? t->init(edge_handle(edge), edge->transport_state) : 0;
 }
 
-void* __pgm_swap_edge_buf(edge_t edge, void* new_uptr, bool swap_producer)
+static int custom_open_consumer(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
 {
-	void* old = 0;
-	struct pgm_graph* g;
-	struct pgm_edge*  e;
-	pgm_memory_hdr_t* hdr;
-	pgm_memory_hdr_t* old_hdr;
-	pgm_memory_hdr_t** old_hdr_ptr;
-
-	if(!new_uptr)
-		goto out;
-	if(!is_valid_graph(edge.graph))
-		goto out;
-
-	// first get the edge
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
-
-	if(!is_data_passing(e))
+	const pgm_edge_transport_t* t = edge_transport(edge);
+	int ret = (t->open_consumer) ?
+		t->open_consumer(edge_handle(edge), edge->transport_state) : 0;
+	if(ret == 0)
 	{
-		E("Tried to swap buffer with non-data-passing edge.\n");
-		goto out;
+		edge->fd_in = (t->read_fd) ? t->read_fd(edge->transport_state) : -1;
+		edge->buf_in = __pgm_malloc_edge_buf(g, edge, false);
+		if(!edge->buf_in)
+		{
+			F("Could not allocate buffer for edge %s/%s\n", g->name, edge->name);
+			ret = -1;
+		}
 	}
+	return ret;
+}
 
-	// get the header for the new buffer
-	hdr = pgm_get_mem_header_safe(new_uptr);
-	if(!hdr)
-	{
-		E("%p is not an edge buffer pointer (or it has been corrupted)\n", new_uptr);
-		goto out;
-	}
-	if(hdr->assigned_edge.graph != BAD_EDGE.graph &&
-	   hdr->assigned_edge.edge != BAD_EDGE.edge)
+static int custom_open_producer(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
+{
+	const pgm_edge_transport_t* t = edge_transport(edge);
+	int ret = (t->open_producer) ?
+		t->open_producer(edge_handle(edge), edge->transport_state) : 0;
+	if(ret == 0)
 	{
-		E("%p is already in use by an edge.\n", new_uptr);
-		goto out;
+		edge->fd_out = -1;
+		edge->buf_out = __pgm_malloc_edge_buf(g, edge, true);
+		if(!edge->buf_out)
+		{
+			F("Could not allocate buffer for edge %s/%s\n", g->name, edge->name);
+			ret = -1;
+		}
 	}
+	return ret;
+}
 
-	// select the old buffer
-	old_hdr_ptr = (swap_producer) ? &e->buf_out : &e->buf_in;
-	old_hdr = *old_hdr_ptr;
-	if(hdr->usersize != old_hdr->usersize)
-	{
-		E("Buffer %p is the wrong size. (is %lu, expected %lu)\n",
-		  new_uptr, hdr->usersize, old_hdr->usersize);
-		goto out;
-	}
+static int custom_close_consumer(pgm_edge* edge)
+{
+	const pgm_edge_transport_t* t = edge_transport(edge);
+	int ret = (t->close_consumer) ?
+		t->close_consumer(edge_handle(edge), edge->transport_state) : 0;
+	__pgm_free_edge_buf(edge->buf_in);
+	edge->buf_in = 0;
+	edge->fd_in = 0;
+	return ret;
+}
 
-	// swap the buffers and update headers
-	hdr->assigned_edge = edge;
-	hdr->producer_flag = old_hdr->producer_flag;
-	old_hdr->assigned_edge = BAD_EDGE;
-	*old_hdr_ptr = hdr;  // apply assignment
+static int custom_close_producer(pgm_edge* edge)
+{
+	const pgm_edge_transport_t* t = edge_transport(edge);
+	int ret = (t->close_producer) ?
+		t->close_producer(edge_handle(edge), edge->transport_state) : 0;
+	__pgm_free_edge_buf(edge->buf_out);
+	edge->buf_out = 0;
+	edge->fd_out = 0;
+	return ret;
+}
 
-	// return the userpointer of the old buffer
-	old = pgm_get_user_ptr(old_hdr);
-out:
-	return old;
+static int custom_destroy(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
+{
+	const pgm_edge_transport_t* t = edge_transport(edge);
+	return (t->destroy) ? t->destroy(edge_handle(edge), edge->transport_state) : 0;
 }
 
-void* pgm_swap_edge_buf_p(edge_t edge, void* new_uptr)
+static ssize_t custom_read(struct pgm_edge* e, void* buf, size_t nbytes)
 {
-	return __pgm_swap_edge_buf(edge, new_uptr, true);
+	return edge_transport(e)->read(e->transport_state, buf, nbytes);
 }
 
-void* pgm_swap_edge_buf_c(edge_t edge, void* new_uptr)
+static ssize_t custom_write(struct pgm_edge* e, const void* buf, size_t nbytes)
 {
-	return __pgm_swap_edge_buf(edge, new_uptr, false);
+	return edge_transport(e)->write(e->transport_state, buf, nbytes);
 }
 
-int pgm_swap_edge_bufs(void* a, void* b)
+static const struct pgm_edge_ops pgm_custom_edge_ops =
+{
+	.init = custom_create,
+	.open_consumer = custom_open_consumer,
+	.open_producer = custom_open_producer,
+	.close_consumer = custom_close_consumer,
+	.close_producer = custom_close_producer,
+	.destroy = custom_destroy,
+	.read = custom_read,
+	.write = custom_write,
+};
+
+int pgm_register_transport(const pgm_edge_transport_t* transport,
+	pgm_edge_type_t* type)
 {
 	int ret = -1;
-	struct pgm_graph *ga, *gb;
-	struct pgm_edge  *ea, *eb;
-	pgm_memory_hdr_t *hdra, *hdrb;
-	pgm_memory_hdr_t **edgeabufptr, **edgebbufptr, *tempbufptr;
-	edge_t    edgea, edgeb;
-	char temp_flag;
+	int id;
 
-	if(!a || !b)
+	if(!transport || !type)
 		goto out;
-	if(a == b)
+	if(!transport->read || !transport->write)
+	{
+		E("Transports must provide read() and write().\n");
 		goto out;
-
-	if(!is_buf_assigned(a, &edgea))
+	}
+	if(!transport->signaled && !transport->read_fd)
 	{
-		E("%p is not assigned to an edge.\n", a);
+		E("Transports must be signaled or provide read_fd().\n");
 		goto out;
 	}
-	if(!is_buf_assigned(b, &edgeb))
+	if(!transport->alloc_buf != !transport->free_buf)
 	{
-		E("%p is not assigned to an edge.\n", b);
+		E("Transports must provide both alloc_buf() and free_buf(), or neither.\n");
 		goto out;
 	}
 
-	hdra = pgm_get_mem_header(a);
-	hdrb = pgm_get_mem_header(b);
-
-	if(hdra->usersize != hdrb->usersize)
+	pthread_mutex_lock(&gTransportLock);
+	if(gNrTransports == PGM_MAX_TRANSPORTS)
 	{
-		E("Buffers are not the same size: %p:%lu vs %p:%lu\n",
-		  a, hdra->usersize, b, hdrb->usersize);
+		pthread_mutex_unlock(&gTransportLock);
+		E("No more available transports.\n");
 		goto out;
 	}
+	id = gNrTransports++;
+	gTransports[id] = *transport;
+	pthread_mutex_unlock(&gTransportLock);
 
-	ga = &gGraphs[edgea.graph];
-	ea = &ga->edges[edgea.edge];
-	gb = &gGraphs[edgeb.graph];
-	eb = &gb->edges[edgeb.edge];
-
-	// update the edges first
-	edgeabufptr = (hdra->producer_flag) ? &(ea->buf_out) : &(ea->buf_in);
-	edgebbufptr = (hdrb->producer_flag) ? &(eb->buf_out) : &(eb->buf_in);
-	tempbufptr = *edgeabufptr;
-	*edgeabufptr = *edgebbufptr;
-	*edgebbufptr = tempbufptr;
-
-	// now update headers
-	hdra->assigned_edge = edgeb;
-	hdrb->assigned_edge = edgea;
-	temp_flag = hdra->producer_flag;
-	hdra->producer_flag = hdrb->producer_flag;
-	hdrb->producer_flag = temp_flag;
-
+	*type = (pgm_edge_type_t)(__PGM_EDGE_CUSTOM | __PGM_DATA_PASSING |
+		(id << __PGM_EDGE_CUSTOM_SHIFT) |
+		((transport->signaled) ? __PGM_SIGNALED : 0));
 	ret = 0;
 
 out:
 	return ret;
 }
 
-///////////////////////////////////////////////////
-//           SYNC PRIMATIVE WRAPPERS             //
-///////////////////////////////////////////////////
 
-#ifdef PGM_USE_PTHREAD_SYNC
+/************* CV IPC ROUTINES *****************/
 
-	static void pgm_lock_init(pgm_lock_t* l)
-	{
+static int cv_create(pgm_graph* g,
+				pgm_node* producer, pgm_node* consumer,
+				pgm_edge* edge)
+{
+	edge->nr_pending = edge->attr.nr_init;
+	return 0;
+}
+
+static const struct pgm_edge_ops pgm_cv_edge_ops =
+{
+	.init = cv_create,
+	.open_consumer = dummy_edge_op,
+	.open_producer = dummy_edge_op,
+	.close_consumer = dummy_edge_close,
+	.close_producer = dummy_edge_close,
+	.destroy = dummy_edge_op,
+	.read = dummy_edge_read,
+	.write = dummy_edge_write,
+};
+
+
+///////////////////////////////////////////////////
+//         Memory Management Routines            //
+///////////////////////////////////////////////////
+
+#define PGM_COOKIE 0x00100100
+#define PGM_USERMEM_ALIGNMENT  16
+#define PGM_USERMEM_PADDING   (size_t(PGM_USERMEM_ALIGNMENT - 1))
+#define PGM_USERMEM_EXTRA     (sizeof(pgm_memory_hdr_t) + sizeof(pgm_offset_t) + PGM_USERMEM_PADDING)
+#define PGM_TRANSMISSION_TAGS (sizeof(pgm_command_t))
+
+//////////////////////////////////////////////////////////////////////
+// Memory Layout:                                                   //
+//                                                                  //
+//  +------------------------------------------------------------+  //
+//  | hdr | pad. | off. | trans. tag | 16-byte aligned user data |  //
+//  +------------------------------------------------------------+  //
+//                                                                  //
+//  hdr: Allocation header information.                             //
+//  pad: 0 to 15 bytes of padding. Variable.                        //
+//  off: Offset from userpointer to hdr (i.e., hdr == user - off)   //
+//  trans. tags: Space used by data-passing edges to pass extra     //
+//               informataion (e.g., termination)                   //
+//  data: User data (16-byte aligned).                              //
+//                                                                  //
+//////////////////////////////////////////////////////////////////////
+
+static const edge_t BAD_EDGE =
+{
+	.graph = -1,
+	.edge = -1,
+};
+
+typedef struct pgm_memory_hdr
+{
+	size_t usersize;
+	edge_t assigned_edge;
+	unsigned int cookie;
+	char producer_flag:1; // valid iff assigned_edge != BAD_EDGE
+	// 0 if allocated with malloc(). Otherwise, 1 + id of the
+	// custom transport that allocated the memory.
+	unsigned char transport;
+} pgm_memory_hdr_t;
+
+typedef pgm_command_t pgm_offset_t;
+
+static inline pgm_memory_hdr_t* pgm_get_mem_header(void* userptr)
+{
+	pgm_offset_t off = ((pgm_offset_t*)userptr)[-2];
+	if(off > PGM_USERMEM_EXTRA)
+		return 0; // offset is too big to be valid
+	pgm_memory_hdr_t* ptr = (pgm_memory_hdr_t*)((char*)userptr - off);
+	return ptr;
+}
+
+static inline pgm_memory_hdr_t* pgm_get_mem_header_safe(void* userptr)
+{
+	pgm_memory_hdr_t* ptr = pgm_get_mem_header(userptr);
+	if(!ptr || ptr->cookie != PGM_COOKIE)
+		return 0;
+	return ptr;
+}
+
+static inline void* pgm_get_user_ptr(pgm_memory_hdr_t* mem)
+{
+	return (void*)(((size_t)mem + PGM_USERMEM_EXTRA) & ~PGM_USERMEM_PADDING);
+}
+
+static inline int is_producer_buf(void* userptr)
+{
+	pgm_memory_hdr_t* ptr = pgm_get_mem_header_safe(userptr);
+	if(!ptr)
+		return 0;
+	if(ptr->assigned_edge.graph == BAD_EDGE.graph &&
+	   ptr->assigned_edge.edge == BAD_EDGE.edge)
+		return 0;
+	return (ptr->producer_flag == 1);
+}
+
+static inline int is_consumer_buf(void* userptr)
+{
+	pgm_memory_hdr_t* ptr = pgm_get_mem_header_safe(userptr);
+	if(!ptr)
+		return 0;
+	if(ptr->assigned_edge.graph == BAD_EDGE.graph &&
+	   ptr->assigned_edge.edge == BAD_EDGE.edge)
+		return 0;
+	return (ptr->producer_flag == 0);
+}
+
+static inline int is_buf_assigned(void* userptr, edge_t* e = NULL)
+{
+	pgm_memory_hdr_t* ptr = pgm_get_mem_header_safe(userptr);
+	if(!ptr)
+		return 0;
+	if(ptr->assigned_edge.graph == BAD_EDGE.graph &&
+	   ptr->assigned_edge.edge == BAD_EDGE.edge)
+		return 0;
+	if(e)
+		*e = ptr->assigned_edge;
+	return 1;
+}
+
+// Allocate from the transport of edge 'e', if it has one.
+static void* pgm_malloc(size_t nbytes, struct pgm_edge* e = 0, bool is_producer = false)
+{
+	char* buf;
+	size_t total = nbytes + PGM_TRANSMISSION_TAGS + PGM_USERMEM_EXTRA;
+	unsigned char transport = 0;
+
+	// ensure the header is not to big to be tracked by offset
+	assert(PGM_USERMEM_EXTRA <= (size_t)~((pgm_offset_t)0));
+
+	if(e && (e->attr.type & __PGM_EDGE_CUSTOM) && edge_transport(e)->alloc_buf)
+	{
+		buf = (char*)edge_transport(e)->alloc_buf(e->transport_state, total, is_producer);
+		transport = 1 + transport_id(&e->attr);
+	}
+	else
+	{
+		buf = (char*)malloc(total);
+	}
+
+	if(!buf)
+		return 0;
+
+	// record header information
+	pgm_memory_hdr_t* hdr = (pgm_memory_hdr_t*)buf;
+	hdr->usersize = nbytes;
+	hdr->assigned_edge = BAD_EDGE;
+	hdr->cookie = PGM_COOKIE;
+	hdr->producer_flag = 0;
+	hdr->transport = transport;
+
+	char* ptr = (char*)pgm_get_user_ptr(hdr);
+
+	// record an offset to the head of the allocated memory
+	((pgm_offset_t*)ptr)[-2] = ptr - buf;
+
+	return ptr;
+}
+
+void pgm_free(void* userptr)
+{
+	pgm_memory_hdr_t* hdr;
+
+	if(!userptr)
+		return;
+
+	hdr = pgm_get_mem_header_safe(userptr);
+
+	if(!hdr)
+	{
+		E("Bad pointer!\n");
+		return;
+	}
+
+	if(is_buf_assigned(userptr))
+	{
+		W("Buffer %p may still be in use by an edge!\n", userptr);
+	}
+
+	__pgm_free_edge_buf(hdr);
+}
+
+void __pgm_free_edge_buf(pgm_memory_hdr_t* mem)
+{
+	if(!mem)
+		return;
+	if(mem->transport)
+		gTransports[mem->transport - 1].free_buf(mem);
+	else
+		free(mem);
+}
+
+pgm_memory_hdr_t* __pgm_malloc_edge_buf(struct pgm_graph* g, struct pgm_edge* e, bool is_producer)
+{
+	pgm_memory_hdr_t* mem = 0;
+	size_t usernbytes = (is_producer) ? e->attr.nr_produce : e->attr.nr_consume;
+	void* uptr = pgm_malloc(usernbytes, e, is_producer);
+
+	if(!uptr)
+		goto out;
+
+	mem = pgm_get_mem_header(uptr);
+	mem->assigned_edge.graph = g - gGraphs;
+	mem->assigned_edge.edge = e - g->edges;
+	mem->producer_flag = is_producer;
+
+out:
+	return mem;
+}
+
+void* pgm_malloc_edge_buf_p(edge_t edge)
+{
+	void* mem = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+
+	mem = pgm_malloc(e->attr.nr_produce, e, true);
+out:
+	return mem;
+}
+
+void* pgm_malloc_edge_buf_c(edge_t edge)
+{
+	void* mem = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+
+	mem = pgm_malloc(e->attr.nr_consume, e, false);
+out:
+	return mem;
+}
+
+void* pgm_get_edge_buf_p(edge_t edge)
+{
+	void* mem = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+
+	if(!is_data_passing(e))
+	{
+//		W("Requested buffer of non-data-passing edge.\n");
+		goto out;
+	}
+
+	mem = pgm_get_user_ptr(pgm_callers_edge_buf(g, e, true));
+
+out:
+	return mem;
+}
+
+void* pgm_get_edge_buf_c(edge_t edge)
+{
+	void* mem = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+
+	if(!is_data_passing(e))
+	{
+//		W("Requested buffer of non-data-passing edge.\n");
+		goto out;
+	}
+
+	mem = pgm_get_user_ptr(pgm_callers_edge_buf(g, e, false));
+
+out:
+	return mem;
+}
+
+void* pgm_get_inv_buf_p(edge_t edge, pgm_inv_t inv)
+{
+	void* mem = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+	struct pgm_node*  n;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+	n = &g->nodes[e->producer];
+
+	if(!is_data_passing(e) || !n->replicas || inv < 0 || inv >= n->nr_inflight)
+		goto out;
+
+	for(int i = 0; i < n->nr_out; ++i)
+		if(n->out[i] == edge.edge)
+			mem = pgm_get_user_ptr(n->replicas->r[inv].buf_out[i]);
+
+out:
+	return mem;
+}
+
+void* pgm_get_inv_buf_c(edge_t edge, pgm_inv_t inv)
+{
+	void* mem = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+	struct pgm_node*  n;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+	n = &g->nodes[e->consumer];
+
+	if(!is_data_passing(e) || !n->replicas || inv < 0 || inv >= n->nr_inflight)
+		goto out;
+
+	for(int i = 0; i < n->nr_in; ++i)
+		if(n->in[i] == edge.edge)
+			mem = pgm_get_user_ptr(n->replicas->r[inv].buf_in[i]);
+
+out:
+	return mem;
+}
+
+edge_t pgm_get_edge_from_buf(void* uptr)
+{
+	edge_t edge;
+	if(is_buf_assigned(uptr, &edge))
+		return edge;
+	return BAD_EDGE;
+}
+
+int pgm_is_buf_in_use(void* uptr)
+{
+	return is_buf_assigned(uptr);
+}
+
+void* __pgm_swap_edge_buf(edge_t edge, void* new_uptr, bool swap_producer)
+{
+	void* old = 0;
+	struct pgm_graph* g;
+	struct pgm_edge*  e;
+	pgm_memory_hdr_t* hdr;
+	pgm_memory_hdr_t* old_hdr;
+	pgm_memory_hdr_t** old_hdr_ptr;
+
+	if(!new_uptr)
+		goto out;
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	// first get the edge
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+
+	if(!is_data_passing(e))
+	{
+		E("Tried to swap buffer with non-data-passing edge.\n");
+		goto out;
+	}
+	if(is_multi_job(&g->nodes[(swap_producer) ? e->producer : e->consumer]))
+	{
+		E("Cannot swap buffers of replicated node.\n");
+		goto out;
+	}
+
+	// get the header for the new buffer
+	hdr = pgm_get_mem_header_safe(new_uptr);
+	if(!hdr)
+	{
+		E("%p is not an edge buffer pointer (or it has been corrupted)\n", new_uptr);
+		goto out;
+	}
+	if(hdr->assigned_edge.graph != BAD_EDGE.graph &&
+	   hdr->assigned_edge.edge != BAD_EDGE.edge)
+	{
+		E("%p is already in use by an edge.\n", new_uptr);
+		goto out;
+	}
+
+	// select the old buffer
+	old_hdr_ptr = (swap_producer) ? &e->buf_out : &e->buf_in;
+	old_hdr = *old_hdr_ptr;
+	if(hdr->usersize != old_hdr->usersize)
+	{
+		E("Buffer %p is the wrong size. (is %lu, expected %lu)\n",
+		  new_uptr, hdr->usersize, old_hdr->usersize);
+		goto out;
+	}
+
+	// swap the buffers and update headers
+	hdr->assigned_edge = edge;
+	hdr->producer_flag = old_hdr->producer_flag;
+	old_hdr->assigned_edge = BAD_EDGE;
+	*old_hdr_ptr = hdr;  // apply assignment
+
+	// return the userpointer of the old buffer
+	old = pgm_get_user_ptr(old_hdr);
+out:
+	return old;
+}
+
+void* pgm_swap_edge_buf_p(edge_t edge, void* new_uptr)
+{
+	return __pgm_swap_edge_buf(edge, new_uptr, true);
+}
+
+void* pgm_swap_edge_buf_c(edge_t edge, void* new_uptr)
+{
+	return __pgm_swap_edge_buf(edge, new_uptr, false);
+}
+
+int pgm_swap_edge_bufs(void* a, void* b)
+{
+	int ret = -1;
+	struct pgm_graph *ga, *gb;
+	struct pgm_edge  *ea, *eb;
+	pgm_memory_hdr_t *hdra, *hdrb;
+	pgm_memory_hdr_t **edgeabufptr, **edgebbufptr, *tempbufptr;
+	edge_t    edgea, edgeb;
+	char temp_flag;
+
+	if(!a || !b)
+		goto out;
+	if(a == b)
+		goto out;
+
+	if(!is_buf_assigned(a, &edgea))
+	{
+		E("%p is not assigned to an edge.\n", a);
+		goto out;
+	}
+	if(!is_buf_assigned(b, &edgeb))
+	{
+		E("%p is not assigned to an edge.\n", b);
+		goto out;
+	}
+
+	hdra = pgm_get_mem_header(a);
+	hdrb = pgm_get_mem_header(b);
+
+	if(hdra->usersize != hdrb->usersize)
+	{
+		E("Buffers are not the same size: %p:%lu vs %p:%lu\n",
+		  a, hdra->usersize, b, hdrb->usersize);
+		goto out;
+	}
+
+	ga = &gGraphs[edgea.graph];
+	ea = &ga->edges[edgea.edge];
+	gb = &gGraphs[edgeb.graph];
+	eb = &gb->edges[edgeb.edge];
+
+	if(is_multi_job(&ga->nodes[(hdra->producer_flag) ? ea->producer : ea->consumer]) ||
+	   is_multi_job(&gb->nodes[(hdrb->producer_flag) ? eb->producer : eb->consumer]))
+	{
+		E("Cannot swap buffers of replicated node.\n");
+		goto out;
+	}
+
+	// update the edges first
+	edgeabufptr = (hdra->producer_flag) ? &(ea->buf_out) : &(ea->buf_in);
+	edgebbufptr = (hdrb->producer_flag) ? &(eb->buf_out) : &(eb->buf_in);
+	tempbufptr = *edgeabufptr;
+	*edgeabufptr = *edgebbufptr;
+	*edgebbufptr = tempbufptr;
+
+	// now update headers
+	hdra->assigned_edge = edgeb;
+	hdrb->assigned_edge = edgea;
+	temp_flag = hdra->producer_flag;
+	hdra->producer_flag = hdrb->producer_flag;
+	hdrb->producer_flag = temp_flag;
+
+	ret = 0;
+
+out:
+	return ret;
+}
+
+///////////////////////////////////////////////////
+//           SYNC PRIMATIVE WRAPPERS             //
+///////////////////////////////////////////////////
+
+/*
+   Each lock type is a policy with static members that operate on a
+   struct pgm_node_sync. Code on the wait/wake path is written once as
+   a template over the policy and instantiated for every lock type, so
+   lock operations stay inline; the node's lock type only selects the
+   instantiation.
+ */
+
+struct pgm_pthread_sync
+{
+	static void init(struct pgm_node_sync* s)
+	{
 		pthread_mutexattr_t attr;
 		pthread_mutexattr_init(&attr);
 	#ifdef PGM_SHARED
 		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
 	#endif
 		pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
-		pthread_mutex_init(l, &attr);
+		pthread_mutex_init(&s->pthread.lock, &attr);
 		pthread_mutexattr_destroy(&attr);
+
+		pthread_condattr_t cattr;
+		pthread_condattr_init(&cattr);
+	#ifdef PGM_SHARED
+		pthread_condattr_setpshared(&cattr, 1);
+	#endif
+		pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+		pthread_cond_init(&s->pthread.cv, &cattr);
+		pthread_condattr_destroy(&cattr);
+	}
+
+	static void destroy(struct pgm_node_sync* s)
+	{
+		pthread_cond_destroy(&s->pthread.cv);
+		pthread_mutex_destroy(&s->pthread.lock);
+	}
+
+	static inline void lock(struct pgm_node_sync* s, unsigned long& flags)
+	{
+		((void)(flags));
+		pthread_mutex_lock(&s->pthread.lock);
+	}
+
+	static inline void unlock(struct pgm_node_sync* s, unsigned long& flags)
+	{
+		((void)(flags));
+		pthread_mutex_unlock(&s->pthread.lock);
+	}
+
+	static inline void wait(struct pgm_node_sync* s, unsigned long& flags)
+	{
+		((void)(flags));
+		pthread_cond_wait(&s->pthread.cv, &s->pthread.lock);
+	}
+
+	// wait until CLOCK_MONOTONIC time 'deadline' (in ns)
+	static inline void timedwait(struct pgm_node_sync* s, unsigned long& flags, uint64_t deadline)
+	{
+		struct timespec abs = pgm_ns_to_timespec(deadline);
+		((void)(flags));
+		pthread_cond_timedwait(&s->pthread.cv, &s->pthread.lock, &abs);
+	}
+
+	static inline void signal(struct pgm_node_sync* s)
+	{
+		pthread_cond_signal(&s->pthread.cv);
+	}
+};
+
+// The spinlocks themselves. Holders are non-preemptive
+// unless PGM_NP_METHOD is 0.
+struct pgm_ticket_lock
+{
+	static inline ticketlock_t* get(struct pgm_node_sync* s) { return &s->ticket.lock; }
+	static inline cv_t* cv(struct pgm_node_sync* s) { return &s->ticket.cv; }
+#ifdef PGM_PREEMPTIVE
+	static inline void init(struct pgm_node_sync* s) { tl_init(get(s)); }
+	static inline void lock(struct pgm_node_sync* s, unsigned long&) { tl_lock(get(s)); }
+	static inline void unlock(struct pgm_node_sync* s, unsigned long) { tl_unlock(get(s)); }
+#else
+	static inline void init(struct pgm_node_sync* s) { tl_init_np(get(s)); }
+	static inline void lock(struct pgm_node_sync* s, unsigned long& flags) { tl_lock_np(get(s), &flags); }
+	static inline void unlock(struct pgm_node_sync* s, unsigned long flags) { tl_unlock_np(get(s), flags); }
+#endif
+};
+
+struct pgm_mcs_lock
+{
+	static inline queuelock_t* get(struct pgm_node_sync* s) { return &s->mcs.lock; }
+	static inline cv_t* cv(struct pgm_node_sync* s) { return &s->mcs.cv; }
+#ifdef PGM_PREEMPTIVE
+	static inline void init(struct pgm_node_sync* s) { ql_init(get(s)); }
+	static inline void lock(struct pgm_node_sync* s, unsigned long&) { ql_lock_no_nest(get(s)); }
+	static inline void unlock(struct pgm_node_sync* s, unsigned long) { ql_unlock_no_nest(get(s)); }
+#else
+	static inline void init(struct pgm_node_sync* s) { ql_init_np(get(s)); }
+	static inline void lock(struct pgm_node_sync* s, unsigned long& flags) { ql_lock_no_nest_np(get(s), &flags); }
+	static inline void unlock(struct pgm_node_sync* s, unsigned long flags) { ql_unlock_no_nest_np(get(s), flags); }
+#endif
+};
+
+// A spinlock paired with a futex-based condition variable.
+template <class Spin>
+struct pgm_spin_sync
+{
+	static void init(struct pgm_node_sync* s)
+	{
+		Spin::init(s);
+	#ifdef PGM_PRIVATE
+		cv_init(Spin::cv(s));
+	#else
+		cv_init_shared(Spin::cv(s));
+	#endif
+	}
+
+	static void destroy(struct pgm_node_sync*)
+	{
+	}
+
+	static inline void lock(struct pgm_node_sync* s, unsigned long& flags)
+	{
+		Spin::lock(s, flags);
+	}
+
+	static inline void unlock(struct pgm_node_sync* s, unsigned long& flags)
+	{
+		Spin::unlock(s, flags);
+	}
+
+	static inline void wait(struct pgm_node_sync* s, unsigned long& flags)
+	{
+		seq_t seq = cv_prepare(Spin::cv(s));
+		Spin::unlock(s, flags); /* memory barrier */
+		cv_block(Spin::cv(s), seq, NULL);
+		Spin::lock(s, flags);
+		cv_finish(Spin::cv(s));
+	}
+
+	// wait until CLOCK_MONOTONIC time 'deadline' (in ns)
+	static inline void timedwait(struct pgm_node_sync* s, unsigned long& flags, uint64_t deadline)
+	{
+		uint64_t now = pgm_now_ns();
+		struct timespec rel = pgm_ns_to_timespec((deadline > now) ? deadline - now : 0);
+		seq_t seq = cv_prepare(Spin::cv(s));
+		Spin::unlock(s, flags); /* memory barrier */
+		cv_block(Spin::cv(s), seq, &rel);
+		Spin::lock(s, flags);
+		cv_finish(Spin::cv(s));
+	}
+
+	static inline void signal(struct pgm_node_sync* s)
+	{
+		cv_signal(Spin::cv(s));
+	}
+};
+
+typedef pgm_spin_sync<pgm_ticket_lock> pgm_ticket_sync;
+typedef pgm_spin_sync<pgm_mcs_lock>    pgm_mcs_sync;
+
+// Calls Policy::member(args) for the lock type of node 'n'.
+#define pgm_sync_call(n, member, ...) \
+	do { \
+		switch((n)->lock_type) \
+		{ \
+			case PGM_LOCK_TICKET: pgm_ticket_sync::member(&(n)->sync, ##__VA_ARGS__); break; \
+			case PGM_LOCK_MCS: pgm_mcs_sync::member(&(n)->sync, ##__VA_ARGS__); break; \
+			default: pgm_pthread_sync::member(&(n)->sync, ##__VA_ARGS__); break; \
+		} \
+	} while(0)
+
+#define pgm_lock_init(n)         pgm_sync_call((n), init)
+#define pgm_lock_destroy(n)      pgm_sync_call((n), destroy)
+#define pgm_lock(n, flags)       pgm_sync_call((n), lock, (flags))
+#define pgm_unlock(n, flags)     pgm_sync_call((n), unlock, (flags))
+
+///////////////////////////////////////////////////
+//      PGM Framework Init/Destroy Routines      //
+///////////////////////////////////////////////////
+
+static int safePath(const path& dir)
+{
+	static const path allowed[] = {
+		path("/dev/shm"),
+		path("/home"),
+		path("/tmp")
+	};
+
+	path dirAbs;
+	if(dir.is_relative())
+	{
+		dirAbs = current_path();
+		dirAbs /= dir;
+	}
+	else
+	{
+		dirAbs = dir;
+	}
+
+	if(dirAbs.empty() || dirAbs == path("/"))
+		return -1;
+
+	int failures = 0;
+	const int nrValidStems = sizeof(allowed)/sizeof(allowed[0]);
+	for(int i = 0; i < nrValidStems; ++i)
+	{
+		for(path::iterator compare(allowed[i].begin()), toCheck(dirAbs.begin());
+			compare != allowed[i].end();
+			++compare, ++toCheck)
+		{
+			if(*compare != *toCheck || toCheck == dirAbs.end())
+			{
+				++failures;
+				break;
+			}
+		}
+	}
+
+	if(nrValidStems == failures)
+		return -1;
+	return 0;
+}
+
+static int prepare_dir(const path& graphDir)
+{
+	int ret = -1;
+
+	if(0 != safePath(graphDir))
+	{
+		E("%s is an invalid path.\n", graphDir.string().c_str());
+		goto out;
+	}
+
+	if(exists(graphDir) && !is_directory(graphDir))
+	{
+		E("%s is a file.\n", graphDir.string().c_str());
+		goto out;
+	}
+
+	if(boost::filesystem::equivalent(graphDir, current_path()))
+	{
+		E("Current working directory cannot be the same as graph directory.\n");
+		goto out;
+	}
+
+	if(!exists(graphDir))
+	{
+	create_dir:
+		if(!create_directories(graphDir))
+		{
+			F("Could not create directory %s\n", graphDir.string().c_str());
+			goto out;
+		}
+	}
+
+	if(!filesystem::is_empty(graphDir))
+	{
+		if(0 == remove_all(graphDir))
+		{
+			F("Unable to remove files in %s\n", graphDir.string().c_str());
+			goto out;
+		}
+		goto create_dir; // i know. this makes a child cry.
+	}
+
+	ret = 0;
+
+out:
+	return ret;
+}
+
+static string get_gMemName(const path& graphDir)
+{
+	const char* graphName = "gGraphSharedMem.dat";
+	boost::hash<std::string> string_hash;
+	stringstream ss;
+	size_t hash;
+
+	hash = string_hash(graphDir.string());
+	ss<<hex<<hash<<"_"<<graphName;
+
+	return ss.str();
+}
+
+static int prepare_graph_shared_mem(const path& graphDir)
+{
+	int ret = -1;
+
+#ifdef PGM_SHARED
+	string memName = get_gMemName(graphDir);
+
+	// allocate twice as much space as we really need, just to be safe.
+	size_t memsize = sizeof(struct pgm_graph) * PGM_MAX_GRAPHS * 2;
+
+	// make sure there's nothing hanging around
+	shared_memory_object::remove(memName.c_str());
+
+	gGraphSharedMem = new managed_shared_memory(create_only, memName.c_str(), memsize);
+	if(!gGraphSharedMem)
+	{
+		F("Could not create shared memory file %s\n", memName.c_str());
+		goto out;
+	}
+
+	gGraphs = gGraphSharedMem->construct<struct pgm_graph>("struct pgm_graph gGraphs")[PGM_MAX_GRAPHS]();
+	if(!gGraphs)
+	{
+		F("Shared memory allocation failure.\n");
+		goto out;
+	}
+	memset(gGraphs, 0, sizeof(struct pgm_graph)*PGM_MAX_GRAPHS);
+
+	ret = 0;
+	gIsGraphMaster = true;
+	gMemName = memName;
+out:
+#else
+	F("PGM not compiled with shared mem support.\n");
+#endif
+	return ret;
+}
+
+static int open_graph_shared_mem(const path& graphDir, const int timeout_s = 60)
+{
+	int ret = -1;
+#ifdef PGM_SHARED
+	int time = 0;
+	string memName = get_gMemName(graphDir);
+
+	do
+	{
+		try
+		{
+			if(!gGraphSharedMem)
+				gGraphSharedMem = new managed_shared_memory(open_only,memName.c_str());
+		}
+		catch (...)
+		{
+			sleep(1);
+
+			if(timeout_s == ++time)
+				goto out;
+		}
+	} while (!gGraphSharedMem);
+
+	gGraphs = gGraphSharedMem->find<struct pgm_graph>("struct pgm_graph gGraphs").first;
+	ret = 0;
+out:
+#else
+	F("PGM not compiled with shared memory support.\n");
+#endif
+	return ret;
+}
+
+static int prepare_graph_private_mem(void)
+{
+	int ret = -1;
+
+	if (gGraphs == 0)
+	{
+		gGraphs = new (std::nothrow) struct pgm_graph[PGM_MAX_GRAPHS];
+		if (gGraphs)
+		{
+			memset(gGraphs, 0, sizeof(struct pgm_graph)*PGM_MAX_GRAPHS);
+			gIsGraphMaster = true;
+			ret = 0;
+		}
+	}
+	else
+	{
+		ret = 1; // TODO: establish proper PGM error codes
+	}
+
+	return ret;
+}
+
+int pgm_init_process_local(void)
+{
+	int ret = prepare_graph_private_mem();
+	return ret;
+}
+
+int pgm_init1(const char* dir){
+	return pgm_init3(dir, 0, 0);
+}
+int pgm_init2(const char* dir, int create){
+	return pgm_init3(dir, create, 0);
+}
+int pgm_init3(const char* dir, int create, int use_shared_mem)
+{
+	int ret = -1;
+	path graphDir(dir);
+
+	if(graphDir.is_relative())
+	{
+		graphDir = current_path();
+		graphDir /= dir;
+	}
+
+	if(create)
+	{
+		// TODO: Create dir for FIFOs on demand.
+		ret = prepare_dir(graphDir);
+		if(0 != ret)
+			goto out;
+
+		if(use_shared_mem)
+		{
+			ret = prepare_graph_shared_mem(graphDir);
+			if(0 != ret)
+				goto out;
+		}
+		else
+		{
+			ret = prepare_graph_private_mem();
+		}
+	}
+	else
+	{
+		if(!use_shared_mem)
+			goto out;
+
+		ret = open_graph_shared_mem(graphDir);
+		if(0 != ret)
+			goto out;
+	}
+
+	gGraphPath = graphDir;
+
+out:
+	return ret;
+}
+
+int pgm_destroy(void)
+{
+	int ret = -1;
+
+	if(gGraphSharedMem)
+	{
+		// we're shared memory
+		gGraphs = 0;
+		delete gGraphSharedMem;
+		gGraphSharedMem = 0;
+
+		if(gIsGraphMaster)
+			shared_memory_object::remove(gMemName.c_str());
+
+		ret = 0;
+	}
+	else
+	{
+		// we (might) be private memory
+		if(gGraphs)
+		{
+			delete [] gGraphs;
+			gGraphs = 0;
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+
+///////////////////////////////////////////////////
+//     Graph/Node/Edge Init/Destroy Routines     //
+///////////////////////////////////////////////////
+
+static int prepare_graph(graph_t* graph, const char* graph_name)
+{
+	int ret = -1;
+	struct pgm_graph *g;
+	size_t len;
+
+	*graph = -1;
+	for(int i = 0; i < PGM_MAX_GRAPHS; ++i)
+	{
+		if(!gGraphs[i].in_use)
+		{
+			*graph = i;
+			break;
+		}
+	}
+
+	if(*graph == -1)
+	{
+		E("Out of graph slots\n");
+		goto out;
+	}
+
+	g = &gGraphs[*graph];
+	memset(g, 0, sizeof(struct pgm_graph));
+	g->in_use = 1;
+
+	len = strnlen(graph_name, PGM_GRAPH_NAME_LEN);
+	if(len <= 0 || len > PGM_GRAPH_NAME_LEN)
+	{
+		E("Bad graph name length: %d\n", (int)len);
+		goto out;
+	}
+
+	strncpy(g->name, graph_name, PGM_GRAPH_NAME_LEN);
+	g->node_lock_type = PGM_LOCK_BUILTIN;
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+#ifdef PGM_SHARED
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#endif
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&g->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	ret = 0;
+
+out:
+	return ret;
+}
+
+static int open_graph(graph_t* graph, const char* graph_name)
+{
+	size_t len = strlen(graph_name);
+
+	*graph = -1;
+	for(int i = 0; i < PGM_MAX_GRAPHS; ++i)
+	{
+		if(0 == strncmp(gGraphs[i].name, graph_name, len))
+		{
+			*graph = i;
+			break;
+		}
+	}
+
+	return (*graph == -1) ? -1: 0;
+}
+
+// Snapshots that sock_stream edges of loaded graphs still point into
+// (attr.node). See pgm_load_graph().
+static struct
+{
+	void* addr;
+	size_t len;
+} gSnapshotMaps[PGM_MAX_GRAPHS];
+
+static void unmap_snapshot(graph_t graph)
+{
+	if(gSnapshotMaps[graph].addr)
+	{
+		munmap(gSnapshotMaps[graph].addr, gSnapshotMaps[graph].len);
+		gSnapshotMaps[graph].addr = 0;
+		gSnapshotMaps[graph].len = 0;
+	}
+}
+
+// Destroy all the nodes and edges of a graph, leaving it empty.
+static void __clear_graph(struct pgm_graph* g)
+{
+	for(int i = 0; i < g->nr_edges; ++i)
+	{
+		g->edges[i].ops->destroy(g,
+				&(g->nodes[g->edges[i].producer]),
+				&(g->nodes[g->edges[i].consumer]),
+				&(g->edges[i]));
+	}
+
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		pgm_lock_destroy(&g->nodes[i]);
+#if defined(PGM_STATS)
+		pgm_hist_free(&g->nodes[i].stats.exec);
+#endif
+#if defined(PGM_LATENCY)
+		pgm_hist_free(&g->nodes[i].latency);
+#endif
+	}
+
+	g->nr_nodes = 0;
+	g->nr_edges = 0;
+	g->release_epoch_ns = 0;
+	memset(g->nodes, 0, sizeof(g->nodes));
+}
+
+static void __destroy_graph(struct pgm_graph* g)
+{
+	__clear_graph(g);
+
+	g->in_use = 0;
+	memset(g->name, 0, sizeof(g->name));
+
+	unmap_snapshot(g - gGraphs);
+}
+
+int pgm_destroy_graph(graph_t graph)
+{
+	int ret = -1;
+	int abort = 0;
+	struct pgm_graph* g;
+
+	if(!gIsGraphMaster)
+		goto out;
+	if(!is_valid_graph(graph))
+		goto out;
+
+	g = &gGraphs[graph];
+
+
+	pthread_mutex_lock(&g->lock);
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		if(g->nodes[i].owner != UNCLAIMED_NODE)
+		{
+			E("Node %s still in use by %d\n", g->nodes[i].name, g->nodes[i].owner);
+			abort = 1;
+			goto out_unlock;
+		}
+	}
+
+out_unlock:
+	if(!abort)
+	{
+		__destroy_graph(g);
+		pthread_mutex_unlock(&g->lock);
+		ret = 0;
+	}
+	else
+	{
+		pthread_mutex_unlock(&g->lock);
+	}
+
+out:
+	return ret;
+}
+
+int pgm_init_graph(graph_t* graph, const char* graph_name)
+{
+	int ret = -1;
+	size_t len;
+
+	if(!gGraphs)
+		goto out;
+
+	len = strnlen(graph_name, PGM_GRAPH_NAME_LEN);
+	if(len <= 0 || len > PGM_GRAPH_NAME_LEN)
+		goto out;
+
+	if(gIsGraphMaster && 0 != pgm_find_graph(graph, graph_name))
+		ret = prepare_graph(graph, graph_name);
+out:
+	return ret;
+}
+
+int pgm_init_graph_int(graph_t* graph, unsigned int numerical_name)
+{
+	char name[PGM_GRAPH_NAME_LEN];
+	snprintf(name, PGM_GRAPH_NAME_LEN, "%x", numerical_name);
+	return pgm_init_graph(graph, name);
+}
+
+int pgm_init_node(node_t* node, graph_t graph, const char* name)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	size_t len;
+
+	if(!node || !is_valid_graph(graph))
+		goto out;
+	if(!gIsGraphMaster)
+		goto out;
+	len = strnlen(name, PGM_NODE_NAME_LEN);
+	if(len <= 0 || len > PGM_NODE_NAME_LEN)
+		goto out;
+
+	g = &gGraphs[graph];
+	pthread_mutex_lock(&g->lock);
+
+	if(g->nr_nodes + 1 == PGM_MAX_NODES)
+	{
+		E("No more available nodes for graph %s.\n", g->name);
+		goto out_unlock;
+	}
+
+	node->graph = graph;
+	node->node = (g->nr_nodes)++;
+	n = &g->nodes[node->node];
+
+	// memset just to be safe...
+	memset(n, 0, sizeof(*n));
+	n->owner = UNCLAIMED_NODE;
+	n->ready_efd = -1;
+	n->ready_epfd = -1;
+	strncpy(n->name, name, len);
+
+	n->lock_type = g->node_lock_type;
+	pgm_lock_init(n);
+
+	g->analysis_valid = 0;
+	ret = 0;
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+
+int pgm_init_node_int(node_t* node, graph_t graph, unsigned int numerical_name)
+{
+	char name[PGM_NODE_NAME_LEN];
+	snprintf(name, PGM_NODE_NAME_LEN, "%x", numerical_name);
+	return pgm_init_node(node, graph, name);
+}
+
+static int validate_edge_attr(const edge_attr_t* attr)
+{
+	int ret = -1;
+
+	if((attr->type & __PGM_EDGE_MQ) && (attr->nr_produce != attr->nr_consume))
+	{
+		E("Produce amnt. must equal consume amnt. for POSIX msg queues.\n");
+		goto out;
+	}
+	if(attr->type & __PGM_EDGE_RING)
+	{
+		if(attr->nr_produce != attr->nr_consume)
+		{
+			E("Produce amnt. must equal consume amnt. for ring buffers.\n");
+			goto out;
+		}
+		if(attr->nmemb == 0)
+		{
+			E("nmemb cannot be zero.\n");
+			goto out;
+		}
+	}
+
+	if((attr->type & __PGM_EDGE_CUSTOM) && transport_id(attr) >= gNrTransports)
+	{
+		E("Unknown transport.\n");
+		goto out;
+	}
+	if(attr->nr_threshold < attr->nr_consume)
+		goto out;
+	if(attr->nr_produce <= 0 || attr->nr_consume <= 0 || attr->nr_threshold <= 0)
+		goto out;
+	if(attr->type == 0)
+		goto out;
+
+	ret = 0;
+
+out:
+	return ret;
+}
+
+static const struct pgm_edge_ops* edge_ops(const edge_attr_t* attr)
+{
+	if     (attr->type & __PGM_EDGE_CUSTOM)
+		return &pgm_custom_edge_ops;
+	else if(attr->type & __PGM_EDGE_CV)
+		return &pgm_cv_edge_ops;
+	else if(attr->type & __PGM_EDGE_FIFO)
+		return &pgm_fifo_edge_ops;
+	else if(attr->type & __PGM_EDGE_MQ)
+		return &pgm_mq_edge_ops;
+	else if(attr->type & __PGM_EDGE_RING)
+		return &pgm_ring_edge_ops;
+	else if(attr->type & __PGM_EDGE_SOCK_STREAM)
+		return &pgm_sock_stream_edge_ops;
+	return 0;
+}
+
+// Append edge 'e' to the out-edges of 'np' and the in-edges of 'nc'.
+// Degrees must have been checked by the caller.
+static void link_edge(struct pgm_node* np, struct pgm_node* nc, int e,
+				const edge_attr_t* attr, bool is_backedge)
+{
+	if(is_signal_driven(attr))
+	{
+		nc->nr_in_signaled++;
+		nc->signal_edge_mask |= ((pgm_fd_mask_t)(1))<<(nc->nr_in);
+
+		if(is_backedge)
+		{
+			nc->nr_in_signaled_backedges++;
+		}
+	}
+	if(is_data_passing(attr))
+	{
+		nc->nr_in_data++;
+		if(is_backedge)
+		{
+			nc->nr_in_data_backedges++;
+		}
+	}
+
+	np->out[np->nr_out++] = e;
+	nc->in[nc->nr_in++] = e;
+}
+
+static int __pgm_init_edge(edge_t* edge,
+	node_t producer, node_t consumer, const char* name,
+	const edge_attr_t* attr,
+	bool is_backedge, size_t nr_skips)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_edge* e;
+	struct pgm_node* np;
+	struct pgm_node* nc;
+	size_t len;
+
+	if(	!edge ||
+		(producer.graph != consumer.graph) ||
+		!is_valid_graph(producer.graph) )
+		goto out;
+	if(!gIsGraphMaster)
+		goto out;
+	len = strnlen(name, PGM_EDGE_NAME_LEN);
+	if(len <= 0 || len > PGM_EDGE_NAME_LEN)
+		goto out;
+
+	if(validate_edge_attr(attr) != 0)
+		goto out;
+
+	g = &gGraphs[producer.graph];
+	pthread_mutex_lock(&g->lock);
+
+	if(g->nr_edges + 1 == PGM_MAX_EDGES)
+	{
+		E("No more available edges for graph %s.\n", g->name);
+		goto out_unlock;
+	}
+	if(g->nr_nodes <= producer.node || g->nr_nodes <= consumer.node)
+	{
+		E("Invalid nodes.\n");
+		goto out_unlock;
+	}
+
+	np = &g->nodes[producer.node];
+	if(np->nr_out+1 == PGM_MAX_OUT_DEGREE)
+		goto out_unlock;
+	nc = &g->nodes[consumer.node];
+	if(nc->nr_in+1 == PGM_MAX_IN_DEGREE)
+		goto out_unlock;
+	// replicas and in-flight jobs would share the staging buffer
+	if(is_multi_job(np) && is_coalesced(attr))
+	{
+		E("Node %s/%s runs several jobs at once and cannot have coalesced out-edges.\n",
+		  g->name, np->name);
+		goto out_unlock;
+	}
+
+	edge->graph = producer.graph;
+	edge->edge = (g->nr_edges)++;
+	e = &g->edges[edge->edge];
+
+	link_edge(np, nc, edge->edge, attr, is_backedge);
+
+	// memset just to be safe...
+	memset(e, 0, sizeof(*e));
+	strncpy(e->name, name, len);
+	e->producer = producer.node;
+	e->consumer = consumer.node;
+	e->attr = *attr;
+
+	if(is_backedge)
+	{
+		e->is_backedge = true;
+		e->nr_skips = nr_skips;
+	}
+
+	e->ops = edge_ops(attr);
+	if(!e->ops)
+		goto out_unlock;
+
+	g->analysis_valid = 0;
+	ret = e->ops->init(g, np, nc, e);
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+
+int pgm_init_edge4(edge_t* edge, node_t producer, node_t consumer,
+	const char* name){
+		printf("init\n");
+		return pgm_init_edge5(edge, producer, consumer, name, &default_edge);
+	}
+int pgm_init_edge5(edge_t* edge,
+	node_t producer, node_t consumer, const char* name,
+	const edge_attr_t* attr)
+{
+	int ret = __pgm_init_edge(edge, producer, consumer, name, attr, false, 0);
+	return ret;
+}
+
+int pgm_init_edge_int5(edge_t* edge, node_t producer, node_t consumer,
+	unsigned int numerical_name,
+	const edge_attr_t* attrs)
+{
+	char name[PGM_EDGE_NAME_LEN];
+	snprintf(name, PGM_EDGE_NAME_LEN, "%x", numerical_name);
+	return pgm_init_edge5(edge, producer, consumer, name, attrs);
+}
+
+int pgm_init_edge_int4(edge_t* edge, node_t producer, node_t consumer,
+	unsigned int numerical_name){
+		return pgm_init_edge_int5(edge, producer, consumer, numerical_name, &default_edge);
+	}
+
+int pgm_init_backedge5(edge_t* edge, size_t nr_skips,
+  	node_t producer, node_t consumer,
+  	const char* name){
+			return pgm_init_backedge6(edge, nr_skips, producer, consumer, name, &default_edge);
+		}
+
+int pgm_init_backedge6(edge_t* edge, size_t nr_skips,
+	node_t producer, node_t consumer, const char* name,
+	const edge_attr_t* attr)
+{
+	int ret = __pgm_init_edge(edge, producer, consumer, name, attr, true, nr_skips);
+	return ret;
+}
+
+int pgm_init_backedge_int5(edge_t* edge, size_t nskips,
+		node_t producer, node_t consumer,
+		unsigned int numerical_name){
+			return pgm_init_backedge_int6(edge, nskips, producer, consumer, numerical_name, &default_edge);
+		}
+
+int pgm_init_backedge_int6(edge_t* edge, size_t nr_skips,
+	node_t producer, node_t consumer,
+	unsigned int numerical_name,
+	const edge_attr_t* attrs)
+{
+	char name[PGM_EDGE_NAME_LEN];
+	snprintf(name, PGM_EDGE_NAME_LEN, "%x", numerical_name);
+	return pgm_init_backedge6(edge, nr_skips, producer, consumer, name, attrs);
+}
+
+///////////////////////////////////////////////////
+//        Graph/Node/Edge Query Routines         //
+///////////////////////////////////////////////////
+
+int pgm_find_graph(graph_t* graph, const char* graph_name)
+{
+	int ret = -1;
+	size_t len;
+
+	if(!gGraphSharedMem)
+		goto out;
+
+	len = strnlen(graph_name, PGM_GRAPH_NAME_LEN);
+	if(len <= 0 || len > PGM_GRAPH_NAME_LEN)
+		goto out;
+
+	ret = open_graph(graph, graph_name);
+
+out:
+	return ret;
+}
+
+int pgm_find_graph_int(graph_t* graph, unsigned int numerical_name)
+{
+	char name[PGM_GRAPH_NAME_LEN];
+	snprintf(name, PGM_GRAPH_NAME_LEN, "%x", numerical_name);
+	return pgm_find_graph(graph, name);
+}
+
+int pgm_find_node(node_t* node, graph_t graph, const char* name)
+{
+	int ret = -1;
+	size_t len;
+	struct pgm_graph* g;
+
+	if(!node || !is_valid_graph(graph))
+		goto out;
+	len = strnlen(name, PGM_NODE_NAME_LEN);
+	if(len <= 0 || len > PGM_NODE_NAME_LEN)
+		goto out;
+
+	g = &gGraphs[graph];
+
+	pthread_mutex_lock(&g->lock);
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		if(0 == strncmp(g->nodes[i].name, name, len))
+		{
+			node->graph = graph;
+			node->node = i;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+
+out:
+	return ret;
+}
+
+int pgm_find_node_int(node_t* node, graph_t graph, unsigned int numerical_name)
+{
+	char name[PGM_NODE_NAME_LEN];
+	snprintf(name, PGM_NODE_NAME_LEN, "%x", numerical_name);
+	return pgm_find_node(node, graph, name);
+}
+
+int pgm_find_edge4(edge_t* edge, node_t producer, node_t consumer,
+ const char* name){
+	 return pgm_find_edge5(edge, producer, consumer, name, NULL);
+ }
+
+int pgm_find_edge5(edge_t* edge, node_t producer, node_t consumer,
+				const char* name, edge_attr_t* attr)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	size_t len;
+
+	if(!name)
+		return pgm_find_first_edge3(edge, producer, consumer);
+
+	if(	!edge ||
+		(producer.graph != consumer.graph) ||
+		!is_valid_graph(producer.graph))
+		goto out;
+	len = strnlen(name, PGM_EDGE_NAME_LEN);
+	if(len <= 0 || len > PGM_EDGE_NAME_LEN)
+		goto out;
+
+	g = &gGraphs[producer.graph];
+
+	pthread_mutex_lock(&g->lock);
+	for(int i = 0; i < g->nr_edges; ++i)
+	{
+		if(g->edges[i].producer == producer.node &&
+		   g->edges[i].consumer == consumer.node &&
+		   (0 == strncmp(g->edges[i].name, name, len)))
+		{
+			int found = 0;
+			pgm_node *np = &g->nodes[producer.node];
+			pgm_node *nc = &g->nodes[consumer.node];
+
+			for(int j = 0; j < np->nr_out; ++j)
+			{
+				if(i == np->out[j])
+				{
+					found++;
+					break;
+				}
+			}
+			for(int j = 0; j < nc->nr_in; ++j)
+			{
+				if(i == nc->in[j])
+				{
+					found++;
+					break;
+				}
+			}
+
+			if(found != 2)
+				goto out_unlock;
+
+			if(attr != 0)
+				*attr = g->edges[i].attr;
+			edge->graph = producer.graph;
+			edge->edge = i;
+			ret = 0;
+			break;
+		}
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+int pgm_find_edge_int4(edge_t* edge, node_t producer, node_t consumer,
+		unsigned int numerical_name){
+			return pgm_find_edge_int5(edge, producer, consumer, numerical_name, NULL);
+		}
+
+int pgm_find_edge_int5(edge_t* edge, node_t producer, node_t consumer,
+	unsigned int numerical_name,
+	edge_attr_t* attrs)
+{
+	char name[PGM_EDGE_NAME_LEN];
+	snprintf(name, PGM_EDGE_NAME_LEN, "%x", numerical_name);
+	return pgm_find_edge5(edge, producer, consumer, name, attrs);
+}
+
+int pgm_find_first_edge3(edge_t* edge, node_t producer, node_t consumer){
+	return pgm_find_first_edge4(edge, producer, consumer, NULL);
+}
+
+
+int pgm_find_first_edge4(edge_t* edge, node_t producer, node_t consumer, edge_attr_t *attr)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+
+	if(!edge ||
+		(producer.graph != consumer.graph) ||
+		!is_valid_graph(producer.graph))
+		goto out;
+
+	g = &gGraphs[producer.graph];
+
+	pthread_mutex_lock(&g->lock);
+	for(int i = 0; i < g->nr_edges; ++i)
+	{
+		if(g->edges[i].producer == producer.node &&
+		   g->edges[i].consumer == consumer.node)
+		{
+			if(attr != 0)
+				*attr = g->edges[i].attr;
+			edge->graph = producer.graph;
+			edge->edge = i;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+
+out:
+	return ret;
+}
+
+int pgm_set_user_data(node_t node, void* udata)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	n->userdata = udata;
+	ret = 0;
+
+out:
+	return ret;
+}
+
+void* pgm_get_user_data(node_t node)
+{
+	void* udata = 0;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	udata = n->userdata;
+
+out:
+	return udata;
+}
+
+static int resolve_lock_type(pgm_lock_type_t* type)
+{
+	int ret = -1;
+
+	switch(*type)
+	{
+		case PGM_LOCK_DEFAULT:
+			*type = PGM_LOCK_BUILTIN;
+			break;
+		case PGM_LOCK_PTHREAD:
+		case PGM_LOCK_TICKET:
+			break;
+		case PGM_LOCK_MCS:
+#ifdef PGM_SHARED
+			// queue nodes live in thread-local memory of each process
+			E("MCS locks cannot be shared between processes.\n");
+			goto out;
+#endif
+			break;
+		default:
+			E("Unknown lock type %d.\n", (int)*type);
+			goto out;
+	}
+	ret = 0;
+
+out:
+	return ret;
+}
+
+int pgm_set_graph_lock_type(graph_t graph, pgm_lock_type_t type)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(graph))
+		goto out;
+	if(resolve_lock_type(&type) != 0)
+		goto out;
+
+	g = &gGraphs[graph];
+	pthread_mutex_lock(&g->lock);
+	g->node_lock_type = type;
+	pthread_mutex_unlock(&g->lock);
+
+	ret = 0;
+
+out:
+	return ret;
+}
+
+int pgm_set_node_lock_type(node_t node, pgm_lock_type_t type)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+	if(resolve_lock_type(&type) != 0)
+		goto out;
+
+	g = &gGraphs[node.graph];
+	pthread_mutex_lock(&g->lock);
+
+	if(node.node < 0 || node.node >= g->nr_nodes)
+		goto out_unlock;
+
+	n = &g->nodes[node.node];
+	if(n->owner != UNCLAIMED_NODE)
+	{
+		E("Cannot change the lock of claimed node %s/%s.\n", g->name, n->name);
+		goto out_unlock;
+	}
+
+	if(n->lock_type != type)
+	{
+		pgm_lock_destroy(n);
+		n->lock_type = type;
+		pgm_lock_init(n);
+	}
+	ret = 0;
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+
+pgm_lock_type_t pgm_get_node_lock_type(node_t node)
+{
+	pgm_lock_type_t type = PGM_LOCK_DEFAULT;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+	if(node.node < 0 || node.node >= gGraphs[node.graph].nr_nodes)
+		goto out;
+
+	type = gGraphs[node.graph].nodes[node.node].lock_type;
+
+out:
+	return type;
+}
+
+int pgm_set_periodic(node_t node, uint64_t period_ns, uint64_t phase_ns)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	pthread_mutex_lock(&g->lock);
+
+	if(node.node < 0 || node.node >= g->nr_nodes)
+		goto out_unlock;
+
+	n = &g->nodes[node.node];
+	if(n->owner != UNCLAIMED_NODE)
+	{
+		E("Cannot change the release of claimed node %s/%s.\n", g->name, n->name);
+		goto out_unlock;
+	}
+
+	n->period_ns = period_ns;
+	n->phase_ns = (period_ns) ? phase_ns : 0;
+	n->next_release_ns = 0;
+	n->release_checked = 0;
+	memset(&n->release_stats, 0, sizeof(n->release_stats));
+	ret = 0;
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+
+// Can node 'n' be made to run several jobs at once? Called with the
+// graph lock held.
+static bool pgm_can_run_jobs_at_once(struct pgm_graph* g, struct pgm_node* n)
+{
+	if(!n->nr_in)
+	{
+		E("Node %s/%s has no in-edges.\n", g->name, n->name);
+		return false;
+	}
+	for(int i = 0; i < n->nr_out; ++i)
+	{
+		if(is_coalesced(&g->edges[n->out[i]].attr))
+		{
+			E("Node %s/%s has coalesced out-edges.\n", g->name, n->name);
+			return false;
+		}
+	}
+	return true;
+}
+
+int pgm_set_replicas(node_t node, int nr_replicas, pgm_replica_policy_t policy)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+	if(nr_replicas < 1 || nr_replicas > PGM_MAX_REPLICAS)
+		goto out;
+	if(policy != PGM_REPLICA_DYNAMIC && policy != PGM_REPLICA_ROUND_ROBIN)
+		goto out;
+
+	g = &gGraphs[node.graph];
+	pthread_mutex_lock(&g->lock);
+
+	if(node.node < 0 || node.node >= g->nr_nodes)
+		goto out_unlock;
+
+	n = &g->nodes[node.node];
+	if(n->owner != UNCLAIMED_NODE)
+	{
+		E("Cannot replicate claimed node %s/%s.\n", g->name, n->name);
+		goto out_unlock;
+	}
+	if(nr_replicas > 1 && n->nr_inflight > 1)
+	{
+		E("Cannot replicate node %s/%s with several jobs in flight.\n", g->name, n->name);
+		goto out_unlock;
+	}
+	if(nr_replicas > 1 && !pgm_can_run_jobs_at_once(g, n))
+		goto out_unlock;
+
+	n->nr_replicas = nr_replicas;
+	n->replica_policy = policy;
+	ret = 0;
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+
+int pgm_set_concurrency(node_t node, int nr_inflight)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+	if(nr_inflight < 1 || nr_inflight > PGM_MAX_INFLIGHT)
+		goto out;
+
+	g = &gGraphs[node.graph];
+	pthread_mutex_lock(&g->lock);
+
+	if(node.node < 0 || node.node >= g->nr_nodes)
+		goto out_unlock;
+
+	n = &g->nodes[node.node];
+	if(n->owner != UNCLAIMED_NODE)
+	{
+		E("Cannot change the concurrency of claimed node %s/%s.\n", g->name, n->name);
+		goto out_unlock;
+	}
+	if(nr_inflight > 1 && n->nr_replicas > 1)
+	{
+		E("Replicated node %s/%s cannot have several jobs in flight.\n", g->name, n->name);
+		goto out_unlock;
+	}
+	if(nr_inflight > 1 && !pgm_can_run_jobs_at_once(g, n))
+		goto out_unlock;
+
+	n->nr_inflight = nr_inflight;
+	ret = 0;
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return ret;
+}
+int pgm_get_successors2(node_t n, node_t* successors, int len){
+	return pgm_get_successors3(n, successors, len, 1);
+}
+
+int pgm_get_successors3(node_t node, node_t* successors, int len, int ignore_backedges)
+{
+	int num = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	node_t* step = successors;
+
+	if(!successors || !is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	pthread_mutex_lock(&g->lock);
+
+	if(len < n->nr_out)
+		goto out_unlock;
+	num = n->nr_out;
+
+	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
+	{
+		if(ignore_backedges && g->edges[n->out[i]].is_backedge)
+		{
+			--num;
+		}
+		else
+		{
+			const pgm_node* const _succ = &g->nodes[g->edges[n->out[i]].consumer];
+			node_t succ =
+			{
+				.graph = node.graph,
+				.node = (int)(_succ - &g->nodes[0])
+			};
+			*step = succ;
+			++step;
+		}
+	}
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return num;
+}
+
+int pgm_get_edges_out2(node_t n, edge_t* edges, int len){
+	return pgm_get_edges_out3(n, edges, len, 1);
+}
+
+int pgm_get_edges_out3(node_t node, edge_t* edges, int len, int ignore_backedges)
+{
+	int num = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	edge_t* step = edges;
+
+	if(!edges || !is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	pthread_mutex_lock(&g->lock);
+
+	if(len < n->nr_out)
+		goto out_unlock;
+	num = n->nr_out;
+
+	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
+	{
+		if(ignore_backedges && g->edges[n->out[i]].is_backedge)
+		{
+			--num;
+		}
+		else
+		{
+			edge_t e =
+			{
+				.graph = node.graph,
+				.edge = n->out[i]
+			};
+			*step = e;
+			++step;
+		}
+	}
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return num;
+}
+
+int pgm_get_predecessors2(node_t node, node_t* predecessors, int len){
+	return pgm_get_predecessors3(node, predecessors, len, 1);
+}
+
+int pgm_get_predecessors3(node_t node, node_t* predecessors, int len, int ignore_backedges)
+{
+	int num = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	node_t* step = predecessors;
+
+	if(!predecessors || !is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	pthread_mutex_lock(&g->lock);
+
+	if(len < n->nr_in)
+		goto out_unlock;
+	num = n->nr_in;
+
+	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
+	{
+		if(ignore_backedges && g->edges[n->in[i]].is_backedge)
+		{
+			--num;
+		}
+		else
+		{
+			const pgm_node* const _pred = &g->nodes[g->edges[n->in[i]].producer];
+			node_t pred =
+			{
+				.graph = node.graph,
+				.node = (int)(_pred - &g->nodes[0])
+			};
+			*step = pred;
+			++step;
+		}
+	}
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return num;
+}
+
+int pgm_get_edges_in3(node_t n, edge_t* edges, int len){
+	return pgm_get_edges_in4(n, edges, len, 1);
+}
+
+int pgm_get_edges_in4(node_t node, edge_t* edges, int len, int ignore_backedges)
+{
+	int num = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	edge_t* step = edges;
+
+	if(!edges || !is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	pthread_mutex_lock(&g->lock);
+
+	if(len < n->nr_in)
+		goto out_unlock;
+	num = n->nr_in;
+
+	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
+	{
+		if(ignore_backedges && g->edges[n->in[i]].is_backedge)
+		{
+			--num;
+		}
+		else
+		{
+			edge_t e =
+			{
+				.graph = node.graph,
+				.edge = n->in[i]
+			};
+			*step = e;
+			++step;
+		}
+	}
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
+	return num;
+}
+
+const char* pgm_get_name(node_t node)
+{
+	const char* name = 0;
+
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+	name = n->name;
+
+out:
+	return name;
+}
+
+const char* pgm_get_edge_name(edge_t edge)
+{
+	const char* name = 0;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+	if(edge.edge < 0 || edge.edge >= gGraphs[edge.graph].nr_edges)
+		goto out;
+
+	name = gGraphs[edge.graph].edges[edge.edge].name;
+
+out:
+	return name;
+}
+
+int pgm_get_nr_nodes(graph_t graph)
+{
+	if(!is_valid_graph(graph))
+		return -1;
+	return gGraphs[graph].nr_nodes;
+}
+
+int pgm_get_nr_edges(graph_t graph)
+{
+	if(!is_valid_graph(graph))
+		return -1;
+	return gGraphs[graph].nr_edges;
+}
+
+int pgm_get_nodes(graph_t graph, node_t* nodes, int len)
+{
+	int num = -1;
+
+	if(!nodes || !is_valid_graph(graph))
+		goto out;
+	if(len < gGraphs[graph].nr_nodes)
+		goto out;
+
+	num = gGraphs[graph].nr_nodes;
+	for(int i = 0; i < num; ++i)
+	{
+		nodes[i].graph = graph;
+		nodes[i].node = i;
+	}
+
+out:
+	return num;
+}
+
+int pgm_get_edges(graph_t graph, edge_t* edges, int len)
+{
+	int num = -1;
+
+	if(!edges || !is_valid_graph(graph))
+		goto out;
+	if(len < gGraphs[graph].nr_edges)
+		goto out;
+
+	num = gGraphs[graph].nr_edges;
+	for(int i = 0; i < num; ++i)
+	{
+		edges[i].graph = graph;
+		edges[i].edge = i;
+	}
+
+out:
+	return num;
+}
+
+node_t pgm_get_producer(edge_t edge)
+{
+	node_t n = {edge.graph, -1};
+	struct pgm_graph* g;
+	struct pgm_edge* e;
+	if(!is_valid_graph(edge.graph))
+		goto out;
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+	n.node = e->producer;
+out:
+	return n;
+}
+
+node_t pgm_get_consumer(edge_t edge)
+{
+	node_t n = {edge.graph, -1};
+	struct pgm_graph* g;
+	struct pgm_edge* e;
+	if(!is_valid_graph(edge.graph))
+		goto out;
+	g = &gGraphs[edge.graph];
+	e = &g->edges[edge.edge];
+	n.node = e->consumer;
+out:
+	return n;
+}
+
+int pgm_get_edge_attrs(edge_t edge, edge_attr_t* attrs)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+	if(!attrs)
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	*attrs = g->edges[edge.edge].attr;
+
+out:
+	return ret;
+}
+
+int pgm_is_backedge(edge_t backedge)
+{
+	int is_be = 0;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(backedge.graph))
+		goto out;
+
+	g = &gGraphs[backedge.graph];
+	is_be = g->edges[backedge.edge].is_backedge;
+
+out:
+	return is_be;
+}
+
+size_t pgn_get_nr_skips_remaining(edge_t backedge)
+{
+	size_t remaining = 0;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(backedge.graph))
+		goto out;
+
+	g = &gGraphs[backedge.graph];
+	if(g->edges[backedge.edge].is_backedge)
+		remaining = g->edges[backedge.edge].nr_skips;
+
+out:
+	return remaining;
+}
+
+int pgm_get_nr_produce(edge_t edge)
+{
+	int produced = -1;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	produced = g->edges[edge.edge].attr.nr_produce;
+
+out:
+	return produced;
+}
+
+int pgm_get_nr_consume(edge_t edge)
+{
+	int consumed = -1;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	consumed = g->edges[edge.edge].attr.nr_consume;
+
+out:
+	return consumed;
+}
+
+int pgm_get_nr_threshold(edge_t edge)
+{
+	int threshold = -1;
+	struct pgm_graph* g;
+
+	if(!is_valid_graph(edge.graph))
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	threshold = g->edges[edge.edge].attr.nr_threshold;
+
+out:
+	return threshold;
+}
+
+int pgm_get_node_stats(node_t node, pgm_node_stats_t* stats)
+{
+	int ret = -1;
+#if defined(PGM_STATS)
+	struct pgm_graph* g;
+	const pgm_node_stats_t* s;
+
+	if(!is_valid_graph(node.graph) || !stats)
+		goto out;
+
+	g = &gGraphs[node.graph];
+	if(node.node < 0 || node.node >= g->nr_nodes)
+		goto out;
+
+	s = &g->nodes[node.node].stats.s;
+	stats->nr_invocations = pgm_stat_read(s->nr_invocations);
+	stats->nr_completions = pgm_stat_read(s->nr_completions);
+	stats->wait_ns = pgm_stat_read(s->wait_ns);
+	stats->max_wait_ns = pgm_stat_read(s->max_wait_ns);
+	stats->exec_ns = pgm_stat_read(s->exec_ns);
+	stats->max_exec_ns = pgm_stat_read(s->max_exec_ns);
+	stats->first_complete_ns = pgm_stat_read(s->first_complete_ns);
+	stats->last_complete_ns = pgm_stat_read(s->last_complete_ns);
+
+	ret = 0;
+out:
+#else
+	E("PGM was built without statistics (PGM_STATS_METHOD).\n");
+#endif
+	return ret;
+}
+
+int pgm_get_edge_stats(edge_t edge, pgm_edge_stats_t* stats)
+{
+	int ret = -1;
+#if defined(PGM_STATS)
+	struct pgm_graph* g;
+	const struct pgm_edge* e;
+
+	if(!is_valid_graph(edge.graph) || !stats)
+		goto out;
+
+	g = &gGraphs[edge.graph];
+	if(edge.edge < 0 || edge.edge >= g->nr_edges)
+		goto out;
+
+	e = &g->edges[edge.edge];
+	stats->nr_produced = pgm_stat_read(e->pstats.nr_produced);
+	stats->bytes_sent = pgm_stat_read(e->pstats.bytes_sent);
+	stats->max_pending = pgm_stat_read(e->pstats.max_pending);
+	stats->nr_consumed = pgm_stat_read(e->cstats.nr_consumed);
+	stats->bytes_received = pgm_stat_read(e->cstats.bytes_received);
+
+	ret = 0;
+out:
+#else
+	E("PGM was built without statistics (PGM_STATS_METHOD).\n");
+#endif
+	return ret;
+}
+
+static inline int is_valid_node(node_t node)
+{
+	return is_valid_graph(node.graph) &&
+		node.node >= 0 && node.node < gGraphs[node.graph].nr_nodes;
+}
+
+int pgm_get_release_stats(node_t node, pgm_release_stats_t* stats)
+{
+	int ret = -1;
+	const pgm_release_stats_t* s;
+
+	if(!is_valid_node(node) || !stats)
+		goto out;
+
+	s = &gGraphs[node.graph].nodes[node.node].release_stats;
+	stats->nr_releases = pgm_stat_read(s->nr_releases);
+	stats->nr_overruns = pgm_stat_read(s->nr_overruns);
+	stats->nr_missed = pgm_stat_read(s->nr_missed);
+	stats->max_lateness_ns = pgm_stat_read(s->max_lateness_ns);
+
+	ret = 0;
+out:
+	return ret;
+}
+
+int pgm_get_exec_percentile(node_t node, double percentile, uint64_t* exec_ns)
+{
+	int ret = -1;
+#if defined(PGM_STATS)
+	const struct pgm_hist* h;
+
+	if(!is_valid_node(node) || !exec_ns || percentile < 0.0 || percentile > 100.0)
+		goto out;
+
+	h = pgm_hist_get(&gGraphs[node.graph].nodes[node.node].stats.exec);
+	*exec_ns = (h) ? pgm_hist_percentile(h, percentile) : 0;
+	ret = 0;
+out:
+#else
+	E("PGM was built without statistics (PGM_STATS_METHOD).\n");
+#endif
+	return ret;
+}
+
+#if defined(PGM_LATENCY)
+static struct pgm_replica* pgm_my_replica(struct pgm_node* n);
+
+// Origin of the caller's job of node 'n'. NULL if the caller is not a
+// replica of a replicated node.
+static uint64_t* pgm_job_origin(struct pgm_node* n)
+{
+	struct pgm_replica* r;
+	if(n->nr_replicas <= 1)
+		return &n->origin_ns;
+	r = pgm_my_replica(n);
+	return (r) ? &r->job.origin_ns : 0;
+}
+
+// Called by the owner of sink 'n' when it completes a job with an origin.
+static void pgm_record_latency(struct pgm_node* n, uint64_t origin_ns)
+{
+	if(origin_ns == PGM_ORIGIN_LOST)
+	{
+		pgm_stat_add(n->nr_latency_lost, 1);
+		return;
+	}
+
+	int64_t ns = (int64_t)(pgm_now_ns() - origin_ns);
+	if(ns >= 0)  // (origin may be in the future)
+		pgm_hist_add(&n->latency, ns);
+}
+#endif
+
+int pgm_set_origin(node_t node, uint64_t origin_ns)
+{
+	int ret = -1;
+#if defined(PGM_LATENCY)
+	uint64_t* origin;
+	if(!is_valid_node(node))
+		goto out;
+	origin = pgm_job_origin(&gGraphs[node.graph].nodes[node.node]);
+	if(!origin)
+		goto out;
+	*origin = origin_ns;
+	ret = 0;
+out:
+#else
+	E("PGM was built without latency tracking (PGM_LATENCY_METHOD).\n");
+#endif
+	return ret;
+}
+
+int pgm_get_origin(node_t node, uint64_t* origin_ns)
+{
+	int ret = -1;
+#if defined(PGM_LATENCY)
+	uint64_t* origin;
+	if(!is_valid_node(node) || !origin_ns)
+		goto out;
+	origin = pgm_job_origin(&gGraphs[node.graph].nodes[node.node]);
+	if(!origin)
+		goto out;
+	*origin_ns = *origin;
+	if(*origin_ns == PGM_ORIGIN_LOST)
+		*origin_ns = 0;
+	ret = 0;
+out:
+#else
+	E("PGM was built without latency tracking (PGM_LATENCY_METHOD).\n");
+#endif
+	return ret;
+}
+
+int pgm_get_latency_stats(node_t node, pgm_latency_stats_t* stats)
+{
+	int ret = -1;
+#if defined(PGM_LATENCY)
+	struct pgm_node* n;
+	const struct pgm_hist* h;
+	uint64_t count;
+
+	if(!is_valid_node(node) || !stats)
+		goto out;
+
+	n = &gGraphs[node.graph].nodes[node.node];
+	memset(stats, 0, sizeof(*stats));
+	stats->nr_lost = pgm_stat_read(n->nr_latency_lost);
+
+	h = pgm_hist_get(&n->latency);
+	if(!h || !(count = __atomic_load_n(&h->count, __ATOMIC_RELAXED)))
+	{
+		ret = 0;
+		goto out;
 	}
-	#define pgm_lock_destroy(l)  pthread_mutex_destroy((l))
-	#define pgm_lock(l, flags)   do { ((void)(flags)); pthread_mutex_lock((l)); } while(0)
-	#define pgm_unlock(l, flags) do { ((void)(flags)); pthread_mutex_unlock((l)); } while(0)
 
-	static void pgm_cv_init(pgm_cv_t* cv)
+	stats->count = count;
+	stats->min_ns = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+	stats->max_ns = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	stats->mean_ns = __atomic_load_n(&h->sum, __ATOMIC_RELAXED) / count;
+	stats->p50_ns = pgm_hist_percentile(h, 50.0);
+	stats->p90_ns = pgm_hist_percentile(h, 90.0);
+	stats->p99_ns = pgm_hist_percentile(h, 99.0);
+	stats->p9999_ns = pgm_hist_percentile(h, 99.99);
+
+	ret = 0;
+out:
+#else
+	E("PGM was built without latency tracking (PGM_LATENCY_METHOD).\n");
+#endif
+	return ret;
+}
+
+int pgm_get_latency_percentile(node_t node, double percentile, uint64_t* latency_ns)
+{
+	int ret = -1;
+#if defined(PGM_LATENCY)
+	const struct pgm_hist* h;
+
+	if(!is_valid_node(node) || !latency_ns || percentile < 0.0 || percentile > 100.0)
+		goto out;
+
+	h = pgm_hist_get(&gGraphs[node.graph].nodes[node.node].latency);
+	*latency_ns = (h) ? pgm_hist_percentile(h, percentile) : 0;
+	ret = 0;
+out:
+#else
+	E("PGM was built without latency tracking (PGM_LATENCY_METHOD).\n");
+#endif
+	return ret;
+}
+
+int pgm_reset_latency_stats(node_t node)
+{
+	int ret = -1;
+#if defined(PGM_LATENCY)
+	struct pgm_node* n;
+	struct pgm_hist* h;
+
+	if(!is_valid_node(node))
+		goto out;
+
+	n = &gGraphs[node.graph].nodes[node.node];
+	h = pgm_hist_get(&n->latency);
+	if(h)
+		memset(h, 0, sizeof(*h));
+	n->nr_latency_lost = 0;
+	ret = 0;
+out:
+#else
+	E("PGM was built without latency tracking (PGM_LATENCY_METHOD).\n");
+#endif
+	return ret;
+}
+
+int pgm_get_degree1(node_t node){
+	return pgm_get_degree2(node, 1);
+}
+
+int pgm_get_degree2(node_t node, int ignore_backedges)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	pthread_mutex_lock(&g->lock);
+	if(!ignore_backedges)
 	{
-		pthread_condattr_t cattr;
-		pthread_condattr_init(&cattr);
-	#ifdef PGM_SHARED
-		pthread_condattr_setpshared(&cattr, 1);
-	#endif
-		pthread_cond_init(cv, &cattr);
-		pthread_condattr_destroy(&cattr);
+		ret = n->nr_in + n->nr_out;
+	}
+	else
+	{
+		ret = 0;
+		for(int i = 0; i < n->nr_in; ++i)
+		{
+			if(!g->edges[n->in[i]].is_backedge)
+				++ret;
+		}
+		for(int i = 0; i < n->nr_out; ++i)
+		{
+			if(!g->edges[n->out[i]].is_backedge)
+				++ret;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+
+out:
+	return ret;
+}
+
+int pgm_get_degree_in1(node_t node){
+	return pgm_get_degree_in2(node, 1);
+}
+
+int pgm_get_degree_in2(node_t node, int ignore_backedges)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+
+	pthread_mutex_lock(&g->lock);
+	if(!ignore_backedges)
+	{
+		ret = n->nr_in;
+	}
+	else
+	{
+		ret = 0;
+		for(int i = 0; i < n->nr_in; ++i)
+		{
+			if(!g->edges[n->in[i]].is_backedge)
+				++ret;
+		}
 	}
-	#define pgm_cv_destroy(cv)   		pthread_cond_destroy((cv))
-	#define pgm_cv_wait(cv, l, flags)   do{ ((void)(flags)); pthread_cond_wait((cv), (l)); } while(0)
-	#define pgm_cv_signal(cv)    		pthread_cond_signal((cv))
+	pthread_mutex_unlock(&g->lock);
+
+out:
+	return ret;
+}
+
+int pgm_get_degree_out1(node_t node){
+	return pgm_get_degree_out2(node, 1);
+};
+
+int pgm_get_degree_out2(node_t node, int ignore_backedges)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
 
-#elif defined(PGM_USE_PGM_SYNC)
+	if(!is_valid_graph(node.graph))
+		goto out;
 
-	#ifdef PGM_PREEMPTIVE
-		#define pgm_lock_init(l)     spin_init((l))
-		#define pgm_lock(l, flags)   do { ((void)(flags)); spin_lock((l)); } while(0)
-		#define pgm_unlock(l, flags) do { ((void)(flags)); spin_unlock((l)); } while(0)
-	#else
-		#define pgm_lock_init(l)     spin_init_np((l))
-		#define pgm_lock(l, flags)   spin_lock_np((l), &(flags))
-		#define pgm_unlock(l, flags) spin_unlock_np((l), (flags))
-	#endif
-	#define pgm_lock_destroy(l) (void)(l)
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
 
-	#ifdef PGM_PRIVATE
-		#define pgm_cv_init(cv)     cv_init((cv))
-	#else
-		#define pgm_cv_init(cv)     cv_init_shared((cv))
-	#endif
-	#define pgm_cv_destroy(cv)  (void)(cv)
-	#ifdef PGM_PREEMPTIVE
-		#define pgm_cv_wait(cv, l, flags) do{ ((void)(flags)); cv_wait((cv), (l)); } while(0)
-	#else
-		#define pgm_cv_wait(cv, l, flags) cv_wait_np((cv), (l), &(flags))
-	#endif
-	#define pgm_cv_signal(cv)   cv_signal((cv))
-#else
-	#error "Unknown synchronization method."
-#endif
+	pthread_mutex_lock(&g->lock);
+	if(!ignore_backedges)
+	{
+		ret = n->nr_out;
+	}
+	else
+	{
+		ret = 0;
+		for(int i = 0; i < n->nr_out; ++i)
+		{
+			if(!g->edges[n->out[i]].is_backedge)
+				++ret;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
 
-///////////////////////////////////////////////////
-//      PGM Framework Init/Destroy Routines      //
-///////////////////////////////////////////////////
+out:
+	return ret;
+}
 
-static int safePath(const path& dir)
+int pgm_is_parent(node_t node, node_t query)
 {
-	static const path allowed[] = {
-		path("/dev/shm"),
-		path("/home"),
-		path("/tmp")
-	};
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	struct pgm_node* q;
 
-	path dirAbs;
-	if(dir.is_relative())
+	if(node.graph != query.graph)
+		goto out;
+	if(!is_valid_graph(node.graph))
+		goto out;
+
+	ret = 0;
+	if(node.node == query.node)
 	{
-		dirAbs = current_path();
-		dirAbs /= dir;
+		goto out;
 	}
-	else
+
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+	q = &g->nodes[query.node];
+
+	pthread_mutex_lock(&g->lock);
+	for(int i = 0; i < n->nr_in; ++i)
 	{
-		dirAbs = dir;
+		if(g->edges[n->in[i]].is_backedge)
+		{
+			continue; // skip backedge
+		}
+
+		if(q == &g->nodes[g->edges[n->in[i]].producer])
+		{
+			ret = 1;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&g->lock);
 
-	if(dirAbs.empty() || dirAbs == path("/"))
-		return -1;
+out:
+	return ret;
+}
 
-	int failures = 0;
-	const int nrValidStems = sizeof(allowed)/sizeof(allowed[0]);
-	for(int i = 0; i < nrValidStems; ++i)
+int pgm_is_child(node_t node, node_t query)
+{
+	return pgm_is_parent(query, node);
+}
+
+static int is_ancestor(const struct pgm_graph* g,
+	const struct pgm_node* n, const struct pgm_node* q,
+	std::set<int>& visited)
+{
+	if(n == q)
+		return 1;
+
+	const int degree = n->nr_in;
+	if(degree == 0)
+		return 0;
+
+	int is_pred = 0;
+
+	// depth-first search to see if q is a predecessor of n.
+	for(int i = 0; i < degree && !is_pred; ++i)
 	{
-		for(path::iterator compare(allowed[i].begin()), toCheck(dirAbs.begin());
-			compare != allowed[i].end();
-			++compare, ++toCheck)
+		if(g->edges[n->in[i]].is_backedge)
+			continue; // skip backeges
+
+		int parent_idx = g->edges[n->in[i]].producer;
+		if(visited.find(parent_idx) == visited.end())
 		{
-			if(*compare != *toCheck || toCheck == dirAbs.end())
-			{
-				++failures;
-				break;
-			}
+			visited.insert(parent_idx);
+
+			const struct pgm_node* parent = &g->nodes[parent_idx];
+			is_pred = is_ancestor(g, parent, q, visited);
 		}
 	}
 
-	if(nrValidStems == failures)
-		return -1;
-	return 0;
+	return is_pred;
 }
 
-static int prepare_dir(const path& graphDir)
+int pgm_is_ancestor(node_t node, node_t query)
 {
 	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	struct pgm_node* q;
 
-	if(0 != safePath(graphDir))
-	{
-		E("%s is an invalid path.\n", graphDir.string().c_str());
+	if(node.graph != query.graph)
 		goto out;
-	}
-
-	if(exists(graphDir) && !is_directory(graphDir))
+	if(!is_valid_graph(node.graph))
+		goto out;
+	if(node.node == query.node)
 	{
-		E("%s is a file.\n", graphDir.string().c_str());
+		ret = 0;
 		goto out;
 	}
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
+	q = &g->nodes[query.node];
 
-	if(boost::filesystem::equivalent(graphDir, current_path()))
 	{
-		E("Current working directory cannot be the same as graph directory.\n");
-		goto out;
+		std::set<int> visited;
+
+		pthread_mutex_lock(&g->lock);
+		ret = is_ancestor(g, n, q, visited);
+		pthread_mutex_unlock(&g->lock);
 	}
 
-	if(!exists(graphDir))
+out:
+	return ret;
+}
+
+int pgm_is_descendant(node_t n, node_t query)
+{
+	return pgm_is_ancestor(query, n);
+}
+
+///////////////////////////////////////////////////
+//           Graph Validation Routines           //
+///////////////////////////////////////////////////
+
+static int dag_visit(
+	const struct pgm_graph* const g,
+	const struct pgm_node* const n,
+	std::set<std::string>& visited,
+	std::set<std::string>& path,
+	int ignore_explicit_backedges)
+{
+	const std::string name(n->name);
+
+	// recursive DFS to detect cycles
+	if(visited.find(name) == visited.end())
 	{
-	create_dir:
-		if(!create_directories(graphDir))
+		visited.insert(name);
+		path.insert(name);
+
+		for(int i = 0; i < n->nr_out; ++i)
 		{
-			F("Could not create directory %s\n", graphDir.string().c_str());
-			goto out;
+			if(ignore_explicit_backedges && g->edges[n->out[i]].is_backedge)
+			{
+				continue;
+			}
+
+			const struct pgm_node* const successor =
+					&(g->nodes[g->edges[n->out[i]].consumer]);
+			const std::string successor_name(successor->name);
+
+			// already appears on this path?
+			if(path.find(successor_name) != path.end())
+				return 0;
+
+			// visit successor
+			if(!dag_visit(g, successor, visited, path, ignore_explicit_backedges))
+				return 0;
 		}
+
+		path.erase(path.find(name));
 	}
 
-	if(!filesystem::is_empty(graphDir))
+	return 1;
+}
+int pgm_is_dag1(graph_t graph){
+	return pgm_is_dag2(graph, 1);
+}
+
+int pgm_is_dag2(graph_t graph, int ignore_explicit_backedges)
+{
+	int isDag = 1; // assume true
+	if(!is_valid_graph(graph))
 	{
-		if(0 == remove_all(graphDir))
+		isDag = 0;
+	}
+	else
+	{
+		const struct pgm_graph* const g = &gGraphs[graph];
+		std::set<std::string> visited;
+
+		if(g->analysis_valid && ignore_explicit_backedges)
+			return g->is_dag;
+
+		// there might be multiple roots or even unconnected nodes,
+		// so iterate over the set until all have been visited or
+		// graph proven not to be a dag.
+		for(int i = 0; i < g->nr_nodes && 1 == isDag; ++i)
 		{
-			F("Unable to remove files in %s\n", graphDir.string().c_str());
-			goto out;
+			const pgm_node* const n = &(g->nodes[i]);
+			if(visited.find(std::string(n->name)) == visited.end())
+			{
+				std::set<std::string> path;
+				isDag = dag_visit(g, n, visited, path, ignore_explicit_backedges);
+			}
 		}
-		goto create_dir; // i know. this makes a child cry.
 	}
 
-	ret = 0;
-
-out:
-	return ret;
+	return isDag;
 }
 
-static string get_gMemName(const path& graphDir)
-{
-	const char* graphName = "gGraphSharedMem.dat";
-	boost::hash<std::string> string_hash;
-	stringstream ss;
-	size_t hash;
 
-	hash = string_hash(graphDir.string());
-	ss<<hex<<hash<<"_"<<graphName;
+///////////////////////////////////////////////////
+//        Longest/Shortest Path Routines         //
+///////////////////////////////////////////////////
+
+// We use boost's graph library (BGL) to compute longest and
+// shortest paths. In the future, we may just want to port
+// the entire PGM graph structures to BGL. Alternatively, we
+// may want to explore using BGL's adaptors to map PGM's graph
+// structures to a BGL interface. However, for now, we translate
+// between PGM's internal graph structures and BGL on demand,
+// since BGL is incredibly complex and has a very steep learning
+// curve. This is not efficient, but these longest/shortest routines
+// should only be called during an initialization phase, so
+// speed is not terribly important.
+
+typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS,
+		boost::no_property, boost::property<boost::edge_weight_t,
+		double> > bgraph_t;
+typedef boost::graph_traits<bgraph_t>::vertex_descriptor bnode_t;
+typedef std::pair<int, int> bedge_t;
 
-	return ss.str();
+double pgm_get_max_depth1(node_t node){
+	return pgm_get_max_depth3(node, NULL, NULL);
 }
 
-static int prepare_graph_shared_mem(const path& graphDir)
-{
-	int ret = -1;
+double pgm_get_max_depth2(node_t node, pgm_weight_func_t w){
+	return pgm_get_max_depth3(node, w, NULL);
+}
 
-#ifdef PGM_SHARED
-	string memName = get_gMemName(graphDir);
 
-	// allocate twice as much space as we really need, just to be safe.
-	size_t memsize = sizeof(struct pgm_graph) * PGM_MAX_GRAPHS * 2;
+double pgm_get_max_depth3(node_t target, pgm_weight_func_t wfunc, void* user)
+{
+	// We can use BGL to compute the longest path by negating
+	// edge weights. This is safe since the input gGraphs are
+	// are all DAGs.
 
-	// make sure there's nothing hanging around
-	shared_memory_object::remove(memName.c_str());
+	double dist = -1.0;
+	struct pgm_graph* g;
 
-	gGraphSharedMem = new managed_shared_memory(create_only, memName.c_str(), memsize);
-	if(!gGraphSharedMem)
-	{
-		F("Could not create shared memory file %s\n", memName.c_str());
+	if(!is_valid_graph(target.graph))
 		goto out;
-	}
-
-	gGraphs = gGraphSharedMem->construct<struct pgm_graph>("struct pgm_graph gGraphs")[PGM_MAX_GRAPHS]();
-	if(!gGraphs)
-	{
-		F("Shared memory allocation failure.\n");
+	if(!pgm_is_dag2(target.graph, true))
+		goto out;
+	if(target.node < 0)
 		goto out;
-	}
-	memset(gGraphs, 0, sizeof(struct pgm_graph)*PGM_MAX_GRAPHS);
-
-	ret = 0;
-	gIsGraphMaster = true;
-	gMemName = memName;
-out:
-#else
-	F("PGM not compiled with shared mem support.\n");
-#endif
-	return ret;
-}
 
-static int open_graph_shared_mem(const path& graphDir, const int timeout_s = 60)
-{
-	int ret = -1;
-#ifdef PGM_SHARED
-	int time = 0;
-	string memName = get_gMemName(graphDir);
+	g = &gGraphs[target.graph];
 
-	do
+	pthread_mutex_lock(&g->lock);
 	{
-		try
+		if(target.node >= g->nr_nodes)
 		{
-			if(!gGraphSharedMem)
-				gGraphSharedMem = new managed_shared_memory(open_only,memName.c_str());
+			pthread_mutex_unlock(&g->lock);
+			goto out;
 		}
-		catch (...)
+		if(!wfunc && g->analysis_valid)
 		{
-			sleep(1);
+			dist = g->nodes[target.node].max_depth;
+			pthread_mutex_unlock(&g->lock);
+			goto out;
+		}
 
-			if(timeout_s == ++time)
-				goto out;
+		int nr_foward_edges = 0;
+		for(int i = 0; i < g->nr_edges; ++i)
+		{
+			if(g->edges[i].is_backedge)
+				continue;
+			++nr_foward_edges;
 		}
-	} while (!gGraphSharedMem);
 
-	gGraphs = gGraphSharedMem->find<struct pgm_graph>("struct pgm_graph gGraphs").first;
-	ret = 0;
-out:
-#else
-	F("PGM not compiled with shared memory support.\n");
-#endif
-	return ret;
-}
+		bedge_t* edge_array = new bedge_t[nr_foward_edges];
+		double* weights = new double[nr_foward_edges];
+		for(int i = 0, j = 0; i < g->nr_edges; ++i)
+		{
+			if(g->edges[i].is_backedge)
+				continue;
 
-static int prepare_graph_private_mem(void)
-{
-	int ret = -1;
+			edge_array[j++] =
+				std::make_pair(g->edges[i].producer, g->edges[i].consumer);
+		}
 
-	if (gGraphs == 0)
-	{
-		gGraphs = new (std::nothrow) struct pgm_graph[PGM_MAX_GRAPHS];
-		if (gGraphs)
+		if(wfunc)
 		{
-			memset(gGraphs, 0, sizeof(struct pgm_graph)*PGM_MAX_GRAPHS);
-			gIsGraphMaster = true;
-			ret = 0;
+			for(int i = 0, j = 0; i < g->nr_edges; ++i)
+			{
+				if(g->edges[i].is_backedge)
+					continue;
+
+				edge_t external_rep = {target.graph, i};
+				weights[j++] = -1.0*wfunc(external_rep, user);
+			}
 		}
+		else
+		{
+			std::fill(weights, weights + nr_foward_edges, -1.0);
+		}
+
+		bgraph_t bgraph(edge_array, edge_array + nr_foward_edges,
+						weights, g->nr_nodes);
+		std::vector<bnode_t> p(boost::num_vertices(bgraph));
+		std::vector<double> d(boost::num_vertices(bgraph));
+
+		dist = std::numeric_limits<double>::max();
+		for(int i = 0; i < g->nr_nodes; ++i)
+		{
+			int nr_forward_in = 0;
+			for(int j = 0; j < g->nodes[i].nr_in; ++j)
+			{
+				if(g->edges[g->nodes[i].in[j]].is_backedge)
+					continue;
+				nr_forward_in++;
+			}
+			if(nr_forward_in != 0)
+				continue;
+			std::fill(d.begin(), d.end(), std::numeric_limits<double>::max());
+			d[i] = 0.0;
+			boost::bellman_ford_shortest_paths(bgraph,
+							boost::num_vertices(bgraph),
+							boost::predecessor_map(&p[0]).distance_map(&d[0]));
+			double adist = d[target.node];
+			if(adist > 0.0)
+				adist = std::numeric_limits<double>::max();
+			dist = std::min(dist, adist);
+		}
+
+		delete edge_array;
+		delete weights;
 	}
-	else
-	{
-		ret = 1; // TODO: establish proper PGM error codes
-	}
+	pthread_mutex_unlock(&g->lock);
 
-	return ret;
+	dist *= -1.0; // negate the distance to get positive distance
+out:
+	return dist;
 }
 
-int pgm_init_process_local(void)
-{
-	int ret = prepare_graph_private_mem();
-	return ret;
+double pgm_get_min_depth1(node_t node){
+	return pgm_get_min_depth3(node, NULL, NULL);
 }
 
-int pgm_init1(const char* dir){
-	return pgm_init3(dir, 0, 0);
-}
-int pgm_init2(const char* dir, int create){
-	return pgm_init3(dir, create, 0);
+double pgm_get_min_depth2(node_t node, pgm_weight_func_t w){
+	return pgm_get_min_depth3(node, w, NULL);
 }
-int pgm_init3(const char* dir, int create, int use_shared_mem)
+
+double pgm_get_min_depth3(node_t target, pgm_weight_func_t wfunc, void* user)
 {
-	int ret = -1;
-	path graphDir(dir);
+	double dist = -1;
+	struct pgm_graph* g;
 
-	if(graphDir.is_relative())
-	{
-		graphDir = current_path();
-		graphDir /= dir;
-	}
+	if(!is_valid_graph(target.graph))
+		goto out;
+	if(!pgm_is_dag2(target.graph, true))
+		goto out;
+	if(target.node < 0)
+		goto out;
 
-	if(create)
+	g = &gGraphs[target.graph];
+
+	pthread_mutex_lock(&g->lock);
 	{
-		// TODO: Create dir for FIFOs on demand.
-		ret = prepare_dir(graphDir);
-		if(0 != ret)
+		if(target.node >= g->nr_nodes)
+		{
+			pthread_mutex_unlock(&g->lock);
+			goto out;
+		}
+		if(!wfunc && g->analysis_valid)
+		{
+			dist = g->nodes[target.node].min_depth;
+			pthread_mutex_unlock(&g->lock);
 			goto out;
+		}
 
-		if(use_shared_mem)
+		int nr_foward_edges = 0;
+		for(int i = 0; i < g->nr_edges; ++i)
 		{
-			ret = prepare_graph_shared_mem(graphDir);
-			if(0 != ret)
-				goto out;
+			if(g->edges[i].is_backedge)
+				continue;
+			++nr_foward_edges;
+		}
+
+		bedge_t* edge_array = new bedge_t[nr_foward_edges];
+		double* weights = new double[nr_foward_edges];
+		for(int i = 0, j = 0; i < g->nr_edges; ++i)
+		{
+			if(g->edges[i].is_backedge)
+				continue;
+			edge_array[j++] =
+				std::make_pair(g->edges[i].producer, g->edges[i].consumer);
+		}
+		if(wfunc)
+		{
+			for(int i = 0, j = 0; i < g->nr_edges; ++i)
+			{
+				if(g->edges[i].is_backedge)
+					continue;
+
+				edge_t external_rep = {target.graph, i};
+				weights[j++] = wfunc(external_rep, user);
+			}
 		}
 		else
 		{
-			ret = prepare_graph_private_mem();
+			std::fill(weights, weights + nr_foward_edges, 1.0);
+		}
+
+		bgraph_t bgraph(edge_array, edge_array + nr_foward_edges,
+						weights, g->nr_nodes);
+		std::vector<bnode_t> p(boost::num_vertices(bgraph));
+		std::vector<double> d(boost::num_vertices(bgraph));
+
+		dist = std::numeric_limits<double>::max();
+		for(int i = 0; i < g->nr_nodes; ++i)
+		{
+			int nr_forward_in = 0;
+			for(int j = 0; j < g->nodes[i].nr_in; ++j)
+			{
+				if(g->edges[g->nodes[i].in[j]].is_backedge)
+					continue;
+				nr_forward_in++;
+			}
+			if(nr_forward_in != 0)
+				continue;
+			bnode_t bsource = boost::vertex(i, bgraph);
+			boost::dijkstra_shortest_paths(bgraph, bsource,
+							boost::predecessor_map(&p[0]).distance_map(&d[0]));
+			double adist = d[target.node];
+			if(adist < 0.0)
+				adist = std::numeric_limits<double>::max();
+			dist = std::min(dist, adist);
 		}
-	}
-	else
-	{
-		if(!use_shared_mem)
-			goto out;
 
-		ret = open_graph_shared_mem(graphDir);
-		if(0 != ret)
-			goto out;
+		delete edge_array;
+		delete weights;
 	}
-
-	gGraphPath = graphDir;
+	pthread_mutex_unlock(&g->lock);
 
 out:
-	return ret;
+	return dist;
 }
 
-int pgm_destroy(void)
-{
-	int ret = -1;
-
-	if(gGraphSharedMem)
-	{
-		// we're shared memory
-		gGraphs = 0;
-		delete gGraphSharedMem;
-		gGraphSharedMem = 0;
+///////////////////////////////////////////////////
+//           SDF Rate Analysis Routines          //
+///////////////////////////////////////////////////
 
-		if(gIsGraphMaster)
-			shared_memory_object::remove(gMemName.c_str());
+/*
+   Edges are analyzed as synchronous dataflow (SDF) channels: every
+   invocation of the producer adds nr_produce tokens, and an invocation
+   of the consumer removes nr_consume tokens once nr_threshold tokens
+   are available. A back-edge starts with the tokens of the invocations
+   its consumer skips (nr_skips * nr_consume).
+ */
 
-		ret = 0;
-	}
-	else
+static uint64_t gcd64(uint64_t a, uint64_t b)
+{
+	while(b)
 	{
-		// we (might) be private memory
-		if(gGraphs)
-		{
-			delete [] gGraphs;
-			gGraphs = 0;
-			ret = 0;
-		}
+		uint64_t t = a % b;
+		a = b;
+		b = t;
 	}
-
-	return ret;
+	return a;
 }
 
-
-///////////////////////////////////////////////////
-//     Graph/Node/Edge Init/Destroy Routines     //
-///////////////////////////////////////////////////
-
-static int prepare_graph(graph_t* graph, const char* graph_name)
+// Smallest solution of q[producer]*nr_produce == q[consumer]*nr_consume
+// over all edges, for each weakly connected component. If 'members' is
+// given, only nodes i with members[i] set (and the edges between them)
+// are considered; the others get 0.
+// Caller must hold g->lock.
+static int compute_repetitions(const struct pgm_graph* g, std::vector<uint64_t>& reps,
+				const std::vector<char>* members = 0)
 {
 	int ret = -1;
-	struct pgm_graph *g;
-	size_t len;
+	// rate of each node relative to the first node of its component,
+	// as a reduced fraction num/den (num == 0: not reached yet)
+	std::vector<uint64_t> num(g->nr_nodes, 0);
+	std::vector<uint64_t> den(g->nr_nodes, 0);
+	std::vector<int> comp;
 
-	*graph = -1;
-	for(int i = 0; i < PGM_MAX_GRAPHS; ++i)
-	{
-		if(!gGraphs[i].in_use)
-		{
-			*graph = i;
-			break;
-		}
-	}
+	reps.assign(g->nr_nodes, 0);
 
-	if(*graph == -1)
+	for(int root = 0; root < g->nr_nodes; ++root)
 	{
-		E("Out of graph slots\n");
-		goto out;
-	}
+		uint64_t scale = 1, common = 0;
 
-	g = &gGraphs[*graph];
-	memset(g, 0, sizeof(struct pgm_graph));
-	g->in_use = 1;
+		if(num[root] || (members && !(*members)[root]))
+			continue;
+		num[root] = 1;
+		den[root] = 1;
+		comp.clear();
+		comp.push_back(root);
 
-	len = strnlen(graph_name, PGM_GRAPH_NAME_LEN);
-	if(len <= 0 || len > PGM_GRAPH_NAME_LEN)
-	{
-		E("Bad graph name length: %d\n", (int)len);
-		goto out;
-	}
+		for(size_t k = 0; k < comp.size(); ++k)
+		{
+			int u = comp[k];
+			const struct pgm_node* n = &g->nodes[u];
 
-	strncpy(g->name, graph_name, PGM_GRAPH_NAME_LEN);
+			for(int j = 0; j < n->nr_out + n->nr_in; ++j)
+			{
+				bool is_out = (j < n->nr_out);
+				const struct pgm_edge* e =
+					&g->edges[(is_out) ? n->out[j] : n->in[j - n->nr_out]];
+				int v = (is_out) ? e->consumer : e->producer;
+				uint64_t p = e->attr.nr_produce;
+				uint64_t c = e->attr.nr_consume;
+				uint64_t vnum, vden, d;
+
+				if(members && !(*members)[v])
+					continue;
+				if(__builtin_mul_overflow(num[u], (is_out) ? p : c, &vnum) ||
+				   __builtin_mul_overflow(den[u], (is_out) ? c : p, &vden))
+					goto overflow;
+				d = gcd64(vnum, vden);
+				vnum /= d;
+				vden /= d;
+
+				if(!num[v])
+				{
+					num[v] = vnum;
+					den[v] = vden;
+					comp.push_back(v);
+				}
+				else if(num[v] != vnum || den[v] != vden)
+				{
+					E("Inconsistent rates at edge %s/%s.\n", g->name, e->name);
+					goto out;
+				}
+			}
+		}
 
-	pthread_mutexattr_t attr;
-	pthread_mutexattr_init(&attr);
-#ifdef PGM_SHARED
-	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-#endif
-	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
-	pthread_mutex_init(&g->lock, &attr);
-	pthread_mutexattr_destroy(&attr);
+		// scale the component to the smallest integer solution
+		for(size_t k = 0; k < comp.size(); ++k)
+			if(__builtin_mul_overflow(scale / gcd64(scale, den[comp[k]]),
+					den[comp[k]], &scale))
+				goto overflow;
+		for(size_t k = 0; k < comp.size(); ++k)
+		{
+			if(__builtin_mul_overflow(num[comp[k]], scale / den[comp[k]], &reps[comp[k]]))
+				goto overflow;
+			common = gcd64(common, reps[comp[k]]);
+		}
+		for(size_t k = 0; k < comp.size(); ++k)
+			reps[comp[k]] /= common;
+	}
 
 	ret = 0;
+	goto out;
 
+overflow:
+	E("Repetition vector of graph %s overflows.\n", g->name);
 out:
 	return ret;
 }
 
-static int open_graph(graph_t* graph, const char* graph_name)
+// Smallest capacity, in tokens, with which the producer of an edge can
+// always complete while the consumer waits for tokens. Tokens left when
+// the consumer cannot run are fewer than nr_threshold and congruent to
+// the initial tokens modulo gcd(nr_produce, nr_consume).
+static uint64_t min_buffer_tokens(const struct pgm_edge* e)
 {
-	size_t len = strlen(graph_name);
-
-	*graph = -1;
-	for(int i = 0; i < PGM_MAX_GRAPHS; ++i)
-	{
-		if(0 == strncmp(gGraphs[i].name, graph_name, len))
-		{
-			*graph = i;
-			break;
-		}
-	}
+	uint64_t p = e->attr.nr_produce;
+	uint64_t c = e->attr.nr_consume;
+	uint64_t t = e->attr.nr_threshold;
+	uint64_t d = (e->is_backedge) ? e->nr_skips * c : 0;
+	uint64_t g = gcd64(p, c);
+	uint64_t r = (t - 1 + g - d % g) % g;
+	uint64_t need = (r <= t - 1) ? (t - 1 - r) + p : p;
 
-	return (*graph == -1) ? -1: 0;
+	return std::max(std::max(need, t), d);
 }
 
-static void __destroy_graph(struct pgm_graph* g)
+// Number of messages (ring elements or MQ messages) that hold 'tokens'
+// tokens, or 0 if the edge's capacity is not set by its attributes.
+static size_t min_buffer_msgs(const struct pgm_edge* e, uint64_t tokens)
 {
-	for(int i = 0; i < g->nr_edges; ++i)
-	{
-		g->edges[i].ops->destroy(g,
-				&(g->nodes[g->edges[i].producer]),
-				&(g->nodes[g->edges[i].consumer]),
-				&(g->edges[i]));
-	}
-
-	for(int i = 0; i < g->nr_nodes; ++i)
-	{
-		pgm_cv_destroy(&g->nodes[i].wait);
-		pgm_lock_destroy(&g->nodes[i].lock);
-	}
-
-	g->in_use = 0;
-	g->nr_nodes = 0;
-	memset(g->name, 0, sizeof(g->name));
-	memset(g->nodes, 0, sizeof(g->nodes));
+	if(!(e->attr.type & (__PGM_EDGE_RING | __PGM_EDGE_MQ)))
+		return 0;
+	// one message per invocation (nr_produce == nr_consume)
+	return (tokens + e->attr.nr_produce - 1) / e->attr.nr_produce;
 }
 
-int pgm_destroy_graph(graph_t graph)
+int pgm_get_repetition_vector(graph_t graph, uint64_t* reps, int len)
 {
 	int ret = -1;
-	int abort = 0;
 	struct pgm_graph* g;
+	std::vector<uint64_t> q;
 
-	if(!gIsGraphMaster)
-		goto out;
-	if(!is_valid_graph(graph))
+	if(!reps || !is_valid_graph(graph))
 		goto out;
 
 	g = &gGraphs[graph];
-
-
 	pthread_mutex_lock(&g->lock);
-	for(int i = 0; i < g->nr_nodes; ++i)
-	{
-		if(g->nodes[i].owner != UNCLAIMED_NODE)
-		{
-			E("Node %s still in use by %d\n", g->nodes[i].name, g->nodes[i].owner);
-			abort = 1;
-			goto out_unlock;
-		}
-	}
-
-out_unlock:
-	if(!abort)
+	if(len >= g->nr_nodes && compute_repetitions(g, q) == 0)
 	{
-		__destroy_graph(g);
-		pthread_mutex_unlock(&g->lock);
+		std::copy(q.begin(), q.end(), reps);
 		ret = 0;
 	}
-	else
-	{
-		pthread_mutex_unlock(&g->lock);
-	}
+	pthread_mutex_unlock(&g->lock);
 
 out:
 	return ret;
 }
 
-int pgm_init_graph(graph_t* graph, const char* graph_name)
+int pgm_get_min_buffer_size(edge_t edge, size_t* nr_tokens, size_t* nr_msgs)
 {
 	int ret = -1;
-	size_t len;
+	struct pgm_graph* g;
+	const struct pgm_edge* e;
+	uint64_t tokens;
 
-	if(!gGraphs)
+	if(!nr_tokens || !is_valid_graph(edge.graph))
 		goto out;
 
-	len = strnlen(graph_name, PGM_GRAPH_NAME_LEN);
-	if(len <= 0 || len > PGM_GRAPH_NAME_LEN)
+	g = &gGraphs[edge.graph];
+	if(edge.edge < 0 || edge.edge >= g->nr_edges)
 		goto out;
 
-	if(gIsGraphMaster && 0 != pgm_find_graph(graph, graph_name))
-		ret = prepare_graph(graph, graph_name);
+	e = &g->edges[edge.edge];
+	tokens = min_buffer_tokens(e);
+	*nr_tokens = tokens;
+	if(nr_msgs)
+		*nr_msgs = min_buffer_msgs(e, tokens);
+	ret = 0;
+
 out:
 	return ret;
 }
 
-int pgm_init_graph_int(graph_t* graph, unsigned int numerical_name)
-{
-	char name[PGM_GRAPH_NAME_LEN];
-	snprintf(name, PGM_GRAPH_NAME_LEN, "%x", numerical_name);
-	return pgm_init_graph(graph, name);
-}
-
-int pgm_init_node(node_t* node, graph_t graph, const char* name)
+int pgm_set_min_buffer_sizes(graph_t graph)
 {
 	int ret = -1;
 	struct pgm_graph* g;
-	struct pgm_node* n;
-	size_t len;
+	std::vector<uint64_t> q;
 
-	if(!node || !is_valid_graph(graph))
+	if(!is_valid_graph(graph))
 		goto out;
 	if(!gIsGraphMaster)
 		goto out;
-	len = strnlen(name, PGM_NODE_NAME_LEN);
-	if(len <= 0 || len > PGM_NODE_NAME_LEN)
-		goto out;
 
 	g = &gGraphs[graph];
 	pthread_mutex_lock(&g->lock);
 
-	if(g->nr_nodes + 1 == PGM_MAX_NODES)
+	for(int i = 0; i < g->nr_nodes; ++i)
 	{
-		E("No more available nodes for graph %s.\n", g->name);
-		goto out_unlock;
+		if(g->nodes[i].owner != UNCLAIMED_NODE)
+		{
+			E("Node %s already claimed; buffers cannot be resized.\n",
+					g->nodes[i].name);
+			goto out_unlock;
+		}
 	}
 
-	node->graph = graph;
-	node->node = (g->nr_nodes)++;
-	n = &g->nodes[node->node];
+	// unbounded buffers will not do if rates are inconsistent
+	if(compute_repetitions(g, q) != 0)
+		goto out_unlock;
 
-	// memset just to be safe...
-	memset(n, 0, sizeof(*n));
-	n->owner = UNCLAIMED_NODE;
-	strncpy(n->name, name, len);
+	for(int i = 0; i < g->nr_edges; ++i)
+	{
+		struct pgm_edge* e = &g->edges[i];
+		struct pgm_node* np = &g->nodes[e->producer];
+		struct pgm_node* nc = &g->nodes[e->consumer];
+		size_t msgs = min_buffer_msgs(e, min_buffer_tokens(e));
+		edge_attr_t old = e->attr;
+
+		if(msgs == 0)
+			continue;
+		if(e->attr.type & __PGM_EDGE_RING)
+		{
+			if(e->attr.nmemb == msgs)
+				continue;
+			e->attr.nmemb = msgs;
+		}
+		else
+		{
+			if(e->attr.mq_maxmsg == (int)msgs)
+				continue;
+			e->attr.mq_maxmsg = msgs;
+		}
 
-	pgm_lock_init(&n->lock);
-	pgm_cv_init(&n->wait);
+		// transports size their buffers at init
+		e->ops->destroy(g, np, nc, e);
+		if(e->ops->init(g, np, nc, e) != 0)
+		{
+			E("Could not resize edge %s/%s.\n", g->name, e->name);
+			e->attr = old;
+			e->ops->init(g, np, nc, e);
+			goto out_unlock;
+		}
+	}
 
 	ret = 0;
 
@@ -1949,1291 +5273,2352 @@ out:
 	return ret;
 }
 
-int pgm_init_node_int(node_t* node, graph_t graph, unsigned int numerical_name)
+
+///////////////////////////////////////////////////
+//            Static Schedule Routines           //
+///////////////////////////////////////////////////
+
+/*
+   A static schedule runs an SDF subgraph on one thread. It fires the
+   nodes in a precomputed order, so no node ever waits. Each edge is a
+   linear buffer: within a period, producers only append and consumers
+   only advance, so passing data is a pointer bump. At the end of a
+   period every edge holds its initial tokens again, and these are moved
+   back to the front. A buffer therefore holds the initial tokens plus
+   one period of production.
+ */
+
+struct pgm_sched_edge
+{
+	int edge;
+	bool data_passing;
+	size_t nr_produce;
+	size_t nr_consume;
+	size_t nr_initial;
+	size_t head;  // first unconsumed token
+	size_t tail;  // one past the last produced token
+	std::vector<char> buf;
+};
+
+struct pgm_schedule
 {
-	char name[PGM_NODE_NAME_LEN];
-	snprintf(name, PGM_NODE_NAME_LEN, "%x", numerical_name);
-	return pgm_init_node(node, graph, name);
-}
+	graph_t graph;
+	pid_t owner;
+	std::vector<int> nodes;
+	std::vector<int> seq;            // node indices, one per firing
+	size_t pos;                      // next firing in 'seq'
+	std::vector<pgm_sched_edge> edges;
+	std::map<int, std::vector<int> > in;   // node -> its in-edges (in 'edges')
+	std::map<int, std::vector<int> > out;  // node -> its out-edges (in 'edges')
+};
 
-static int __pgm_init_edge(edge_t* edge,
-	node_t producer, node_t consumer, const char* name,
-	const edge_attr_t* attr,
-	bool is_backedge, size_t nr_skips)
+// Find a periodic admissible sequence of firings by simulation: fire,
+// in node order, any node that has invocations left in this period and
+// enough tokens on every in-edge, until every node has fired q[i] times.
+static int compute_schedule(struct pgm_graph* g, pgm_schedule* s,
+				const std::vector<uint64_t>& reps)
 {
 	int ret = -1;
-	struct pgm_graph* g;
-	struct pgm_edge* e;
-	struct pgm_node* np;
-	struct pgm_node* nc;
-	size_t len;
+	std::vector<uint64_t> left(reps);
+	std::vector<uint64_t> tokens(s->edges.size());
+	std::vector<uint64_t> produced(s->edges.size(), 0);
+	uint64_t total = 0;
+	bool progress = true;
+
+	for(size_t i = 0; i < s->edges.size(); ++i)
+		tokens[i] = s->edges[i].nr_initial;
+	for(size_t i = 0; i < s->nodes.size(); ++i)
+		total += reps[s->nodes[i]];
 
-	if(	!edge ||
-		(producer.graph != consumer.graph) ||
-		!is_valid_graph(producer.graph) )
-		goto out;
-	if(!gIsGraphMaster)
-		goto out;
-	len = strnlen(name, PGM_EDGE_NAME_LEN);
-	if(len <= 0 || len > PGM_EDGE_NAME_LEN)
-		goto out;
+	while(s->seq.size() < total && progress)
+	{
+		progress = false;
+		for(size_t i = 0; i < s->nodes.size(); ++i)
+		{
+			int n = s->nodes[i];
+			const std::vector<int>& in = s->in[n];
+			const std::vector<int>& out = s->out[n];
+			bool ready = (left[n] > 0);
+
+			for(size_t j = 0; j < in.size() && ready; ++j)
+				ready = (tokens[in[j]] >=
+					(uint64_t)g->edges[s->edges[in[j]].edge].attr.nr_threshold);
+			if(!ready)
+				continue;
 
-	if((attr->type & __PGM_EDGE_MQ) && (attr->nr_produce != attr->nr_consume))
+			for(size_t j = 0; j < in.size(); ++j)
+				tokens[in[j]] -= s->edges[in[j]].nr_consume;
+			for(size_t j = 0; j < out.size(); ++j)
+			{
+				tokens[out[j]] += s->edges[out[j]].nr_produce;
+				produced[out[j]] += s->edges[out[j]].nr_produce;
+			}
+			--left[n];
+			s->seq.push_back(n);
+			progress = true;
+		}
+	}
+
+	if(s->seq.size() < total)
 	{
-		E("Produce amnt. must equal consume amnt. for POSIX msg queues.\n");
+		E("Graph %s deadlocks: a cycle lacks initial tokens.\n", g->name);
 		goto out;
 	}
-	if(attr->type & __PGM_EDGE_RING)
+
+	for(size_t i = 0; i < s->edges.size(); ++i)
 	{
-		if(attr->nr_produce != attr->nr_consume)
-		{
-			E("Produce amnt. must equal consume amnt. for ring buffers.\n");
-			goto out;
-		}
-		if(attr->nmemb == 0)
-		{
-			E("nmemb cannot be zero.\n");
-			goto out;
-		}
+		pgm_sched_edge* e = &s->edges[i];
+		e->head = 0;
+		e->tail = e->nr_initial;
+		if(e->data_passing)
+			e->buf.assign(e->nr_initial + produced[i], 0);
 	}
+	ret = 0;
 
-	if(attr->nr_threshold < attr->nr_consume)
-		goto out;
-	if(attr->nr_produce <= 0 || attr->nr_consume <= 0 || attr->nr_threshold <= 0)
+out:
+	return ret;
+}
+
+int pgm_init_static_schedule(pgm_schedule_t* sched, graph_t graph,
+				const node_t* nodes, int nr_nodes)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	pgm_schedule* s = 0;
+	std::vector<char> members;
+	std::vector<uint64_t> reps;
+
+	if(!sched || !is_valid_graph(graph))
 		goto out;
-	if(attr->type == 0)
+	if(nodes && nr_nodes <= 0)
 		goto out;
 
-	g = &gGraphs[producer.graph];
+	g = &gGraphs[graph];
 	pthread_mutex_lock(&g->lock);
 
-	if(g->nr_edges + 1 == PGM_MAX_EDGES)
+	s = new pgm_schedule;
+	s->graph = graph;
+	s->owner = pgm_gettid();
+	s->pos = 0;
+
+	members.assign(g->nr_nodes, (nodes) ? 0 : 1);
+	for(int i = 0; nodes && i < nr_nodes; ++i)
 	{
-		E("No more available edges for graph %s.\n", g->name);
-		goto out_unlock;
+		if(nodes[i].graph != graph || nodes[i].node < 0 || nodes[i].node >= g->nr_nodes)
+		{
+			E("Invalid node in schedule of graph %s.\n", g->name);
+			goto out_unlock;
+		}
+		members[nodes[i].node] = 1;
 	}
-	if(g->nr_nodes <= producer.node || g->nr_nodes <= consumer.node)
+	for(int i = 0; i < g->nr_nodes; ++i)
 	{
-		E("Invalid nodes.\n");
-		goto out_unlock;
+		if(!members[i])
+			continue;
+		if(g->nodes[i].owner != UNCLAIMED_NODE)
+		{
+			E("Node %s is already claimed.\n", g->nodes[i].name);
+			goto out_unlock;
+		}
+		s->nodes.push_back(i);
+		s->in[i];
+		s->out[i];
 	}
 
-	edge->graph = producer.graph;
-	edge->edge = (g->nr_edges)++;
-	e = &g->edges[edge->edge];
-
-	np = &g->nodes[producer.node];
-	if(np->nr_out+1 == PGM_MAX_OUT_DEGREE)
-		goto out_unlock;
-	nc = &g->nodes[consumer.node];
-	if(nc->nr_in+1 == PGM_MAX_IN_DEGREE)
+	if(s->nodes.empty())
 		goto out_unlock;
 
-	if(is_signal_driven(attr))
+	// the schedule has no way to wait for edges from outside
+	for(int i = 0; i < g->nr_edges; ++i)
 	{
-		nc->nr_in_signaled++;
-		nc->signal_edge_mask |= ((pgm_fd_mask_t)(1))<<(nc->nr_in);
+		const struct pgm_edge* e = &g->edges[i];
+		pgm_sched_edge se;
 
-		if(is_backedge)
-		{
-			nc->nr_in_signaled_backedges++;
-		}
-	}
-	if(is_data_passing(attr))
-	{
-		nc->nr_in_data++;
-		if(is_backedge)
+		if(!members[e->producer] && !members[e->consumer])
+			continue;
+		if(!members[e->producer] || !members[e->consumer])
 		{
-			nc->nr_in_data_backedges++;
+			E("Edge %s/%s crosses the boundary of the schedule.\n", g->name, e->name);
+			goto out_unlock;
 		}
-	}
-
-	np->out[np->nr_out++] = edge->edge;
-	nc->in[nc->nr_in++] = edge->edge;
 
-	// memset just to be safe...
-	memset(e, 0, sizeof(*e));
-	strncpy(e->name, name, len);
-	e->producer = producer.node;
-	e->consumer = consumer.node;
-	e->attr = *attr;
+		se.edge = i;
+		se.data_passing = is_data_passing(&e->attr);
+		se.nr_produce = e->attr.nr_produce;
+		se.nr_consume = e->attr.nr_consume;
+		se.nr_initial = (e->is_backedge) ? e->nr_skips * e->attr.nr_consume : 0;
+		se.head = se.tail = 0;
+		s->edges.push_back(se);
+	}
 
-	if(is_backedge)
+	// edges of each node in the order of its in[] and out[]
+	for(size_t k = 0; k < s->nodes.size(); ++k)
 	{
-		e->is_backedge = true;
-		e->nr_skips = nr_skips;
+		const struct pgm_node* n = &g->nodes[s->nodes[k]];
+		for(int j = 0; j < n->nr_in; ++j)
+			for(size_t i = 0; i < s->edges.size(); ++i)
+				if(s->edges[i].edge == n->in[j])
+					s->in[s->nodes[k]].push_back(i);
+		for(int j = 0; j < n->nr_out; ++j)
+			for(size_t i = 0; i < s->edges.size(); ++i)
+				if(s->edges[i].edge == n->out[j])
+					s->out[s->nodes[k]].push_back(i);
 	}
 
-	if     (attr->type & __PGM_EDGE_CV)
-		e->ops = &pgm_cv_edge_ops;
-	else if(attr->type & __PGM_EDGE_FIFO)
-		e->ops = &pgm_fifo_edge_ops;
-	else if(attr->type & __PGM_EDGE_MQ)
-		e->ops = &pgm_mq_edge_ops;
-	else if(attr->type & __PGM_EDGE_RING)
-		e->ops = &pgm_ring_edge_ops;
-	else if(attr->type & __PGM_EDGE_SOCK_STREAM)
-		e->ops = &pgm_sock_stream_edge_ops;
-	else
+	if(compute_repetitions(g, reps, &members) != 0)
+		goto out_unlock;
+	if(compute_schedule(g, s, reps) != 0)
 		goto out_unlock;
 
-	ret = e->ops->init(g, np, nc, e);
+	// the nodes now belong to the schedule
+	for(size_t k = 0; k < s->nodes.size(); ++k)
+		g->nodes[s->nodes[k]].owner = s->owner;
+
+	*sched = s;
+	s = 0;
+	ret = 0;
 
 out_unlock:
 	pthread_mutex_unlock(&g->lock);
+	delete s;
 out:
 	return ret;
 }
 
-int pgm_init_edge4(edge_t* edge, node_t producer, node_t consumer,
-	const char* name){
-		printf("init\n");
-		return pgm_init_edge5(edge, producer, consumer, name, &default_edge);
-	}
-int pgm_init_edge5(edge_t* edge,
-	node_t producer, node_t consumer, const char* name,
-	const edge_attr_t* attr)
+int pgm_destroy_static_schedule(pgm_schedule_t sched)
 {
-	int ret = __pgm_init_edge(edge, producer, consumer, name, attr, false, 0);
+	int ret = -1;
+	struct pgm_graph* g;
+
+	if(!sched || !is_valid_graph(sched->graph))
+		goto out;
+
+	g = &gGraphs[sched->graph];
+	pthread_mutex_lock(&g->lock);
+	for(size_t k = 0; k < sched->nodes.size(); ++k)
+		g->nodes[sched->nodes[k]].owner = UNCLAIMED_NODE;
+	pthread_mutex_unlock(&g->lock);
+
+	delete sched;
+	ret = 0;
+
+out:
 	return ret;
 }
 
-int pgm_init_edge_int5(edge_t* edge, node_t producer, node_t consumer,
-	unsigned int numerical_name,
-	const edge_attr_t* attrs)
+int pgm_get_static_schedule(pgm_schedule_t sched, node_t* seq, int len)
 {
-	char name[PGM_EDGE_NAME_LEN];
-	snprintf(name, PGM_EDGE_NAME_LEN, "%x", numerical_name);
-	return pgm_init_edge5(edge, producer, consumer, name, attrs);
-}
-
-int pgm_init_edge_int4(edge_t* edge, node_t producer, node_t consumer,
-	unsigned int numerical_name){
-		return pgm_init_edge_int5(edge, producer, consumer, numerical_name, &default_edge);
-	}
+	int ret = -1;
 
-int pgm_init_backedge5(edge_t* edge, size_t nr_skips,
-  	node_t producer, node_t consumer,
-  	const char* name){
-			return pgm_init_backedge6(edge, nr_skips, producer, consumer, name, &default_edge);
+	if(!sched)
+		goto out;
+	if(seq)
+	{
+		if(len < (int)sched->seq.size())
+			goto out;
+		for(size_t i = 0; i < sched->seq.size(); ++i)
+		{
+			seq[i].graph = sched->graph;
+			seq[i].node = sched->seq[i];
 		}
+	}
+	ret = sched->seq.size();
 
-int pgm_init_backedge6(edge_t* edge, size_t nr_skips,
-	node_t producer, node_t consumer, const char* name,
-	const edge_attr_t* attr)
-{
-	int ret = __pgm_init_edge(edge, producer, consumer, name, attr, true, nr_skips);
+out:
 	return ret;
 }
 
-int pgm_init_backedge_int5(edge_t* edge, size_t nskips,
-		node_t producer, node_t consumer,
-		unsigned int numerical_name){
-			return pgm_init_backedge_int6(edge, nskips, producer, consumer, numerical_name, &default_edge);
+int64_t pgm_run_static_schedule(pgm_schedule_t sched, pgm_fire_func_t fire,
+				void* user, uint64_t nr_periods)
+{
+	int64_t ret = -1;
+	void* in[PGM_MAX_IN_DEGREE];
+	void* out[PGM_MAX_OUT_DEGREE];
+	uint64_t done = 0;
+
+	if(!sched || !fire)
+		goto out;
+
+	while(done < nr_periods)
+	{
+		node_t node = {sched->graph, sched->seq[sched->pos]};
+		const std::vector<int>& ein = sched->in[node.node];
+		const std::vector<int>& eout = sched->out[node.node];
+		int stop;
+
+		for(size_t j = 0; j < ein.size(); ++j)
+		{
+			pgm_sched_edge* e = &sched->edges[ein[j]];
+			in[j] = (e->data_passing) ? &e->buf[e->head] : 0;
+		}
+		for(size_t j = 0; j < eout.size(); ++j)
+		{
+			pgm_sched_edge* e = &sched->edges[eout[j]];
+			out[j] = (e->data_passing) ? &e->buf[e->tail] : 0;
 		}
 
-int pgm_init_backedge_int6(edge_t* edge, size_t nr_skips,
-	node_t producer, node_t consumer,
-	unsigned int numerical_name,
-	const edge_attr_t* attrs)
-{
-	char name[PGM_EDGE_NAME_LEN];
-	snprintf(name, PGM_EDGE_NAME_LEN, "%x", numerical_name);
-	return pgm_init_backedge6(edge, nr_skips, producer, consumer, name, attrs);
+		stop = fire(node, in, out, user);
+
+		for(size_t j = 0; j < ein.size(); ++j)
+			sched->edges[ein[j]].head += sched->edges[ein[j]].nr_consume;
+		for(size_t j = 0; j < eout.size(); ++j)
+			sched->edges[eout[j]].tail += sched->edges[eout[j]].nr_produce;
+
+		if(++sched->pos == sched->seq.size())
+		{
+			// back to the initial tokens
+			for(size_t i = 0; i < sched->edges.size(); ++i)
+			{
+				pgm_sched_edge* e = &sched->edges[i];
+				if(e->data_passing && e->head != 0)
+					memmove(&e->buf[0], &e->buf[e->head], e->tail - e->head);
+				e->tail -= e->head;
+				e->head = 0;
+			}
+			sched->pos = 0;
+			++done;
+		}
+
+		if(stop)
+			break;
+	}
+	ret = done;
+
+out:
+	return ret;
 }
 
+
 ///////////////////////////////////////////////////
-//        Graph/Node/Edge Query Routines         //
+//                Graph Snapshots                //
 ///////////////////////////////////////////////////
 
-int pgm_find_graph(graph_t* graph, const char* graph_name)
-{
-	int ret = -1;
-	size_t len;
+/*
+   A snapshot is a header, an array of node records and an array of
+   edge records. Records hold what pgm_init_node() and pgm_init_edge()
+   were given, the settings of pgm_set_periodic(), pgm_set_replicas()
+   and pgm_set_concurrency(), plus precomputed analysis. In/out-edge lists and the
+   per-node edge counts are rebuilt from the edge records in edge
+   order, just as pgm_init_edge() built them. edge_attr_t is stored
+   as-is, so a snapshot can only be loaded by a build with the same
+   limits and ABI; the header records both.
+ */
+
+static const char PGM_SNAPSHOT_MAGIC[8] = {'P', 'G', 'M', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t PGM_SNAPSHOT_VERSION = 2;
+#define PGM_SNAPSHOT_HOST_LEN 256
+
+struct pgm_snapshot_hdr
+{
+	char magic[8];
+	uint32_t version;
+
+	// layout and limits of the writer
+	uint32_t hdr_size;
+	uint32_t node_size;
+	uint32_t edge_size;
+	uint32_t max_nodes;
+	uint32_t max_edges;
+	uint32_t max_in_degree;
+	uint32_t max_out_degree;
+
+	int32_t nr_nodes;
+	int32_t nr_edges;
+	int32_t node_lock_type;
+
+	// 1 if the graph is a DAG, ignoring back-edges
+	int32_t is_dag;
+
+	// size of the file, and hash of everything after the header
+	uint64_t size;
+	uint64_t checksum;
 
-	if(!gGraphSharedMem)
-		goto out;
+	char name[PGM_GRAPH_NAME_LEN];
+};
 
-	len = strnlen(graph_name, PGM_GRAPH_NAME_LEN);
-	if(len <= 0 || len > PGM_GRAPH_NAME_LEN)
-		goto out;
+struct pgm_snapshot_node
+{
+	char name[PGM_NODE_NAME_LEN];
+	int32_t lock_type;
 
-	ret = open_graph(graph, graph_name);
+	// unit-weight depths (valid if the graph is a DAG)
+	int32_t min_depth;
+	int32_t max_depth;
 
-out:
-	return ret;
-}
+	// see pgm_set_replicas() and pgm_set_concurrency()
+	int32_t nr_replicas;
+	int32_t replica_policy;
+	int32_t nr_inflight;
 
-int pgm_find_graph_int(graph_t* graph, unsigned int numerical_name)
+	// see pgm_set_periodic()
+	uint64_t period_ns;
+	uint64_t phase_ns;
+};
+
+struct pgm_snapshot_edge
 {
-	char name[PGM_GRAPH_NAME_LEN];
-	snprintf(name, PGM_GRAPH_NAME_LEN, "%x", numerical_name);
-	return pgm_find_graph(graph, name);
+	char name[PGM_EDGE_NAME_LEN];
+	int32_t producer;
+	int32_t consumer;
+	int32_t is_backedge;
+	uint64_t nr_skips;
+
+	// attr.node of sock_stream edges is stored in 'host'
+	edge_attr_t attr;
+	char host[PGM_SNAPSHOT_HOST_LEN];
+};
+
+// FNV-1a over 64-bit words instead of bytes, which is several times
+// faster on snapshots of large graphs. The shift feeds high bits back
+// into the low ones, which the multiply alone never does.
+static uint64_t snapshot_hash(const void* data, size_t len)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t h = 14695981039346656037ull;
+	size_t i = 0;
+	for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+	{
+		uint64_t w;
+		memcpy(&w, p + i, sizeof(w));
+		h ^= w;
+		h *= 1099511628211ull;
+		h ^= h >> 29;
+	}
+	for(; i < len; ++i)
+	{
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
 }
 
-int pgm_find_node(node_t* node, graph_t graph, const char* name)
+// Order the nodes such that every node comes after its producers,
+// ignoring back-edges (Kahn's algorithm).
+// Return: 1 if the graph is a DAG, 0 if it is not ('order' is then partial).
+static int topo_sort(const struct pgm_graph* g, std::vector<int>& order)
 {
-	int ret = -1;
-	size_t len;
-	struct pgm_graph* g;
-
-	if(!node || !is_valid_graph(graph))
-		goto out;
-	len = strnlen(name, PGM_NODE_NAME_LEN);
-	if(len <= 0 || len > PGM_NODE_NAME_LEN)
-		goto out;
+	std::vector<int> nr_in(g->nr_nodes, 0);
 
-	g = &gGraphs[graph];
+	order.clear();
+	order.reserve(g->nr_nodes);
 
-	pthread_mutex_lock(&g->lock);
+	for(int i = 0; i < g->nr_edges; ++i)
+		if(!g->edges[i].is_backedge)
+			++nr_in[g->edges[i].consumer];
 	for(int i = 0; i < g->nr_nodes; ++i)
+		if(nr_in[i] == 0)
+			order.push_back(i);
+
+	for(size_t k = 0; k < order.size(); ++k)
 	{
-		if(0 == strncmp(g->nodes[i].name, name, len))
+		const struct pgm_node* n = &g->nodes[order[k]];
+		for(int i = 0; i < n->nr_out; ++i)
 		{
-			node->graph = graph;
-			node->node = i;
-			ret = 0;
-			break;
+			const struct pgm_edge* e = &g->edges[n->out[i]];
+			if(!e->is_backedge && --nr_in[e->consumer] == 0)
+				order.push_back(e->consumer);
 		}
 	}
-	pthread_mutex_unlock(&g->lock);
 
-out:
-	return ret;
+	return ((int)order.size() == g->nr_nodes) ? 1 : 0;
 }
 
-int pgm_find_node_int(node_t* node, graph_t graph, unsigned int numerical_name)
-{
-	char name[PGM_NODE_NAME_LEN];
-	snprintf(name, PGM_NODE_NAME_LEN, "%x", numerical_name);
-	return pgm_find_node(node, graph, name);
+// Unit-weight min/max depth of every node, in one pass over the nodes
+// in topological order (ignoring back-edges).
+// Return: 1 if the graph is a DAG, 0 if it is not (depths are then invalid).
+static int compute_depths(const struct pgm_graph* g,
+				std::vector<int>& min_depth, std::vector<int>& max_depth)
+{
+	std::vector<int> order;
+	int is_dag = topo_sort(g, order);
+
+	min_depth.assign(g->nr_nodes, std::numeric_limits<int>::max());
+	max_depth.assign(g->nr_nodes, 0);
+
+	for(size_t k = 0; k < order.size(); ++k)
+	{
+		int idx = order[k];
+		const struct pgm_node* n = &g->nodes[idx];
+
+		if(min_depth[idx] == std::numeric_limits<int>::max())
+			min_depth[idx] = 0;  // a source
+		for(int i = 0; i < n->nr_out; ++i)
+		{
+			const struct pgm_edge* e = &g->edges[n->out[i]];
+			if(e->is_backedge)
+				continue;
+			min_depth[e->consumer] = std::min(min_depth[e->consumer], min_depth[idx] + 1);
+			max_depth[e->consumer] = std::max(max_depth[e->consumer], max_depth[idx] + 1);
+		}
+	}
+
+	return is_dag;
 }
 
-int pgm_find_edge4(edge_t* edge, node_t producer, node_t consumer,
- const char* name){
-	 return pgm_find_edge5(edge, producer, consumer, name, NULL);
- }
-
-int pgm_find_edge5(edge_t* edge, node_t producer, node_t consumer,
-				const char* name, edge_attr_t* attr)
+int pgm_save_graph(graph_t graph, const char* filename)
 {
 	int ret = -1;
 	struct pgm_graph* g;
-	size_t len;
+	struct pgm_snapshot_hdr* hdr;
+	struct pgm_snapshot_node* snodes;
+	struct pgm_snapshot_edge* sedges;
+	std::vector<char> buf;
+	std::vector<int> min_depth, max_depth;
+	std::string tmpname;
+	FILE* f;
+	size_t size;
+
+	if(!filename || !is_valid_graph(graph))
+		goto out;
 
-	if(!name)
-		return pgm_find_first_edge3(edge, producer, consumer);
+	g = &gGraphs[graph];
+	pthread_mutex_lock(&g->lock);
 
-	if(	!edge ||
-		(producer.graph != consumer.graph) ||
-		!is_valid_graph(producer.graph))
-		goto out;
-	len = strnlen(name, PGM_EDGE_NAME_LEN);
-	if(len <= 0 || len > PGM_EDGE_NAME_LEN)
-		goto out;
+	size = sizeof(*hdr) +
+		g->nr_nodes*sizeof(*snodes) +
+		g->nr_edges*sizeof(*sedges);
+	buf.assign(size, 0);
+	hdr = (struct pgm_snapshot_hdr*)&buf[0];
+	snodes = (struct pgm_snapshot_node*)(hdr + 1);
+	sedges = (struct pgm_snapshot_edge*)(snodes + g->nr_nodes);
+
+	memcpy(hdr->magic, PGM_SNAPSHOT_MAGIC, sizeof(hdr->magic));
+	hdr->version = PGM_SNAPSHOT_VERSION;
+	hdr->hdr_size = sizeof(*hdr);
+	hdr->node_size = sizeof(*snodes);
+	hdr->edge_size = sizeof(*sedges);
+	hdr->max_nodes = PGM_MAX_NODES;
+	hdr->max_edges = PGM_MAX_EDGES;
+	hdr->max_in_degree = PGM_MAX_IN_DEGREE;
+	hdr->max_out_degree = PGM_MAX_OUT_DEGREE;
+	hdr->nr_nodes = g->nr_nodes;
+	hdr->nr_edges = g->nr_edges;
+	hdr->node_lock_type = g->node_lock_type;
+	hdr->is_dag = compute_depths(g, min_depth, max_depth);
+	hdr->size = size;
+	memcpy(hdr->name, g->name, sizeof(hdr->name));
 
-	g = &gGraphs[producer.graph];
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		memcpy(snodes[i].name, g->nodes[i].name, sizeof(snodes[i].name));
+		snodes[i].lock_type = g->nodes[i].lock_type;
+		snodes[i].min_depth = (hdr->is_dag) ? min_depth[i] : -1;
+		snodes[i].max_depth = (hdr->is_dag) ? max_depth[i] : -1;
+		snodes[i].nr_replicas = g->nodes[i].nr_replicas;
+		snodes[i].replica_policy = g->nodes[i].replica_policy;
+		snodes[i].nr_inflight = g->nodes[i].nr_inflight;
+		snodes[i].period_ns = g->nodes[i].period_ns;
+		snodes[i].phase_ns = g->nodes[i].phase_ns;
+	}
 
-	pthread_mutex_lock(&g->lock);
 	for(int i = 0; i < g->nr_edges; ++i)
 	{
-		if(g->edges[i].producer == producer.node &&
-		   g->edges[i].consumer == consumer.node &&
-		   (0 == strncmp(g->edges[i].name, name, len)))
+		const struct pgm_edge* e = &g->edges[i];
+		memcpy(sedges[i].name, e->name, sizeof(sedges[i].name));
+		sedges[i].producer = e->producer;
+		sedges[i].consumer = e->consumer;
+		sedges[i].is_backedge = e->is_backedge;
+		sedges[i].nr_skips = e->nr_skips;
+		sedges[i].attr = e->attr;
+
+		if(e->attr.type == pgm_sock_stream_edge)
 		{
-			int found = 0;
-			pgm_node *np = &g->nodes[producer.node];
-			pgm_node *nc = &g->nodes[consumer.node];
-
-			for(int j = 0; j < np->nr_out; ++j)
-			{
-				if(i == np->out[j])
-				{
-					found++;
-					break;
-				}
-			}
-			for(int j = 0; j < nc->nr_in; ++j)
+			sedges[i].attr.node = 0;
+			if(e->attr.node)
 			{
-				if(i == nc->in[j])
+				if(strlen(e->attr.node) >= PGM_SNAPSHOT_HOST_LEN)
 				{
-					found++;
-					break;
+					E("Host name of edge %s/%s is too long.\n", g->name, e->name);
+					pthread_mutex_unlock(&g->lock);
+					goto out;
 				}
+				strcpy(sedges[i].host, e->attr.node);
 			}
-
-			if(found != 2)
-				goto out_unlock;
-
-			if(attr != 0)
-				*attr = g->edges[i].attr;
-			edge->graph = producer.graph;
-			edge->edge = i;
-			ret = 0;
-			break;
 		}
 	}
 
-out_unlock:
 	pthread_mutex_unlock(&g->lock);
+
+	hdr->checksum = snapshot_hash(hdr + 1, size - sizeof(*hdr));
+
+	// write to the side and rename, so a reader never sees a partial file
+	tmpname = std::string(filename) + ".tmp";
+	f = fopen(tmpname.c_str(), "wb");
+	if(!f)
+	{
+		E("Could not create %s.\n", tmpname.c_str());
+		goto out;
+	}
+	if(fwrite(&buf[0], 1, size, f) != size || fflush(f) != 0 || fsync(fileno(f)) != 0)
+	{
+		E("Could not write %s.\n", tmpname.c_str());
+		fclose(f);
+		unlink(tmpname.c_str());
+		goto out;
+	}
+	fclose(f);
+
+	if(rename(tmpname.c_str(), filename) != 0)
+	{
+		E("Could not rename %s to %s.\n", tmpname.c_str(), filename);
+		unlink(tmpname.c_str());
+		goto out;
+	}
+
+	ret = 0;
+
 out:
 	return ret;
 }
-int pgm_find_edge_int4(edge_t* edge, node_t producer, node_t consumer,
-		unsigned int numerical_name){
-			return pgm_find_edge_int5(edge, producer, consumer, numerical_name, NULL);
-		}
 
-int pgm_find_edge_int5(edge_t* edge, node_t producer, node_t consumer,
-	unsigned int numerical_name,
-	edge_attr_t* attrs)
+static int validate_snapshot(const struct pgm_snapshot_hdr* hdr, size_t size)
 {
-	char name[PGM_EDGE_NAME_LEN];
-	snprintf(name, PGM_EDGE_NAME_LEN, "%x", numerical_name);
-	return pgm_find_edge5(edge, producer, consumer, name, attrs);
-}
+	int ret = -1;
+	const struct pgm_snapshot_node* snodes;
+	const struct pgm_snapshot_edge* sedges;
+	int nr_in[PGM_MAX_NODES];
+	int nr_out[PGM_MAX_NODES];
 
-int pgm_find_first_edge3(edge_t* edge, node_t producer, node_t consumer){
-	return pgm_find_first_edge4(edge, producer, consumer, NULL);
-}
+	if(size < sizeof(*hdr) ||
+	   memcmp(hdr->magic, PGM_SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0)
+	{
+		E("Not a graph snapshot.\n");
+		goto out;
+	}
+	if(hdr->version != PGM_SNAPSHOT_VERSION)
+	{
+		E("Unsupported snapshot version %u.\n", hdr->version);
+		goto out;
+	}
+	if(hdr->hdr_size != sizeof(*hdr) ||
+	   hdr->node_size != sizeof(*snodes) ||
+	   hdr->edge_size != sizeof(*sedges) ||
+	   hdr->max_nodes != PGM_MAX_NODES ||
+	   hdr->max_edges != PGM_MAX_EDGES ||
+	   hdr->max_in_degree != PGM_MAX_IN_DEGREE ||
+	   hdr->max_out_degree != PGM_MAX_OUT_DEGREE)
+	{
+		E("Snapshot was written by a PGM build with different limits.\n");
+		goto out;
+	}
+	if(hdr->nr_nodes < 0 || hdr->nr_nodes >= PGM_MAX_NODES ||
+	   hdr->nr_edges < 0 || hdr->nr_edges >= PGM_MAX_EDGES ||
+	   hdr->size != size ||
+	   size != sizeof(*hdr) +
+			hdr->nr_nodes*sizeof(*snodes) +
+			hdr->nr_edges*sizeof(*sedges))
+	{
+		E("Snapshot is truncated or corrupt.\n");
+		goto out;
+	}
+	if(hdr->checksum != snapshot_hash(hdr + 1, size - sizeof(*hdr)))
+	{
+		E("Snapshot checksum mismatch.\n");
+		goto out;
+	}
 
+	snodes = (const struct pgm_snapshot_node*)(hdr + 1);
+	sedges = (const struct pgm_snapshot_edge*)(snodes + hdr->nr_nodes);
+
+	for(int i = 0; i < hdr->nr_nodes; ++i)
+	{
+		pgm_lock_type_t type = (pgm_lock_type_t)snodes[i].lock_type;
+		if(snodes[i].name[0] == '\0' || resolve_lock_type(&type) != 0)
+			goto corrupt;
+		if(hdr->is_dag &&
+		   (snodes[i].min_depth < 0 || snodes[i].min_depth > snodes[i].max_depth ||
+		    snodes[i].max_depth >= hdr->nr_nodes))
+			goto corrupt;
+		if(snodes[i].nr_replicas < 0 || snodes[i].nr_replicas > PGM_MAX_REPLICAS ||
+		   (snodes[i].replica_policy != PGM_REPLICA_DYNAMIC &&
+		    snodes[i].replica_policy != PGM_REPLICA_ROUND_ROBIN) ||
+		   snodes[i].nr_inflight < 0 || snodes[i].nr_inflight > PGM_MAX_INFLIGHT ||
+		   (snodes[i].nr_replicas > 1 && snodes[i].nr_inflight > 1) ||
+		   (!snodes[i].period_ns && snodes[i].phase_ns))
+			goto corrupt;
+		nr_in[i] = 0;
+		nr_out[i] = 0;
+	}
 
-int pgm_find_first_edge4(edge_t* edge, node_t producer, node_t consumer, edge_attr_t *attr)
+	for(int i = 0; i < hdr->nr_edges; ++i)
+	{
+		const struct pgm_snapshot_edge* e = &sedges[i];
+		if(e->name[0] == '\0' ||
+		   e->producer < 0 || e->producer >= hdr->nr_nodes ||
+		   e->consumer < 0 || e->consumer >= hdr->nr_nodes ||
+		   (e->is_backedge != 0 && e->is_backedge != 1) ||
+		   !memchr(e->host, '\0', sizeof(e->host)))
+			goto corrupt;
+		if(validate_edge_attr(&e->attr) != 0 || !edge_ops(&e->attr))
+			goto corrupt;
+		// see pgm_can_run_jobs_at_once()
+		if(is_coalesced(&e->attr) &&
+		   (snodes[e->producer].nr_replicas > 1 || snodes[e->producer].nr_inflight > 1))
+			goto corrupt;
+		// pgm_init_edge() never fills the last slot
+		if(++nr_out[e->producer] >= PGM_MAX_OUT_DEGREE ||
+		   ++nr_in[e->consumer] >= PGM_MAX_IN_DEGREE)
+			goto corrupt;
+	}
+	for(int i = 0; i < hdr->nr_nodes; ++i)
+		if((snodes[i].nr_replicas > 1 || snodes[i].nr_inflight > 1) && !nr_in[i])
+			goto corrupt;
+
+	ret = 0;
+	goto out;
+
+corrupt:
+	E("Snapshot is corrupt.\n");
+out:
+	return ret;
+}
+
+int pgm_load_graph(graph_t* graph, const char* filename, const char* graph_name)
 {
 	int ret = -1;
+	int fd = -1;
+	struct stat st;
+	void* map = MAP_FAILED;
+	const struct pgm_snapshot_hdr* hdr;
+	const struct pgm_snapshot_node* snodes;
+	const struct pgm_snapshot_edge* sedges;
 	struct pgm_graph* g;
+	char name[PGM_GRAPH_NAME_LEN + 1];
+	bool uses_map = false;
 
-	if(!edge ||
-		(producer.graph != consumer.graph) ||
-		!is_valid_graph(producer.graph))
+	if(!graph || !filename || !gGraphs)
+		goto out;
+	if(!gIsGraphMaster)
 		goto out;
 
-	g = &gGraphs[producer.graph];
+	fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		E("Could not open snapshot %s.\n", filename);
+		goto out;
+	}
+	if(fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		E("Could not read snapshot %s.\n", filename);
+		goto out;
+	}
+	// every byte is hashed, so fault the file in up front
+	map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		E("Could not map snapshot %s.\n", filename);
+		goto out;
+	}
+
+	hdr = (const struct pgm_snapshot_hdr*)map;
+	if(validate_snapshot(hdr, st.st_size) != 0)
+		goto out;
+	snodes = (const struct pgm_snapshot_node*)(hdr + 1);
+	sedges = (const struct pgm_snapshot_edge*)(snodes + hdr->nr_nodes);
+
+	memset(name, 0, sizeof(name));
+	strncpy(name, (graph_name) ? graph_name : hdr->name, PGM_GRAPH_NAME_LEN);
+	if(pgm_init_graph(graph, name) != 0)
+	{
+		E("Could not create graph %s.\n", name);
+		goto out;
+	}
 
+	g = &gGraphs[*graph];
 	pthread_mutex_lock(&g->lock);
-	for(int i = 0; i < g->nr_edges; ++i)
+
+	g->node_lock_type = (pgm_lock_type_t)hdr->node_lock_type;
+	resolve_lock_type(&g->node_lock_type);
+
+	for(int i = 0; i < hdr->nr_nodes; ++i)
 	{
-		if(g->edges[i].producer == producer.node &&
-		   g->edges[i].consumer == consumer.node)
+		struct pgm_node* n = &g->nodes[i];
+		memset(n, 0, sizeof(*n));
+		n->owner = UNCLAIMED_NODE;
+		n->ready_efd = -1;
+		n->ready_epfd = -1;
+		strncpy(n->name, snodes[i].name, PGM_NODE_NAME_LEN);
+
+		n->lock_type = (pgm_lock_type_t)snodes[i].lock_type;
+		resolve_lock_type(&n->lock_type);
+		pgm_lock_init(n);
+
+		n->min_depth = snodes[i].min_depth;
+		n->max_depth = snodes[i].max_depth;
+
+		n->nr_replicas = snodes[i].nr_replicas;
+		n->replica_policy = (pgm_replica_policy_t)snodes[i].replica_policy;
+		n->nr_inflight = snodes[i].nr_inflight;
+		n->period_ns = snodes[i].period_ns;
+		n->phase_ns = snodes[i].phase_ns;
+	}
+	g->nr_nodes = hdr->nr_nodes;
+
+	for(int i = 0; i < hdr->nr_edges; ++i)
+	{
+		const struct pgm_snapshot_edge* se = &sedges[i];
+		struct pgm_edge* e = &g->edges[i];
+		struct pgm_node* np = &g->nodes[se->producer];
+		struct pgm_node* nc = &g->nodes[se->consumer];
+
+		memset(e, 0, sizeof(*e));
+		strncpy(e->name, se->name, PGM_EDGE_NAME_LEN);
+		e->producer = se->producer;
+		e->consumer = se->consumer;
+		e->attr = se->attr;
+		if(se->is_backedge)
 		{
-			if(attr != 0)
-				*attr = g->edges[i].attr;
-			edge->graph = producer.graph;
-			edge->edge = i;
-			ret = 0;
-			break;
+			e->is_backedge = true;
+			e->nr_skips = se->nr_skips;
+		}
+		if(e->attr.type == pgm_sock_stream_edge)
+		{
+			// point into the snapshot, which then stays mapped
+			e->attr.node = (se->host[0]) ? se->host : 0;
+			uses_map = uses_map || se->host[0];
 		}
-	}
-	pthread_mutex_unlock(&g->lock);
 
-out:
-	return ret;
-}
+		link_edge(np, nc, i, &e->attr, e->is_backedge);
+		e->ops = edge_ops(&e->attr);
 
-int pgm_set_user_data(node_t node, void* udata)
-{
-	int ret = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
+		if(e->ops->init(g, np, nc, e) != 0)
+		{
+			E("Could not initialize edge %s/%s.\n", g->name, e->name);
+			__destroy_graph(g);
+			pthread_mutex_unlock(&g->lock);
+			goto out;
+		}
+		g->nr_edges = i + 1;
+	}
 
-	if(!is_valid_graph(node.graph))
-		goto out;
+	g->is_dag = hdr->is_dag;
+	g->analysis_valid = 1;
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
+	if(uses_map)
+	{
+		gSnapshotMaps[*graph].addr = map;
+		gSnapshotMaps[*graph].len = st.st_size;
+		map = MAP_FAILED;
+	}
 
-	n->userdata = udata;
+	pthread_mutex_unlock(&g->lock);
 	ret = 0;
 
 out:
+	if(map != MAP_FAILED)
+		munmap(map, st.st_size);
+	if(fd >= 0)
+		close(fd);
 	return ret;
 }
 
-void* pgm_get_user_data(node_t node)
-{
-	void* udata = 0;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-
-	if(!is_valid_graph(node.graph))
-		goto out;
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
+///////////////////////////////////////////////////
+//            Bulk Graph Construction            //
+///////////////////////////////////////////////////
 
-	udata = n->userdata;
+static void cache_analysis(struct pgm_graph* g)
+{
+	std::vector<int> min_depth, max_depth;
 
-out:
-	return udata;
+	g->is_dag = compute_depths(g, min_depth, max_depth);
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		g->nodes[i].min_depth = (g->is_dag) ? min_depth[i] : -1;
+		g->nodes[i].max_depth = (g->is_dag) ? max_depth[i] : -1;
+	}
+	g->analysis_valid = 1;
 }
-int pgm_get_successors2(node_t n, node_t* successors, int len){
-	return pgm_get_successors3(n, successors, len, 1);
+
+static std::string default_edge_name(const char* producer, const char* consumer)
+{
+	return std::string("edge_") + producer + "_" + consumer;
 }
 
-int pgm_get_successors3(node_t node, node_t* successors, int len, int ignore_backedges)
+// Check everything pgm_init_node() and pgm_init_edge() would check, for
+// a whole description. Resolves the edge names.
+static int validate_graph_desc(const pgm_graph_desc_t* desc,
+				std::vector<std::string>& edge_names)
 {
-	int num = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-	node_t* step = successors;
+	int ret = -1;
+	std::set<std::string> names;
+	int nr_in[PGM_MAX_NODES];
+	int nr_out[PGM_MAX_NODES];
 
-	if(!successors || !is_valid_graph(node.graph))
+	// pgm_init_node() and pgm_init_edge() never fill the last slot
+	if(desc->nr_nodes < 0 || desc->nr_nodes >= PGM_MAX_NODES ||
+	   (desc->nr_nodes && !desc->nodes))
+	{
+		E("Invalid number of nodes: %d.\n", desc->nr_nodes);
 		goto out;
+	}
+	if(desc->nr_edges < 0 || desc->nr_edges >= PGM_MAX_EDGES ||
+	   (desc->nr_edges && !desc->edges))
+	{
+		E("Invalid number of edges: %d.\n", desc->nr_edges);
+		goto out;
+	}
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
+	for(int i = 0; i < desc->nr_nodes; ++i)
+	{
+		const char* name = desc->nodes[i];
+		size_t len = (name) ? strnlen(name, PGM_NODE_NAME_LEN + 1) : 0;
+		if(len <= 0 || len > PGM_NODE_NAME_LEN)
+		{
+			E("Invalid name of node %d.\n", i);
+			goto out;
+		}
+		if(!names.insert(name).second)
+		{
+			E("Duplicate node %s.\n", name);
+			goto out;
+		}
+		nr_in[i] = 0;
+		nr_out[i] = 0;
+	}
 
-	pthread_mutex_lock(&g->lock);
+	edge_names.resize(desc->nr_edges);
+	for(int i = 0; i < desc->nr_edges; ++i)
+	{
+		const pgm_edge_desc_t* e = &desc->edges[i];
+		if(e->producer < 0 || e->producer >= desc->nr_nodes ||
+		   e->consumer < 0 || e->consumer >= desc->nr_nodes)
+		{
+			E("Invalid nodes of edge %d.\n", i);
+			goto out;
+		}
 
-	if(len < n->nr_out)
-		goto out_unlock;
-	num = n->nr_out;
+		edge_names[i] = (e->name) ? e->name :
+			default_edge_name(desc->nodes[e->producer], desc->nodes[e->consumer]);
+		if(edge_names[i].empty() || edge_names[i].size() > PGM_EDGE_NAME_LEN)
+		{
+			E("Invalid name of edge %d (%s).\n", i, edge_names[i].c_str());
+			goto out;
+		}
 
-	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
-	{
-		if(ignore_backedges && g->edges[n->out[i]].is_backedge)
+		if(validate_edge_attr(&e->attr) != 0 || !edge_ops(&e->attr))
 		{
-			--num;
+			E("Invalid attributes of edge %s.\n", edge_names[i].c_str());
+			goto out;
 		}
-		else
+
+		if(++nr_out[e->producer] >= PGM_MAX_OUT_DEGREE)
 		{
-			const pgm_node* const _succ = &g->nodes[g->edges[n->out[i]].consumer];
-			node_t succ =
-			{
-				.graph = node.graph,
-				.node = (int)(_succ - &g->nodes[0])
-			};
-			*step = succ;
-			++step;
+			E("Too many out-edges of node %s.\n", desc->nodes[e->producer]);
+			goto out;
+		}
+		if(++nr_in[e->consumer] >= PGM_MAX_IN_DEGREE)
+		{
+			E("Too many in-edges of node %s.\n", desc->nodes[e->consumer]);
+			goto out;
 		}
 	}
-out_unlock:
-	pthread_mutex_unlock(&g->lock);
-out:
-	return num;
-}
 
-int pgm_get_edges_out2(node_t n, edge_t* edges, int len){
-	return pgm_get_edges_out3(n, edges, len, 1);
+	ret = 0;
+
+out:
+	return ret;
 }
 
-int pgm_get_edges_out3(node_t node, edge_t* edges, int len, int ignore_backedges)
+int pgm_build_graph(graph_t graph, const pgm_graph_desc_t* desc)
 {
-	int num = -1;
+	int ret = -1;
 	struct pgm_graph* g;
-	struct pgm_node* n;
-	edge_t* step = edges;
+	std::vector<std::string> edge_names;
 
-	if(!edges || !is_valid_graph(node.graph))
+	if(!desc || !is_valid_graph(graph))
+		goto out;
+	if(!gIsGraphMaster)
+		goto out;
+	if(validate_graph_desc(desc, edge_names) != 0)
 		goto out;
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
-
+	g = &gGraphs[graph];
 	pthread_mutex_lock(&g->lock);
 
-	if(len < n->nr_out)
+	if(g->nr_nodes != 0 || g->nr_edges != 0)
+	{
+		E("Graph %s is not empty.\n", g->name);
 		goto out_unlock;
-	num = n->nr_out;
+	}
 
-	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
+	for(int i = 0; i < desc->nr_nodes; ++i)
 	{
-		if(ignore_backedges && g->edges[n->out[i]].is_backedge)
+		struct pgm_node* n = &g->nodes[i];
+		memset(n, 0, sizeof(*n));
+		n->owner = UNCLAIMED_NODE;
+		n->ready_efd = -1;
+		n->ready_epfd = -1;
+		strncpy(n->name, desc->nodes[i], PGM_NODE_NAME_LEN);
+
+		n->lock_type = g->node_lock_type;
+		pgm_lock_init(n);
+	}
+	g->nr_nodes = desc->nr_nodes;
+
+	for(int i = 0; i < desc->nr_edges; ++i)
+	{
+		const pgm_edge_desc_t* d = &desc->edges[i];
+		struct pgm_edge* e = &g->edges[i];
+		struct pgm_node* np = &g->nodes[d->producer];
+		struct pgm_node* nc = &g->nodes[d->consumer];
+
+		memset(e, 0, sizeof(*e));
+		strncpy(e->name, edge_names[i].c_str(), PGM_EDGE_NAME_LEN);
+		e->producer = d->producer;
+		e->consumer = d->consumer;
+		e->attr = d->attr;
+		if(d->is_backedge)
 		{
-			--num;
+			e->is_backedge = true;
+			e->nr_skips = d->nr_skips;
 		}
-		else
+
+		link_edge(np, nc, i, &e->attr, e->is_backedge);
+		e->ops = edge_ops(&e->attr);
+
+		if(e->ops->init(g, np, nc, e) != 0)
 		{
-			edge_t e =
-			{
-				.graph = node.graph,
-				.edge = n->out[i]
-			};
-			*step = e;
-			++step;
+			E("Could not initialize edge %s/%s.\n", g->name, e->name);
+			__clear_graph(g);
+			goto out_unlock;
 		}
+		g->nr_edges = i + 1;
 	}
+
+	cache_analysis(g);
+	ret = 0;
+
 out_unlock:
 	pthread_mutex_unlock(&g->lock);
 out:
-	return num;
+	return ret;
 }
 
-int pgm_get_predecessors2(node_t node, node_t* predecessors, int len){
-	return pgm_get_predecessors3(node, predecessors, len, 1);
+// Parse "<name>[.<amount>[.<amount>]]". Returns the number of amounts
+// parsed, or -1 on error.
+static int parse_endpoint(const std::string& str, std::string& name,
+				int* amounts, int max_amounts)
+{
+	std::istringstream ss(str);
+	std::string token;
+	int nr_amounts = 0;
+
+	std::getline(ss, name, '.');
+	if(name.empty())
+		return -1;
+	while(std::getline(ss, token, '.'))
+	{
+		char* end;
+		long v = strtol(token.c_str(), &end, 10);
+		if(nr_amounts == max_amounts || token.empty() || *end != '\0' ||
+		   v <= 0 || v > std::numeric_limits<int>::max())
+			return -1;
+		amounts[nr_amounts++] = (int)v;
+	}
+	return nr_amounts;
 }
 
-int pgm_get_predecessors3(node_t node, node_t* predecessors, int len, int ignore_backedges)
+int pgm_build_graph_str(graph_t graph, const char* desc, const edge_attr_t* attr)
 {
-	int num = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-	node_t* step = predecessors;
-
-	if(!predecessors || !is_valid_graph(node.graph))
+	int ret = -1;
+	std::map<std::string, int> index;
+	std::vector<std::string> names;
+	std::vector<const char*> cnames;
+	std::vector<pgm_edge_desc_t> edges;
+	std::istringstream entries;
+	std::string entry;
+	edge_attr_t cv_attr;
+	pgm_graph_desc_t gdesc;
+
+	if(!desc)
 		goto out;
+	if(!attr)
+	{
+		memset(&cv_attr, 0, sizeof(cv_attr));
+		cv_attr.type = pgm_cv_edge;
+		attr = &cv_attr;
+	}
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
-
-	pthread_mutex_lock(&g->lock);
+	entries.str(desc);
+	while(std::getline(entries, entry, ','))
+	{
+		size_t colon = entry.find(':');
+		std::string ends[2];
+		int produce[1] = {1};
+		int consume[2] = {1, 1};
+		int nr_consume = 0;
 
-	if(len < n->nr_in)
-		goto out_unlock;
-	num = n->nr_in;
+		if(parse_endpoint(entry.substr(0, colon), ends[0], produce, 1) < 0)
+			goto invalid;
+		if(colon != std::string::npos && colon + 1 != entry.size())
+		{
+			nr_consume = parse_endpoint(entry.substr(colon + 1), ends[1], consume, 2);
+			if(nr_consume < 0)
+				goto invalid;
+		}
 
-	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
-	{
-		if(ignore_backedges && g->edges[n->in[i]].is_backedge)
+		for(int i = 0; i < 2; ++i)
 		{
-			--num;
+			if(ends[i].empty() || index.count(ends[i]))
+				continue;
+			index[ends[i]] = names.size();
+			names.push_back(ends[i]);
 		}
-		else
+
+		if(!ends[1].empty())
 		{
-			const pgm_node* const _pred = &g->nodes[g->edges[n->in[i]].producer];
-			node_t pred =
-			{
-				.graph = node.graph,
-				.node = (int)(_pred - &g->nodes[0])
-			};
-			*step = pred;
-			++step;
+			pgm_edge_desc_t e;
+			memset(&e, 0, sizeof(e));
+			e.producer = index[ends[0]];
+			e.consumer = index[ends[1]];
+			e.attr = *attr;
+			e.attr.nr_produce = produce[0];
+			e.attr.nr_consume = consume[0];
+			// the threshold defaults to the consume amount if not given
+			e.attr.nr_threshold = (nr_consume == 2) ? consume[1] : consume[0];
+			edges.push_back(e);
 		}
 	}
-out_unlock:
-	pthread_mutex_unlock(&g->lock);
-out:
-	return num;
-}
 
-int pgm_get_edges_in3(node_t n, edge_t* edges, int len){
-	return pgm_get_edges_in4(n, edges, len, 1);
-}
+	for(size_t i = 0; i < names.size(); ++i)
+		cnames.push_back(names[i].c_str());
 
-int pgm_get_edges_in4(node_t node, edge_t* edges, int len, int ignore_backedges)
-{
-	int num = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-	edge_t* step = edges;
+	gdesc.nr_nodes = names.size();
+	gdesc.nodes = cnames.data();
+	gdesc.nr_edges = edges.size();
+	gdesc.edges = edges.data();
+	ret = pgm_build_graph(graph, &gdesc);
+	goto out;
 
-	if(!edges || !is_valid_graph(node.graph))
-		goto out;
+invalid:
+	E("Invalid graph description: %s\n", entry.c_str());
+out:
+	return ret;
+}
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
 
-	pthread_mutex_lock(&g->lock);
+///////////////////////////////////////////////////
+//          Real-Time Analysis Routines          //
+///////////////////////////////////////////////////
 
-	if(len < n->nr_in)
-		goto out_unlock;
-	num = n->nr_in;
+/*
+   Rates propagate as in Sec. 3.1 of Liu and Anderson, "Supporting Soft
+   Real-Time DAG-based Systems on Multiprocessors with No Utilization
+   Loss": if a producer is released x times every y time units and
+   produces p tokens per job on an edge from which its consumer consumes
+   c, the consumer is released px/gcd(px, c) times every
+   y*c/gcd(px, c) time units. Each cluster is taken to be scheduled by
+   G-EDF with implicit deadlines, under which tardiness is bounded as
+   shown by Devi and Anderson, "Tardiness Bounds under Global EDF
+   Scheduling on a Multiprocessor".
+ */
+
+// Rates of all nodes, in topological order.
+static int rt_propagate(const struct pgm_graph* g, const std::vector<int>& order,
+				pgm_rt_node_t* rt)
+{
+	int ret = -1;
 
-	for(int i = 0, nr_to_check = num; i < nr_to_check; ++i)
+	for(size_t k = 0; k < order.size(); ++k)
 	{
-		if(ignore_backedges && g->edges[n->in[i]].is_backedge)
+		int u = order[k];
+		const struct pgm_node* n = &g->nodes[u];
+		uint64_t x = 0, y = 0;
+
+		for(int i = 0; i < n->nr_in; ++i)
 		{
-			--num;
+			const struct pgm_edge* e = &g->edges[n->in[i]];
+			const pgm_rt_node_t* p = &rt[e->producer];
+			uint64_t c = e->attr.nr_consume;
+			uint64_t px, d, ex, ey, l;
+
+			if(e->is_backedge)
+				continue;
+			if(__builtin_mul_overflow(p->rate_releases, (uint64_t)e->attr.nr_produce, &px))
+				goto overflow;
+			d = gcd64(px, c);
+			ex = px / d;
+			if(__builtin_mul_overflow(c / d, p->rate_interval_us, &ey))
+				goto overflow;
+
+			if(!y)
+			{
+				x = ex;
+				y = ey;
+				continue;
+			}
+			// every producer must release the consumer at the same rate
+			if((unsigned __int128)ex * y != (unsigned __int128)x * ey)
+			{
+				E("Inconsistent rates into node %s/%s.\n", g->name, n->name);
+				goto out;
+			}
+			l = y / gcd64(y, ey);
+			if(__builtin_mul_overflow(l, ey, &l) ||
+			   __builtin_mul_overflow(x, l / y, &x))
+				goto overflow;
+			y = l;
 		}
-		else
+
+		if(!y)
 		{
-			edge_t e =
+			// a source
+			if(rt[u].nr_releases == 0 || rt[u].interval_us == 0)
 			{
-				.graph = node.graph,
-				.edge = n->in[i]
-			};
-			*step = e;
-			++step;
+				E("Source node %s/%s has no rate.\n", g->name, n->name);
+				goto out;
+			}
+			x = rt[u].nr_releases;
+			y = rt[u].interval_us;
 		}
-	}
-out_unlock:
-	pthread_mutex_unlock(&g->lock);
-out:
-	return num;
-}
-
-const char* pgm_get_name(node_t node)
-{
-	const char* name = 0;
-
-	struct pgm_graph* g;
-	struct pgm_node* n;
 
-	if(!is_valid_graph(node.graph))
-		goto out;
+		rt[u].rate_releases = x;
+		rt[u].rate_interval_us = y;
+		rt[u].period_us = (double)y / x;
+		rt[u].utilization = rt[u].wcet_us / rt[u].period_us;
+	}
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
-	name = n->name;
+	ret = 0;
+	goto out;
 
+overflow:
+	E("Rates of graph %s overflow.\n", g->name);
 out:
-	return name;
+	return ret;
 }
 
-node_t pgm_get_producer(edge_t edge)
+// Tardiness bound of every node in a cluster (G-EDF, Devi and Anderson):
+// x = (sum of the m-1 largest WCETs - smallest WCET) /
+//     (m - sum of the m-2 largest utilizations), and node i is late by
+// at most x + wcet_i.
+static void rt_tardiness(pgm_rt_node_t* rt, const std::vector<int>& members, int m)
 {
-	node_t n = {edge.graph, -1};
-	struct pgm_graph* g;
-	struct pgm_edge* e;
-	if(!is_valid_graph(edge.graph))
-		goto out;
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
-	n.node = e->producer;
-out:
-	return n;
-}
+	std::vector<double> wcet, util;
+	double sum_wcet = 0.0, sum_util = 0.0, min_wcet, x;
 
-node_t pgm_get_consumer(edge_t edge)
-{
-	node_t n = {edge.graph, -1};
-	struct pgm_graph* g;
-	struct pgm_edge* e;
-	if(!is_valid_graph(edge.graph))
-		goto out;
-	g = &gGraphs[edge.graph];
-	e = &g->edges[edge.edge];
-	n.node = e->consumer;
-out:
-	return n;
+	// EDF is optimal on one CPU, and nothing waits with a CPU per node
+	if(m == 1 || (int)members.size() <= m)
+	{
+		for(size_t i = 0; i < members.size(); ++i)
+			rt[members[i]].tardiness_us = 0.0;
+		return;
+	}
+
+	for(size_t i = 0; i < members.size(); ++i)
+	{
+		wcet.push_back(rt[members[i]].wcet_us);
+		util.push_back(rt[members[i]].utilization);
+	}
+	std::sort(wcet.begin(), wcet.end(), std::greater<double>());
+	std::sort(util.begin(), util.end(), std::greater<double>());
+	for(int i = 0; i < m - 1; ++i)
+		sum_wcet += wcet[i];
+	for(int i = 0; i < m - 2; ++i)
+		sum_util += util[i];
+	min_wcet = wcet.back();
+
+	x = std::max(0.0, (sum_wcet - min_wcet) / (m - sum_util));
+	for(size_t i = 0; i < members.size(); ++i)
+		rt[members[i]].tardiness_us = x + rt[members[i]].wcet_us;
 }
 
-int pgm_get_edge_attrs(edge_t edge, edge_attr_t* attrs)
+int pgm_analyze_rt(graph_t graph, pgm_rt_node_t* rt, int nr_nodes,
+				pgm_rt_cluster_t* clusters, int nr_clusters, double* etoe_us)
 {
 	int ret = -1;
 	struct pgm_graph* g;
+	std::vector<int> order;
+	std::vector<std::vector<int> > members;
+	bool overloaded = false;
+	double etoe = 0.0;
 
-	if(!is_valid_graph(edge.graph))
+	if(!rt || !clusters || nr_clusters <= 0 || !is_valid_graph(graph))
 		goto out;
-	if(!attrs)
-		goto out;
-
-	g = &gGraphs[edge.graph];
-	*attrs = g->edges[edge.edge].attr;
 
-out:
-	return ret;
-}
+	g = &gGraphs[graph];
+	pthread_mutex_lock(&g->lock);
 
-int pgm_is_backedge(edge_t backedge)
-{
-	int is_be = 0;
-	struct pgm_graph* g;
+	if(nr_nodes != g->nr_nodes)
+	{
+		E("Expected parameters of %d nodes.\n", g->nr_nodes);
+		goto out_unlock;
+	}
+	if(!topo_sort(g, order))
+	{
+		E("Graph %s is not acyclic.\n", g->name);
+		goto out_unlock;
+	}
+	members.resize(nr_clusters);
+	for(int i = 0; i < nr_nodes; ++i)
+	{
+		if(rt[i].cluster < 0 || rt[i].cluster >= nr_clusters ||
+		   clusters[rt[i].cluster].nr_cpus <= 0 || rt[i].wcet_us < 0.0)
+		{
+			E("Invalid parameters of node %s/%s.\n", g->name, g->nodes[i].name);
+			goto out_unlock;
+		}
+		members[rt[i].cluster].push_back(i);
+	}
 
-	if(!is_valid_graph(backedge.graph))
-		goto out;
+	if(rt_propagate(g, order, rt) != 0)
+		goto out_unlock;
 
-	g = &gGraphs[backedge.graph];
-	is_be = g->edges[backedge.edge].is_backedge;
+	for(int c = 0; c < nr_clusters; ++c)
+	{
+		clusters[c].utilization = 0.0;
+		clusters[c].overloaded = 0;
+		for(size_t i = 0; i < members[c].size(); ++i)
+		{
+			const pgm_rt_node_t* n = &rt[members[c][i]];
+			clusters[c].utilization += n->utilization;
+			if(n->utilization > 1.0)
+				clusters[c].overloaded = 1;
+		}
+		if(clusters[c].utilization > clusters[c].nr_cpus)
+			clusters[c].overloaded = 1;
 
-out:
-	return is_be;
-}
+		if(clusters[c].overloaded)
+		{
+			overloaded = true;
+			for(size_t i = 0; i < members[c].size(); ++i)
+				rt[members[c][i]].tardiness_us = HUGE_VAL;
+		}
+		else
+		{
+			rt_tardiness(rt, members[c], clusters[c].nr_cpus);
+		}
+	}
 
-size_t pgn_get_nr_skips_remaining(edge_t backedge)
-{
-	size_t remaining = 0;
-	struct pgm_graph* g;
+	// A job may start once its producers have completed the jobs that
+	// fill its threshold: the j-th job of a producer is released
+	// (j-1) periods after its offset and completes within its response
+	// time.
+	for(size_t k = 0; k < order.size(); ++k)
+	{
+		int u = order[k];
+		const struct pgm_node* n = &g->nodes[u];
 
-	if(!is_valid_graph(backedge.graph))
-		goto out;
+		rt[u].response_us = rt[u].period_us + rt[u].tardiness_us;
+		rt[u].offset_us = 0.0;
+		for(int i = 0; i < n->nr_in; ++i)
+		{
+			const struct pgm_edge* e = &g->edges[n->in[i]];
+			const pgm_rt_node_t* p = &rt[e->producer];
+			int jobs;
 
-	g = &gGraphs[backedge.graph];
-	if(g->edges[backedge.edge].is_backedge)
-		remaining = g->edges[backedge.edge].nr_skips;
+			if(e->is_backedge)
+				continue;
+			jobs = (e->attr.nr_threshold + e->attr.nr_produce - 1) / e->attr.nr_produce;
+			rt[u].offset_us = std::max(rt[u].offset_us,
+				p->offset_us + (jobs - 1)*p->period_us + p->response_us);
+		}
+		etoe = std::max(etoe, rt[u].offset_us + rt[u].response_us);
+	}
+
+	if(etoe_us)
+		*etoe_us = etoe;
+	ret = (overloaded) ? 1 : 0;
 
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
 out:
-	return remaining;
+	return ret;
 }
 
-int pgm_get_nr_produce(edge_t edge)
-{
-	int produced = -1;
-	struct pgm_graph* g;
 
-	if(!is_valid_graph(edge.graph))
-		goto out;
+///////////////////////////////////////////////////
+//            Node Placement Routines            //
+///////////////////////////////////////////////////
 
-	g = &gGraphs[edge.graph];
-	produced = g->edges[edge.edge].attr.nr_produce;
+// Where a CPU sits in the cache hierarchy. A cache domain is named by
+// the first CPU that shares it.
+struct pgm_cpu_topo
+{
+	int l2;
+	int l3;
+	int package;
+};
 
-out:
-	return produced;
+static bool read_sysfs_line(const char* path, char* buf, size_t len)
+{
+	bool ok = false;
+	FILE* f = fopen(path, "r");
+	if(!f)
+		return false;
+	if(fgets(buf, len, f))
+	{
+		buf[strcspn(buf, "\n")] = '\0';
+		ok = true;
+	}
+	fclose(f);
+	return ok;
 }
 
-int pgm_get_nr_consume(edge_t edge)
+// Parse a list of CPUs in the format of sysfs, e.g., "0-3,8,10-11".
+static bool parse_cpu_list(const char* str, std::vector<int>& cpus)
 {
-	int consumed = -1;
-	struct pgm_graph* g;
-
-	if(!is_valid_graph(edge.graph))
-		goto out;
-
-	g = &gGraphs[edge.graph];
-	consumed = g->edges[edge.edge].attr.nr_consume;
+	cpus.clear();
+	while(*str)
+	{
+		char* end;
+		long lo, hi;
 
-out:
-	return consumed;
+		lo = hi = strtol(str, &end, 10);
+		if(end == str || lo < 0)
+			return false;
+		if(*end == '-')
+		{
+			str = end + 1;
+			hi = strtol(str, &end, 10);
+			if(end == str || hi < lo)
+				return false;
+		}
+		if(hi >= CPU_SETSIZE)
+			return false;
+		for(long c = lo; c <= hi; ++c)
+			cpus.push_back((int)c);
+		if(*end == ',')
+			++end;
+		else if(*end != '\0')
+			return false;
+		str = end;
+	}
+	return !cpus.empty();
 }
 
-int pgm_get_nr_threshold(edge_t edge)
+static void get_cpu_topology(const std::vector<int>& cpus, std::vector<pgm_cpu_topo>& topo)
 {
-	int threshold = -1;
-	struct pgm_graph* g;
+	char path[128];
+	char buf[256];
+	std::vector<int> shared;
 
-	if(!is_valid_graph(edge.graph))
-		goto out;
+	topo.resize(cpus.size());
+	for(size_t i = 0; i < cpus.size(); ++i)
+	{
+		// without cache information, assume private L2s and an L3
+		// per package
+		topo[i].l2 = cpus[i];
+		topo[i].l3 = -1;
+		topo[i].package = 0;
 
-	g = &gGraphs[edge.graph];
-	threshold = g->edges[edge.edge].attr.nr_threshold;
+		snprintf(path, sizeof(path),
+			"/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpus[i]);
+		if(read_sysfs_line(path, buf, sizeof(buf)))
+			topo[i].package = atoi(buf);
 
-out:
-	return threshold;
+		for(int k = 0; ; ++k)
+		{
+			int level;
+			snprintf(path, sizeof(path),
+				"/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpus[i], k);
+			if(!read_sysfs_line(path, buf, sizeof(buf)))
+				break;
+			level = atoi(buf);
+			if(level != 2 && level != 3)
+				continue;
+			snprintf(path, sizeof(path),
+				"/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpus[i], k);
+			if(!read_sysfs_line(path, buf, sizeof(buf)) || !parse_cpu_list(buf, shared))
+				continue;
+			if(level == 2)
+				topo[i].l2 = shared[0];
+			else
+				topo[i].l3 = shared[0];
+		}
+		if(topo[i].l3 < 0)
+			topo[i].l3 = -1 - topo[i].package;
+	}
 }
 
-int pgm_get_degree1(node_t node){
-	return pgm_get_degree2(node, 1);
+// Benefit of passing data between two CPUs, by the caches they share.
+static inline double cache_affinity(const pgm_cpu_topo& a, const pgm_cpu_topo& b)
+{
+	if(a.l2 == b.l2)
+		return 4.0;
+	if(a.l3 == b.l3)
+		return 2.0;
+	if(a.package == b.package)
+		return 1.0;
+	return 0.0;
 }
 
-int pgm_get_degree2(node_t node, int ignore_backedges)
+// Orders indices by decreasing weight.
+struct heavier_index
+{
+	const double* weight;
+	heavier_index(const double* w) : weight(w) {}
+	bool operator()(int a, int b) const
+	{
+		return weight[a] > weight[b];
+	}
+};
+
+static int find_group(std::vector<int>& group, int u)
 {
+	while(group[u] != u)
+	{
+		group[u] = group[group[u]];
+		u = group[u];
+	}
+	return u;
+}
+
+int pgm_place_nodes(graph_t graph, const double* load, const double* volume,
+				const int* cpus, int nr_cpus, int* placement)
+{
+	static const double eps = 1e-9;
+
 	int ret = -1;
 	struct pgm_graph* g;
-	struct pgm_node* n;
-
-	if(!is_valid_graph(node.graph))
+	char buf[256];
+	std::vector<int> cpu_ids;
+	std::vector<pgm_cpu_topo> topo;
+	std::vector<int> group, by_volume, by_load, group_cpu;
+	std::vector<std::vector<int> > members;
+	std::vector<double> group_load, cpu_load, score;
+	double total = 0.0, limit;
+	int nr_groups;
+	bool overloaded = false;
+
+	if(!load || !placement || (cpus && nr_cpus <= 0) || !is_valid_graph(graph))
 		goto out;
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
-
-	pthread_mutex_lock(&g->lock);
-	if(!ignore_backedges)
+	if(cpus)
 	{
-		ret = n->nr_in + n->nr_out;
+		for(int i = 0; i < nr_cpus; ++i)
+		{
+			if(cpus[i] < 0)
+			{
+				E("Invalid CPU %d.\n", cpus[i]);
+				goto out;
+			}
+			cpu_ids.push_back(cpus[i]);
+		}
 	}
-	else
+	else if(!read_sysfs_line("/sys/devices/system/cpu/online", buf, sizeof(buf)) ||
+			!parse_cpu_list(buf, cpu_ids))
 	{
-		ret = 0;
-		for(int i = 0; i < n->nr_in; ++i)
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		cpu_ids.clear();
+		for(long i = 0; i < std::max(n, 1L); ++i)
+			cpu_ids.push_back((int)i);
+	}
+	get_cpu_topology(cpu_ids, topo);
+
+	g = &gGraphs[graph];
+	pthread_mutex_lock(&g->lock);
+
+	group.resize(g->nr_nodes);
+	group_load.resize(g->nr_nodes);
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		if(!(load[i] >= 0.0) || !(load[i] < HUGE_VAL))
 		{
-			if(!g->edges[n->in[i]].is_backedge)
-				++ret;
+			E("Invalid load of node %s/%s.\n", g->name, g->nodes[i].name);
+			goto out_unlock;
 		}
-		for(int i = 0; i < n->nr_out; ++i)
+		group[i] = i;
+		group_load[i] = load[i];
+		total += load[i];
+	}
+	for(int i = 0; volume && i < g->nr_edges; ++i)
+	{
+		if(!(volume[i] >= 0.0) || !(volume[i] < HUGE_VAL))
 		{
-			if(!g->edges[n->out[i]].is_backedge)
-				++ret;
+			E("Invalid volume of edge %s/%s.\n", g->name, g->edges[i].name);
+			goto out_unlock;
 		}
 	}
-	pthread_mutex_unlock(&g->lock);
-
-out:
-	return ret;
-}
-
-int pgm_get_degree_in1(node_t node){
-	return pgm_get_degree_in2(node, 1);
-}
 
-int pgm_get_degree_in2(node_t node, int ignore_backedges)
-{
-	int ret = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-
-	if(!is_valid_graph(node.graph))
-		goto out;
+	// Join the ends of the heaviest edges while there are more groups
+	// than CPUs and the load of a group stays within one CPU
+	nr_groups = g->nr_nodes;
+	for(int i = 0; i < g->nr_edges; ++i)
+		by_volume.push_back(i);
+	if(volume)
+		std::stable_sort(by_volume.begin(), by_volume.end(), heavier_index(volume));
+	for(size_t k = 0; k < by_volume.size(); ++k)
+	{
+		const struct pgm_edge* e = &g->edges[by_volume[k]];
+		int a, b;
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
+		if(volume && volume[by_volume[k]] <= 0.0)
+			break;
+		if(nr_groups <= (int)cpu_ids.size())
+			break;
+		a = find_group(group, e->producer);
+		b = find_group(group, e->consumer);
+		if(a == b || group_load[a] + group_load[b] > 1.0 + eps)
+			continue;
+		group[b] = a;
+		group_load[a] += group_load[b];
+		--nr_groups;
+	}
 
-	pthread_mutex_lock(&g->lock);
-	if(!ignore_backedges)
+	members.resize(g->nr_nodes);
+	for(int i = 0; i < g->nr_nodes; ++i)
 	{
-		ret = n->nr_in;
+		int r = find_group(group, i);
+		if(members[r].empty())
+			by_load.push_back(r);
+		members[r].push_back(i);
 	}
-	else
-	{
-		ret = 0;
-		for(int i = 0; i < n->nr_in; ++i)
+	limit = total / cpu_ids.size();
+	for(size_t k = 0; k < by_load.size(); ++k)
+		limit = std::max(limit, group_load[by_load[k]]);
+	limit = std::min(limit, 1.0);
+	std::stable_sort(by_load.begin(), by_load.end(), heavier_index(group_load.data()));
+
+	// Place the heaviest groups first: on the CPU, within the average
+	// load (or that of the heaviest group) if possible and else within a
+	// load of 1, that is closest to the groups it exchanges data with.
+	// Ties go to the least loaded.
+	group_cpu.assign(g->nr_nodes, -1);
+	cpu_load.assign(cpu_ids.size(), 0.0);
+	for(size_t k = 0; k < by_load.size(); ++k)
+	{
+		int r = by_load[k];
+		int best = -1;
+
+		score.assign(cpu_ids.size(), 0.0);
+		for(size_t m = 0; m < members[r].size(); ++m)
 		{
-			if(!g->edges[n->in[i]].is_backedge)
-				++ret;
+			const struct pgm_node* n = &g->nodes[members[r][m]];
+			for(int i = 0; i < n->nr_in + n->nr_out; ++i)
+			{
+				int eid = (i < n->nr_in) ? n->in[i] : n->out[i - n->nr_in];
+				const struct pgm_edge* e = &g->edges[eid];
+				int other = find_group(group, (i < n->nr_in) ? e->producer : e->consumer);
+				double w = (volume) ? volume[eid] : 1.0;
+
+				if(other == r || group_cpu[other] < 0)
+					continue;
+				for(size_t c = 0; c < cpu_ids.size(); ++c)
+					score[c] += w * cache_affinity(topo[c], topo[group_cpu[other]]);
+			}
+		}
+
+		for(int pass = 0; pass < 2 && best < 0; ++pass)
+		{
+			double cap = (pass == 0) ? limit : 1.0;
+			for(size_t c = 0; c < cpu_ids.size(); ++c)
+			{
+				if(cpu_load[c] + group_load[r] > cap + eps)
+					continue;
+				if(best < 0 || score[c] > score[best] ||
+				   (score[c] == score[best] && cpu_load[c] < cpu_load[best]))
+					best = c;
+			}
 		}
+		if(best < 0)
+		{
+			overloaded = true;
+			best = std::min_element(cpu_load.begin(), cpu_load.end()) - cpu_load.begin();
+		}
+		group_cpu[r] = best;
+		cpu_load[best] += group_load[r];
 	}
-	pthread_mutex_unlock(&g->lock);
 
+	for(int i = 0; i < g->nr_nodes; ++i)
+		placement[i] = cpu_ids[group_cpu[group[i]]];
+	ret = (overloaded) ? 1 : 0;
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
 out:
 	return ret;
 }
 
-int pgm_get_degree_out1(node_t node){
-	return pgm_get_degree_out2(node, 1);
+
+///////////////////////////////////////////////////
+//            Event Tracing Routines             //
+///////////////////////////////////////////////////
+
+#if defined(PGM_TRACE)
+
+// Events per thread buffer. Must be a power of two.
+#define PGM_TRACE_RING_SIZE   (1024*16)
+// How often the flusher drains thread buffers.
+#define PGM_TRACE_FLUSH_MS    10
+
+// Single-producer (the recording thread) / single-consumer (the
+// flusher) ring of events.
+struct pgm_trace_ring
+{
+	pgm_trace_event_t ev[PGM_TRACE_RING_SIZE];
+	uint64_t head __attribute__((aligned(PGM_CACHE_LINE_SIZE)));  // flusher
+	uint64_t tail __attribute__((aligned(PGM_CACHE_LINE_SIZE)));  // owner
+	uint64_t nr_dropped;
+	pid_t tid;
+	// set once the owning thread exits. the ring may then be reused.
+	volatile int orphaned;
+	struct pgm_trace_ring* next;
 };
 
-int pgm_get_degree_out2(node_t node, int ignore_backedges)
+static volatile int gTraceOn = 0;
+static FILE* gTraceFile = 0;
+static pthread_mutex_t gTraceLock = PTHREAD_MUTEX_INITIALIZER;
+static struct pgm_trace_ring* volatile gTraceRings = 0;
+static pthread_t gTraceFlusher;
+static pthread_key_t gTraceRingKey;
+static pthread_once_t gTraceRingKeyOnce = PTHREAD_ONCE_INIT;
+static __thread struct pgm_trace_ring* tTraceRing = 0;
+
+static void pgm_trace_ring_orphan(void* r)
 {
-	int ret = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
+	((struct pgm_trace_ring*)r)->orphaned = 1;
+}
 
-	if(!is_valid_graph(node.graph))
-		goto out;
+static void pgm_trace_make_key(void)
+{
+	pthread_key_create(&gTraceRingKey, pgm_trace_ring_orphan);
+}
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
+// Rings are never freed. Threads that come and go reuse the
+// rings of those that exited.
+static struct pgm_trace_ring* pgm_trace_get_ring(void)
+{
+	struct pgm_trace_ring* r;
 
-	pthread_mutex_lock(&g->lock);
-	if(!ignore_backedges)
+	pthread_once(&gTraceRingKeyOnce, pgm_trace_make_key);
+
+	pthread_mutex_lock(&gTraceLock);
+	for(r = gTraceRings; r; r = r->next)
 	{
-		ret = n->nr_out;
+		if(r->orphaned && r->head == r->tail)
+			break;
 	}
-	else
+	if(!r)
 	{
-		ret = 0;
-		for(int i = 0; i < n->nr_out; ++i)
+		r = (struct pgm_trace_ring*)calloc(1, sizeof(*r));
+		if(r)
 		{
-			if(!g->edges[n->out[i]].is_backedge)
-				++ret;
+			r->next = gTraceRings;
+			gTraceRings = r;
 		}
 	}
-	pthread_mutex_unlock(&g->lock);
+	if(r)
+	{
+		r->tid = pgm_gettid();
+		r->nr_dropped = 0;
+		r->orphaned = 0;
+		pthread_setspecific(gTraceRingKey, r);
+	}
+	pthread_mutex_unlock(&gTraceLock);
 
-out:
-	return ret;
+	tTraceRing = r;
+	return r;
 }
 
-int pgm_is_parent(node_t node, node_t query)
+static void __pgm_trace(uint16_t type, int graph, int node, int edge, uint64_t arg)
 {
-	int ret = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-	struct pgm_node* q;
+	struct pgm_trace_ring* r = (tTraceRing) ? tTraceRing : pgm_trace_get_ring();
+	pgm_trace_event_t* ev;
+	uint64_t tail;
 
-	if(node.graph != query.graph)
-		goto out;
-	if(!is_valid_graph(node.graph))
-		goto out;
+	if(!r)
+		return;
 
-	ret = 0;
-	if(node.node == query.node)
+	tail = r->tail;
+	if(tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= PGM_TRACE_RING_SIZE)
 	{
-		goto out;
+		++r->nr_dropped;
+		return;
 	}
 
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
-	q = &g->nodes[query.node];
+	ev = &r->ev[tail & (PGM_TRACE_RING_SIZE - 1)];
+	ev->type = type;
+	ev->graph = graph;
+	ev->tid = r->tid;
+	ev->node = node;
+	ev->edge = edge;
+	ev->ts = pgm_now_ns();
+	ev->arg = arg;
 
-	pthread_mutex_lock(&g->lock);
-	for(int i = 0; i < n->nr_in; ++i)
-	{
-		if(g->edges[n->in[i]].is_backedge)
-		{
-			continue; // skip backedge
-		}
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
 
-		if(q == &g->nodes[g->edges[n->in[i]].producer])
+static inline void pgm_trace(uint16_t type, int graph, int node, int edge = -1, uint64_t arg = 0)
+{
+	if(__builtin_expect(gTraceOn, 0))
+		__pgm_trace(type, graph, node, edge, arg);
+}
+
+// Write out all buffered events. Caller holds gTraceLock.
+static void pgm_trace_drain(void)
+{
+	for(struct pgm_trace_ring* r = gTraceRings; r; r = r->next)
+	{
+		uint64_t head = r->head;
+		uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		while(head != tail)
 		{
-			ret = 1;
-			break;
+			// write out the contiguous run
+			uint64_t start = head & (PGM_TRACE_RING_SIZE - 1);
+			uint64_t n = std::min(tail - head, (uint64_t)PGM_TRACE_RING_SIZE - start);
+			fwrite(&r->ev[start], sizeof(pgm_trace_event_t), n, gTraceFile);
+			head += n;
 		}
+		__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
 	}
-	pthread_mutex_unlock(&g->lock);
-
-out:
-	return ret;
 }
 
-int pgm_is_child(node_t node, node_t query)
+static void* pgm_trace_flusher(void*)
 {
-	return pgm_is_parent(query, node);
+	struct timespec ts = pgm_ns_to_timespec(PGM_TRACE_FLUSH_MS * 1000000ull);
+	while(gTraceOn)
+	{
+		nanosleep(&ts, 0);
+		pthread_mutex_lock(&gTraceLock);
+		pgm_trace_drain();
+		pthread_mutex_unlock(&gTraceLock);
+	}
+	return 0;
 }
 
-static int is_ancestor(const struct pgm_graph* g,
-	const struct pgm_node* n, const struct pgm_node* q,
-	std::set<int>& visited)
+// Caller holds gTraceLock.
+static void pgm_trace_write_name(uint16_t type, int graph, int node, int edge,
+				int consumer, const char* name)
 {
-	if(n == q)
-		return 1;
+	pgm_trace_event_t ev;
+	char buf[PGM_TRACE_NAME_LEN];
 
-	const int degree = n->nr_in;
-	if(degree == 0)
-		return 0;
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.graph = graph;
+	ev.tid = consumer;
+	ev.node = node;
+	ev.edge = edge;
 
-	int is_pred = 0;
+	memset(buf, 0, sizeof(buf));
+	strncpy(buf, name, sizeof(buf) - 1);
 
-	// depth-first search to see if q is a predecessor of n.
-	for(int i = 0; i < degree && !is_pred; ++i)
-	{
-		if(g->edges[n->in[i]].is_backedge)
-			continue; // skip backeges
+	fwrite(&ev, sizeof(ev), 1, gTraceFile);
+	fwrite(buf, sizeof(buf), 1, gTraceFile);
+}
 
-		int parent_idx = g->edges[n->in[i]].producer;
-		if(visited.find(parent_idx) == visited.end())
-		{
-			visited.insert(parent_idx);
+// Record the names of a node and its edges. (Names of edges may be
+// recorded more than once.)
+static void pgm_trace_names(struct pgm_graph* g, struct pgm_node* n)
+{
+	int graph = g - gGraphs;
 
-			const struct pgm_node* parent = &g->nodes[parent_idx];
-			is_pred = is_ancestor(g, parent, q, visited);
+	pthread_mutex_lock(&gTraceLock);
+	if(gTraceFile)
+	{
+		pgm_trace_write_name(PGM_TRACE_NAME_GRAPH, graph, -1, -1, 0, g->name);
+		pgm_trace_write_name(PGM_TRACE_NAME_NODE, graph, n - g->nodes, -1, 0, n->name);
+		for(int i = 0; i < n->nr_out; ++i)
+		{
+			struct pgm_edge* e = &g->edges[n->out[i]];
+			pgm_trace_write_name(PGM_TRACE_NAME_EDGE, graph, e->producer, n->out[i],
+				e->consumer, e->name);
 		}
 	}
-
-	return is_pred;
+	pthread_mutex_unlock(&gTraceLock);
 }
 
-int pgm_is_ancestor(node_t node, node_t query)
+int pgm_trace_start(const char* file)
 {
 	int ret = -1;
-	struct pgm_graph* g;
-	struct pgm_node* n;
-	struct pgm_node* q;
 
-	if(node.graph != query.graph)
-		goto out;
-	if(!is_valid_graph(node.graph))
+	if(!file)
 		goto out;
-	if(node.node == query.node)
+
+	pthread_mutex_lock(&gTraceLock);
+	if(gTraceFile)
 	{
-		ret = 0;
-		goto out;
+		E("A trace is already being recorded.\n");
+		goto out_unlock;
 	}
-	g = &gGraphs[node.graph];
-	n = &g->nodes[node.node];
-	q = &g->nodes[query.node];
 
+	gTraceFile = fopen(file, "w");
+	if(!gTraceFile)
 	{
-		std::set<int> visited;
-
-		pthread_mutex_lock(&g->lock);
-		ret = is_ancestor(g, n, q, visited);
-		pthread_mutex_unlock(&g->lock);
+		E("Could not open trace file %s.\n", file);
+		goto out_unlock;
 	}
+	fwrite(PGM_TRACE_MAGIC, PGM_TRACE_MAGIC_LEN, 1, gTraceFile);
 
-out:
-	return ret;
-}
-
-int pgm_is_descendant(node_t n, node_t query)
-{
-	return pgm_is_ancestor(query, n);
-}
+	// discard anything left behind by a previous trace
+	for(struct pgm_trace_ring* r = gTraceRings; r; r = r->next)
+	{
+		r->head = r->tail;
+		r->nr_dropped = 0;
+	}
 
-///////////////////////////////////////////////////
-//           Graph Validation Routines           //
-///////////////////////////////////////////////////
+	gTraceOn = 1;
+	if(pthread_create(&gTraceFlusher, 0, pgm_trace_flusher, 0) != 0)
+	{
+		gTraceOn = 0;
+		fclose(gTraceFile);
+		gTraceFile = 0;
+		goto out_unlock;
+	}
+	ret = 0;
 
-static int dag_visit(
-	const struct pgm_graph* const g,
-	const struct pgm_node* const n,
-	std::set<std::string>& visited,
-	std::set<std::string>& path,
-	int ignore_explicit_backedges)
-{
-	const std::string name(n->name);
+out_unlock:
+	pthread_mutex_unlock(&gTraceLock);
 
-	// recursive DFS to detect cycles
-	if(visited.find(name) == visited.end())
+	// name the nodes that are already running
+	if(ret == 0 && gGraphs)
 	{
-		visited.insert(name);
-		path.insert(name);
-
-		for(int i = 0; i < n->nr_out; ++i)
+		for(int i = 0; i < PGM_MAX_GRAPHS; ++i)
 		{
-			if(ignore_explicit_backedges && g->edges[n->out[i]].is_backedge)
-			{
+			struct pgm_graph* g = &gGraphs[i];
+			if(!g->in_use)
 				continue;
-			}
-
-			const struct pgm_node* const successor =
-					&(g->nodes[g->edges[n->out[i]].consumer]);
-			const std::string successor_name(successor->name);
-
-			// already appears on this path?
-			if(path.find(successor_name) != path.end())
-				return 0;
-
-			// visit successor
-			if(!dag_visit(g, successor, visited, path, ignore_explicit_backedges))
-				return 0;
+			for(int j = 0; j < g->nr_nodes; ++j)
+				if(g->nodes[j].owner != UNCLAIMED_NODE)
+					pgm_trace_names(g, &g->nodes[j]);
 		}
-
-		path.erase(path.find(name));
 	}
-
-	return 1;
-}
-int pgm_is_dag1(graph_t graph){
-	return pgm_is_dag2(graph, 1);
+out:
+	return ret;
 }
 
-int pgm_is_dag2(graph_t graph, int ignore_explicit_backedges)
+int pgm_trace_stop(void)
 {
-	int isDag = 1; // assume true
-	if(!is_valid_graph(graph))
+	int ret = -1;
+
+	pthread_mutex_lock(&gTraceLock);
+	if(!gTraceFile || !gTraceOn)
 	{
-		isDag = 0;
+		pthread_mutex_unlock(&gTraceLock);
+		goto out;
 	}
-	else
-	{
-		const struct pgm_graph* const g = &gGraphs[graph];
-		std::set<std::string> visited;
+	gTraceOn = 0;
+	pthread_mutex_unlock(&gTraceLock);
 
-		// there might be multiple roots or even unconnected nodes,
-		// so iterate over the set until all have been visited or
-		// graph proven not to be a dag.
-		for(int i = 0; i < g->nr_nodes && 1 == isDag; ++i)
+	pthread_join(gTraceFlusher, 0);
+
+	pthread_mutex_lock(&gTraceLock);
+	pgm_trace_drain();
+	for(struct pgm_trace_ring* r = gTraceRings; r; r = r->next)
+	{
+		if(r->nr_dropped)
 		{
-			const pgm_node* const n = &(g->nodes[i]);
-			if(visited.find(std::string(n->name)) == visited.end())
-			{
-				std::set<std::string> path;
-				isDag = dag_visit(g, n, visited, path, ignore_explicit_backedges);
-			}
+			pgm_trace_event_t ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.type = PGM_TRACE_DROPPED;
+			ev.tid = r->tid;
+			ev.node = -1;
+			ev.edge = -1;
+			ev.ts = pgm_now_ns();
+			ev.arg = r->nr_dropped;
+			fwrite(&ev, sizeof(ev), 1, gTraceFile);
+			W("Thread %d dropped %lu trace events.\n", r->tid, r->nr_dropped);
 		}
 	}
+	ret = (fclose(gTraceFile) == 0) ? 0 : -1;
+	gTraceFile = 0;
+	pthread_mutex_unlock(&gTraceLock);
 
-	return isDag;
+out:
+	return ret;
+}
+
+#else
+
+#define pgm_trace(...) do {} while(0)
+
+int pgm_trace_start(const char* file)
+{
+	E("PGM was built without tracing support.\n");
+	return -1;
+}
+
+int pgm_trace_stop(void)
+{
+	return -1;
 }
 
+#endif
 
 ///////////////////////////////////////////////////
-//        Longest/Shortest Path Routines         //
+//           Node Replication Routines           //
 ///////////////////////////////////////////////////
 
-// We use boost's graph library (BGL) to compute longest and
-// shortest paths. In the future, we may just want to port
-// the entire PGM graph structures to BGL. Alternatively, we
-// may want to explore using BGL's adaptors to map PGM's graph
-// structures to a BGL interface. However, for now, we translate
-// between PGM's internal graph structures and BGL on demand,
-// since BGL is incredibly complex and has a very steep learning
-// curve. This is not efficient, but these longest/shortest routines
-// should only be called during an initialization phase, so
-// speed is not terribly important.
+static __thread pid_t gSelfTid = 0;
 
-typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS,
-		boost::no_property, boost::property<boost::edge_weight_t,
-		double> > bgraph_t;
-typedef boost::graph_traits<bgraph_t>::vertex_descriptor bnode_t;
-typedef std::pair<int, int> bedge_t;
+static void pgm_forget_self_tid(void)
+{
+	gSelfTid = 0;
+}
 
-double pgm_get_max_depth1(node_t node){
-	return pgm_get_max_depth3(node, NULL, NULL);
+static void pgm_init_self_tid(void)
+{
+	// a forked child is a new thread
+	pthread_atfork(0, 0, pgm_forget_self_tid);
 }
 
-double pgm_get_max_depth2(node_t node, pgm_weight_func_t w){
-	return pgm_get_max_depth3(node, w, NULL);
+// Thread ID of the caller. Only the first call of a thread is a system
+// call; replicas look themselves up for every job.
+static inline pid_t pgm_self_tid(void)
+{
+	if(!gSelfTid)
+	{
+		static pthread_once_t once = PTHREAD_ONCE_INIT;
+		pthread_once(&once, pgm_init_self_tid);
+		gSelfTid = pgm_gettid();
+	}
+	return gSelfTid;
 }
 
+// The replica of 'n' that is run by thread 'tid' (a free slot if 'tid'
+// is 0). NULL if there is none. 'n' must be replicated in this process.
+static struct pgm_replica* pgm_find_replica(struct pgm_node* n, pid_t tid)
+{
+	struct pgm_replicas* reps = n->replicas;
+	// (a node with jobs in flight has one owner, in slot 0)
+	for(int i = 0; i < std::max(n->nr_replicas, 1); ++i)
+		if(__atomic_load_n(&reps->r[i].tid, __ATOMIC_RELAXED) == tid)
+			return &reps->r[i];
+	return 0;
+}
 
-double pgm_get_max_depth3(node_t target, pgm_weight_func_t wfunc, void* user)
+static inline struct pgm_replica* pgm_my_replica(struct pgm_node* n)
 {
-	// We can use BGL to compute the longest path by negating
-	// edge weights. This is safe since the input gGraphs are
-	// are all DAGs.
+	return (n->nr_replicas > 1 && n->replicas) ? pgm_find_replica(n, pgm_self_tid()) : 0;
+}
 
-	double dist = -1.0;
-	struct pgm_graph* g;
+static pgm_memory_hdr_t* pgm_callers_edge_buf(struct pgm_graph* g,
+				struct pgm_edge* e, bool is_producer)
+{
+	struct pgm_node* n = &g->nodes[(is_producer) ? e->producer : e->consumer];
+	struct pgm_replica* r = pgm_my_replica(n);
+	int idx = e - g->edges;
 
-	if(!is_valid_graph(target.graph))
-		goto out;
-	if(!pgm_is_dag2(target.graph, true))
-		goto out;
-	if(target.node < 0)
+	if(r && is_producer)
+	{
+		for(int i = 0; i < n->nr_out; ++i)
+			if(n->out[i] == idx)
+				return r->buf_out[i];
+	}
+	else if(r)
+	{
+		for(int i = 0; i < n->nr_in; ++i)
+			if(n->in[i] == idx)
+				return r->buf_in[i];
+	}
+	return (is_producer) ? e->buf_out : e->buf_in;
+}
+
+// Set up the replicas of 'n' for the thread that claims it first. Called
+// with the graph lock held.
+static int pgm_init_replicas(struct pgm_node* n, pid_t tid)
+{
+	int ret = -1;
+	pthread_condattr_t attr;
+	struct pgm_replicas* reps = new (std::nothrow) pgm_replicas();
+
+	if(!reps)
 		goto out;
 
-	g = &gGraphs[target.graph];
+	pthread_mutex_init(&reps->lock, 0);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);  // see pgm_replica_wait()
+	pthread_cond_init(&reps->cv, &attr);
+	pthread_condattr_destroy(&attr);
 
-	pthread_mutex_lock(&g->lock);
-	{
-		if(target.node >= g->nr_nodes)
-		{
-			pthread_mutex_unlock(&g->lock);
-			goto out;
-		}
+	reps->r[0].tid = tid;
+	reps->nr_owners = 1;
 
-		int nr_foward_edges = 0;
-		for(int i = 0; i < g->nr_edges; ++i)
-		{
-			if(g->edges[i].is_backedge)
-				continue;
-			++nr_foward_edges;
-		}
+	n->replicas = reps;
+	n->replicas_pid = getpid();
+	ret = 0;
 
-		bedge_t* edge_array = new bedge_t[nr_foward_edges];
-		double* weights = new double[nr_foward_edges];
-		for(int i = 0, j = 0; i < g->nr_edges; ++i)
-		{
-			if(g->edges[i].is_backedge)
-				continue;
+out:
+	return ret;
+}
 
-			edge_array[j++] =
-				std::make_pair(g->edges[i].producer, g->edges[i].consumer);
-		}
+static void pgm_free_replica_bufs(struct pgm_node* n, struct pgm_replica* r)
+{
+	struct pgm_replicas* reps = n->replicas;
+	for(int i = 0; i < n->nr_in; ++i)
+	{
+		if(r->buf_in[i] != reps->orig_in[i])
+			__pgm_free_edge_buf(r->buf_in[i]);
+		r->buf_in[i] = 0;
+	}
+	for(int i = 0; i < n->nr_out; ++i)
+	{
+		if(r->buf_out[i] != reps->orig_out[i])
+			__pgm_free_edge_buf(r->buf_out[i]);
+		r->buf_out[i] = 0;
+	}
+}
 
-		if(wfunc)
-		{
-			for(int i = 0, j = 0; i < g->nr_edges; ++i)
-			{
-				if(g->edges[i].is_backedge)
-					continue;
+static int pgm_alloc_replica_bufs(struct pgm_graph* g, struct pgm_node* n,
+				struct pgm_replica* r)
+{
+	for(int i = 0; i < n->nr_in; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		if(is_data_passing(e) && !(r->buf_in[i] = __pgm_malloc_edge_buf(g, e, false)))
+			goto out_free;
+	}
+	for(int i = 0; i < n->nr_out; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->out[i]];
+		if(is_data_passing(e) && !(r->buf_out[i] = __pgm_malloc_edge_buf(g, e, true)))
+			goto out_free;
+	}
+	return 0;
 
-				edge_t external_rep = {target.graph, i};
-				weights[j++] = -1.0*wfunc(external_rep, user);
-			}
-		}
-		else
-		{
-			std::fill(weights, weights + nr_foward_edges, -1.0);
-		}
+out_free:
+	F("Could not allocate edge buffers for node %s/%s.\n", g->name, n->name);
+	pgm_free_replica_bufs(n, r);
+	return -1;
+}
 
-		bgraph_t bgraph(edge_array, edge_array + nr_foward_edges,
-						weights, g->nr_nodes);
-		std::vector<bnode_t> p(boost::num_vertices(bgraph));
-		std::vector<double> d(boost::num_vertices(bgraph));
+// Called by the first replica once it has tried to open the edges of
+// 'n'. It keeps the buffers that the edges were opened with. Other
+// invocations get buffers of their own.
+static int pgm_replicas_opened(struct pgm_graph* g, struct pgm_node* n, int ret)
+{
+	struct pgm_replicas* reps = n->replicas;
 
-		dist = std::numeric_limits<double>::max();
-		for(int i = 0; i < g->nr_nodes; ++i)
-		{
-			int nr_forward_in = 0;
-			for(int j = 0; j < g->nodes[i].nr_in; ++j)
-			{
-				if(g->edges[g->nodes[i].in[j]].is_backedge)
-					continue;
-				nr_forward_in++;
-			}
-			if(nr_forward_in != 0)
-				continue;
-			std::fill(d.begin(), d.end(), std::numeric_limits<double>::max());
-			d[i] = 0.0;
-			boost::bellman_ford_shortest_paths(bgraph,
-							boost::num_vertices(bgraph),
-							boost::predecessor_map(&p[0]).distance_map(&d[0]));
-			double adist = d[target.node];
-			if(adist > 0.0)
-				adist = std::numeric_limits<double>::max();
-			dist = std::min(dist, adist);
-		}
+	pthread_mutex_lock(&reps->lock);
+	if(ret == 0)
+	{
+		for(int i = 0; i < n->nr_in; ++i)
+			reps->r[0].buf_in[i] = reps->orig_in[i] = g->edges[n->in[i]].buf_in;
+		for(int i = 0; i < n->nr_out; ++i)
+			reps->r[0].buf_out[i] = reps->orig_out[i] = g->edges[n->out[i]].buf_out;
+		for(int j = 1; j < n->nr_inflight && ret == 0; ++j)
+			ret = pgm_alloc_replica_bufs(g, n, &reps->r[j]);
+	}
+	reps->opened = (ret == 0) ? 1 : -1;
+	pthread_cond_broadcast(&reps->cv);
+	pthread_mutex_unlock(&reps->lock);
 
-		delete edge_array;
-		delete weights;
+	return ret;
+}
+
+
+// Add thread 'tid' as a replica of 'n', which another replica has
+// claimed. Called with the graph lock held.
+static int pgm_join_replicas(struct pgm_graph* g, struct pgm_node* n, pid_t tid)
+{
+	int ret = -1;
+	struct pgm_replica* r;
+
+	if(!n->replicas || n->replicas_pid != getpid() || pgm_find_replica(n, tid))
+		goto out;
+
+	r = pgm_find_replica(n, 0);
+	if(!r)
+	{
+		E("All %d replicas of node %s/%s are claimed.\n", n->nr_replicas, g->name, n->name);
+		goto out;
 	}
-	pthread_mutex_unlock(&g->lock);
 
-	dist *= -1.0; // negate the distance to get positive distance
+	if(pgm_alloc_replica_bufs(g, n, r) != 0)
+		goto out;
+
+	r->running = false;
+	memset(&r->job, 0, sizeof(r->job));
+	__atomic_store_n(&r->tid, tid, __ATOMIC_RELAXED);
+	++n->replicas->nr_owners;
+	ret = 0;
+
 out:
-	return dist;
+	return ret;
 }
 
-double pgm_get_min_depth1(node_t node){
-	return pgm_get_min_depth3(node, NULL, NULL);
-}
+// Block a replica that joined 'n' until the first replica has opened
+// the node's edges.
+static int pgm_wait_replicas_opened(struct pgm_node* n)
+{
+	struct pgm_replicas* reps = n->replicas;
+	int opened;
 
-double pgm_get_min_depth2(node_t node, pgm_weight_func_t w){
-	return pgm_get_min_depth3(node, w, NULL);
+	pthread_mutex_lock(&reps->lock);
+	while(!reps->opened)
+		pthread_cond_wait(&reps->cv, &reps->lock);
+	opened = reps->opened;
+	pthread_mutex_unlock(&reps->lock);
+
+	return (opened == 1) ? 0 : -1;
 }
 
-double pgm_get_min_depth3(node_t target, pgm_weight_func_t wfunc, void* user)
+// Remove thread 'tid' from the replicas of 'n'. Called with the graph
+// lock held.
+// Return: 0 if other replicas remain. 1 if 'tid' was the last; the
+//   edges then hold the buffers they were opened with, and may be
+//   closed. -1 if 'tid' is not a replica of 'n'.
+static int pgm_leave_replicas(struct pgm_graph* g, struct pgm_node* n, pid_t tid)
 {
-	double dist = -1;
-	struct pgm_graph* g;
+	int ret = -1;
+	struct pgm_replicas* reps = n->replicas;
+	struct pgm_replica* r;
 
-	if(!is_valid_graph(target.graph))
-		goto out;
-	if(!pgm_is_dag2(target.graph, true))
+	if(n->replicas_pid != getpid())
 		goto out;
-	if(target.node < 0)
+	r = pgm_find_replica(n, tid);
+	if(!r)
 		goto out;
 
-	g = &gGraphs[target.graph];
+	pgm_free_replica_bufs(n, r);
+	__atomic_store_n(&r->tid, 0, __ATOMIC_RELAXED);
 
-	pthread_mutex_lock(&g->lock);
+	ret = (--reps->nr_owners == 0) ? 1 : 0;
+	if(ret == 1)
 	{
-		if(target.node >= g->nr_nodes)
-		{
-			pthread_mutex_unlock(&g->lock);
-			goto out;
-		}
+		for(int j = 1; j < n->nr_inflight; ++j)
+			pgm_free_replica_bufs(n, &reps->r[j]);
 
-		int nr_foward_edges = 0;
-		for(int i = 0; i < g->nr_edges; ++i)
-		{
-			if(g->edges[i].is_backedge)
-				continue;
-			++nr_foward_edges;
-		}
+		// the edges may hold buffers of any replica
+		for(int i = 0; i < n->nr_in; ++i)
+			g->edges[n->in[i]].buf_in = reps->orig_in[i];
+		for(int i = 0; i < n->nr_out; ++i)
+			g->edges[n->out[i]].buf_out = reps->orig_out[i];
 
-		bedge_t* edge_array = new bedge_t[nr_foward_edges];
-		double* weights = new double[nr_foward_edges];
-		for(int i = 0, j = 0; i < g->nr_edges; ++i)
+		pthread_cond_destroy(&reps->cv);
+		pthread_mutex_destroy(&reps->lock);
+		delete reps;
+		n->replicas = 0;
+		n->replicas_pid = 0;
+	}
+
+out:
+	return ret;
+}
+
+///////////////////////////////////////////////////
+//            Node Ownership Routines            //
+///////////////////////////////////////////////////
+
+// How long to wait for all edges of a node to open.
+static const int PGM_OPEN_TIMEOUT_MS = 60*1000;
+// Bounds of the back-off between retries of edges that cannot be poll()ed.
+static const int PGM_OPEN_MIN_DELAY_MS = 1;
+static const int PGM_OPEN_MAX_DELAY_MS = 32;
+
+// Drive the opens of all pending edges to completion concurrently.
+static int __pgm_finish_opens(struct pgm_graph* g,
+				struct pgm_edge** edges, const bool* is_producer, int nr_edges)
+{
+	int ret = -1;
+	int was_error = 0;
+	int nr_left = nr_edges;
+	int64_t start = pgm_now_ms();
+	int64_t now = start;
+
+	struct pgm_open_ctx ctx[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+	struct pollfd pfds[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+	int64_t retry_at[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+	int delay[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+	bool done[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+
+	for(int i = 0; i < nr_edges; ++i)
+	{
+		memset(&ctx[i], 0, sizeof(ctx[i]));
+		ctx[i].pfd.fd = -1;
+		retry_at[i] = now;
+		delay[i] = PGM_OPEN_MIN_DELAY_MS;
+		done[i] = false;
+	}
+
+	while(1)
+	{
+		int64_t next_retry = now + PGM_OPEN_MAX_DELAY_MS;
+
+		// let every edge that is ready make progress
+		for(int i = 0; i < nr_edges; ++i)
 		{
-			if(g->edges[i].is_backedge)
+			struct pgm_edge* e = edges[i];
+			int status;
+
+			if(done[i])
 				continue;
-			edge_array[j++] =
-				std::make_pair(g->edges[i].producer, g->edges[i].consumer);
-		}
-		if(wfunc)
-		{
-			for(int i = 0, j = 0; i < g->nr_edges; ++i)
+			if((ctx[i].pfd.fd >= 0 && !ctx[i].pfd.revents) ||
+			   (ctx[i].pfd.fd < 0 && now < retry_at[i]))
 			{
-				if(g->edges[i].is_backedge)
-					continue;
+				if(ctx[i].pfd.fd < 0 && retry_at[i] < next_retry)
+					next_retry = retry_at[i];
+				continue;
+			}
 
-				edge_t external_rep = {target.graph, i};
-				weights[j++] = wfunc(external_rep, user);
+			status = (is_producer[i]) ?
+				e->ops->resume_producer(g, e, &ctx[i]) :
+				e->ops->resume_consumer(g, e, &ctx[i]);
+			ctx[i].pfd.revents = 0;
+
+			if(status == PGM_OPEN_PENDING)
+			{
+				if(ctx[i].pfd.fd < 0)
+				{
+					// back off
+					retry_at[i] = now + delay[i];
+					if(retry_at[i] < next_retry)
+						next_retry = retry_at[i];
+					delay[i] = (2*delay[i] <= PGM_OPEN_MAX_DELAY_MS) ?
+						2*delay[i] : PGM_OPEN_MAX_DELAY_MS;
+				}
+				continue;
 			}
-		}
-		else
-		{
-			std::fill(weights, weights + nr_foward_edges, 1.0);
+
+			if(status != 0)
+				was_error = 1;
+			done[i] = true;
+			--nr_left;
 		}
 
-		bgraph_t bgraph(edge_array, edge_array + nr_foward_edges,
-						weights, g->nr_nodes);
-		std::vector<bnode_t> p(boost::num_vertices(bgraph));
-		std::vector<double> d(boost::num_vertices(bgraph));
+		if(nr_left == 0)
+			break;
 
-		dist = std::numeric_limits<double>::max();
-		for(int i = 0; i < g->nr_nodes; ++i)
+		if(now - start > PGM_OPEN_TIMEOUT_MS)
 		{
-			int nr_forward_in = 0;
-			for(int j = 0; j < g->nodes[i].nr_in; ++j)
+			for(int i = 0; i < nr_edges; ++i)
 			{
-				if(g->edges[g->nodes[i].in[j]].is_backedge)
-					continue;
-				nr_forward_in++;
+				if(!done[i])
+				{
+					E("Timed out opening edge %s/%s.\n", g->name, edges[i]->name);
+					if(!is_producer[i] && ctx[i].pfd.fd >= 0)
+						close(ctx[i].pfd.fd);
+				}
 			}
-			if(nr_forward_in != 0)
-				continue;
-			bnode_t bsource = boost::vertex(i, bgraph);
-			boost::dijkstra_shortest_paths(bgraph, bsource,
-							boost::predecessor_map(&p[0]).distance_map(&d[0]));
-			double adist = d[target.node];
-			if(adist < 0.0)
-				adist = std::numeric_limits<double>::max();
-			dist = std::min(dist, adist);
+			was_error = 1;
+			break;
 		}
 
-		delete edge_array;
-		delete weights;
+		// wait for any edge to become ready (poll() skips negative fds)
+		for(int i = 0; i < nr_edges; ++i)
+		{
+			pfds[i].fd = (done[i]) ? -1 : ctx[i].pfd.fd;
+			pfds[i].events = ctx[i].pfd.events;
+			pfds[i].revents = 0;
+		}
+		if(poll(pfds, nr_edges, (next_retry > now) ? (int)(next_retry - now) : 0) < 0 &&
+		   errno != EINTR)
+		{
+			F("poll() failed.\n");
+			was_error = 1;
+			break;
+		}
+		for(int i = 0; i < nr_edges; ++i)
+			ctx[i].pfd.revents = pfds[i].revents;
+
+		now = pgm_now_ms();
 	}
-	pthread_mutex_unlock(&g->lock);
 
-out:
-	return dist;
+	ret = (was_error) ? -1 : 0;
+	return ret;
 }
 
-///////////////////////////////////////////////////
-//            Node Ownership Routines            //
-///////////////////////////////////////////////////
-
 static int __pgm_claim_node(struct pgm_graph* g, struct pgm_node* n)
 {
 	int ret = -1;
 	int was_error = 0;
 
+	// edges that could not be opened without blocking
+	struct pgm_edge* pending[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+	bool is_producer[PGM_MAX_IN_DEGREE + PGM_MAX_OUT_DEGREE];
+	int nr_pending = 0;
+
 	// We open inbound edges first because FIFOs can deadlock otherwise.
 	// Open inbound.
 	for(int i = 0; i < n->nr_in; ++i)
@@ -3241,7 +7626,12 @@ static int __pgm_claim_node(struct pgm_graph* g, struct pgm_node* n)
 		struct pgm_edge* e = &g->edges[n->in[i]];
 		struct pgm_node* p = &g->nodes[e->producer];
 		ret = e->ops->open_consumer(g, p, n, e);
-		if(ret != 0)
+		if(ret == PGM_OPEN_PENDING)
+		{
+			pending[nr_pending] = e;
+			is_producer[nr_pending++] = false;
+		}
+		else if(ret != 0)
 			was_error = 1;
 	}
 	// Open outbound.
@@ -3250,11 +7640,26 @@ static int __pgm_claim_node(struct pgm_graph* g, struct pgm_node* n)
 		struct pgm_edge* e = &g->edges[n->out[i]];
 		struct pgm_node* c = &g->nodes[e->consumer];
 		ret = e->ops->open_producer(g, n, c, e);
-		if(ret != 0)
+		if(ret == PGM_OPEN_PENDING)
+		{
+			pending[nr_pending] = e;
+			is_producer[nr_pending++] = true;
+		}
+		else if(ret != 0)
 			was_error = 1;
 	}
 
+	// Wait for the remaining edges all together.
+	if(nr_pending && __pgm_finish_opens(g, pending, is_producer, nr_pending) != 0)
+		was_error = 1;
+
 	ret = (was_error) ? -1 : 0;
+
+#if defined(PGM_TRACE)
+	if(ret == 0 && gTraceOn)
+		pgm_trace_names(g, n);
+#endif
+
 	return ret;
 }
 
@@ -3283,15 +7688,28 @@ int pgm_claim_node2(node_t node, pid_t tid)
 		n = &g->nodes[node.node];
 		if(n->owner != UNCLAIMED_NODE)
 		{
+			// further replicas share the edges opened by the first
+			if(n->nr_replicas > 1)
+				ret = pgm_join_replicas(g, n, (tid == 0) ? pgm_gettid() : tid);
 			pthread_mutex_unlock(&g->lock);
+			if(ret == 0)
+				ret = pgm_wait_replicas_opened(n);
 			goto out;
 		}
 
 		n->owner = (tid == 0) ? pgm_gettid() : tid;
+		if(is_multi_job(n) && pgm_init_replicas(n, n->owner) != 0)
+		{
+			n->owner = UNCLAIMED_NODE;
+			pthread_mutex_unlock(&g->lock);
+			goto out;
+		}
 	}
 	pthread_mutex_unlock(&g->lock);
 
 	ret = __pgm_claim_node(g, n);
+	if(is_multi_job(n))
+		ret = pgm_replicas_opened(g, n, ret);
 
 out:
 	return ret;
@@ -3324,6 +7742,11 @@ int pgm_claim_any_node3(graph_t graph, node_t* node, pid_t tid)
 				node_id = i;
 				n = &g->nodes[i];
 				n->owner = (tid == 0) ? pgm_gettid() : tid;
+				if(is_multi_job(n) && pgm_init_replicas(n, n->owner) != 0)
+				{
+					n->owner = UNCLAIMED_NODE;
+					n = 0;
+				}
 				break;
 			}
 		}
@@ -3334,6 +7757,8 @@ int pgm_claim_any_node3(graph_t graph, node_t* node, pid_t tid)
 		goto out;
 
 	ret = __pgm_claim_node(g, n);
+	if(is_multi_job(n))
+		ret = pgm_replicas_opened(g, n, ret);
 	if(ret == 0)
 	{
 		node->graph = graph;
@@ -3344,6 +7769,24 @@ out:
 	return ret;
 }
 
+static void pgm_close_ready_fd(struct pgm_node* n)
+{
+	unsigned long flags;
+	int efd, epfd;
+
+	pgm_lock(n, flags);
+	efd = n->ready_efd;
+	epfd = n->ready_epfd;
+	n->ready_efd = -1;
+	n->ready_epfd = -1;
+	pgm_unlock(n, flags);
+
+	if(efd >= 0)
+		close(efd);
+	if(epfd >= 0)
+		close(epfd);
+}
+
 int pgm_release_node1(node_t node){
 	return pgm_release_node2(node, 0);
 }
@@ -3368,7 +7811,16 @@ int pgm_release_node2(node_t node, pid_t tid)
 
 	pthread_mutex_lock(&g->lock);
 
-	if(node.node < 0 || node.node >= g->nr_nodes || n->owner != tid || n->owner == UNCLAIMED_NODE)
+	if(node.node < 0 || node.node >= g->nr_nodes || n->owner == UNCLAIMED_NODE)
+		goto out_unlock;
+	if(n->replicas)
+	{
+		// only the last replica closes the edges
+		ret = pgm_leave_replicas(g, n, tid);
+		if(ret != 1)
+			goto out_unlock;
+	}
+	else if(n->owner != tid)
 		goto out_unlock;
 
 	// Close the FIFOs in the reverse order they were opened (w.r.t. in vs out)
@@ -3389,7 +7841,10 @@ int pgm_release_node2(node_t node, pid_t tid)
 			was_error = 1;
 	}
 
+	pgm_close_ready_fd(n);
+
 	n->owner = UNCLAIMED_NODE;
+	n->nr_out_coalesced = 0;
 
 	if(was_error)
 		ret = -1;
@@ -3452,12 +7907,80 @@ static void pgm_nr_ready_edges(struct pgm_graph* g, struct pgm_node* n, int& nr_
 	}
 }
 
-static eWaitStatus pgm_wait_for_tokens(struct pgm_graph* g, struct pgm_node* n)
+// Send data held back by out-edges. Called before a node blocks.
+static void pgm_flush_out_edges(struct pgm_graph* g, struct pgm_node* n)
+{
+	for(int i = 0; i < n->nr_out; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->out[i]];
+		if(e->ops->flush)
+			e->ops->flush(e);
+	}
+}
+
+// Record time spent blocked since 'start' (from pgm_stats_clock()).
+static inline void pgm_account_wait(struct pgm_node* n, uint64_t start)
+{
+#if defined(PGM_STATS)
+	uint64_t t = pgm_now_ns() - start;
+	pgm_stat_add(n->stats.s.wait_ns, t);
+	pgm_stat_max(n->stats.s.max_wait_ns, t);
+#endif
+}
+
+// Sleep on the node's condition variable until all signaled in-edges
+// are ready (see pgm_wait_for_tokens()).
+template <class Sync>
+static eWaitStatus pgm_sleep_for_tokens(struct pgm_graph* g, struct pgm_node* n,
+				uint64_t deadline)
 {
 	int nr_ready, nr_ready_normal;
 	unsigned long flags;
 	eWaitStatus wait_status = WaitSuccess;
 
+	Sync::lock(&n->sync, flags);
+	do
+	{
+		// recheck the condition
+		pgm_nr_ready_edges(g, n, nr_ready, nr_ready_normal);
+		if(nr_ready == n->nr_in_signaled)
+			break;
+		if(nr_ready_normal == 0 &&
+		   n->nr_terminate_signals != 0 &&
+		   n->nr_terminate_signals == (n->nr_in_signaled - n->nr_in_signaled_backedges))
+		{
+			wait_status = WaitExhaustedAndTerminate;
+			break;
+		}
+		// condition still does not hold -- wait for a signal
+		if(!deadline)
+		{
+			Sync::wait(&n->sync, flags);
+		}
+		else if(pgm_now_ns() < deadline)
+		{
+			Sync::timedwait(&n->sync, flags, deadline);
+		}
+		else
+		{
+			wait_status = WaitTimeout;
+			break;
+		}
+	}while(1);
+	Sync::unlock(&n->sync, flags);
+
+	return wait_status;
+}
+
+// Block until all signaled in-edges are ready. If 'deadline' is non-zero,
+// give up (WaitTimeout) once CLOCK_MONOTONIC passes 'deadline' (in ns).
+static eWaitStatus pgm_wait_for_tokens(struct pgm_graph* g, struct pgm_node* n,
+				uint64_t deadline = 0)
+{
+	int nr_ready, nr_ready_normal;
+	uint64_t start;
+	eWaitStatus wait_status = WaitSuccess;
+
 	// quick-path
 	pgm_nr_ready_edges(g, n, nr_ready, nr_ready_normal);
 	if(nr_ready == n->nr_in_signaled)
@@ -3473,41 +7996,123 @@ static eWaitStatus pgm_wait_for_tokens(struct pgm_graph* g, struct pgm_node* n)
 		goto out;
 	}
 
-	// we have to wait
-	pgm_lock(&n->lock, flags);
-	do
+	// we have to wait. don't sleep on held-back data.
+	if(n->nr_out_coalesced)
+		pgm_flush_out_edges(g, n);
+
+	start = pgm_stats_clock();
+	switch(n->lock_type)
 	{
-		// recheck the condition
-		pgm_nr_ready_edges(g, n, nr_ready, nr_ready_normal);
-		if(nr_ready == n->nr_in_signaled)
+		case PGM_LOCK_TICKET:
+			wait_status = pgm_sleep_for_tokens<pgm_ticket_sync>(g, n, deadline);
 			break;
-		if(nr_ready_normal == 0 &&
-		   n->nr_terminate_signals != 0 &&
-		   n->nr_terminate_signals == (n->nr_in_signaled - n->nr_in_signaled_backedges))
-		{
-			wait_status = WaitExhaustedAndTerminate;
+		case PGM_LOCK_MCS:
+			wait_status = pgm_sleep_for_tokens<pgm_mcs_sync>(g, n, deadline);
 			break;
-		}
-		// condition still does not hold -- wait for a signal
-		pgm_cv_wait(&n->wait, &n->lock, flags);
-	}while(1);
-	pgm_unlock(&n->lock, flags);
+		default:
+			wait_status = pgm_sleep_for_tokens<pgm_pthread_sync>(g, n, deadline);
+			break;
+	}
+	pgm_account_wait(n, start);
 
 out:
 	return wait_status;
 }
 
-static void pgm_consume_skips(struct pgm_graph* g, struct pgm_node* n)
+static void pgm_consume_skips(struct pgm_graph* g, struct pgm_node* n)
+{
+	for(int i = 0; i < n->nr_in; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		if(e->nr_skips > 0)
+		{
+			e->nr_skips--;
+		}
+	}
+}
+
+#if defined(PGM_STATS)
+static void pgm_account_consumption(struct pgm_graph* g, struct pgm_node* n)
+{
+	pgm_stat_add(n->stats.s.nr_invocations, 1);
+	for(int i = 0; i < n->nr_in; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		if(e->nr_skips)
+			continue;
+		pgm_stat_add(e->cstats.nr_consumed, e->attr.nr_consume);
+		if(is_data_passing(e))
+			pgm_stat_add(e->cstats.bytes_received, e->attr.nr_consume);
+	}
+}
+#endif
+
+#if defined(PGM_TRACK_TOKENS)
+// Number of the production (nr_sent) that produced the 'token'-th
+// token (counting from 1) to cross edge 'e'. 0 for initial tokens.
+static inline uint64_t pgm_token_seq(const struct pgm_edge* e, uint64_t token)
+{
+	int64_t produced = (int64_t)token - (int64_t)e->attr.nr_init;
+	return (produced > 0) ? (produced + e->attr.nr_produce - 1) / e->attr.nr_produce : 0;
+}
+
+// Follow the tokens that a successful wait consumed back to the
+// productions that made them.
+static void pgm_track_consumption(struct pgm_graph* g, struct pgm_node* n, node_t node)
 {
+#if defined(PGM_LATENCY)
+	uint64_t origin = 0;
+	bool lost = false;
+#endif
+
 	for(int i = 0; i < n->nr_in; ++i)
 	{
 		struct pgm_edge* e = &g->edges[n->in[i]];
-		if(e->nr_skips > 0)
+		if(e->nr_skips)
+			continue;
+
+		uint64_t k = ++e->cstats.nr_recv;
+
+#if defined(PGM_TRACE)
+		// the production that completed the tokens we consumed
+		if(gTraceOn)
+			__pgm_trace(PGM_TRACE_RECV, node.graph, node.node, n->in[i],
+				pgm_token_seq(e, k * e->attr.nr_consume));
+#endif
+#if defined(PGM_LATENCY)
+		// the production that made the oldest token we consumed
+		uint64_t seq = pgm_token_seq(e, (k - 1) * e->attr.nr_consume + 1);
+		if(seq)
 		{
-			e->nr_skips--;
+			uint64_t o;
+			unsigned int slot = seq % PGM_LATENCY_SLOTS;
+			if(__atomic_load_n(&e->origins.slot[slot].seq, __ATOMIC_ACQUIRE) != seq)
+			{
+				lost = true;
+				continue;
+			}
+			o = __atomic_load_n(&e->origins.slot[slot].ns, __ATOMIC_RELAXED);
+			// the producer may have overwritten the slot while we read it
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(&e->origins.slot[slot].seq, __ATOMIC_RELAXED) != seq)
+			{
+				lost = true;
+				continue;
+			}
+			if(o == PGM_ORIGIN_LOST)
+				lost = true;
+			else if(o && (!origin || o < origin))
+				origin = o;
 		}
+#endif
 	}
+
+#if defined(PGM_LATENCY)
+	// the oldest token may be among those lost
+	n->origin_ns = (lost) ? PGM_ORIGIN_LOST : origin;
+#endif
 }
+#endif
 
 static void pgm_consume_tokens(struct pgm_graph* g, struct pgm_node* n)
 {
@@ -3525,6 +8130,10 @@ static bool pgm_send_tokens(struct pgm_edge* e)
 {
 	size_t old_nr_tokens = __sync_fetch_and_add(&e->nr_pending, e->attr.nr_produce);
 
+#if defined(PGM_STATS)
+	pgm_stat_max(e->pstats.max_pending, (uint64_t)(old_nr_tokens + e->attr.nr_produce));
+#endif
+
 	if(old_nr_tokens < e->attr.nr_threshold &&
 	   old_nr_tokens + e->attr.nr_produce >= e->attr.nr_threshold)
 	{
@@ -3545,18 +8154,21 @@ typedef uint32_t pgm_fd_mask_t;
 
 static const unsigned char PGM_NORMAL = 0x01;
 
-static int pgm_send_std_data(struct pgm_edge* e, pgm_command_t tag)
+// Writes the tag into the space reserved just before the user's buffer
+// and returns the start of the message. Only the tag is sent if this is
+// a terminate message.
+static inline char* pgm_tag_std_data(struct pgm_edge* e, pgm_command_t tag, size_t* sz)
 {
-	// only the tag is sent if this is a terminate message
+	pgm_command_t* tag_ptr = (pgm_command_t*)pgm_get_user_ptr(e->buf_out) - 1;
+	*tag_ptr = tag;
+	*sz = (tag & PGM_TERMINATE) ? sizeof(tag) : e->attr.nr_produce + sizeof(tag);
+	return (char*)tag_ptr;
+}
 
+static int pgm_send_std_bytes(struct pgm_edge* e, char* buf, size_t sz)
+{
 	int ret = -1;
 	ssize_t bytes;
-	size_t sz = (tag & PGM_TERMINATE) ? sizeof(tag) : e->attr.nr_produce + sizeof(tag);
-	pgm_command_t* tag_ptr = (pgm_command_t*)pgm_get_user_ptr(e->buf_out) - 1;
-	char* buf = (char*)tag_ptr;
-
-	// tag the message
-	*tag_ptr = tag;
 
 	while(1)
 	{
@@ -3589,6 +8201,13 @@ static int pgm_send_std_data(struct pgm_edge* e, pgm_command_t tag)
 	return ret;
 }
 
+static int pgm_send_std_data(struct pgm_edge* e, pgm_command_t tag)
+{
+	size_t sz;
+	char* buf = pgm_tag_std_data(e, tag, &sz);
+	return pgm_send_std_bytes(e, buf, sz);
+}
+
 static int pgm_send_ring_data(struct pgm_edge* e, pgm_command_t tag)
 {
 	if(!(tag & PGM_TERMINATE))
@@ -3615,6 +8234,11 @@ static eWaitStatus pgm_wait_for_data(pgm_fd_mask_t* to_wait,
 	int sum, i, scanned;
 
 	int num_looped = 0;
+	uint64_t start = pgm_stats_clock();
+
+	// if out-edges hold back data, flush it before we block
+	bool flush_first = (n->nr_out_coalesced != 0);
+	struct timeval no_wait;
 
 	while(*to_wait)
 	{
@@ -3631,7 +8255,15 @@ static eWaitStatus pgm_wait_for_data(pgm_fd_mask_t* to_wait,
 			}
 		}
 
-		int nr_ready = select(sum + 1, &set, 0, 0, 0);
+		no_wait.tv_sec = 0;
+		no_wait.tv_usec = 0;
+		int nr_ready = select(sum + 1, &set, 0, 0, (flush_first) ? &no_wait : 0);
+		if(nr_ready == 0 && flush_first)
+		{
+			pgm_flush_out_edges(g, n);
+			flush_first = false;
+			continue;
+		}
 		if(nr_ready == 0)
 		{
 			wait_status = WaitTimeout;
@@ -3655,9 +8287,484 @@ static eWaitStatus pgm_wait_for_data(pgm_fd_mask_t* to_wait,
 		++num_looped;
 	}
 
+	pgm_account_wait(n, start);
+	return wait_status;
+}
+
+// Whether pgm_recv_data() can read a whole job's worth of data (or a
+// terminate message) from FIFO/sock_stream edge 'e' without blocking.
+// 'revents' is from a poll() of the edge. Jobs that are larger than the
+// pipe or socket buffer can never be buffered whole, so any data is
+// taken as ready for those.
+static bool pgm_stream_is_ready(const struct pgm_edge* e, short revents)
+{
+	const size_t msg_size = e->attr.nr_produce + sizeof(pgm_command_t);
+	const size_t next_tag = e->next_tag;
+	size_t need, last;
+	int avail = 0, cap = 0;
+
+	// the producer is gone, so reads return what is left
+	if(revents & (POLLHUP | POLLERR))
+		return true;
+	if(ioctl(e->fd_in, FIONREAD, &avail) != 0)
+		return true;
+
+	// bytes to read for nr_consume, counting the tags crossed on the way
+	need = e->attr.nr_consume;
+	if(need > next_tag)
+		need += ((need - next_tag + e->attr.nr_produce - 1) / e->attr.nr_produce) *
+			sizeof(pgm_command_t);
+	if((size_t)avail >= need)
+		return true;
+	if(avail == 0)
+		return false;
+
+	// Nothing follows a terminate message, so one can only be the last
+	// byte available, and only where a tag would be.
+	last = avail - 1;
+	if(last >= next_tag && (last - next_tag) % msg_size == 0)
+	{
+		if(e->attr.type & __PGM_EDGE_FIFO)
+		{
+			// writes of up to PIPE_BUF are atomic, so a lone tag
+			// can't be the start of a normal message
+			if(msg_size <= PIPE_BUF)
+				return true;
+		}
+		else
+		{
+			std::vector<char> peek(avail);
+			if(recv(e->fd_in, &peek[0], avail, MSG_PEEK | MSG_DONTWAIT) == avail &&
+			   (peek[last] & PGM_TERMINATE))
+				return true;
+		}
+	}
+
+	if(e->attr.type & __PGM_EDGE_FIFO)
+		cap = fcntl(e->fd_in, F_GETPIPE_SZ);
+	else
+	{
+		socklen_t len = sizeof(cap);
+		// (Linux reports twice the usable space)
+		if(getsockopt(e->fd_in, SOL_SOCKET, SO_RCVBUF, &cap, &len) == 0)
+			cap /= 2;
+	}
+	return (cap <= 0 || need > (size_t)cap);
+}
+
+// Wait until every data-passing in-edge that is not being skipped has
+// data (or a terminate message) to read, without reading anything.
+// For FIFO and sock_stream edges, the whole job must have arrived;
+// partially written messages are left in place.
+// Return: WaitSuccess, or WaitTimeout if CLOCK_MONOTONIC passes
+// 'deadline' (in ns) first.
+static eWaitStatus pgm_poll_for_data(struct pgm_graph* g, struct pgm_node* n,
+				uint64_t deadline)
+{
+	eWaitStatus wait_status = WaitSuccess;
+	pgm_fd_mask_t to_wait = 0;
+	pgm_fd_mask_t b;
+	pgm_fd_mask_t partial = 0;
+	struct pollfd pfds[PGM_MAX_IN_DEGREE];
+	int idx[PGM_MAX_IN_DEGREE];
+	int nr_fds, i, ret, timeout_ms;
+	uint64_t now, start;
+
+	for(i = 0, b = 1; i < n->nr_in; ++i, b <<= 1)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		if(is_data_passing(e) && !(n->signal_edge_mask & b) && e->nr_skips == 0)
+			to_wait |= b;
+	}
+
+	// don't hold back data while we wait
+	if(to_wait && n->nr_out_coalesced)
+		pgm_flush_out_edges(g, n);
+
+	start = pgm_stats_clock();
+	while(to_wait)
+	{
+		nr_fds = 0;
+		for(i = 0, b = 1; i < n->nr_in; ++i, b <<= 1)
+		{
+			if(to_wait & b)
+			{
+				pfds[nr_fds].fd = g->edges[n->in[i]].fd_in;
+				// (an edge holding part of a message would always
+				// poll as readable, so only watch it for hang-ups)
+				pfds[nr_fds].events = (partial & b) ? 0 : POLLIN;
+				pfds[nr_fds].revents = 0;
+				idx[nr_fds++] = i;
+			}
+		}
+
+		now = pgm_now_ns();
+		timeout_ms = (now < deadline) ? (int)((deadline - now + 999999) / 1000000) : 0;
+		if(partial && timeout_ms > 1)
+			timeout_ms = 1;  // the rest of the message is on its way
+		ret = poll(pfds, nr_fds, timeout_ms);
+		if(ret == -1 && errno != EINTR)
+		{
+			wait_status = WaitError;
+			break;
+		}
+
+		for(i = 0; ret >= 0 && i < nr_fds; ++i)
+		{
+			struct pgm_edge* e = &g->edges[n->in[idx[i]]];
+			b = ((pgm_fd_mask_t)1) << idx[i];
+			if(!pfds[i].revents && !(partial & b))
+				continue;
+			if(!(e->attr.type & (__PGM_EDGE_FIFO | __PGM_EDGE_SOCK_STREAM)) ||
+			   pgm_stream_is_ready(e, pfds[i].revents))
+			{
+				to_wait &= ~b;
+				partial &= ~b;
+			}
+			else
+			{
+				partial |= b;
+			}
+		}
+
+		if(to_wait && pgm_now_ns() >= deadline)
+		{
+			wait_status = WaitTimeout;
+			break;
+		}
+	}
+	pgm_account_wait(n, start);
+
+	return wait_status;
+}
+
+#if defined(PGM_USE_IO_URING)
+
+///////////////////////////////////////////////////
+//          Batched I/O with io_uring            //
+///////////////////////////////////////////////////
+
+// Each edge needs at most a poll+read or poll+write pair.
+#define PGM_URING_ENTRIES (2*PGM_MAX_IN_DEGREE + 2*PGM_MAX_OUT_DEGREE)
+
+// user_data of an SQE: edge slot in the upper bits, and
+// the low bit is set for the poll half of a linked pair.
+#define PGM_URING_POLL		0x1
+#define PGM_URING_SLOT(ud)	((int)((ud) >> 1))
+
+static pthread_once_t gUringKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gUringKey;
+static __thread struct uring* gThreadUring = 0;
+static __thread bool gThreadUringFailed = false;
+
+static void pgm_free_uring(void* u)
+{
+	free_uring((struct uring*)u);
+	free(u);
+}
+
+static void pgm_make_uring_key(void)
+{
+	pthread_key_create(&gUringKey, pgm_free_uring);
+}
+
+// Get the calling thread's ring, setting it up on first use.
+// Returns NULL if io_uring is unavailable.
+static struct uring* pgm_get_uring(void)
+{
+	struct uring* u;
+
+	if(gThreadUring || gThreadUringFailed)
+		goto out;
+
+	pthread_once(&gUringKeyOnce, pgm_make_uring_key);
+
+	u = (struct uring*)malloc(sizeof(*u));
+	if(!u || init_uring(u, PGM_URING_ENTRIES) != 0)
+	{
+		W("io_uring is unavailable. Falling back to select()/read().\n");
+		free(u);
+		gThreadUringFailed = true;
+		goto out;
+	}
+
+	pthread_setspecific(gUringKey, u);
+	gThreadUring = u;
+
+out:
+	return gThreadUring;
+}
+
+static void pgm_drop_uring(void)
+{
+	pthread_setspecific(gUringKey, 0);
+	pgm_free_uring(gThreadUring);
+	gThreadUring = 0;
+	gThreadUringFailed = true;
+}
+
+static inline bool is_uring_capable(const struct pgm_edge* e)
+{
+	return (e->ops == &pgm_fifo_edge_ops || e->ops == &pgm_sock_stream_edge_ops);
+}
+
+static inline bool is_uring_send_capable(const struct pgm_edge* e)
+{
+	// coalesced and zero-copy sends go through the sock_stream ops
+	if(e->ops == &pgm_sock_stream_edge_ops)
+		return (!e->stage_buf && !e->attr.zerocopy_min);
+	return is_uring_capable(e);
+}
+
+// Submit all prepared SQEs and reap 'nr_expected' completions.
+// res[slot] receives the result of the read/write of each slot.
+// Return: 0 on success. 1 if nothing could be submitted (caller
+// may fall back to plain I/O). -1 on error with I/O in flight.
+static int pgm_uring_submit_and_reap(struct uring* u, int nr_expected, ssize_t* res)
+{
+	int ret = -1;
+	int nr_reaped = 0;
+	struct io_uring_cqe* cqe;
+
+	if(uring_submit_and_wait(u, nr_expected) < 0 && errno != EINTR)
+	{
+		F("io_uring_enter() failed.\n");
+		pgm_drop_uring();
+		ret = 1;
+		goto out;
+	}
+
+	while(1)
+	{
+		while((cqe = uring_peek_cqe(u)) != NULL)
+		{
+			if(!(cqe->user_data & PGM_URING_POLL))
+				res[PGM_URING_SLOT(cqe->user_data)] = cqe->res;
+			uring_cqe_seen(u);
+			++nr_reaped;
+		}
+		if(nr_reaped >= nr_expected)
+			break;
+		if(uring_submit_and_wait(u, nr_expected - nr_reaped) < 0 && errno != EINTR)
+		{
+			F("io_uring_enter() failed.\n");
+			pgm_drop_uring();
+			goto out;
+		}
+	}
+
+	ret = 0;
+
+out:
+	return ret;
+}
+
+// Posts reads for the message tag and leading data of every edge in
+// 'to_wait' that sits on a message boundary, and reaps them as one batch.
+// Edges that are fully received are moved from 'to_wait' to 'done'.
+// Partially-received edges stay in 'to_wait' (with dest_ptrs[] advanced)
+// and are finished by the select()/read() path.
+static eWaitStatus pgm_uring_recv_data(pgm_fd_mask_t* to_wait, pgm_fd_mask_t* done,
+				char** dest_ptrs, struct pgm_graph* g, struct pgm_node* n)
+{
+	eWaitStatus wait_status = WaitSuccess;
+	struct uring* u;
+	struct io_uring_sqe* sqe;
+	ssize_t res[PGM_MAX_IN_DEGREE];
+	pgm_fd_mask_t posted = 0, b;
+	int i, nr_posted = 0;
+
+	u = pgm_get_uring();
+	if(!u)
+		goto out;
+
+	for(i = 0, b = 1; i < n->nr_in; ++i, b <<= 1)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		if(!(*to_wait & b) || !is_uring_capable(e) || e->next_tag != 0)
+			continue;
+
+		// same as the first read in pgm_recv_data(): tag and data in one
+		// operation, but no further than the producer's next tag.
+		size_t chunk_size = (e->attr.nr_consume <= e->attr.nr_produce) ?
+				e->attr.nr_consume : e->attr.nr_produce;
+		pgm_command_t* tag_ptr = ((pgm_command_t*)dest_ptrs[i])-1;
+
+		sqe = uring_get_sqe(u);
+		uring_prep_poll(sqe, e->fd_in, POLLIN, (i << 1) | PGM_URING_POLL);
+		sqe = uring_get_sqe(u);
+		if(e->ops == &pgm_sock_stream_edge_ops)
+			uring_prep_recv(sqe, e->fd_in, tag_ptr, chunk_size + sizeof(pgm_command_t), 0, i << 1);
+		else
+			uring_prep_read(sqe, e->fd_in, tag_ptr, chunk_size + sizeof(pgm_command_t), i << 1);
+
+		res[i] = -ECANCELED;
+		posted |= b;
+		++nr_posted;
+	}
+
+	if(!nr_posted)
+		goto out;
+
+	switch(pgm_uring_submit_and_reap(u, 2*nr_posted, res))
+	{
+		case 0:
+			break;
+		case 1:
+			goto out; // nothing was read. select() will handle it.
+		default:
+			wait_status = WaitError;
+			goto out;
+	}
+
+	for(i = 0, b = 1; i < n->nr_in; ++i, b <<= 1)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		pgm_command_t* tag_ptr = ((pgm_command_t*)dest_ptrs[i])-1;
+		ssize_t bytes_read = res[i];
+
+		if(!(posted & b))
+			continue;
+
+		if(bytes_read == -EAGAIN || bytes_read == -ECANCELED || bytes_read == -EINTR)
+			continue; // leave it to select()
+		if(bytes_read < 0)
+		{
+			errno = -bytes_read;
+			F("read() error for edge %s/%s of node %s/%s.\n",
+				g->name, e->name, g->name, n->name);
+			wait_status = WaitError;
+			goto out;
+		}
+
+		if(bytes_read > 0)
+		{
+			bytes_read -= sizeof(pgm_command_t); // don't inc. tag in read count
+
+			e->next_tag = e->attr.nr_produce - bytes_read;
+
+			if(*tag_ptr & PGM_TERMINATE)
+			{
+				n->nr_terminate_msgs++;
+			}
+			else if(!(*tag_ptr & PGM_NORMAL))
+			{
+				E("Malformed data stream detected on edge %s\n", e->name);
+				wait_status = WaitError;
+				goto out;
+			}
+			else if((size_t)bytes_read != e->attr.nr_consume)
+			{
+				dest_ptrs[i] += bytes_read;
+				continue;
+			}
+		}
+
+		*to_wait &= ~b;
+		*done |= b;
+	}
+
+out:
 	return wait_status;
 }
 
+// Posts writes for the data-passing out-edges of a node that support
+// io_uring and reaps them as one batch. sent[i] is set for every out-edge
+// handled here. Writes that complete only partially are finished with
+// plain writes.
+static int pgm_uring_send_data(struct pgm_graph* g, struct pgm_node* n,
+				pgm_command_t command, bool* sent)
+{
+	int ret = 0;
+	struct uring* u;
+	struct io_uring_sqe* sqe;
+	ssize_t res[PGM_MAX_OUT_DEGREE];
+	char* bufs[PGM_MAX_OUT_DEGREE];
+	size_t szs[PGM_MAX_OUT_DEGREE];
+	int i, nr_posted = 0;
+
+	for(i = 0; i < n->nr_out; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->out[i]];
+		if(is_data_passing(e) && is_uring_send_capable(e) &&
+		   !((command & PGM_TERMINATE) && e->is_backedge))
+			++nr_posted;
+	}
+
+	// a single write is cheaper without the ring
+	if(nr_posted < 2)
+		goto out;
+
+	u = pgm_get_uring();
+	if(!u)
+		goto out;
+
+	nr_posted = 0;
+	for(i = 0; i < n->nr_out; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->out[i]];
+		if(!is_data_passing(e) || !is_uring_send_capable(e) ||
+		   ((command & PGM_TERMINATE) && e->is_backedge))
+			continue;
+
+		bufs[i] = pgm_tag_std_data(e, command, &szs[i]);
+
+		sqe = uring_get_sqe(u);
+		uring_prep_poll(sqe, e->fd_out, POLLOUT, (i << 1) | PGM_URING_POLL);
+		sqe = uring_get_sqe(u);
+		if(e->ops == &pgm_sock_stream_edge_ops)
+			uring_prep_send(sqe, e->fd_out, bufs[i], szs[i], MSG_NOSIGNAL, i << 1);
+		else
+			uring_prep_write(sqe, e->fd_out, bufs[i], szs[i], i << 1);
+
+		res[i] = -ECANCELED;
+		sent[i] = true;
+		++nr_posted;
+	}
+
+	switch(pgm_uring_submit_and_reap(u, 2*nr_posted, res))
+	{
+		case 0:
+			break;
+		case 1:
+			// nothing was written. let the caller send normally.
+			for(i = 0; i < n->nr_out; ++i)
+				sent[i] = false;
+			goto out;
+		default:
+			ret = -1;
+			goto out;
+	}
+
+	for(i = 0; i < n->nr_out; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->out[i]];
+		ssize_t bytes = res[i];
+
+		if(!sent[i] || bytes == (ssize_t)szs[i])
+			continue;
+
+		if(bytes >= 0 || bytes == -EAGAIN || bytes == -ECANCELED || bytes == -EINTR)
+		{
+			// finish the remainder synchronously
+			size_t offset = (bytes > 0) ? bytes : 0;
+			if(pgm_send_std_bytes(e, bufs[i] + offset, szs[i] - offset))
+				ret = -1;
+		}
+		else
+		{
+			errno = -bytes;
+			F("Failed to send data on edge %s\n", e->name);
+			ret = -1;
+		}
+	}
+
+out:
+	return ret;
+}
+
+#endif
+
 static eWaitStatus pgm_recv_data(struct pgm_graph* g, struct pgm_node* n)
 {
 	// TODO: Function must be refactored to remove the heavy abuse of goto.
@@ -3665,6 +8772,7 @@ static eWaitStatus pgm_recv_data(struct pgm_graph* g, struct pgm_node* n)
 	eWaitStatus wait_status = WaitSuccess;
 	pgm_fd_mask_t to_wait;
 	pgm_fd_mask_t to_skip = 0;
+	pgm_fd_mask_t done = 0;
 
 	// Each element points to where data needs to be copied.
 	// Reads for each edge do not always read all the needed
@@ -3698,6 +8806,16 @@ static eWaitStatus pgm_recv_data(struct pgm_graph* g, struct pgm_node* n)
 	// ...but mask out the signal-driven edges and edges we're skipping
 	to_wait &= ~(n->signal_edge_mask | to_skip);
 
+#if defined(PGM_USE_IO_URING)
+	// (the batch may block, so don't leave data held back)
+	if(n->nr_out_coalesced)
+		pgm_flush_out_edges(g, n);
+
+	// read whatever we can from all edges in one batch
+	wait_status = pgm_uring_recv_data(&to_wait, &done, dest_ptrs, g, n);
+	if(wait_status != WaitSuccess)
+		goto out;
+#endif
 
 wait_for_data: // jump here if we would block on read
 	while(to_wait)
@@ -3725,6 +8843,7 @@ wait_for_data: // jump here if we would block on read
 	for(int i = 0; i < n->nr_in; ++i)
 	{
 		struct pgm_edge* e = &g->edges[n->in[i]];
+		pgm_fd_mask_t b = ((pgm_fd_mask_t)1)<<i;
 		ssize_t bytes_read;
 		ssize_t remaining;
 
@@ -3733,6 +8852,9 @@ wait_for_data: // jump here if we would block on read
 			continue;
 		if(e->nr_skips > 0)
 			continue;
+		// skip over edges that have already been fully read
+		if(done & b)
+			continue;
 
 		if(e->attr.type & __PGM_EDGE_RING)
 		{
@@ -3773,6 +8895,7 @@ read_more: // jump to here if we need to read more bytes into our buffer
 				if(*tag_ptr & PGM_TERMINATE)
 				{
 					n->nr_terminate_msgs++;
+					done |= b;
 					continue; // we're done with this edge
 				}
 				if(!(*tag_ptr & PGM_NORMAL))
@@ -3825,6 +8948,7 @@ read_more: // jump to here if we need to read more bytes into our buffer
 				if(tag & PGM_TERMINATE)
 				{
 					n->nr_terminate_msgs++;
+					done |= b;
 					continue; // we're done with this edge.
 				}
 				if(!(tag & PGM_NORMAL))
@@ -3837,102 +8961,767 @@ read_more: // jump to here if we need to read more bytes into our buffer
 			}
 		}
 
-		if(bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		if(bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && e->fd_in < 0)
+		{
+			// Signaled custom transport without a descriptor. The
+			// producer has sent the whole message, so just retry.
+			goto read_more;
+		}
+		else if(bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
 		{
 			// We need to block again on select(). Block on this edge,
 			// and all those we have yet to handle.
 
-			// recompute a mask for this edge and all after i.
-			to_wait = ~((pgm_fd_mask_t)0) >> (sizeof(to_wait)*8 - (i + 1));
-			// ...but mask out signal-driven edges and edge's we're skipping
-			to_wait &= ~(n->signal_edge_mask | to_skip);
-			// ...but still make sure that we wait for this edge,
-			// even if it's a singalled one (we can't be reading an edge
-			// that we're skipping since we would have skipped it and
-			// there would have been no failure).
-			to_wait |= ((pgm_fd_mask_t)1)<<i;
+			// recompute a mask for this edge and all those not yet done.
+			to_wait = ~((pgm_fd_mask_t)0) >> (sizeof(to_wait)*8 - n->nr_in);
+			// ...but mask out signal-driven edges and edge's we're skipping
+			to_wait &= ~(n->signal_edge_mask | to_skip | done);
+			// ...but still make sure that we wait for this edge,
+			// even if it's a singalled one (we can't be reading an edge
+			// that we're skipping since we would have skipped it and
+			// there would have been no failure).
+			to_wait |= ((pgm_fd_mask_t)1)<<i;
+
+			goto wait_for_data;
+		}
+		else if(bytes_read == -1)
+		{
+			F("read() error for edge %s/%s of node %s/%s.\n",
+				g->name, e->name, g->name, n->name);
+
+			wait_status = WaitError;
+			goto out;
+		}
+
+		done |= b;
+	}
+
+out:
+	// signal terminte if everyone has checked in
+	if(n->nr_terminate_msgs &&
+	   (n->nr_terminate_msgs == (n->nr_in_data - n->nr_in_data_backedges)))
+		wait_status = WaitExhaustedAndTerminate;
+
+	return wait_status;
+}
+
+static const int PGM_WAIT_TIMEOUT = -2;
+
+// Sleep until the next release of periodic node 'n', or until
+// 'deadline' (if non-zero). The release is not consumed; see
+// pgm_commit_release().
+static eWaitStatus pgm_wait_for_release(struct pgm_graph* g, struct pgm_node* n,
+				uint64_t deadline)
+{
+	uint64_t now = pgm_now_ns();
+	uint64_t release = n->next_release_ns;
+
+	if(!release)
+	{
+		// the first periodic node to wait fixes time zero for the graph
+		uint64_t epoch = 0;
+		if(!__atomic_compare_exchange_n(&g->release_epoch_ns, &epoch, now,
+				false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			now = std::max(now, epoch);
+		else
+			epoch = now;
+		release = epoch + n->phase_ns;
+		// releases a full period before the node's first wait are
+		// skipped without being counted
+		if(release < now)
+			release += (now - release) / n->period_ns * n->period_ns;
+		n->release_checked = 1;
+	}
+	else if(!n->release_checked)
+	{
+		if(now > release)
+		{
+			uint64_t nr_missed = (now - release) / n->period_ns;
+			pgm_stat_add(n->release_stats.nr_overruns, 1);
+			if(nr_missed)
+			{
+				pgm_stat_add(n->release_stats.nr_missed, nr_missed);
+				release += nr_missed * n->period_ns;
+			}
+		}
+		n->release_checked = 1;
+	}
+	n->next_release_ns = release;
+
+	// we have to sleep. don't sleep on held-back data.
+	if(now < release && n->nr_out_coalesced)
+		pgm_flush_out_edges(g, n);
+
+	while(now < release)
+	{
+		struct timespec ts;
+		if(deadline && deadline < release)
+		{
+			if(now >= deadline)
+				return WaitTimeout;
+			ts = pgm_ns_to_timespec(deadline);
+		}
+		else
+			ts = pgm_ns_to_timespec(release);
+		int err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		if(err && err != EINTR)
+		{
+			errno = err;
+			return WaitError;
+		}
+		now = pgm_now_ns();
+	}
+
+	return WaitSuccess;
+}
+
+// Called once a wait of periodic node 'n' succeeds.
+static void pgm_commit_release(struct pgm_node* n)
+{
+	uint64_t lateness = pgm_now_ns() - n->next_release_ns;
+
+	pgm_stat_add(n->release_stats.nr_releases, 1);
+	pgm_stat_max(n->release_stats.max_lateness_ns, lateness);
+#if defined(PGM_LATENCY)
+	if(!n->nr_in)
+		n->origin_ns = n->next_release_ns;
+#endif
+	n->next_release_ns += n->period_ns;
+	n->release_checked = 0;
+}
+
+// If 'deadline' is non-zero, nothing is consumed unless all inputs
+// become available before CLOCK_MONOTONIC passes 'deadline' (in ns).
+// Return: PGM_WAIT_TIMEOUT if they do not.
+static int pgm_wait_inputs(node_t node, uint64_t deadline)
+{
+	int ret = -1;
+	struct pgm_graph* g = &gGraphs[node.graph];
+	struct pgm_node* n = &g->nodes[node.node];
+
+	eWaitStatus token_status = WaitExhaustedAndTerminate;
+	eWaitStatus data_status = WaitExhaustedAndTerminate;
+
+	// no locking or error checking for the sake of speed.
+	// we assume initialization is done. use higher-level constructs, such
+	// as barriers, to ensure clean bring-up and shutdown.
+
+	pgm_trace(PGM_TRACE_WAIT_BEGIN, node.graph, node.node);
+
+	if(deadline && n->ready_efd >= 0)
+	{
+		// clear old notifications before we test for readiness
+		uint64_t count;
+		if(read(n->ready_efd, &count, sizeof(count))) {}
+	}
+
+	if(n->period_ns)
+	{
+		switch(pgm_wait_for_release(g, n, deadline))
+		{
+			case WaitSuccess:
+				break;
+			case WaitTimeout:
+				ret = PGM_WAIT_TIMEOUT;
+				goto out;
+			default:
+				F("Release of node %s/%s failed.\n", g->name, n->name);
+				goto out;
+		}
+		if(!n->nr_in)
+		{
+			// a periodic source has nothing else to wait for
+			ret = 0;
+#if defined(PGM_STATS)
+			pgm_stat_add(n->stats.s.nr_invocations, 1);
+			n->stats.job_start = pgm_now_ns();
+#endif
+			pgm_commit_release(n);
+			goto out;
+		}
+	}
+
+	// wait to be signaled before attempting to read
+	if(n->nr_in_signaled)
+	{
+		token_status = pgm_wait_for_tokens(g, n, deadline);
+		if(token_status == WaitTimeout)
+		{
+			ret = PGM_WAIT_TIMEOUT;
+			goto out;
+		}
+	}
+	if(deadline && n->nr_in_data)
+	{
+		// nothing has been consumed yet
+		switch(pgm_poll_for_data(g, n, deadline))
+		{
+			case WaitSuccess:
+				break;
+			case WaitTimeout:
+				ret = PGM_WAIT_TIMEOUT;
+				goto out;
+			default:
+				F("poll() error for node %s/%s.\n", g->name, n->name);
+				goto out;
+		}
+	}
+	if(n->nr_in_data)
+	{
+		data_status = pgm_recv_data(g, n);
+	}
+
+	if(token_status == WaitExhaustedAndTerminate &&
+	   data_status == WaitExhaustedAndTerminate)
+	{
+		ret = PGM_TERMINATE;
+	}
+	else
+	{
+		ret = (token_status == WaitTimeout || token_status == WaitError ||
+		       data_status  == WaitTimeout || data_status  == WaitError) ?
+				-1 : 0;
+	}
+
+	if(n->nr_in_signaled && ret != PGM_TERMINATE)
+		pgm_consume_tokens(g, n);  // consume the token counters
+
+#if defined(PGM_STATS)
+	if(ret == 0)
+	{
+		pgm_account_consumption(g, n);
+		n->stats.job_start = pgm_now_ns();
+	}
+#endif
+#if defined(PGM_TRACK_TOKENS)
+	if(ret == 0)
+		pgm_track_consumption(g, n, node);
+#endif
+
+	pgm_consume_skips(g, n); // decrement skip counts
+
+	if(ret == 0 && n->period_ns)
+		pgm_commit_release(n);
+
+	// (replicas pass termination on once their jobs are done)
+	if(ret == PGM_TERMINATE && !is_multi_job(n))
+		pgm_terminate(node);
+
+out:
+	pgm_trace(PGM_TRACE_WAIT_END, node.graph, node.node, -1, ret);
+	return ret;
+}
+
+static int pgm_produce(node_t node, pgm_command_t command = PGM_NORMAL,
+				struct pgm_job* job = 0);
+
+// Replicas take turns waiting for inputs, and a replica that gets a
+// job is given the next sequence number.
+static int pgm_replica_wait(node_t node, uint64_t deadline)
+{
+	int ret = -1;
+	struct pgm_graph* g = &gGraphs[node.graph];
+	struct pgm_node* n = &g->nodes[node.node];
+	struct pgm_replicas* reps = n->replicas;
+	struct pgm_replica* r = pgm_my_replica(n);
+	int slot;
+
+	if(!r)
+	{
+		E("Thread is not a replica of node %s/%s.\n", g->name, n->name);
+		goto out;
+	}
+	slot = r - reps->r;
+
+	pthread_mutex_lock(&reps->lock);
+	while(!reps->terminated &&
+		  (reps->in_busy ||
+		   (n->replica_policy == PGM_REPLICA_ROUND_ROBIN &&
+			reps->next_in % n->nr_replicas != (uint64_t)slot)))
+	{
+		if(!deadline)
+			pthread_cond_wait(&reps->cv, &reps->lock);
+		else
+		{
+			struct timespec ts = pgm_ns_to_timespec(deadline);
+			if(pthread_cond_timedwait(&reps->cv, &reps->lock, &ts) == ETIMEDOUT)
+			{
+				ret = PGM_WAIT_TIMEOUT;
+				goto out_unlock;
+			}
+		}
+	}
+	if(reps->terminated)
+	{
+		ret = PGM_TERMINATE;
+		goto out_unlock;
+	}
+	reps->in_busy = true;
+	pthread_mutex_unlock(&reps->lock);
+
+	// receive into the buffers of this replica
+	for(int i = 0; i < n->nr_in; ++i)
+		if(r->buf_in[i])
+			g->edges[n->in[i]].buf_in = r->buf_in[i];
+
+	ret = pgm_wait_inputs(node, deadline);
+	if(ret == 0)
+	{
+#if defined(PGM_LATENCY)
+		r->job.origin_ns = n->origin_ns;
+		n->origin_ns = 0;
+#endif
+#if defined(PGM_STATS)
+		r->job.start_ns = n->stats.job_start;
+		n->stats.job_start = 0;
+#endif
+		r->running = true;
+	}
+
+	pthread_mutex_lock(&reps->lock);
+	reps->in_busy = false;
+	if(ret == 0)
+		r->seq = reps->next_in++;
+	else if(ret == PGM_TERMINATE)
+	{
+		reps->terminated = true;
+		pthread_cond_broadcast(&reps->cv);
+		// jobs handed out before termination go first
+		while(reps->next_out != reps->next_in)
+			pthread_cond_wait(&reps->cv, &reps->lock);
+	}
+	pthread_cond_broadcast(&reps->cv);
+	pthread_mutex_unlock(&reps->lock);
+
+	if(ret == PGM_TERMINATE)
+	{
+		for(int i = 0; i < n->nr_out; ++i)
+			if(r->buf_out[i])
+				g->edges[n->out[i]].buf_out = r->buf_out[i];
+		pgm_terminate(node);
+	}
+	goto out;
+
+out_unlock:
+	pthread_mutex_unlock(&reps->lock);
+out:
+	return ret;
+}
+
+// Replicas complete their jobs in sequence.
+static int pgm_replica_complete(node_t node)
+{
+	int ret = -1;
+	struct pgm_graph* g = &gGraphs[node.graph];
+	struct pgm_node* n = &g->nodes[node.node];
+	struct pgm_replicas* reps = n->replicas;
+	struct pgm_replica* r = pgm_my_replica(n);
+
+	if(!r || !r->running)
+	{
+		E("Thread has no job of node %s/%s to complete.\n", g->name, n->name);
+		goto out;
+	}
+
+	pthread_mutex_lock(&reps->lock);
+	while(reps->next_out != r->seq)
+		pthread_cond_wait(&reps->cv, &reps->lock);
+	pthread_mutex_unlock(&reps->lock);
+
+	// send from the buffers of this replica
+	for(int i = 0; i < n->nr_out; ++i)
+		if(r->buf_out[i])
+			g->edges[n->out[i]].buf_out = r->buf_out[i];
+
+	ret = pgm_produce(node, PGM_NORMAL, &r->job);
+	r->running = false;
+
+	pthread_mutex_lock(&reps->lock);
+	++reps->next_out;
+	pthread_cond_broadcast(&reps->cv);
+	pthread_mutex_unlock(&reps->lock);
+
+out:
+	return ret;
+}
+
+// Send the outputs of completed invocations, oldest first, up to the
+// first that is still running. Then pass on termination if it is due.
+// Called with the lock of the invocations held; returns with it held.
+static int pgm_send_completed(node_t node)
+{
+	int ret = 0;
+	struct pgm_graph* g = &gGraphs[node.graph];
+	struct pgm_node* n = &g->nodes[node.node];
+	struct pgm_replicas* reps = n->replicas;
+	struct pgm_replica* r;
+	bool terminate = false;
+
+	reps->out_busy = true;
+	do
+	{
+		r = 0;
+		for(int j = 0; j < n->nr_inflight; ++j)
+		{
+			if(reps->r[j].done && reps->r[j].seq == reps->next_out)
+			{
+				r = &reps->r[j];
+				break;
+			}
+		}
+		if(r)
+		{
+			pthread_mutex_unlock(&reps->lock);
+			for(int i = 0; i < n->nr_out; ++i)
+				if(r->buf_out[i])
+					g->edges[n->out[i]].buf_out = r->buf_out[i];
+			if(pgm_produce(node, PGM_NORMAL, &r->job) != 0)
+				ret = -1;
+			pthread_mutex_lock(&reps->lock);
+			r->done = false;
+			++reps->next_out;
+		}
+		else if(reps->terminated && !reps->terminate_sent &&
+				reps->next_out == reps->next_in)
+		{
+			reps->terminate_sent = true;
+			terminate = true;
+		}
+	} while(r);
+
+	if(terminate)
+	{
+		pthread_mutex_unlock(&reps->lock);
+		pgm_terminate(node);
+		pthread_mutex_lock(&reps->lock);
+	}
+	reps->out_busy = false;
+	pthread_cond_broadcast(&reps->cv);
+
+	return ret;
+}
+
+// sequence number of an invocation that is waiting for its inputs
+static const uint64_t PGM_INV_UNNUMBERED = ~0ull;
+
+// Invocations take turns waiting for inputs, like replicas, but are not
+// bound to threads.
+static int pgm_inv_wait(node_t node, pgm_inv_t* inv, uint64_t deadline)
+{
+	int ret = -1;
+	struct pgm_graph* g = &gGraphs[node.graph];
+	struct pgm_node* n = &g->nodes[node.node];
+	struct pgm_replicas* reps = n->replicas;
+	struct pgm_replica* r = 0;
+
+	if(n->nr_inflight <= 1 || !reps || !inv)
+	{
+		E("Node %s/%s does not have several jobs in flight.\n", g->name, n->name);
+		goto out;
+	}
+
+	pthread_mutex_lock(&reps->lock);
+	while(!reps->terminated && reps->in_busy)
+	{
+		if(!deadline)
+			pthread_cond_wait(&reps->cv, &reps->lock);
+		else
+		{
+			struct timespec ts = pgm_ns_to_timespec(deadline);
+			if(pthread_cond_timedwait(&reps->cv, &reps->lock, &ts) == ETIMEDOUT)
+			{
+				ret = PGM_WAIT_TIMEOUT;
+				goto out_unlock;
+			}
+		}
+	}
+	if(reps->terminated)
+	{
+		ret = PGM_TERMINATE;
+		goto out_unlock;
+	}
+	for(int j = 0; j < n->nr_inflight && !r; ++j)
+		if(!reps->r[j].running && !reps->r[j].done)
+			r = &reps->r[j];
+	if(!r)
+	{
+		errno = EBUSY;
+		goto out_unlock;
+	}
+	reps->in_busy = true;
+	r->running = true;
+	r->seq = PGM_INV_UNNUMBERED;
+	pthread_mutex_unlock(&reps->lock);
+
+	for(int i = 0; i < n->nr_in; ++i)
+		if(r->buf_in[i])
+			g->edges[n->in[i]].buf_in = r->buf_in[i];
 
-			goto wait_for_data;
-		}
-		else if(bytes_read == -1)
-		{
-			F("read() error for edge %s/%s of node %s/%s.\n",
-				g->name, e->name, g->name, n->name);
+	ret = pgm_wait_inputs(node, deadline);
+	if(ret == 0)
+	{
+#if defined(PGM_LATENCY)
+		r->job.origin_ns = n->origin_ns;
+		n->origin_ns = 0;
+#endif
+#if defined(PGM_STATS)
+		r->job.start_ns = n->stats.job_start;
+		n->stats.job_start = 0;
+#endif
+	}
 
-			wait_status = WaitError;
-			goto out;
-		}
+	pthread_mutex_lock(&reps->lock);
+	reps->in_busy = false;
+	if(ret == 0)
+	{
+		r->seq = reps->next_in++;
+		*inv = r - reps->r;
+	}
+	else
+		r->running = false;
+	if(ret == PGM_TERMINATE)
+	{
+		reps->terminated = true;
+		// (unless a thread sending outputs will do it)
+		if(!reps->out_busy)
+			pgm_send_completed(node);
 	}
+	pthread_cond_broadcast(&reps->cv);
 
+out_unlock:
+	pthread_mutex_unlock(&reps->lock);
 out:
-	// signal terminte if everyone has checked in
-	if(n->nr_terminate_msgs &&
-	   (n->nr_terminate_msgs == (n->nr_in_data - n->nr_in_data_backedges)))
-		wait_status = WaitExhaustedAndTerminate;
+	return ret;
+}
 
-	return wait_status;
+int pgm_wait_inv(node_t node, pgm_inv_t* inv)
+{
+	return pgm_inv_wait(node, inv, 0);
 }
 
-int pgm_wait(node_t node)
+int pgm_try_wait_inv(node_t node, pgm_inv_t* inv)
+{
+	int ret = pgm_inv_wait(node, inv, 1);  // deadline has already passed
+	if(ret == PGM_WAIT_TIMEOUT)
+	{
+		errno = EAGAIN;
+		ret = -1;
+	}
+	return ret;
+}
+
+int pgm_complete_inv(node_t node, pgm_inv_t inv)
 {
 	int ret = -1;
 	struct pgm_graph* g = &gGraphs[node.graph];
 	struct pgm_node* n = &g->nodes[node.node];
+	struct pgm_replicas* reps = n->replicas;
 
-	eWaitStatus token_status = WaitExhaustedAndTerminate;
-	eWaitStatus data_status = WaitExhaustedAndTerminate;
+	if(n->nr_inflight <= 1 || !reps || inv < 0 || inv >= n->nr_inflight)
+		goto out;
 
-	// no locking or error checking for the sake of speed.
-	// we assume initialization is done. use higher-level constructs, such
-	// as barriers, to ensure clean bring-up and shutdown.
+	pthread_mutex_lock(&reps->lock);
+	if(!reps->r[inv].running || reps->r[inv].seq == PGM_INV_UNNUMBERED)
+	{
+		pthread_mutex_unlock(&reps->lock);
+		E("Invocation %d of node %s/%s is not running.\n", inv, g->name, n->name);
+		goto out;
+	}
+	reps->r[inv].running = false;
+	reps->r[inv].done = true;
+	// (the thread sending outputs will send these, too)
+	ret = (reps->out_busy) ? 0 : pgm_send_completed(node);
+	pthread_mutex_unlock(&reps->lock);
 
-	// wait to be signaled before attempting to read
-	if(n->nr_in_signaled)
+out:
+	return ret;
+}
+
+static int __pgm_wait(node_t node, uint64_t deadline)
+{
+	struct pgm_node* n = &gGraphs[node.graph].nodes[node.node];
+	if(n->nr_replicas > 1)
+		return pgm_replica_wait(node, deadline);
+	if(n->nr_inflight > 1)
 	{
-		token_status = pgm_wait_for_tokens(g, n);
+		E("Node %s/%s has several jobs in flight. Use pgm_wait_inv().\n",
+		  gGraphs[node.graph].name, n->name);
+		return -1;
 	}
-	if(n->nr_in_data)
+	return pgm_wait_inputs(node, deadline);
+}
+
+int pgm_wait(node_t node)
+{
+	return __pgm_wait(node, 0);
+}
+
+int pgm_try_wait(node_t node)
+{
+	int ret = __pgm_wait(node, 1);  // deadline has already passed
+	if(ret == PGM_WAIT_TIMEOUT)
 	{
-		data_status = pgm_recv_data(g, n);
+		errno = EAGAIN;
+		ret = -1;
 	}
+	return ret;
+}
 
-	if(token_status == WaitExhaustedAndTerminate &&
-	   data_status == WaitExhaustedAndTerminate)
+int pgm_wait_timed(node_t node, const struct timespec* timeout)
+{
+	int ret;
+	uint64_t deadline;
+
+	if(!timeout)
+		return pgm_wait(node);
+
+	deadline = pgm_now_ns() + (uint64_t)timeout->tv_sec*1000000000ull + timeout->tv_nsec;
+	ret = __pgm_wait(node, deadline);
+	if(ret == PGM_WAIT_TIMEOUT)
 	{
-		ret = PGM_TERMINATE;
+		errno = ETIMEDOUT;
+		ret = -1;
 	}
-	else
+	return ret;
+}
+
+int pgm_get_ready_fd(node_t node)
+{
+	int ret = -1;
+	struct pgm_graph* g;
+	struct pgm_node* n;
+	struct epoll_event ev;
+	unsigned long flags;
+	uint64_t one = 1;
+	int efd = -1, epfd = -1;
+
+	if(!is_valid_graph(node.graph))
+		goto out;
+	if(gGraphSharedMem)
 	{
-		ret = (token_status == WaitTimeout || token_status == WaitError ||
-		       data_status  == WaitTimeout || data_status  == WaitError) ?
-				-1 : 0;
+		E("Readiness descriptors are not supported for shared-memory graphs.\n");
+		goto out;
 	}
 
-	if(n->nr_in_signaled && ret != PGM_TERMINATE)
-		pgm_consume_tokens(g, n);  // consume the token counters
+	g = &gGraphs[node.graph];
+	n = &g->nodes[node.node];
 
-	pgm_consume_skips(g, n); // decrement skip counts
+	pthread_mutex_lock(&g->lock);
 
-	if(ret == PGM_TERMINATE)
-		pgm_terminate(node);
+	if(node.node < 0 || node.node >= g->nr_nodes || n->owner != pgm_gettid())
+		goto out_unlock;
+	if(is_multi_job(n))
+	{
+		E("Readiness descriptors are not supported for nodes that run several jobs at once.\n");
+		goto out_unlock;
+	}
+
+	if(n->ready_epfd >= 0)
+	{
+		ret = n->ready_epfd;
+		goto out_unlock;
+	}
+
+	efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(efd == -1 || epfd == -1)
+		goto out_close;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev) == -1)
+		goto out_close;
+
+	// (level-triggered, so the descriptor stays ready while data is queued)
+	for(int i = 0; i < n->nr_in; ++i)
+	{
+		struct pgm_edge* e = &g->edges[n->in[i]];
+		if(!is_data_passing(e) || is_signal_driven(e) || e->fd_in < 0)
+			continue;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, e->fd_in, &ev) == -1)
+			goto out_close;
+	}
 
+	// the node may already be ready; let the caller check once.
+	if(write(efd, &one, sizeof(one))) {}
+
+	pgm_lock(n, flags);
+	n->ready_efd = efd;
+	n->ready_epfd = epfd;
+	pgm_unlock(n, flags);
+
+	ret = epfd;
+	goto out_unlock;
+
+out_close:
+	E("Could not create readiness descriptor for node %s/%s.\n", g->name, n->name);
+	if(efd != -1)
+		close(efd);
+	if(epfd != -1)
+		close(epfd);
+
+out_unlock:
+	pthread_mutex_unlock(&g->lock);
+out:
 	return ret;
 }
 
-static int pgm_produce(node_t node, pgm_command_t command = PGM_NORMAL)
+// Wake consumer 'c' if its signaled in-edges are now ready. The signal
+// is sent after the lock is dropped so that the woken consumer does not
+// immediately contend for (or, with spinlocks, spin on) a lock held by
+// a producer it may have preempted. This is safe: a consumer checks
+// for ready edges under the lock before it sleeps.
+template <class Sync>
+static inline void pgm_wake(struct pgm_graph* g, struct pgm_node* c, pgm_command_t command)
+{
+	unsigned long flags;
+	bool ready;
+
+	Sync::lock(&c->sync, flags);
+	ready = (command & PGM_TERMINATE) || pgm_nr_ready_edges(g, c) == c->nr_in_signaled;
+	if(ready && c->ready_efd >= 0)
+	{
+		uint64_t one = 1;
+		if(write(c->ready_efd, &one, sizeof(one))) {}
+	}
+	Sync::unlock(&c->sync, flags);
+
+	if(ready)
+		Sync::signal(&c->sync);
+}
+
+// 'job' overrides the job state kept in the node (see pgm_replica).
+static int pgm_produce(node_t node, pgm_command_t command, struct pgm_job* job)
 {
 	int ret = -1, was_error = 0;
 	struct pgm_graph* g = &gGraphs[node.graph];
 	struct pgm_node* n = &g->nodes[node.node];
 	struct pgm_edge* e;
 
+#if defined(PGM_STATS)
+	uint64_t* job_start = (job) ? &job->start_ns : &n->stats.job_start;
+#endif
+#if defined(PGM_LATENCY)
+	uint64_t* origin_ns = (job) ? &job->origin_ns : &n->origin_ns;
+#endif
+
 	struct pgm_node* to_wake[PGM_MAX_OUT_DEGREE];
 	int nr_to_wake = 0;
 
+#if defined(PGM_USE_IO_URING)
+	bool sent[PGM_MAX_OUT_DEGREE] = {false};
+#endif
+
 	// no locking or error checking for the sake of speed.
 	// we assume initialization is done. use higher-level constructs, such
 	// as barriers, to ensure clean bring-up and shutdown.
 
+#if defined(PGM_USE_IO_URING)
+	// write to all fd-based out-edges in one batch
+	if(n->nr_out > 1 && pgm_uring_send_data(g, n, command, sent))
+		was_error = 1;
+#endif
+
 	for(int i = 0; i < n->nr_out; ++i)
 	{
 		e = &g->edges[n->out[i]];
@@ -3941,7 +9730,41 @@ static int pgm_produce(node_t node, pgm_command_t command = PGM_NORMAL)
 		if((command & PGM_TERMINATE) && e->is_backedge)
 			continue;
 
+#if defined(PGM_STATS)
+		if(!(command & PGM_TERMINATE))
+		{
+			pgm_stat_add(e->pstats.nr_produced, e->attr.nr_produce);
+			if(is_data_passing(e))
+			{
+				// (signaled edges track this in pgm_send_tokens())
+				uint64_t pending = e->attr.nr_init + e->pstats.nr_produced -
+					pgm_stat_read(e->cstats.nr_consumed);
+				pgm_stat_add(e->pstats.bytes_sent, e->attr.nr_produce);
+				pgm_stat_max(e->pstats.max_pending, pending);
+			}
+		}
+#endif
+#if defined(PGM_TRACK_TOKENS)
+		if(!(command & PGM_TERMINATE))
+		{
+			uint64_t seq = ++e->pstats.nr_sent;
+#if defined(PGM_LATENCY)
+			// stamp the origin before the consumer can see the tokens
+			unsigned int slot = seq % PGM_LATENCY_SLOTS;
+			__atomic_store_n(&e->origins.slot[slot].seq, 0, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			__atomic_store_n(&e->origins.slot[slot].ns, *origin_ns, __ATOMIC_RELAXED);
+			__atomic_store_n(&e->origins.slot[slot].seq, seq, __ATOMIC_RELEASE);
+#endif
+			pgm_trace(PGM_TRACE_SEND, node.graph, node.node, n->out[i], seq);
+		}
+#endif
+
+#if defined(PGM_USE_IO_URING)
+		if(is_data_passing(e) && !sent[i])
+#else
 		if(is_data_passing(e))
+#endif
 		{
 			ret = pgm_send_data(e, command);
 			if(ret)
@@ -3962,16 +9785,51 @@ static int pgm_produce(node_t node, pgm_command_t command = PGM_NORMAL)
 		}
 	}
 
+	// nothing may be held back once we terminate
+	if((command & PGM_TERMINATE) && n->nr_out_coalesced)
+		pgm_flush_out_edges(g, n);
+
+#if defined(PGM_STATS)
+	if(!(command & PGM_TERMINATE))
+	{
+		uint64_t now = pgm_now_ns();
+		if(*job_start)
+		{
+			uint64_t t = now - *job_start;
+			pgm_stat_add(n->stats.s.exec_ns, t);
+			pgm_stat_max(n->stats.s.max_exec_ns, t);
+			pgm_hist_add(&n->stats.exec, t);
+			*job_start = 0;
+		}
+		if(!n->stats.s.first_complete_ns)
+			pgm_stat_add(n->stats.s.first_complete_ns, now);
+		__atomic_store_n(&n->stats.s.last_complete_ns, now, __ATOMIC_RELAXED);
+		pgm_stat_add(n->stats.s.nr_completions, 1);
+	}
+#endif
+#if defined(PGM_LATENCY)
+	if(*origin_ns)
+	{
+		if(n->nr_out == 0 && !(command & PGM_TERMINATE))
+			pgm_record_latency(n, *origin_ns);
+		*origin_ns = 0;
+	}
+#endif
+
 	for(int i = 0; i < nr_to_wake; ++i)
 	{
 		struct pgm_node* c = to_wake[i];
-		unsigned long flags;
-		pgm_lock(&c->lock, flags);
-		if((command & PGM_TERMINATE) || pgm_nr_ready_edges(g, c) == c->nr_in_signaled)
-			pgm_cv_signal(&c->wait);
-		pgm_unlock(&c->lock, flags);
+		switch(c->lock_type)
+		{
+			case PGM_LOCK_TICKET: pgm_wake<pgm_ticket_sync>(g, c, command); break;
+			case PGM_LOCK_MCS: pgm_wake<pgm_mcs_sync>(g, c, command); break;
+			default: pgm_wake<pgm_pthread_sync>(g, c, command); break;
+		}
 	}
 
+	pgm_trace((command & PGM_TERMINATE) ? PGM_TRACE_TERMINATE : PGM_TRACE_COMPLETE,
+		node.graph, node.node);
+
 	ret = (was_error) ? -1 : 0;
 
 	return ret;
@@ -3979,6 +9837,15 @@ static int pgm_produce(node_t node, pgm_command_t command = PGM_NORMAL)
 
 int pgm_complete(node_t node)
 {
+	struct pgm_node* n = &gGraphs[node.graph].nodes[node.node];
+	if(n->nr_replicas > 1)
+		return pgm_replica_complete(node);
+	if(n->nr_inflight > 1)
+	{
+		E("Node %s/%s has several jobs in flight. Use pgm_complete_inv().\n",
+		  gGraphs[node.graph].name, n->name);
+		return -1;
+	}
 	return pgm_produce(node);
 }
 
@@ -3999,6 +9866,8 @@ static const char* edgeTypeStr(const struct pgm_edge* e)
 		return "stream";
 	if(e->ops == &pgm_cv_edge_ops)
 		return "cv";
+	if(e->ops == &pgm_custom_edge_ops)
+		return (edge_transport(e)->name) ? edge_transport(e)->name : "custom";
 	return "unknown";
 }
 
@@ -4116,3 +9985,162 @@ int pgm_print_graph(graph_t graph, FILE* outs)
 out:
 	return ret;
 }
+
+#if defined(PGM_STATS)
+// Graphviz HSV color from green (heat = 0) to red (heat = 1).
+static void heat_color(char* buf, size_t len, double heat)
+{
+	heat = std::max(0.0, std::min(1.0, heat));
+	snprintf(buf, len, "\"%.3f 0.600 0.950\"", (1.0 - heat) * 0.333);
+}
+
+// Seconds between the first and last completion of a node.
+static double node_active_s(const struct pgm_node* n)
+{
+	uint64_t first = pgm_stat_read(n->stats.s.first_complete_ns);
+	uint64_t last = pgm_stat_read(n->stats.s.last_complete_ns);
+	return (first && last > first) ? (last - first) / 1e9 : 0.0;
+}
+#endif
+
+int pgm_print_graph_stats(graph_t graph, FILE* outs)
+{
+	int ret = -1;
+#if defined(PGM_STATS)
+	struct pgm_graph* g;
+
+	char namebuf[std::max(PGM_GRAPH_NAME_LEN,
+		std::max(PGM_NODE_NAME_LEN, PGM_EDGE_NAME_LEN)) + 1];
+	char color[40];
+	double max_rate = 0.0;
+	double max_queued = 0.0;
+
+	if(!is_valid_graph(graph))
+		goto out;
+
+	g = &gGraphs[graph];
+
+	pthread_mutex_lock(&g->lock);
+
+	snprintf(namebuf, sizeof(namebuf), "%.*s", PGM_GRAPH_NAME_LEN, g->name);
+	filter_ctrlchars(namebuf, sizeof(namebuf));
+
+	fprintf(outs,
+		"digraph G {\n"
+		"\trankdir=TB;\n"
+		"\tsize=\"11,8.5\";\n"
+		"\tlabel=\"%s\";\n"
+		"\tnode [style=filled, fontsize=10];\n"
+		"\tedge [fontsize=9];\n",
+		namebuf);
+
+	for(int i = 0; i < g->nr_nodes; ++i)
+	{
+		struct pgm_node* n = &g->nodes[i];
+		const pgm_node_stats_t* s = &n->stats.s;
+		bool isSrc = (n->nr_in == n->nr_in_data_backedges + n->nr_in_signaled_backedges);
+		bool isSink = true;
+		for(int j = 0; j < n->nr_out; ++j)
+			if(!g->edges[n->out[j]].is_backedge)
+				isSink = false;
+
+		uint64_t completions = pgm_stat_read(s->nr_completions);
+		uint64_t exec = pgm_stat_read(s->exec_ns);
+		uint64_t wait = pgm_stat_read(s->wait_ns);
+		double active = node_active_s(n);
+		double rate = (active > 0.0) ? (completions - 1) / active : 0.0;
+		char line[160];
+
+		snprintf(namebuf, sizeof(namebuf), "%.*s", PGM_NODE_NAME_LEN, n->name);
+		filter_ctrlchars(namebuf, sizeof(namebuf));
+
+		if(exec + wait > 0 && !isSrc)
+		{
+			// utilization: share of time spent executing rather than blocked
+			double util = (double)exec / (exec + wait);
+			const struct pgm_hist* h = pgm_hist_get(&n->stats.exec);
+			uint64_t invocations = pgm_stat_read(s->nr_invocations);
+			heat_color(color, sizeof(color), util);
+			snprintf(line, sizeof(line),
+				"\\nutil %.0f%%\\nexec %.3f / %.3f ms\\n%.1f /s",
+				util * 100.0,
+				(invocations) ? exec / 1e6 / invocations : 0.0,
+				(h) ? pgm_hist_percentile(h, 99.0) / 1e6 : 0.0,
+				rate);
+		}
+		else
+		{
+			snprintf(color, sizeof(color), "%s", (isSrc) ? "\"#56A0D3\"" : "white");
+			snprintf(line, sizeof(line), "\\n%.1f /s", rate);
+		}
+
+		fprintf(outs,
+			"\t%d [shape=%s, fillcolor=%s, label=\"%s%s\"];\n",
+			i,
+			(isSrc || isSink) ? "doublecircle" : "circle",
+			color,
+			namebuf,
+			line);
+	}
+
+	// scale edges relative to the busiest and most congested
+	for(int i = 0; i < g->nr_edges; ++i)
+	{
+		const struct pgm_edge* e = &g->edges[i];
+		double active = node_active_s(&g->nodes[e->producer]);
+		if(active > 0.0)
+			max_rate = std::max(max_rate,
+				pgm_stat_read(e->pstats.nr_produced) / active / e->attr.nr_produce);
+		max_queued = std::max(max_queued,
+			(double)pgm_stat_read(e->pstats.max_pending) / e->attr.nr_consume);
+	}
+
+	for(int i = 0; i < g->nr_edges; ++i)
+	{
+		const struct pgm_edge* e = &g->edges[i];
+		double active = node_active_s(&g->nodes[e->producer]);
+		uint64_t produced = pgm_stat_read(e->pstats.nr_produced);
+		uint64_t max_pending = pgm_stat_read(e->pstats.max_pending);
+		double rate = (active > 0.0) ? produced / active / e->attr.nr_produce : 0.0;
+		// consumer invocations' worth of queued tokens. more than one
+		// means the consumer fell behind.
+		double queued = (double)max_pending / e->attr.nr_consume;
+		char throughput[64];
+
+		snprintf(namebuf, sizeof(namebuf), "%.*s", PGM_EDGE_NAME_LEN, e->name);
+		filter_ctrlchars(namebuf, sizeof(namebuf));
+
+		if(is_data_passing(e))
+			snprintf(throughput, sizeof(throughput), "%.1f /s, %.1f KB/s",
+				rate, (active > 0.0) ? pgm_stat_read(e->pstats.bytes_sent) / active / 1024.0 : 0.0);
+		else
+			snprintf(throughput, sizeof(throughput), "%.1f /s", rate);
+
+		heat_color(color, sizeof(color),
+			(max_queued > 1.0) ? (queued - 1.0) / (max_queued - 1.0) : 0.0);
+
+		fprintf(outs,
+			"\t%d -> %d [style=%s, color=%s, penwidth=%.2f, label=\"%s_%s\\n%s\\nmax backlog %lu\"]\n",
+			e->producer,
+			e->consumer,
+			(!e->is_backedge) ? "solid" : "dashed",
+			color,
+			1.0 + ((max_rate > 0.0) ? 4.0 * rate / max_rate : 0.0),
+			edgeTypeStr(e),
+			namebuf,
+			throughput,
+			max_pending);
+	}
+
+	fprintf(outs, "}\n");
+
+	pthread_mutex_unlock(&g->lock);
+
+	ret = 0;
+
+out:
+#else
+	E("PGM was built without statistics (PGM_STATS_METHOD).\n");
+#endif
+	return ret;
+}
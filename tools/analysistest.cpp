@@ -0,0 +1,238 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing the real-time analysis and node placement of a
+   graph against values computed by hand. Placement is given explicit
+   CPUs, and the loads leave it only one choice, so the results do not
+   depend on the cache topology of the machine. */
+
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+#define Expect(cond) \
+do { if(!(cond)) { \
+	errors++; \
+	fprintf(stderr, "Failed: %s @ %s:%d\n", #cond, __FILE__, __LINE__); \
+}}while(0)
+
+static bool near(double x, double y)
+{
+	return fabs(x - y) <= 1e-6 * std::max(1.0, fabs(y));
+}
+
+static void init_edge(node_t producer, node_t consumer, const char* name,
+	int produce, int consume, int threshold)
+{
+	edge_t e;
+	edge_attr_t attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_cv_edge;
+	attr.nr_produce = produce;
+	attr.nr_consume = consume;
+	attr.nr_threshold = threshold;
+	CheckError(pgm_init_edge5(&e, producer, consumer, name, &attr));
+}
+
+/*
+   src.2:1 a.1:3 sink, with src released once every 10 ms, and all three
+   nodes on one cluster of two CPUs:
+
+   node  period  wcet  util
+   src   10000   2000  0.2
+   a      5000   1000  0.2   (two jobs per job of src)
+   sink  15000   3000  0.2   (one job per three of a)
+
+   G-EDF on m=2: x = (largest WCET - smallest WCET) / m
+                   = (3000 - 1000) / 2 = 1000,
+   and tardiness = x + wcet. A node responds within period + tardiness.
+   a waits for one job of src, sink for three jobs of a:
+
+   node  tardiness  response  offset
+   src   3000       13000     0
+   a     2000        7000     13000
+   sink  4000       19000     13000 + 2*5000 + 7000 = 30000
+
+   End to end: 30000 + 19000 = 49000.
+ */
+static void chain(void)
+{
+	graph_t g;
+	node_t src, a, sink;
+	pgm_rt_node_t rt[3];
+	pgm_rt_cluster_t cluster;
+	double etoe = 0.0;
+
+	CheckError(pgm_init_graph(&g, "analysistest_chain"));
+	CheckError(pgm_init_node(&src, g, "src"));
+	CheckError(pgm_init_node(&a, g, "a"));
+	CheckError(pgm_init_node(&sink, g, "sink"));
+	init_edge(src, a, "src_a", 2, 1, 1);
+	init_edge(a, sink, "a_sink", 1, 3, 3);
+
+	memset(rt, 0, sizeof(rt));
+	rt[0].nr_releases = 1;
+	rt[0].interval_us = 10000;
+	rt[0].wcet_us = 2000;
+	rt[1].wcet_us = 1000;
+	rt[2].wcet_us = 3000;
+	memset(&cluster, 0, sizeof(cluster));
+	cluster.nr_cpus = 2;
+
+	Expect(pgm_analyze_rt(g, rt, 3, &cluster, 1, &etoe) == 0);
+
+	Expect(rt[1].rate_releases == 2 && rt[1].rate_interval_us == 10000);
+	Expect(rt[2].rate_releases == 2 && rt[2].rate_interval_us == 30000);
+	Expect(near(rt[0].period_us, 10000) && near(rt[1].period_us, 5000) &&
+	       near(rt[2].period_us, 15000));
+	Expect(near(rt[0].utilization, 0.2) && near(rt[1].utilization, 0.2) &&
+	       near(rt[2].utilization, 0.2));
+	Expect(near(cluster.utilization, 0.6) && !cluster.overloaded);
+
+	Expect(near(rt[0].tardiness_us, 3000) && near(rt[1].tardiness_us, 2000) &&
+	       near(rt[2].tardiness_us, 4000));
+	Expect(near(rt[0].response_us, 13000) && near(rt[1].response_us, 7000) &&
+	       near(rt[2].response_us, 19000));
+	Expect(near(rt[0].offset_us, 0) && near(rt[1].offset_us, 13000) &&
+	       near(rt[2].offset_us, 30000));
+	Expect(near(etoe, 49000));
+
+	// a cluster of one CPU is scheduled by EDF, which is never late
+	cluster.nr_cpus = 1;
+	Expect(pgm_analyze_rt(g, rt, 3, &cluster, 1, &etoe) == 0);
+	Expect(near(rt[2].tardiness_us, 0) && near(rt[2].offset_us, 10000 + 2*5000 + 5000));
+	Expect(near(etoe, 25000 + 15000));
+
+	// a needs 6 ms every 5 ms
+	cluster.nr_cpus = 2;
+	rt[1].wcet_us = 6000;
+	Expect(pgm_analyze_rt(g, rt, 3, &cluster, 1, &etoe) == 1);
+	Expect(cluster.overloaded);
+	Expect(rt[1].tardiness_us == HUGE_VAL);
+
+	CheckError(pgm_destroy_graph(g));
+}
+
+// Two sources that release their common consumer at different rates.
+static void inconsistent(void)
+{
+	graph_t g;
+	node_t s0, s1, t;
+	pgm_rt_node_t rt[3];
+	pgm_rt_cluster_t cluster;
+
+	CheckError(pgm_init_graph(&g, "analysistest_inconsistent"));
+	CheckError(pgm_init_node(&s0, g, "s0"));
+	CheckError(pgm_init_node(&s1, g, "s1"));
+	CheckError(pgm_init_node(&t, g, "t"));
+	init_edge(s0, t, "s0_t", 1, 1, 1);
+	init_edge(s1, t, "s1_t", 1, 1, 1);
+
+	memset(rt, 0, sizeof(rt));
+	rt[0].nr_releases = 1;
+	rt[0].interval_us = 1000;
+	rt[1].nr_releases = 1;
+	rt[1].interval_us = 2000;
+	memset(&cluster, 0, sizeof(cluster));
+	cluster.nr_cpus = 1;
+
+	Expect(pgm_analyze_rt(g, rt, 3, &cluster, 1, 0) == -1);
+
+	// with matching rates, t is released at the common rate
+	rt[1].nr_releases = 2;
+	rt[1].interval_us = 2000;
+	Expect(pgm_analyze_rt(g, rt, 3, &cluster, 1, 0) == 0);
+	Expect(near(rt[2].period_us, 1000));
+
+	CheckError(pgm_destroy_graph(g));
+}
+
+/*
+   a -> b -> c -> d with a load of 0.5 per node on CPUs 2 and 5. The
+   heavy edges a->b and c->d are joined first, which leaves two groups of
+   load 1 and no room for b->c. Each group fills one CPU.
+ */
+static void placement(void)
+{
+	graph_t g;
+	node_t a, b, c, d;
+	const int cpus[] = {2, 5};
+	const double load[] = {0.5, 0.5, 0.5, 0.5};
+	const double volume[] = {10.0, 1.0, 10.0};
+	const double heavy[] = {0.8, 0.8, 0.8};
+	const int bad_cpus[] = {0, -1};
+	int where[4];
+
+	CheckError(pgm_init_graph(&g, "analysistest_placement"));
+	CheckError(pgm_init_node(&a, g, "a"));
+	CheckError(pgm_init_node(&b, g, "b"));
+	CheckError(pgm_init_node(&c, g, "c"));
+	CheckError(pgm_init_node(&d, g, "d"));
+	init_edge(a, b, "a_b", 1, 1, 1);
+	init_edge(b, c, "b_c", 1, 1, 1);
+	init_edge(c, d, "c_d", 1, 1, 1);
+
+	Expect(pgm_place_nodes(g, load, volume, cpus, 2, where) == 0);
+	Expect(where[0] == 2 && where[1] == 2);
+	Expect(where[2] == 5 && where[3] == 5);
+
+	// one CPU takes everything, and is overloaded
+	Expect(pgm_place_nodes(g, load, volume, cpus, 1, where) == 1);
+	Expect(where[0] == 2 && where[1] == 2 && where[2] == 2 && where[3] == 2);
+
+	Expect(pgm_place_nodes(g, load, volume, bad_cpus, 2, where) == -1);
+
+	CheckError(pgm_destroy_graph(g));
+
+	/*
+	   x -> y -> z with a load of 0.8 per node on CPUs 2 and 5. No two
+	   nodes fit on one CPU: x and y go to the two CPUs, and z is put on
+	   the first of the (equally) least loaded.
+	 */
+	CheckError(pgm_init_graph(&g, "analysistest_overloaded"));
+	CheckError(pgm_init_node(&a, g, "x"));
+	CheckError(pgm_init_node(&b, g, "y"));
+	CheckError(pgm_init_node(&c, g, "z"));
+	init_edge(a, b, "x_y", 1, 1, 1);
+	init_edge(b, c, "y_z", 1, 1, 1);
+
+	Expect(pgm_place_nodes(g, heavy, 0, cpus, 2, where) == 1);
+	Expect(where[0] == 2 && where[1] == 5 && where[2] == 2);
+
+	CheckError(pgm_destroy_graph(g));
+}
+
+int main(void)
+{
+	CheckError(pgm_init_process_local());
+
+	chain();
+	inconsistent();
+	placement();
+
+	CheckError(pgm_destroy());
+
+	fprintf(stdout, "%s\n", (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}
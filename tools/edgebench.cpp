@@ -0,0 +1,609 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* Measures the one-way latency and sustained throughput of each edge
+   type across a range of message sizes, with the producer and consumer
+   pinned to the same core, to different cores of the same socket, or
+   to different sockets. Results are written as CSV (default) or JSON,
+   one record per (type, size, placement). */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+int ITERATIONS = 10000;       // upper bound on messages per measurement
+int MIN_ITERATIONS = 20;      // lower bound on messages per measurement
+size_t BUDGET = 256ul << 20;  // bytes moved per measurement (bounds iterations)
+int PORT = 10301;
+int MQ_MAXMSG = 10;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+struct edge_kind
+{
+	const char* name;
+	pgm_edge_type_t type;
+};
+
+static const edge_kind KINDS[] =
+{
+	{"cv", pgm_cv_edge},
+	{"ring", pgm_ring_edge},
+	{"fifo", pgm_fifo_edge},
+	{"fast_fifo", pgm_fast_fifo_edge},
+	{"mq", pgm_mq_edge},
+	{"fast_mq", pgm_fast_mq_edge},
+	{"sock_stream", pgm_sock_stream_edge},
+};
+
+struct placement
+{
+	std::string name;
+	int cpu0;  // producer of the measured edge
+	int cpu1;  // consumer of the measured edge
+};
+
+/*
+   CPU topology. "same-core" uses two hardware threads of one core if
+   the core has more than one, and otherwise pins both ends to the same
+   CPU. Placements the machine cannot provide are skipped.
+ */
+
+static int read_topology(int cpu, const char* file)
+{
+	char path[128];
+	int val = -1;
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, file);
+	FILE* f = fopen(path, "r");
+	if(f)
+	{
+		if(fscanf(f, "%d", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static bool find_placement(const std::string& name, placement& p)
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	std::vector<int> pkg(ncpus), core(ncpus);
+	for(int i = 0; i < ncpus; ++i)
+	{
+		pkg[i] = std::max(read_topology(i, "physical_package_id"), 0);
+		core[i] = read_topology(i, "core_id");
+	}
+
+	p.name = name;
+	for(int i = 0; i < ncpus; ++i)
+	{
+		for(int j = i + 1; j < ncpus; ++j)
+		{
+			bool same_core = (pkg[i] == pkg[j] && core[i] == core[j]);
+			if((name == "same-core" && same_core) ||
+			   (name == "same-socket" && pkg[i] == pkg[j] && !same_core) ||
+			   (name == "cross-socket" && pkg[i] != pkg[j]))
+			{
+				p.cpu0 = i;
+				p.cpu1 = j;
+				return true;
+			}
+		}
+	}
+	if(name == "same-core" && ncpus > 0)
+	{
+		p.cpu0 = p.cpu1 = 0;
+		return true;
+	}
+	return false;
+}
+
+static void pin(int cpu)
+{
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu, &cpu_set);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+	{
+		fprintf(stderr, "Could not pin thread to CPU %d\n", cpu);
+		errors++;
+	}
+}
+
+/*
+   A single measurement. n0 produces to n1 on 'fwd'. For latency,
+   n1 answers over 'back' (a back-edge of the same type and size).
+ */
+
+struct bench
+{
+	size_t size;
+	int iterations;
+	placement where;
+
+	node_t n0, n1;
+	edge_t fwd, back;
+
+	std::vector<uint64_t> rtts;
+	uint64_t tp_start, tp_end;
+	int tp_count;
+};
+
+static void stamp(char* buf, size_t size, uint32_t seq)
+{
+	if(buf)
+		memcpy(buf, &seq, std::min(sizeof(seq), size));
+}
+
+static uint32_t unstamp(const char* buf, size_t size)
+{
+	uint32_t seq = 0;
+	if(buf)
+		memcpy(&seq, buf, std::min(sizeof(seq), size));
+	return seq;
+}
+
+void* lat_initiator(void* arg)
+{
+	bench* b = (bench*)arg;
+	pin(b->where.cpu0);
+	CheckError(pgm_claim_node1(b->n0));
+	char* out = (char*)pgm_get_edge_buf_p(b->fwd);
+
+	CheckError(pgm_wait(b->n0)); // skip the back-edge
+	for(int i = 0; i < b->iterations && !errors; ++i)
+	{
+		stamp(out, b->size, i);
+		uint64_t start = now_ns();
+		CheckError(pgm_complete(b->n0));
+		CheckError(pgm_wait(b->n0));
+		b->rtts.push_back(now_ns() - start);
+	}
+	CheckError(pgm_terminate(b->n0));
+
+	CheckError(pgm_release_node1(b->n0));
+	pthread_exit(0);
+}
+
+void* lat_responder(void* arg)
+{
+	int ret;
+	bench* b = (bench*)arg;
+	pin(b->where.cpu1);
+	CheckError(pgm_claim_node1(b->n1));
+	char* out = (char*)pgm_get_edge_buf_p(b->back);
+	const char* in = (const char*)pgm_get_edge_buf_c(b->fwd);
+	while((ret = pgm_wait(b->n1)) != PGM_TERMINATE)
+	{
+		CheckError(ret);
+		stamp(out, b->size, unstamp(in, b->size));
+		CheckError(pgm_complete(b->n1));
+	}
+	CheckError(pgm_release_node1(b->n1));
+	pthread_exit(0);
+}
+
+void* tp_source(void* arg)
+{
+	bench* b = (bench*)arg;
+	pin(b->where.cpu0);
+	CheckError(pgm_claim_node1(b->n0));
+	char* out = (char*)pgm_get_edge_buf_p(b->fwd);
+
+	b->tp_start = now_ns();
+	for(int i = 0; i < b->iterations && !errors; ++i)
+	{
+		stamp(out, b->size, i);
+		CheckError(pgm_complete(b->n0));
+	}
+	CheckError(pgm_terminate(b->n0));
+
+	CheckError(pgm_release_node1(b->n0));
+	pthread_exit(0);
+}
+
+void* tp_sink(void* arg)
+{
+	int ret;
+	bench* b = (bench*)arg;
+	pin(b->where.cpu1);
+	CheckError(pgm_claim_node1(b->n1));
+	const char* in = (const char*)pgm_get_edge_buf_c(b->fwd);
+	while((ret = pgm_wait(b->n1)) != PGM_TERMINATE)
+	{
+		CheckError(ret);
+		if(in && b->size >= sizeof(uint32_t) && unstamp(in, b->size) != (uint32_t)b->tp_count)
+		{
+			fprintf(stderr, "Out of order message: %u (expected %d)\n",
+				unstamp(in, b->size), b->tp_count);
+			errors++;
+		}
+		++b->tp_count;
+		CheckError(pgm_complete(b->n1));
+	}
+	b->tp_end = now_ns();
+	CheckError(pgm_release_node1(b->n1));
+	pthread_exit(0);
+}
+
+static int next_port(void)
+{
+	static int offset = 0;
+	return PORT + (offset++ % 1000);
+}
+
+static void make_attr(edge_attr_t& attr, const edge_kind& kind, size_t size)
+{
+	memset(&attr, 0, sizeof(attr));
+	attr.type = kind.type;
+	attr.nr_produce = size;
+	attr.nr_consume = size;
+	attr.nr_threshold = size;
+
+	if(kind.type == pgm_ring_edge)
+		attr.nmemb = std::max<size_t>(2, std::min<size_t>(64, (64ul << 20) / size));
+	else if(kind.type & __PGM_EDGE_MQ)
+		attr.mq_maxmsg = MQ_MAXMSG;
+	else if(kind.type == pgm_sock_stream_edge)
+	{
+		attr.port = next_port();
+		attr.node = "localhost";
+	}
+}
+
+static int run(bench& b, const edge_kind& kind, bool latency)
+{
+	static int nr_graphs = 0;
+	char name[PGM_GRAPH_NAME_LEN];
+	graph_t g;
+	edge_attr_t attr;
+	pthread_t t0, t1;
+
+	snprintf(name, sizeof(name), "edgebench_%d_%d", getpid(), nr_graphs++);
+	CheckError(pgm_init_graph(&g, name));
+	CheckError(pgm_init_node(&b.n0, g, "n0"));
+	CheckError(pgm_init_node(&b.n1, g, "n1"));
+
+	make_attr(attr, kind, b.size);
+	CheckError(pgm_init_edge5(&b.fwd, b.n0, b.n1, "fwd", &attr));
+	if(latency)
+	{
+		make_attr(attr, kind, b.size);
+		CheckError(pgm_init_backedge6(&b.back, 1, b.n1, b.n0, "back", &attr));
+	}
+
+	if(!errors)
+	{
+		b.rtts.clear();
+		b.rtts.reserve(b.iterations);
+		b.tp_count = 0;
+		pthread_create(&t0, 0, (latency) ? lat_initiator : tp_source, &b);
+		pthread_create(&t1, 0, (latency) ? lat_responder : tp_sink, &b);
+		pthread_join(t0, 0);
+		pthread_join(t1, 0);
+	}
+	CheckError(pgm_destroy_graph(g));
+
+	return (errors) ? -1 : 0;
+}
+
+static size_t mq_msgsize_max(void)
+{
+	size_t val = 8192;
+	FILE* f = fopen("/proc/sys/fs/mqueue/msgsize_max", "r");
+	if(f)
+	{
+		if(fscanf(f, "%lu", &val) != 1)
+			val = 8192;
+		fclose(f);
+	}
+	return val;
+}
+
+static size_t pipe_capacity(void)
+{
+	int fds[2];
+	long val = 65536;
+	if(pipe(fds) == 0)
+	{
+		val = fcntl(fds[1], F_GETPIPE_SZ);
+		close(fds[0]);
+		close(fds[1]);
+	}
+	return (val > 0) ? val : 65536;
+}
+
+/* Returns a reason if 'kind' cannot carry messages of 'size' bytes. */
+static const char* unsupported(const edge_kind& kind, size_t size)
+{
+	if((kind.type & __PGM_EDGE_MQ) && size + sizeof(pgm_command_t) > mq_msgsize_max())
+		return "larger than /proc/sys/fs/mqueue/msgsize_max";
+	// the producer of a signaled FIFO edge writes the whole message
+	// before it signals the consumer, so the message must fit in the pipe
+	if(kind.type == pgm_fast_fifo_edge && size + sizeof(pgm_command_t) > pipe_capacity())
+		return "larger than the pipe buffer";
+	return 0;
+}
+
+static double pct(const std::vector<uint64_t>& sorted, double p)
+{
+	size_t i = std::min(sorted.size() - 1, (size_t)(sorted.size() * p / 100.0));
+	return sorted[i] / 2e3;  // one-way, in microseconds
+}
+
+static bool json = false;
+static int nr_records = 0;
+
+static void header(FILE* out)
+{
+	if(json)
+		fprintf(out, "[");
+	else
+		fprintf(out, "type,size,placement,cpu0,cpu1,lat_iterations,lat_min_us,lat_mean_us,"
+			"lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,"
+			"tp_iterations,msgs_per_s,mb_per_s\n");
+}
+
+static void footer(FILE* out)
+{
+	if(json)
+		fprintf(out, "\n]\n");
+}
+
+static void record(FILE* out, const edge_kind& kind, bench& lat, bench& tp)
+{
+	std::vector<uint64_t>& r = lat.rtts;
+	std::sort(r.begin(), r.end());
+	double sum = 0;
+	for(size_t i = 0; i < r.size(); ++i)
+		sum += r[i];
+
+	double secs = (tp.tp_end - tp.tp_start) / 1e9;
+	double msgs = (secs > 0) ? tp.tp_count / secs : 0;
+	size_t size = (kind.type & __PGM_DATA_PASSING) ? lat.size : 0;
+	double mbs = msgs * size / (1024.0*1024.0);
+
+	if(json)
+	{
+		fprintf(out, "%s\n\t{\"type\":\"%s\",\"size\":%lu,\"placement\":\"%s\",\"cpu0\":%d,\"cpu1\":%d,"
+			"\"lat_iterations\":%lu,\"lat_min_us\":%.3f,\"lat_mean_us\":%.3f,"
+			"\"lat_p50_us\":%.3f,\"lat_p90_us\":%.3f,\"lat_p99_us\":%.3f,\"lat_p999_us\":%.3f,"
+			"\"lat_max_us\":%.3f,\"tp_iterations\":%d,\"msgs_per_s\":%.1f,\"mb_per_s\":%.3f}",
+			(nr_records) ? "," : "",
+			kind.name, size, lat.where.name.c_str(), lat.where.cpu0, lat.where.cpu1,
+			r.size(), r.front() / 2e3, sum / r.size() / 2e3,
+			pct(r, 50), pct(r, 90), pct(r, 99), pct(r, 99.9), r.back() / 2e3,
+			tp.tp_count, msgs, mbs);
+	}
+	else
+	{
+		fprintf(out, "%s,%lu,%s,%d,%d,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%.1f,%.3f\n",
+			kind.name, size, lat.where.name.c_str(), lat.where.cpu0, lat.where.cpu1,
+			r.size(), r.front() / 2e3, sum / r.size() / 2e3,
+			pct(r, 50), pct(r, 90), pct(r, 99), pct(r, 99.9), r.back() / 2e3,
+			tp.tp_count, msgs, mbs);
+	}
+	fflush(out);
+	++nr_records;
+}
+
+static size_t parse_size(const char* str)
+{
+	char* end;
+	size_t val = strtoul(str, &end, 10);
+	switch(*end)
+	{
+		case 'k': case 'K': val <<= 10; break;
+		case 'm': case 'M': val <<= 20; break;
+		case 'g': case 'G': val <<= 30; break;
+		default: break;
+	}
+	return val;
+}
+
+static std::vector<std::string> split(const char* str)
+{
+	std::vector<std::string> out;
+	std::string s(str);
+	size_t start = 0, end;
+	while((end = s.find(',', start)) != std::string::npos)
+	{
+		out.push_back(s.substr(start, end - start));
+		start = end + 1;
+	}
+	out.push_back(s.substr(start));
+	return out;
+}
+
+void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t types   comma-separated edge types (default: all of cv,ring,fifo,fast_fifo,\n"
+		"             mq,fast_mq,sock_stream)\n"
+		"  -s sizes   comma-separated message sizes, with optional K/M suffix\n"
+		"             (default: powers of four from 1 to 16M)\n"
+		"  -P places  comma-separated placements: same-core, same-socket, cross-socket\n"
+		"             (default: all the machine supports)\n"
+		"  -n count   maximum messages per measurement (default %d)\n"
+		"  -m count   minimum messages per measurement (default %d)\n"
+		"  -B bytes   bytes to move per measurement; bounds the message count\n"
+		"             of large sizes between -m and -n (default 256M)\n"
+		"  -p port    first TCP port for sock_stream edges (default %d)\n"
+		"  -q count   mq_maxmsg of MQ edges (default %d)\n"
+		"  -j         write JSON instead of CSV\n"
+		"  -o file    write results to 'file' instead of stdout\n",
+		prog, ITERATIONS, MIN_ITERATIONS, PORT, MQ_MAXMSG);
+	exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const edge_kind*> kinds;
+	std::vector<size_t> sizes;
+	std::vector<placement> places;
+	bool placed = false;  // -P given
+	std::vector<std::string> names;
+	FILE* out = stdout;
+	int opt;
+
+	while((opt = getopt(argc, argv, "t:s:P:n:m:B:p:q:jo:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 't':
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+				{
+					size_t k;
+					for(k = 0; k < sizeof(KINDS)/sizeof(KINDS[0]); ++k)
+						if(names[i] == KINDS[k].name)
+							break;
+					if(k == sizeof(KINDS)/sizeof(KINDS[0]))
+						usage(argv[0]);
+					kinds.push_back(&KINDS[k]);
+				}
+				break;
+			case 's':
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+					sizes.push_back(parse_size(names[i].c_str()));
+				break;
+			case 'P':
+				placed = true;
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+				{
+					placement p;
+					if(names[i] != "same-core" && names[i] != "same-socket" &&
+					   names[i] != "cross-socket")
+						usage(argv[0]);
+					if(find_placement(names[i], p))
+						places.push_back(p);
+					else
+						fprintf(stderr, "Skipping %s: not supported by this machine.\n",
+							names[i].c_str());
+				}
+				break;
+			case 'n': ITERATIONS = atoi(optarg); break;
+			case 'm': MIN_ITERATIONS = atoi(optarg); break;
+			case 'B': BUDGET = parse_size(optarg); break;
+			case 'p': PORT = atoi(optarg); break;
+			case 'q': MQ_MAXMSG = atoi(optarg); break;
+			case 'j': json = true; break;
+			case 'o':
+				out = fopen(optarg, "w");
+				if(!out)
+				{
+					perror(optarg);
+					return -1;
+				}
+				break;
+			default: usage(argv[0]);
+		}
+	}
+	if(ITERATIONS <= 0 || MIN_ITERATIONS <= 0 || MIN_ITERATIONS > ITERATIONS ||
+	   BUDGET == 0 || MQ_MAXMSG <= 0 || optind != argc)
+		usage(argv[0]);
+	for(size_t i = 0; i < sizes.size(); ++i)
+		if(sizes[i] == 0)
+			usage(argv[0]);
+
+	if(kinds.empty())
+		for(size_t k = 0; k < sizeof(KINDS)/sizeof(KINDS[0]); ++k)
+			kinds.push_back(&KINDS[k]);
+	if(sizes.empty())
+		for(size_t s = 1; s <= (16ul << 20); s *= 4)
+			sizes.push_back(s);
+	if(placed && places.empty())
+	{
+		fprintf(stderr, "None of the placements given with -P is supported by this machine.\n");
+		return -1;
+	}
+	if(!placed)
+	{
+		const char* all[] = {"same-core", "same-socket", "cross-socket"};
+		for(size_t i = 0; i < sizeof(all)/sizeof(all[0]); ++i)
+		{
+			placement p;
+			if(find_placement(all[i], p))
+				places.push_back(p);
+			else
+				fprintf(stderr, "Skipping %s: not supported by this machine.\n", all[i]);
+		}
+	}
+
+	CheckError(pgm_init2("/tmp/graphs", 1));
+
+	header(out);
+	for(size_t k = 0; k < kinds.size() && !errors; ++k)
+	{
+		const edge_kind& kind = *kinds[k];
+		for(size_t s = 0; s < sizes.size() && !errors; ++s)
+		{
+			// CV edges pass no data, so size does not matter
+			size_t size = (kind.type == pgm_cv_edge) ? 1 : sizes[s];
+			if(kind.type == pgm_cv_edge && s > 0)
+				break;
+
+			const char* why = unsupported(kind, size);
+			if(why)
+			{
+				fprintf(stderr, "Skipping %s/%lu: %s.\n", kind.name, size, why);
+				continue;
+			}
+
+			for(size_t p = 0; p < places.size() && !errors; ++p)
+			{
+				bench lat, tp;
+				lat.size = tp.size = size;
+				lat.where = tp.where = places[p];
+				lat.iterations = tp.iterations = (int)std::max<size_t>(MIN_ITERATIONS,
+					std::min<size_t>(ITERATIONS, BUDGET / size));
+
+				fprintf(stderr, "%s/%lu/%s...\n", kind.name, size, places[p].name.c_str());
+				if(run(lat, kind, true) != 0 || run(tp, kind, false) != 0 || lat.rtts.empty())
+					break;
+				record(out, kind, lat, tp);
+			}
+		}
+	}
+	footer(out);
+
+	if(out != stdout)
+		fclose(out);
+	CheckError(pgm_destroy());
+
+	return (errors) ? -1 : 0;
+}
@@ -0,0 +1,281 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing pgm_try_wait(), pgm_wait_timed(), and
+   readiness descriptors. A single thread services two consumer
+   nodes (one fed by a CV edge, one by a FIFO edge) from an epoll
+   loop. Finally, a message is written to a FIFO edge in pieces, and
+   neither call may block on, or consume, the part that has arrived. */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/epoll.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+int TOTAL_ITERATIONS = 10*1000;
+
+node_t src_cv, src_fifo, sink_cv, sink_fifo;
+edge_t cv_edge, fifo_edge;
+pthread_barrier_t start_barrier;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+void* source(void* _node)
+{
+	node_t node = *(node_t*)_node;
+	CheckError(pgm_claim_node1(node));
+	uint32_t* out = (node.node == src_fifo.node) ?
+		(uint32_t*)pgm_get_edge_buf_p(fifo_edge) : 0;
+
+	pthread_barrier_wait(&start_barrier);
+
+	for(int i = 0; i < TOTAL_ITERATIONS && !errors; ++i)
+	{
+		if(out)
+			*out = i;
+		CheckError(pgm_complete(node));
+		if(i % 1000 == 0)
+			usleep(1000); // let the consumer catch up and sleep
+	}
+	CheckError(pgm_terminate(node));
+	CheckError(pgm_release_node1(node));
+	pthread_exit(0);
+}
+
+// Write to the FIFO edge 'partial' as its producer would: a one-byte
+// tag (0x01 for data, PGM_TERMINATE), then the data.
+static void partial_message(void)
+{
+	graph_t g;
+	node_t w, r;
+	edge_t e;
+	edge_attr_t attr;
+	glob_t paths;
+	struct timespec timeout;
+	uint64_t start;
+	int fd = -1;
+	int ret;
+
+	CheckError(pgm_init_graph(&g, "eventlooptest_partial"));
+	CheckError(pgm_init_node(&w, g, "w"));
+	CheckError(pgm_init_node(&r, g, "r"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_fifo_edge;
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+	CheckError(pgm_init_edge5(&e, w, r, "partial", &attr));
+
+	CheckError(pgm_claim_node1(r));
+	const uint32_t* in = (const uint32_t*)pgm_get_edge_buf_c(e);
+
+	if(glob("/tmp/graphs/*_eventlooptest_partial_w_r_partial.edge", 0, 0, &paths) == 0)
+	{
+		fd = open(paths.gl_pathv[0], O_WRONLY | O_NONBLOCK);
+		globfree(&paths);
+	}
+	CheckError(fd);
+	if(fd >= 0)
+	{
+		uint32_t value = 0x12345678;
+		unsigned char msg[1 + sizeof(value)];
+		msg[0] = 0x01;
+		memcpy(&msg[1], &value, sizeof(value));
+
+		// the tag and half of the data
+		CheckError(write(fd, msg, 3));
+		ret = pgm_try_wait(r);
+		if(ret != -1 || errno != EAGAIN)
+		{
+			fprintf(stderr, "pgm_try_wait() on a partial message: %d\n", ret);
+			errors++;
+		}
+		timeout.tv_sec = 0;
+		timeout.tv_nsec = 20*1000*1000;
+		start = now_ns();
+		ret = pgm_wait_timed(r, &timeout);
+		if(ret != -1 || errno != ETIMEDOUT || now_ns() - start < 20*1000*1000)
+		{
+			fprintf(stderr, "pgm_wait_timed() on a partial message: %d\n", ret);
+			errors++;
+		}
+
+		// the rest, followed by a terminate message
+		CheckError(write(fd, &msg[3], sizeof(msg) - 3));
+		ret = pgm_try_wait(r);
+		CheckError(ret);
+		if(ret == 0 && *in != value)
+		{
+			fprintf(stderr, "Bad partial message: %x\n", *in);
+			errors++;
+		}
+		msg[0] = PGM_TERMINATE;
+		CheckError(write(fd, msg, 1));
+		ret = pgm_try_wait(r);
+		if(ret != PGM_TERMINATE)
+		{
+			fprintf(stderr, "pgm_try_wait() missed the terminate message: %d\n", ret);
+			errors++;
+		}
+		close(fd);
+	}
+
+	CheckError(pgm_release_node1(r));
+	CheckError(pgm_destroy_graph(g));
+}
+
+int main(void)
+{
+	graph_t g;
+	pthread_t t0, t1;
+	edge_attr_t attr;
+	struct timespec timeout;
+	uint64_t start;
+	int ret;
+
+	CheckError(pgm_init2("/tmp/graphs", 1));
+	CheckError(pgm_init_graph(&g, "eventlooptest"));
+
+	CheckError(pgm_init_node(&src_cv, g, "src_cv"));
+	CheckError(pgm_init_node(&src_fifo, g, "src_fifo"));
+	CheckError(pgm_init_node(&sink_cv, g, "sink_cv"));
+	CheckError(pgm_init_node(&sink_fifo, g, "sink_fifo"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_cv_edge;
+	attr.nr_produce = 1;
+	attr.nr_consume = 1;
+	attr.nr_threshold = 1;
+	CheckError(pgm_init_edge5(&cv_edge, src_cv, sink_cv, "cv", &attr));
+
+	attr.type = pgm_fifo_edge;
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+	CheckError(pgm_init_edge5(&fifo_edge, src_fifo, sink_fifo, "fifo", &attr));
+
+	pthread_barrier_init(&start_barrier, 0, 3);
+	pthread_create(&t0, 0, source, &src_cv);
+	pthread_create(&t1, 0, source, &src_fifo);
+
+	// this thread services both sinks
+	CheckError(pgm_claim_node1(sink_cv));
+	CheckError(pgm_claim_node1(sink_fifo));
+	const uint32_t* in = (const uint32_t*)pgm_get_edge_buf_c(fifo_edge);
+
+	// nothing has been produced yet
+	ret = pgm_try_wait(sink_cv);
+	if(ret != -1 || errno != EAGAIN)
+	{
+		fprintf(stderr, "pgm_try_wait() did not fail with EAGAIN: %d\n", ret);
+		errors++;
+	}
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = 20*1000*1000;
+	start = now_ns();
+	ret = pgm_wait_timed(sink_fifo, &timeout);
+	if(ret != -1 || errno != ETIMEDOUT || now_ns() - start < 20*1000*1000)
+	{
+		fprintf(stderr, "pgm_wait_timed() did not time out: %d\n", ret);
+		errors++;
+	}
+
+	int epfd = epoll_create1(0);
+	node_t sinks[2] = {sink_cv, sink_fifo};
+	int count[2] = {0, 0};
+	bool terminated[2] = {false, false};
+	for(int i = 0; i < 2; ++i)
+	{
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		int fd = pgm_get_ready_fd(sinks[i]);
+		CheckError(fd);
+		CheckError(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev));
+	}
+
+	pthread_barrier_wait(&start_barrier);
+
+	int nr_sleeps = 0;
+	while(!errors && !(terminated[0] && terminated[1]))
+	{
+		struct epoll_event evs[2];
+		int nr = epoll_wait(epfd, evs, 2, 5000);
+		if(nr <= 0)
+		{
+			fprintf(stderr, "epoll_wait() returned %d\n", nr);
+			errors++;
+			break;
+		}
+		++nr_sleeps;
+		for(int j = 0; j < nr; ++j)
+		{
+			int i = evs[j].data.u32;
+			if(terminated[i])
+				continue;
+			while((ret = pgm_try_wait(sinks[i])) == 0)
+			{
+				if(i == 1 && *in != (uint32_t)count[i])
+				{
+					fprintf(stderr, "Bad message %d: %u\n", count[i], *in);
+					errors++;
+				}
+				++count[i];
+			}
+			if(ret == PGM_TERMINATE)
+				terminated[i] = true;
+			else if(errno != EAGAIN)
+				CheckError(ret);
+		}
+	}
+	close(epfd);
+
+	CheckError(pgm_release_node1(sink_cv));
+	CheckError(pgm_release_node1(sink_fifo));
+
+	pthread_join(t0, 0);
+	pthread_join(t1, 0);
+
+	CheckError(pgm_destroy_graph(g));
+
+	partial_message();
+
+	CheckError(pgm_destroy());
+
+	if(count[0] != TOTAL_ITERATIONS || count[1] != TOTAL_ITERATIONS)
+	{
+		fprintf(stderr, "Received %d and %d of %d messages\n",
+			count[0], count[1], TOTAL_ITERATIONS);
+		errors++;
+	}
+
+	fprintf(stdout, "%d wakeups. %s\n", nr_sleeps, (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}
@@ -0,0 +1,502 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* Generates synthetic DAGs and measures how the overhead of pgm_wait()
+   and pgm_complete() scales with graph shape. Shapes are chains,
+   fan-out/fan-in, random layered DAGs, and random series-parallel
+   graphs, each with a single source and a single sink. A graph may be
+   written as a pgmrt graph file, or run in memory with zero-work nodes
+   (one thread per node, CV edges). Each run reports:
+     - per-hop overhead: the source-to-source round trip with one
+       release in flight, divided by the number of hops of the longest
+       path (including a back-edge from the sink to the source).
+     - maximum sustainable release rate: sink completions per second
+       with up to 'window' releases in flight.
+   One CSV record is written for every combination of the given sizes. */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+int LAT_ITERATIONS = 2000;
+int TP_ITERATIONS = 20000;
+int WINDOW = 32;
+
+// in-edges a node may have (pgm_init_edge() refuses the last slot)
+static const int MAX_DEGREE = PGM_MAX_IN_DEGREE - 1;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/*
+   Graph descriptions. Node 0 is the source. The sink is the only
+   node without successors.
+ */
+
+struct dag
+{
+	std::string shape;
+	int size;   // chain length, layers, or series-parallel nodes
+	int width;  // fan width or layer width
+	int nr_nodes;
+	std::vector<std::pair<int, int> > edges;
+
+	int degree_in(int n) const
+	{
+		int d = 0;
+		for(size_t i = 0; i < edges.size(); ++i)
+			d += (edges[i].second == n);
+		return d;
+	}
+
+	int degree_out(int n) const
+	{
+		int d = 0;
+		for(size_t i = 0; i < edges.size(); ++i)
+			d += (edges[i].first == n);
+		return d;
+	}
+
+	int max_degree_in(void) const
+	{
+		int d = 0;
+		for(int n = 0; n < nr_nodes; ++n)
+			d = std::max(d, degree_in(n));
+		return d;
+	}
+
+	int sink(void) const
+	{
+		for(int n = nr_nodes - 1; n >= 0; --n)
+			if(degree_out(n) == 0)
+				return n;
+		return -1;
+	}
+};
+
+static void make_chain(dag& d, int length)
+{
+	d.nr_nodes = std::max(length, 2);
+	for(int i = 1; i < d.nr_nodes; ++i)
+		d.edges.push_back(std::make_pair(i - 1, i));
+}
+
+static void make_fan(dag& d, int width)
+{
+	// source -> 'width' workers -> sink
+	d.nr_nodes = width + 2;
+	for(int i = 1; i <= width; ++i)
+	{
+		d.edges.push_back(std::make_pair(0, i));
+		d.edges.push_back(std::make_pair(i, width + 1));
+	}
+}
+
+static void make_layered(dag& d, int layers, int width, double p)
+{
+	// source -> 'layers' layers of 'width' nodes -> sink. Each node is
+	// connected to each node of the next layer with probability 'p',
+	// and every node has at least one predecessor and one successor.
+	d.nr_nodes = layers * width + 2;
+	int sink = d.nr_nodes - 1;
+	for(int i = 0; i < width; ++i)
+	{
+		d.edges.push_back(std::make_pair(0, 1 + i));
+		d.edges.push_back(std::make_pair(1 + (layers - 1) * width + i, sink));
+	}
+	for(int l = 1; l < layers; ++l)
+	{
+		int prev = 1 + (l - 1) * width;
+		int cur = 1 + l * width;
+		std::vector<bool> has_succ(width, false);
+		for(int j = 0; j < width; ++j)
+		{
+			bool has_pred = false;
+			for(int i = 0; i < width; ++i)
+			{
+				if(drand48() < p)
+				{
+					d.edges.push_back(std::make_pair(prev + i, cur + j));
+					has_succ[i] = has_pred = true;
+				}
+			}
+			if(!has_pred)
+			{
+				int i = lrand48() % width;
+				d.edges.push_back(std::make_pair(prev + i, cur + j));
+				has_succ[i] = true;
+			}
+		}
+		for(int i = 0; i < width; ++i)
+			if(!has_succ[i])
+				d.edges.push_back(std::make_pair(prev + i, cur + lrand48() % width));
+	}
+}
+
+static void make_series_parallel(dag& d, int nodes)
+{
+	// Start with source -> sink and repeatedly replace a random edge
+	// (u,v) with u -> x -> v (series), or add u -> x -> v next to it
+	// (parallel). Parallel composition is limited by the degree bounds.
+	d.nr_nodes = 2;
+	d.edges.push_back(std::make_pair(0, 1));
+	while(d.nr_nodes < std::max(nodes, 2))
+	{
+		size_t i = lrand48() % d.edges.size();
+		int u = d.edges[i].first;
+		int v = d.edges[i].second;
+		int x = d.nr_nodes++;
+		bool parallel = (lrand48() & 1) &&
+			d.degree_out(u) < MAX_DEGREE && d.degree_in(v) < MAX_DEGREE;
+		if(!parallel)
+			d.edges.erase(d.edges.begin() + i);
+		d.edges.push_back(std::make_pair(u, x));
+		d.edges.push_back(std::make_pair(x, v));
+	}
+}
+
+static bool make_dag(dag& d, const std::string& shape, int size, int width, double p)
+{
+	d.shape = shape;
+	d.size = size;
+	d.width = width;
+	d.edges.clear();
+	if(shape == "chain")
+		make_chain(d, size);
+	else if(shape == "fan")
+		make_fan(d, width);
+	else if(shape == "layered")
+		make_layered(d, size, width, p);
+	else if(shape == "sp")
+		make_series_parallel(d, size);
+	else
+		return false;
+	return true;
+}
+
+/*
+   pgmrt graph file. The source is released at 'rate' Hz and every
+   node has zero execution time.
+ */
+
+static int write_graph_file(const dag& d, const char* filename, double rate)
+{
+	FILE* out = fopen(filename, "w");
+	if(!out)
+	{
+		perror(filename);
+		return -1;
+	}
+	fprintf(out, "# %s, size %d, width %d: %d nodes, %lu edges\n",
+		d.shape.c_str(), d.size, d.width, d.nr_nodes, d.edges.size());
+	fprintf(out, "graph = ");
+	for(size_t i = 0; i < d.edges.size(); ++i)
+		fprintf(out, "%sn%d:n%d", (i) ? "," : "", d.edges[i].first, d.edges[i].second);
+	fprintf(out, "\nrates = n0:1:%g\nexecution = ", 1000.0 / rate);
+	for(int n = 0; n < d.nr_nodes; ++n)
+		fprintf(out, "%sn%d:0", (n) ? "," : "", n);
+	fprintf(out, "\n");
+	fclose(out);
+	return 0;
+}
+
+/*
+   In-memory runs. The sink feeds the source over a back-edge that
+   the source initially skips 'window' times, which bounds the number
+   of releases in flight.
+ */
+
+struct run_state
+{
+	node_t node;
+	bool is_src;
+	bool is_sink;
+	int iterations;
+
+	std::vector<uint64_t>* rtts;
+	uint64_t* start;
+	uint64_t* end;
+	int* nr_completions;
+};
+
+void* zero_work(void* arg)
+{
+	int ret;
+	run_state* s = (run_state*)arg;
+	CheckError(pgm_claim_node1(s->node));
+
+	if(s->is_src)
+	{
+		uint64_t released = 0;
+		*s->start = now_ns();
+		for(int i = 0; i < s->iterations && !errors; ++i)
+		{
+			CheckError(pgm_wait(s->node));
+			if(s->rtts && i > 0)
+				s->rtts->push_back(now_ns() - released);
+			released = now_ns();
+			CheckError(pgm_complete(s->node));
+		}
+		CheckError(pgm_terminate(s->node));
+	}
+	else
+	{
+		while((ret = pgm_wait(s->node)) != PGM_TERMINATE)
+		{
+			CheckError(ret);
+			CheckError(pgm_complete(s->node));
+			if(s->is_sink)
+			{
+				++*s->nr_completions;
+				*s->end = now_ns();
+			}
+		}
+	}
+
+	CheckError(pgm_release_node1(s->node));
+	pthread_exit(0);
+}
+
+struct result
+{
+	int hops;
+	double hop_p50_us;
+	double hop_p99_us;
+	double releases_per_s;
+};
+
+static int run(const dag& d, int window, int iterations, std::vector<uint64_t>* rtts,
+				int* hops, double* rate)
+{
+	static int nr_graphs = 0;
+	char name[PGM_GRAPH_NAME_LEN];
+	graph_t g;
+	edge_t e;
+	edge_attr_t attr;
+	std::vector<node_t> nodes(d.nr_nodes);
+	int sink = d.sink();
+	uint64_t start = 0, end = 0;
+	int nr_completions = 0;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_cv_edge;
+	attr.nr_produce = 1;
+	attr.nr_consume = 1;
+	attr.nr_threshold = 1;
+
+	snprintf(name, sizeof(name), "graphgen_%d_%d", getpid(), nr_graphs++);
+	CheckError(pgm_init_graph(&g, name));
+	for(int n = 0; n < d.nr_nodes; ++n)
+	{
+		char nname[PGM_NODE_NAME_LEN];
+		snprintf(nname, sizeof(nname), "n%d", n);
+		CheckError(pgm_init_node(&nodes[n], g, nname));
+	}
+	for(size_t i = 0; i < d.edges.size(); ++i)
+	{
+		char ename[PGM_EDGE_NAME_LEN];
+		snprintf(ename, sizeof(ename), "n%d_n%d", d.edges[i].first, d.edges[i].second);
+		CheckError(pgm_init_edge5(&e, nodes[d.edges[i].first], nodes[d.edges[i].second],
+			ename, &attr));
+	}
+	if(errors)
+		return -1;
+
+	*hops = (int)pgm_get_max_depth1(nodes[sink]) + 1;
+	CheckError(pgm_init_backedge6(&e, window, nodes[sink], nodes[0], "back", &attr));
+
+	std::vector<run_state> states(d.nr_nodes);
+	std::vector<pthread_t> threads(d.nr_nodes);
+	for(int n = 0; n < d.nr_nodes && !errors; ++n)
+	{
+		run_state& s = states[n];
+		s.node = nodes[n];
+		s.is_src = (n == 0);
+		s.is_sink = (n == sink);
+		s.iterations = iterations;
+		s.rtts = rtts;
+		s.start = &start;
+		s.end = &end;
+		s.nr_completions = &nr_completions;
+	}
+	if(!errors)
+	{
+		for(int n = 0; n < d.nr_nodes; ++n)
+			pthread_create(&threads[n], 0, zero_work, &states[n]);
+		for(int n = 0; n < d.nr_nodes; ++n)
+			pthread_join(threads[n], 0);
+	}
+	CheckError(pgm_destroy_graph(g));
+
+	if(rate)
+		*rate = (end > start) ? nr_completions / ((end - start) / 1e9) : 0.0;
+	return (errors) ? -1 : 0;
+}
+
+static bool measure(const dag& d, result& r)
+{
+	std::vector<uint64_t> rtts;
+	rtts.reserve(LAT_ITERATIONS);
+	if(run(d, 1, LAT_ITERATIONS + 1, &rtts, &r.hops, 0) != 0 || rtts.empty())
+		return false;
+	if(run(d, WINDOW, TP_ITERATIONS, 0, &r.hops, &r.releases_per_s) != 0)
+		return false;
+
+	std::sort(rtts.begin(), rtts.end());
+	r.hop_p50_us = rtts[rtts.size() / 2] / 1e3 / r.hops;
+	r.hop_p99_us = rtts[std::min(rtts.size() - 1, (size_t)(rtts.size() * 0.99))] / 1e3 / r.hops;
+	return true;
+}
+
+static std::vector<int> parse_list(const char* str)
+{
+	std::vector<int> out;
+	std::string s(str);
+	size_t start = 0, end;
+	do
+	{
+		end = s.find(',', start);
+		out.push_back(atoi(s.substr(start, end - start).c_str()));
+		start = end + 1;
+	} while(end != std::string::npos);
+	return out;
+}
+
+void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t shape   chain, fan, layered, or sp (series-parallel) (default: chain)\n"
+		"  -n sizes   comma-separated chain lengths, numbers of layers, or numbers of\n"
+		"             series-parallel nodes (default: 2,4,8,16,32,64)\n"
+		"  -w widths  comma-separated fan or layer widths, at most %d\n"
+		"             (default: 1,2,4,8,16,%d)\n"
+		"  -p prob    edge probability of layered graphs (default 0.5)\n"
+		"  -s seed    random seed (default 1)\n"
+		"  -i count   releases for the per-hop measurement (default %d)\n"
+		"  -k count   releases for the release-rate measurement (default %d)\n"
+		"  -q count   releases in flight for the release-rate measurement (default %d)\n"
+		"  -o file    write the (single) graph as a pgmrt graph file and exit\n"
+		"  -r hz      source release rate written to the graph file (default 100)\n",
+		prog, MAX_DEGREE, MAX_DEGREE, LAT_ITERATIONS, TP_ITERATIONS, WINDOW);
+	exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+	std::string shape = "chain";
+	std::vector<int> sizes, widths;
+	double p = 0.5;
+	long seed = 1;
+	const char* outfile = 0;
+	double rate = 100.0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "t:n:w:p:s:i:k:q:o:r:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 't': shape = optarg; break;
+			case 'n': sizes = parse_list(optarg); break;
+			case 'w': widths = parse_list(optarg); break;
+			case 'p': p = atof(optarg); break;
+			case 's': seed = atol(optarg); break;
+			case 'i': LAT_ITERATIONS = atoi(optarg); break;
+			case 'k': TP_ITERATIONS = atoi(optarg); break;
+			case 'q': WINDOW = atoi(optarg); break;
+			case 'o': outfile = optarg; break;
+			case 'r': rate = atof(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc || LAT_ITERATIONS <= 0 || TP_ITERATIONS <= 0 || WINDOW <= 0 ||
+	   rate <= 0.0 || p < 0.0 || p > 1.0)
+		usage(argv[0]);
+
+	// only the dimensions a shape uses are swept
+	if(shape == "fan")
+		sizes.assign(1, 0);
+	else if(sizes.empty())
+		for(int n = 2; n <= 64; n *= 2)
+			sizes.push_back(n);
+	if(shape == "chain" || shape == "sp")
+		widths.assign(1, 1);
+	else if(widths.empty())
+	{
+		for(int w = 1; w < MAX_DEGREE; w *= 2)
+			widths.push_back(w);
+		widths.push_back(MAX_DEGREE);
+	}
+	for(size_t i = 0; i < sizes.size(); ++i)
+		if(sizes[i] < 0 || (sizes[i] == 0 && shape != "fan"))
+			usage(argv[0]);
+	for(size_t i = 0; i < widths.size(); ++i)
+		if(widths[i] <= 0 || widths[i] > MAX_DEGREE)
+			usage(argv[0]);
+
+	dag d;
+	if(outfile)
+	{
+		if(sizes.size() != 1 || widths.size() != 1)
+		{
+			fprintf(stderr, "Give a single size and width with -o.\n");
+			return -1;
+		}
+		srand48(seed);
+		if(!make_dag(d, shape, sizes[0], widths[0], p))
+			usage(argv[0]);
+		return write_graph_file(d, outfile, rate);
+	}
+
+	CheckError(pgm_init2("/tmp/graphs", 1));
+
+	fprintf(stdout, "shape,size,width,nodes,edges,max_in_degree,hops,"
+		"hop_p50_us,hop_p99_us,releases_per_s\n");
+	for(size_t i = 0; i < sizes.size() && !errors; ++i)
+	{
+		for(size_t j = 0; j < widths.size() && !errors; ++j)
+		{
+			result r;
+			srand48(seed);
+			if(!make_dag(d, shape, sizes[i], widths[j], p))
+				usage(argv[0]);
+			if(!measure(d, r))
+				break;
+			fprintf(stdout, "%s,%d,%d,%d,%lu,%d,%d,%.3f,%.3f,%.1f\n",
+				shape.c_str(), d.size, d.width, d.nr_nodes, d.edges.size(),
+				d.max_degree_in(), r.hops, r.hop_p50_us, r.hop_p99_us, r.releases_per_s);
+			fflush(stdout);
+		}
+	}
+
+	CheckError(pgm_destroy());
+	return (errors) ? -1 : 0;
+}
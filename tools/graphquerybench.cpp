@@ -0,0 +1,288 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* Measures how graph construction, lookups and analyses scale with the
+   size of a graph, up to PGM_MAX_NODES and PGM_MAX_EDGES. Graphs are
+   layered DAGs, about sqrt(nodes) wide and deep unless a width is
+   given (a width of 1 makes a chain). Every node below the
+   first layer gets one producer in the layer above, and then as many
+   more (up to -d in total) as the edge limit permits. One CSV record
+   is written for every (graph size, API call). */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+// pgm_init_node() and pgm_init_edge() refuse the last slot
+static const int MAX_NODES = PGM_MAX_NODES - 1;
+static const int MAX_EDGES = PGM_MAX_EDGES - 1;
+
+int DEGREE = 2;          // in-edges per node, budget permitting
+int NR_PAIRS = 1000;     // pgm_is_ancestor() queries
+int NR_TARGETS = 4;      // nodes passed to pgm_get_{max,min}_depth3()
+int WIDTH = 0;           // nodes per layer (0: sqrt of the number of nodes)
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+struct layered
+{
+	graph_t g;
+	std::vector<node_t> nodes;
+	std::vector<std::string> node_names;
+	std::vector<edge_t> edges;
+	std::vector<std::string> edge_names;
+	std::vector<std::pair<int, int> > ends;  // (producer, consumer)
+	int width;
+};
+
+static void record(FILE* out, const layered& l, const char* call,
+				uint64_t calls, uint64_t ns)
+{
+	fprintf(out, "%d,%d,%s,%lu,%.3f,%.3f\n",
+		(int)l.nodes.size(), (int)l.edges.size(), call, calls,
+		ns / 1e6, (calls) ? ns / 1e3 / calls : 0.0);
+	fflush(out);
+}
+
+static double unit_weight(edge_t e, void* user)
+{
+	return 1.0;
+}
+
+static int build(layered& l, int nr_nodes, FILE* out)
+{
+	static int nr_graphs = 0;
+	char name[PGM_GRAPH_NAME_LEN];
+	edge_attr_t attr;
+	uint64_t start;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_cv_edge;
+	attr.nr_produce = 1;
+	attr.nr_consume = 1;
+	attr.nr_threshold = 1;
+
+	l.width = (WIDTH) ? std::min(WIDTH, nr_nodes) : std::max(1, (int)sqrt((double)nr_nodes));
+	l.nodes.resize(nr_nodes);
+	l.node_names.resize(nr_nodes);
+	for(int i = 0; i < nr_nodes; ++i)
+	{
+		snprintf(name, sizeof(name), "n%d", i);
+		l.node_names[i] = name;
+	}
+
+	// the edge set: a producer directly above every node, and then
+	// diagonal neighbours while the edge budget lasts
+	l.ends.clear();
+	for(int d = 0; d < DEGREE; ++d)
+		for(int c = l.width; c < nr_nodes && (int)l.ends.size() < MAX_EDGES; ++c)
+		{
+			int layer = c / l.width;
+			int p = (layer - 1)*l.width + (c % l.width + d) % l.width;
+			l.ends.push_back(std::make_pair(p, c));
+		}
+	l.edges.resize(l.ends.size());
+	l.edge_names.resize(l.ends.size());
+	for(size_t i = 0; i < l.ends.size(); ++i)
+	{
+		snprintf(name, sizeof(name), "e%d_%d", l.ends[i].first, l.ends[i].second);
+		l.edge_names[i] = name;
+	}
+
+	snprintf(name, sizeof(name), "graphquerybench_%d_%d", getpid(), nr_graphs++);
+	CheckError(pgm_init_graph(&l.g, name));
+	if(errors)
+		return -1;
+
+	start = now_ns();
+	for(int i = 0; i < nr_nodes && !errors; ++i)
+		CheckError(pgm_init_node(&l.nodes[i], l.g, l.node_names[i].c_str()));
+	record(out, l, "pgm_init_node", nr_nodes, now_ns() - start);
+
+	start = now_ns();
+	for(size_t i = 0; i < l.ends.size() && !errors; ++i)
+		CheckError(pgm_init_edge5(&l.edges[i], l.nodes[l.ends[i].first],
+			l.nodes[l.ends[i].second], l.edge_names[i].c_str(), &attr));
+	record(out, l, "pgm_init_edge", l.ends.size(), now_ns() - start);
+
+	return (errors) ? -1 : 0;
+}
+
+static void query(layered& l, FILE* out)
+{
+	std::vector<node_t> buf(PGM_MAX_OUT_DEGREE + PGM_MAX_IN_DEGREE);
+	int nr_nodes = l.nodes.size();
+	int nr_edges = l.edges.size();
+	uint64_t start;
+
+	// lookups, every node and edge
+	start = now_ns();
+	for(int i = 0; i < nr_nodes && !errors; ++i)
+	{
+		node_t n;
+		CheckError(pgm_find_node(&n, l.g, l.node_names[i].c_str()));
+	}
+	record(out, l, "pgm_find_node", nr_nodes, now_ns() - start);
+
+	start = now_ns();
+	for(int i = 0; i < nr_edges && !errors; ++i)
+	{
+		edge_t e;
+		CheckError(pgm_find_edge4(&e, l.nodes[l.ends[i].first],
+			l.nodes[l.ends[i].second], l.edge_names[i].c_str()));
+	}
+	record(out, l, "pgm_find_edge", nr_edges, now_ns() - start);
+
+	start = now_ns();
+	for(int i = 0; i < nr_nodes && !errors; ++i)
+		CheckError(pgm_get_successors3(l.nodes[i], buf.data(), buf.size(), 1));
+	record(out, l, "pgm_get_successors3", nr_nodes, now_ns() - start);
+
+	start = now_ns();
+	for(int i = 0; i < nr_nodes && !errors; ++i)
+		CheckError(pgm_get_predecessors3(l.nodes[i], buf.data(), buf.size(), 1));
+	record(out, l, "pgm_get_predecessors3", nr_nodes, now_ns() - start);
+
+	// ancestry between pseudo-random pairs; the same pairs every run
+	unsigned int seed = 1;
+	start = now_ns();
+	for(int i = 0; i < NR_PAIRS && !errors; ++i)
+	{
+		int a = rand_r(&seed) % nr_nodes;
+		int b = rand_r(&seed) % nr_nodes;
+		CheckError(pgm_is_ancestor(l.nodes[a], l.nodes[b]));
+	}
+	record(out, l, "pgm_is_ancestor", NR_PAIRS, now_ns() - start);
+
+	// whole-graph analyses
+	start = now_ns();
+	if(pgm_is_dag2(l.g, 1) != 1)
+	{
+		fprintf(stderr, "Graph is not a DAG?\n");
+		errors++;
+	}
+	record(out, l, "pgm_is_dag2", 1, now_ns() - start);
+
+	// depth of nodes spread over the last layer
+	int targets = std::min(NR_TARGETS, std::min(nr_nodes, l.width));
+	start = now_ns();
+	for(int i = 0; i < targets && !errors; ++i)
+		if(pgm_get_max_depth3(l.nodes[nr_nodes - 1 - i], unit_weight, 0) < 0.0)
+			CheckError(-1);
+	record(out, l, "pgm_get_max_depth3", targets, now_ns() - start);
+
+	start = now_ns();
+	for(int i = 0; i < targets && !errors; ++i)
+		if(pgm_get_min_depth3(l.nodes[nr_nodes - 1 - i], unit_weight, 0) < 0.0)
+			CheckError(-1);
+	record(out, l, "pgm_get_min_depth3", targets, now_ns() - start);
+}
+
+static std::vector<std::string> split(const char* str)
+{
+	std::vector<std::string> out;
+	std::string s(str);
+	size_t start = 0, end;
+	do
+	{
+		end = s.find(',', start);
+		out.push_back(s.substr(start, end - start));
+		start = end + 1;
+	} while(end != std::string::npos);
+	return out;
+}
+
+void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n sizes   comma-separated numbers of nodes, at most %d\n"
+		"             (default: powers of 4 from 16, and %d)\n"
+		"  -w width   nodes per layer (default: square root of the number of nodes)\n"
+		"  -d degree  in-edges per node while fewer than %d edges (default %d)\n"
+		"  -a count   pgm_is_ancestor() queries per graph (default %d)\n"
+		"  -t count   target nodes of pgm_get_{max,min}_depth3() (default %d)\n",
+		prog, MAX_NODES, MAX_NODES, MAX_EDGES, DEGREE, NR_PAIRS, NR_TARGETS);
+	exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> sizes;
+	std::vector<std::string> names;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:w:d:a:t:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+					sizes.push_back(atoi(names[i].c_str()));
+				break;
+			case 'w': WIDTH = atoi(optarg); break;
+			case 'd': DEGREE = atoi(optarg); break;
+			case 'a': NR_PAIRS = atoi(optarg); break;
+			case 't': NR_TARGETS = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc || DEGREE <= 0 || DEGREE >= PGM_MAX_IN_DEGREE ||
+	   NR_PAIRS < 0 || NR_TARGETS < 0 || WIDTH < 0)
+		usage(argv[0]);
+
+	if(sizes.empty())
+	{
+		for(int n = 16; n < MAX_NODES; n *= 4)
+			sizes.push_back(n);
+		sizes.push_back(MAX_NODES);
+	}
+	for(size_t i = 0; i < sizes.size(); ++i)
+		if(sizes[i] <= 0 || sizes[i] > MAX_NODES)
+			usage(argv[0]);
+
+	CheckError(pgm_init_process_local());
+
+	fprintf(stdout, "nodes,edges,call,calls,total_ms,per_call_us\n");
+	for(size_t i = 0; i < sizes.size() && !errors; ++i)
+	{
+		layered l;
+		if(build(l, sizes[i], stdout) == 0)
+			query(l, stdout);
+		CheckError(pgm_destroy_graph(l.g));
+	}
+
+	CheckError(pgm_destroy());
+	return (errors) ? -1 : 0;
+}
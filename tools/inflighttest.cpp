@@ -0,0 +1,218 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing nodes with several jobs in flight. In the chain
+   a:b:c, b has up to four jobs in flight and completes them in reverse
+   order. c must still see every value that a sends, in order, and then
+   terminate. */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+#define Expect(cond) \
+do { if(!(cond)) { \
+	errors++; \
+	fprintf(stderr, "Failed: %s @ %s:%d\n", #cond, __FILE__, __LINE__); \
+}}while(0)
+
+// not a multiple of NR_INFLIGHT, so b is signaled to terminate with
+// jobs in flight
+int TOTAL_ITERATIONS = 10*1000 + 1;
+const int NR_INFLIGHT = 4;
+
+node_t a, b, c;
+edge_t ab, bc;
+pthread_barrier_t init_barrier;
+
+void* thread_a(void*)
+{
+	CheckError(pgm_claim_node1(a));
+	pthread_barrier_wait(&init_barrier);
+
+	uint32_t* out = (uint32_t*)pgm_get_edge_buf_p(ab);
+	for(int i = 0; i < TOTAL_ITERATIONS && !errors; ++i)
+	{
+		*out = i;
+		CheckError(pgm_complete(a));
+	}
+	CheckError(pgm_terminate(a));
+
+	pthread_barrier_wait(&init_barrier);
+	CheckError(pgm_release_node1(a));
+	return 0;
+}
+
+void* thread_b(void*)
+{
+	pgm_inv_t inv[NR_INFLIGHT], extra;
+	bool terminated = false;
+	int ret;
+
+	CheckError(pgm_claim_node1(b));
+	pthread_barrier_wait(&init_barrier);
+
+	Expect(pgm_wait(b) == -1);
+
+	while(!terminated && !errors)
+	{
+		int nr = 0;
+		while(nr < NR_INFLIGHT)
+		{
+			ret = pgm_wait_inv(b, &inv[nr]);
+			if(ret == PGM_TERMINATE)
+			{
+				terminated = true;
+				break;
+			}
+			CheckError(ret);
+
+			uint32_t* in = (uint32_t*)pgm_get_inv_buf_c(ab, inv[nr]);
+			uint32_t* out = (uint32_t*)pgm_get_inv_buf_p(bc, inv[nr]);
+			Expect(in && out);
+			if(in && out)
+				*out = *in * 3;
+			++nr;
+		}
+		if(nr == NR_INFLIGHT)
+			Expect(pgm_try_wait_inv(b, &extra) == -1 && errno == EBUSY);
+
+		// outputs must still leave in order
+		for(int i = nr - 1; i >= 0; --i)
+			CheckError(pgm_complete_inv(b, inv[i]));
+	}
+	Expect(pgm_wait_inv(b, &extra) == PGM_TERMINATE);
+
+	pthread_barrier_wait(&init_barrier);
+	CheckError(pgm_release_node1(b));
+	return 0;
+}
+
+void* thread_c(void*)
+{
+	uint32_t expected = 0;
+	int ret;
+
+	CheckError(pgm_claim_node1(c));
+	pthread_barrier_wait(&init_barrier);
+
+	uint32_t* in = (uint32_t*)pgm_get_edge_buf_c(bc);
+	while((ret = pgm_wait(c)) == 0)
+	{
+		if(*in != expected * 3)
+		{
+			fprintf(stderr, "Bad value: %u, expected %u\n", *in, expected * 3);
+			errors++;
+			break;
+		}
+		++expected;
+		CheckError(pgm_complete(c));
+	}
+	Expect(ret == PGM_TERMINATE);
+	Expect(expected == (uint32_t)TOTAL_ITERATIONS);
+
+	pthread_barrier_wait(&init_barrier);
+	CheckError(pgm_release_node1(c));
+	return 0;
+}
+
+// a node with several jobs in flight may not get a coalesced out-edge:
+// its jobs would share the staging buffer.
+void coalesced_edge(void)
+{
+	graph_t g;
+	node_t x, y, z;
+	edge_t xy, yz;
+	edge_attr_t attr, tcp_attr;
+
+	CheckError(pgm_init_graph(&g, "inflighttest_coalesced"));
+
+	CheckError(pgm_init_node(&x, g, "x"));
+	CheckError(pgm_init_node(&y, g, "y"));
+	CheckError(pgm_init_node(&z, g, "z"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_ring_edge;
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+	attr.nmemb = 64;
+	CheckError(pgm_init_edge5(&xy, x, y, "x_y", &attr));
+
+	CheckError(pgm_set_concurrency(y, NR_INFLIGHT));
+
+	memset(&tcp_attr, 0, sizeof(tcp_attr));
+	tcp_attr.type = pgm_sock_stream_edge;
+	tcp_attr.nr_produce = sizeof(uint32_t);
+	tcp_attr.nr_consume = sizeof(uint32_t);
+	tcp_attr.nr_threshold = sizeof(uint32_t);
+	tcp_attr.port = 10104;
+	tcp_attr.node = "localhost";
+	tcp_attr.coalesce_us = 100;
+	Expect(pgm_init_edge5(&yz, y, z, "y_z", &tcp_attr) == -1);
+
+	CheckError(pgm_destroy_graph(g));
+}
+
+int main(void)
+{
+	graph_t g;
+	edge_attr_t attr;
+	pthread_t t0, t1, t2;
+
+	CheckError(pgm_init_process_local());
+	CheckError(pgm_init_graph(&g, "inflighttest"));
+
+	CheckError(pgm_init_node(&a, g, "a"));
+	CheckError(pgm_init_node(&b, g, "b"));
+	CheckError(pgm_init_node(&c, g, "c"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_ring_edge;
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+	attr.nmemb = 64;
+	CheckError(pgm_init_edge5(&ab, a, b, "a_b", &attr));
+	CheckError(pgm_init_edge5(&bc, b, c, "b_c", &attr));
+
+	Expect(pgm_set_concurrency(a, NR_INFLIGHT) == -1);  // a source
+	CheckError(pgm_set_concurrency(b, NR_INFLIGHT));
+	Expect(pgm_set_replicas(b, 2, PGM_REPLICA_DYNAMIC) == -1);
+
+	pthread_barrier_init(&init_barrier, 0, 3);
+	pthread_create(&t0, 0, thread_a, 0);
+	pthread_create(&t1, 0, thread_b, 0);
+	pthread_create(&t2, 0, thread_c, 0);
+
+	pthread_join(t0, 0);
+	pthread_join(t1, 0);
+	pthread_join(t2, 0);
+
+	CheckError(pgm_destroy_graph(g));
+
+	coalesced_edge();
+
+	CheckError(pgm_destroy());
+
+	fprintf(stdout, "%s\n", (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}
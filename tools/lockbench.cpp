@@ -0,0 +1,301 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* Measures the node lock types (see pgm_set_graph_lock_type()) under
+   contention. Many producers complete as fast as they can into one
+   consumer over CV edges, so every pgm_complete() takes the consumer's
+   lock to check for and deliver a wakeup. Each producer is held back
+   by a back-edge from the consumer that it skips 'window' times, so
+   the consumer repeatedly sleeps and is woken. One CSV record is
+   written for every (lock type, number of producers). */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+int ITERATIONS = 20000;  // per producer
+int WINDOW = 4;
+bool PIN = false;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+struct lock_kind
+{
+	const char* name;
+	pgm_lock_type_t type;
+};
+
+static const lock_kind KINDS[] =
+{
+	{"pthread", PGM_LOCK_PTHREAD},
+	{"ticket", PGM_LOCK_TICKET},
+	{"mcs", PGM_LOCK_MCS},
+};
+
+struct worker
+{
+	node_t node;
+	int cpu;
+	bool is_consumer;
+	uint64_t complete_ns;  // time spent in pgm_complete()
+	uint64_t nr_completions;
+};
+
+static void pin(int cpu)
+{
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu, &cpu_set);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+	{
+		fprintf(stderr, "Could not pin thread to CPU %d\n", cpu);
+		errors++;
+	}
+}
+
+void* work(void* arg)
+{
+	int ret;
+	worker* w = (worker*)arg;
+	if(PIN)
+		pin(w->cpu);
+	CheckError(pgm_claim_node1(w->node));
+
+	if(!w->is_consumer)
+	{
+		for(int i = 0; i < ITERATIONS && !errors; ++i)
+		{
+			CheckError(pgm_wait(w->node));
+			uint64_t start = now_ns();
+			CheckError(pgm_complete(w->node));
+			w->complete_ns += now_ns() - start;
+			++w->nr_completions;
+		}
+		CheckError(pgm_terminate(w->node));
+	}
+	else
+	{
+		while((ret = pgm_wait(w->node)) != PGM_TERMINATE)
+		{
+			CheckError(ret);
+			CheckError(pgm_complete(w->node));
+			++w->nr_completions;
+		}
+	}
+
+	CheckError(pgm_release_node1(w->node));
+	pthread_exit(0);
+}
+
+static int run(const lock_kind& kind, int nr_producers, FILE* out)
+{
+	static int nr_graphs = 0;
+	char name[PGM_GRAPH_NAME_LEN];
+	graph_t g;
+	edge_t e;
+	node_t consumer;
+	edge_attr_t attr;
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	std::vector<worker> workers(nr_producers + 1);
+	std::vector<pthread_t> threads(nr_producers + 1);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_cv_edge;
+	attr.nr_produce = 1;
+	attr.nr_consume = 1;
+	attr.nr_threshold = 1;
+
+	snprintf(name, sizeof(name), "lockbench_%d_%d", getpid(), nr_graphs++);
+	CheckError(pgm_init_graph(&g, name));
+	if(pgm_set_graph_lock_type(g, kind.type) != 0)
+	{
+		// e.g., MCS locks in a build with PGM_SYNC_SCOPE=1
+		fprintf(stderr, "Skipping %s: not supported by this build.\n", kind.name);
+		CheckError(pgm_destroy_graph(g));
+		return 0;
+	}
+	CheckError(pgm_init_node(&consumer, g, "consumer"));
+	for(int i = 0; i < nr_producers; ++i)
+	{
+		char nname[PGM_NODE_NAME_LEN];
+		char ename[PGM_EDGE_NAME_LEN];
+		worker& w = workers[i + 1];
+		snprintf(nname, sizeof(nname), "p%d", i);
+		CheckError(pgm_init_node(&w.node, g, nname));
+		snprintf(ename, sizeof(ename), "p%d_c", i);
+		CheckError(pgm_init_edge5(&e, w.node, consumer, ename, &attr));
+		snprintf(ename, sizeof(ename), "c_p%d", i);
+		CheckError(pgm_init_backedge6(&e, WINDOW, consumer, w.node, ename, &attr));
+	}
+	if(errors)
+		return -1;
+
+	if(pgm_get_node_lock_type(consumer) != kind.type)
+	{
+		fprintf(stderr, "Lock type was not applied.\n");
+		errors++;
+		return -1;
+	}
+
+	for(int i = 0; i <= nr_producers; ++i)
+	{
+		worker& w = workers[i];
+		if(i == 0)
+			w.node = consumer;
+		w.cpu = i % ncpus;
+		w.is_consumer = (i == 0);
+		w.complete_ns = 0;
+		w.nr_completions = 0;
+	}
+
+	uint64_t start = now_ns();
+	for(int i = 0; i <= nr_producers; ++i)
+		pthread_create(&threads[i], 0, work, &workers[i]);
+	for(int i = 0; i <= nr_producers; ++i)
+		pthread_join(threads[i], 0);
+	uint64_t elapsed = now_ns() - start;
+	CheckError(pgm_destroy_graph(g));
+	if(errors)
+		return -1;
+
+	uint64_t produced = 0, complete_ns = 0;
+	for(int i = 1; i <= nr_producers; ++i)
+	{
+		produced += workers[i].nr_completions;
+		complete_ns += workers[i].complete_ns;
+	}
+
+	fprintf(out, "%s,%d,%d,%.3f,%.1f,%.1f,%.3f\n",
+		kind.name, nr_producers, WINDOW,
+		elapsed / 1e9,
+		produced / (elapsed / 1e9),
+		workers[0].nr_completions / (elapsed / 1e9),
+		(produced) ? complete_ns / 1e3 / produced : 0.0);
+	fflush(out);
+	return 0;
+}
+
+static std::vector<std::string> split(const char* str)
+{
+	std::vector<std::string> out;
+	std::string s(str);
+	size_t start = 0, end;
+	do
+	{
+		end = s.find(',', start);
+		out.push_back(s.substr(start, end - start));
+		start = end + 1;
+	} while(end != std::string::npos);
+	return out;
+}
+
+void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -l locks   comma-separated lock types: pthread, ticket, mcs\n"
+		"             (default: all)\n"
+		"  -p counts  comma-separated numbers of producers, at most %d\n"
+		"             (default: powers of two up to twice the number of CPUs)\n"
+		"  -n count   completions per producer (default %d)\n"
+		"  -q count   completions a producer may run ahead of the consumer (default %d)\n"
+		"  -c         pin thread i to CPU (i mod #CPUs); the consumer is thread 0\n",
+		prog, PGM_MAX_IN_DEGREE - 1, ITERATIONS, WINDOW);
+	exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const lock_kind*> kinds;
+	std::vector<int> counts;
+	std::vector<std::string> names;
+	int opt;
+
+	while((opt = getopt(argc, argv, "l:p:n:q:ch")) != -1)
+	{
+		switch(opt)
+		{
+			case 'l':
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+				{
+					size_t k;
+					for(k = 0; k < sizeof(KINDS)/sizeof(KINDS[0]); ++k)
+						if(names[i] == KINDS[k].name)
+							break;
+					if(k == sizeof(KINDS)/sizeof(KINDS[0]))
+						usage(argv[0]);
+					kinds.push_back(&KINDS[k]);
+				}
+				break;
+			case 'p':
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+					counts.push_back(atoi(names[i].c_str()));
+				break;
+			case 'n': ITERATIONS = atoi(optarg); break;
+			case 'q': WINDOW = atoi(optarg); break;
+			case 'c': PIN = true; break;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc || ITERATIONS <= 0 || WINDOW <= 0)
+		usage(argv[0]);
+
+	// the consumer has an in-edge and an out-edge per producer
+	int max_producers = PGM_MAX_IN_DEGREE - 1;
+	if(kinds.empty())
+		for(size_t k = 0; k < sizeof(KINDS)/sizeof(KINDS[0]); ++k)
+			kinds.push_back(&KINDS[k]);
+	if(counts.empty())
+	{
+		int limit = std::min(max_producers, 2 * (int)sysconf(_SC_NPROCESSORS_ONLN));
+		for(int p = 1; p < limit; p *= 2)
+			counts.push_back(p);
+		counts.push_back(limit);
+	}
+	for(size_t i = 0; i < counts.size(); ++i)
+		if(counts[i] <= 0 || counts[i] > max_producers)
+			usage(argv[0]);
+
+	CheckError(pgm_init_process_local());
+
+	fprintf(stdout, "lock,producers,window,seconds,completions_per_s,"
+		"consumer_jobs_per_s,complete_us\n");
+	for(size_t k = 0; k < kinds.size() && !errors; ++k)
+		for(size_t i = 0; i < counts.size() && !errors; ++i)
+			run(*kinds[k], counts[i], stdout);
+
+	CheckError(pgm_destroy());
+	return (errors) ? -1 : 0;
+}
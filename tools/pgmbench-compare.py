@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014, Glenn Elliott
+# All rights reserved.
+
+"""Compare two pgmbench result files.
+
+Every pgmbench result is in ns/op, so lower is better. A benchmark is
+flagged as a regression if its median grew by more than the threshold
+(in percent) relative to the baseline. Exits with status 1 if any
+benchmark regressed, and 2 if the files could not be compared.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        doc = json.load(f)
+    return dict((r['name'], r) for r in doc['results'])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('baseline', help='stored pgmbench JSON results')
+    parser.add_argument('current', help='new pgmbench JSON results')
+    parser.add_argument('-t', '--threshold', type=float, default=10.0,
+                        help='percent slowdown of the median that counts as '
+                             'a regression (default: 10)')
+    args = parser.parse_args()
+
+    try:
+        base = load(args.baseline)
+        cur = load(args.current)
+    except (IOError, ValueError, KeyError) as e:
+        sys.stderr.write('Could not read results: %s\n' % e)
+        return 2
+
+    regressions = 0
+    print('%-14s %14s %14s %9s  %s' %
+          ('BENCHMARK', 'BASELINE', 'CURRENT', 'CHANGE', 'STATUS'))
+    for name in sorted(set(base) | set(cur)):
+        if name not in base or name not in cur:
+            print('%-14s %14s %14s %9s  %s' %
+                  (name, '-' if name not in base else '%.1f' % base[name]['median'],
+                   '-' if name not in cur else '%.1f' % cur[name]['median'],
+                   '', 'new' if name not in base else 'missing'))
+            continue
+
+        b = base[name]['median']
+        c = cur[name]['median']
+        change = (c - b) / b * 100.0 if b > 0 else 0.0
+        if change > args.threshold:
+            status = 'REGRESSION'
+            regressions += 1
+        elif change < -args.threshold:
+            status = 'improved'
+        else:
+            status = 'ok'
+        print('%-14s %14.1f %14.1f %+8.1f%%  %s' % (name, b, c, change, status))
+
+    if regressions:
+        print('%d benchmark(s) regressed by more than %.1f%%.' %
+              (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,556 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A fixed set of microbenchmarks of the token-passing hot paths
+   (pgm_wait()/pgm_complete()) and graph queries, meant to catch
+   performance regressions. Every benchmark reports nanoseconds per
+   operation (lower is better). Each is run a number of times after
+   warming up, and the per-run samples and their summary statistics
+   are written as JSON. Compare two result files with
+   tools/pgmbench-compare.py, or run 'make bench'. */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+bool PIN = true;
+double SCALE = 1.0;  // multiplies the iterations of every benchmark
+
+static const char* GRAPH_DIR = "/tmp/graphs";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static void pin(int cpu)
+{
+	if(!PIN)
+		return;
+
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &cpu_set);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+	{
+		fprintf(stderr, "Could not pin thread to CPU %d\n", cpu);
+		errors++;
+	}
+}
+
+static void init_attr(edge_attr_t& attr, pgm_edge_type_t type, size_t size)
+{
+	memset(&attr, 0, sizeof(attr));
+	attr.type = type;
+	attr.nr_produce = size;
+	attr.nr_consume = size;
+	attr.nr_threshold = size;
+}
+
+static std::string graph_name(const char* bench)
+{
+	static int nr_graphs = 0;
+	char name[PGM_GRAPH_NAME_LEN];
+	snprintf(name, sizeof(name), "pgmbench_%s_%d_%d", bench, getpid(), nr_graphs++);
+	return std::string(name);
+}
+
+/* Token-passing benchmarks: every node of a graph is run by its own
+   thread. Sources complete 'iterations' times (after waiting on their
+   back-edges, if they have any) and then terminate. Everybody else
+   runs until terminated. */
+
+struct stage
+{
+	node_t node;
+	int cpu;
+	int iterations;
+	int drain;  // back-edge tokens to collect before terminating
+};
+
+void* stage_work(void* arg)
+{
+	int ret;
+	stage* s = (stage*)arg;
+	pin(s->cpu);
+	CheckError(pgm_claim_node1(s->node));
+
+	if(s->iterations > 0)
+	{
+		bool has_inputs = (pgm_get_degree_in2(s->node, 0) > 0);
+		for(int i = 0; i < s->iterations && !errors; ++i)
+		{
+			if(has_inputs)
+				CheckError(pgm_wait(s->node));
+			CheckError(pgm_complete(s->node));
+		}
+		for(int i = 0; i < s->drain && !errors; ++i)
+			CheckError(pgm_wait(s->node));
+		CheckError(pgm_terminate(s->node));
+	}
+	else
+	{
+		while((ret = pgm_wait(s->node)) != PGM_TERMINATE)
+		{
+			CheckError(ret);
+			CheckError(pgm_complete(s->node));
+		}
+	}
+
+	CheckError(pgm_release_node1(s->node));
+	pthread_exit(0);
+}
+
+// Return: nanoseconds from starting the first thread to joining the last.
+static uint64_t run_stages(std::vector<stage>& stages)
+{
+	std::vector<pthread_t> threads(stages.size());
+	for(size_t i = 0; i < stages.size(); ++i)
+	{
+		stages[i].cpu = i;
+		stages[i].drain = 0;
+	}
+
+	uint64_t start = now_ns();
+	for(size_t i = 0; i < stages.size(); ++i)
+		pthread_create(&threads[i], 0, stage_work, &stages[i]);
+	for(size_t i = 0; i < stages.size(); ++i)
+		pthread_join(threads[i], 0);
+	return now_ns() - start;
+}
+
+// Single producer, single consumer over a ring buffer. ns per token.
+static double bench_ring_spsc(int iterations)
+{
+	graph_t g;
+	edge_t e;
+	edge_attr_t attr;
+	std::vector<stage> stages(2);
+
+	init_attr(attr, pgm_ring_edge, sizeof(uint64_t));
+	attr.nmemb = 64;
+
+	CheckError(pgm_init_graph(&g, graph_name("ring").c_str()));
+	CheckError(pgm_init_node(&stages[0].node, g, "src"));
+	CheckError(pgm_init_node(&stages[1].node, g, "sink"));
+	CheckError(pgm_init_edge5(&e, stages[0].node, stages[1].node, "e", &attr));
+	stages[0].iterations = iterations;
+	stages[1].iterations = 0;
+
+	uint64_t elapsed = (errors) ? 0 : run_stages(stages);
+	CheckError(pgm_destroy_graph(g));
+	return (errors) ? -1.0 : (double)elapsed / iterations;
+}
+
+// A chain of CV edges closed by a back-edge that lets one token
+// circulate at a time. ns per trip around the loop.
+static double bench_cv_chain(int iterations)
+{
+	const int LENGTH = 4;
+	graph_t g;
+	edge_t e;
+	edge_attr_t attr;
+	std::vector<stage> stages(LENGTH);
+
+	init_attr(attr, pgm_cv_edge, 1);
+
+	CheckError(pgm_init_graph(&g, graph_name("chain").c_str()));
+	for(int i = 0; i < LENGTH; ++i)
+	{
+		char name[PGM_NODE_NAME_LEN];
+		snprintf(name, sizeof(name), "n%d", i);
+		CheckError(pgm_init_node(&stages[i].node, g, name));
+		stages[i].iterations = (i == 0) ? iterations : 0;
+	}
+	for(int i = 1; i < LENGTH; ++i)
+	{
+		char name[PGM_EDGE_NAME_LEN];
+		snprintf(name, sizeof(name), "e%d", i);
+		CheckError(pgm_init_edge5(&e, stages[i-1].node, stages[i].node, name, &attr));
+	}
+	CheckError(pgm_init_backedge6(&e, 1, stages[LENGTH-1].node, stages[0].node, "back", &attr));
+
+	uint64_t elapsed = (errors) ? 0 : run_stages(stages);
+	CheckError(pgm_destroy_graph(g));
+	return (errors) ? -1.0 : (double)elapsed / iterations;
+}
+
+// Several producers joined by one consumer over CV edges. Each
+// producer may run a few tokens ahead of the consumer. ns per join.
+static double bench_fan_in_join(int iterations)
+{
+	const int WIDTH = 4;
+	const int WINDOW = 4;
+	graph_t g;
+	edge_t e;
+	edge_attr_t attr;
+	std::vector<stage> stages(WIDTH + 1);
+
+	init_attr(attr, pgm_cv_edge, 1);
+
+	CheckError(pgm_init_graph(&g, graph_name("join").c_str()));
+	CheckError(pgm_init_node(&stages[0].node, g, "join"));
+	stages[0].iterations = 0;
+	for(int i = 1; i <= WIDTH; ++i)
+	{
+		char name[PGM_NODE_NAME_LEN];
+		snprintf(name, sizeof(name), "p%d", i);
+		CheckError(pgm_init_node(&stages[i].node, g, name));
+		stages[i].iterations = iterations;
+
+		snprintf(name, sizeof(name), "p%d_join", i);
+		CheckError(pgm_init_edge5(&e, stages[i].node, stages[0].node, name, &attr));
+		snprintf(name, sizeof(name), "join_p%d", i);
+		CheckError(pgm_init_backedge6(&e, WINDOW, stages[0].node, stages[i].node, name, &attr));
+	}
+
+	uint64_t elapsed = (errors) ? 0 : run_stages(stages);
+	CheckError(pgm_destroy_graph(g));
+	return (errors) ? -1.0 : (double)elapsed / iterations;
+}
+
+// Ping-pong over a pair of FIFO edges between two processes.
+// ns per round trip.
+static double bench_fifo_xproc(int iterations)
+{
+	int status;
+	graph_t g;
+	node_t ping, pong;
+	edge_t e;
+	edge_attr_t attr;
+	stage s;
+	pid_t child;
+	uint64_t elapsed = 0;
+
+	init_attr(attr, pgm_fifo_edge, sizeof(uint64_t));
+
+	CheckError(pgm_init_graph(&g, graph_name("fifo").c_str()));
+	CheckError(pgm_init_node(&ping, g, "ping"));
+	CheckError(pgm_init_node(&pong, g, "pong"));
+	CheckError(pgm_init_edge5(&e, ping, pong, "fwd", &attr));
+	CheckError(pgm_init_backedge6(&e, 1, pong, ping, "back", &attr));
+	if(errors)
+		goto out;
+
+	// FIFO edges carry all of their state in the kernel, so the child
+	// can claim its node in its copy of the graph.
+	fflush(stdout);
+	fflush(stderr);
+	child = fork();
+	if(child == 0)
+	{
+		s.node = pong;
+		s.cpu = 1;
+		s.iterations = 0;
+		s.drain = 0;
+		pthread_t t;
+		pthread_create(&t, 0, stage_work, &s);
+		pthread_join(t, 0);
+		_exit((errors) ? 1 : 0);
+	}
+	else if(child < 0)
+	{
+		CheckError(-1);
+		goto out;
+	}
+
+	{
+		// the last reply must be read before the FIFO is closed, or
+		// pong's write fails with EPIPE
+		s.node = ping;
+		s.cpu = 0;
+		s.iterations = iterations;
+		s.drain = 1;
+		pthread_t t;
+		uint64_t start = now_ns();
+		pthread_create(&t, 0, stage_work, &s);
+		pthread_join(t, 0);
+		elapsed = now_ns() - start;
+	}
+
+	if(waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "FIFO peer process failed.\n");
+		errors++;
+	}
+
+out:
+	CheckError(pgm_destroy_graph(g));
+	return (errors) ? -1.0 : (double)elapsed / iterations;
+}
+
+// Name lookups and ancestor queries on a layered graph of 1024 nodes
+// (32 layers of 32; every node has two producers in the layer above).
+// ns per query.
+static double bench_graph_query(int iterations)
+{
+	const int LAYERS = 32;
+	const int WIDTH = 32;
+	graph_t g;
+	edge_t e;
+	edge_attr_t attr;
+	std::vector<node_t> nodes(LAYERS * WIDTH);
+	std::vector<std::string> names(nodes.size());
+	uint64_t elapsed = 0;
+	int nr_queries = 0;
+
+	init_attr(attr, pgm_cv_edge, 1);
+
+	CheckError(pgm_init_graph(&g, graph_name("query").c_str()));
+	for(size_t i = 0; i < nodes.size() && !errors; ++i)
+	{
+		char name[PGM_NODE_NAME_LEN];
+		snprintf(name, sizeof(name), "n%lu", i);
+		names[i] = name;
+		CheckError(pgm_init_node(&nodes[i], g, name));
+	}
+	for(int l = 1; l < LAYERS && !errors; ++l)
+	{
+		for(int w = 0; w < WIDTH; ++w)
+		{
+			int c = l*WIDTH + w;
+			int p0 = (l-1)*WIDTH + w;
+			int p1 = (l-1)*WIDTH + (w + 1) % WIDTH;
+			char name[PGM_EDGE_NAME_LEN];
+			snprintf(name, sizeof(name), "e%d_%d", p0, c);
+			CheckError(pgm_init_edge5(&e, nodes[p0], nodes[c], name, &attr));
+			snprintf(name, sizeof(name), "e%d_%d", p1, c);
+			CheckError(pgm_init_edge5(&e, nodes[p1], nodes[c], name, &attr));
+		}
+	}
+
+	// queries are spread over the graph with a fixed seed so that
+	// every run does the same work
+	unsigned int seed = 1;
+	for(int i = 0; i < iterations && !errors; ++i)
+	{
+		node_t found;
+		int a = rand_r(&seed) % nodes.size();
+		int b = rand_r(&seed) % nodes.size();
+
+		uint64_t start = now_ns();
+		CheckError(pgm_find_node(&found, g, names[a].c_str()));
+		CheckError(pgm_is_ancestor(nodes[b], nodes[a]));
+		elapsed += now_ns() - start;
+		nr_queries += 2;
+	}
+
+	CheckError(pgm_destroy_graph(g));
+	return (errors) ? -1.0 : (double)elapsed / nr_queries;
+}
+
+typedef double (*bench_fn)(int iterations);
+
+struct bench_case
+{
+	const char* name;
+	const char* description;
+	bench_fn fn;
+	int iterations;
+};
+
+static const bench_case CASES[] =
+{
+	{"ring_spsc", "ns per token, ring edge, one producer and one consumer",
+		bench_ring_spsc, 200000},
+	{"cv_chain", "ns per round trip of a 4-node CV chain closed by a back-edge",
+		bench_cv_chain, 20000},
+	{"fan_in_join", "ns per join of 4 producers over CV edges",
+		bench_fan_in_join, 20000},
+	{"fifo_xproc", "ns per round trip over FIFO edges between two processes",
+		bench_fifo_xproc, 20000},
+	{"graph_query", "ns per pgm_find_node()/pgm_is_ancestor() on 1024 nodes",
+		bench_graph_query, 2000},
+};
+static const size_t NR_CASES = sizeof(CASES)/sizeof(CASES[0]);
+
+struct summary
+{
+	double median, mean, stddev, min, max;
+};
+
+static summary summarize(std::vector<double> samples)
+{
+	summary s;
+	size_t n = samples.size();
+	std::sort(samples.begin(), samples.end());
+
+	s.min = samples.front();
+	s.max = samples.back();
+	s.median = (n % 2) ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+
+	s.mean = 0.0;
+	for(size_t i = 0; i < n; ++i)
+		s.mean += samples[i];
+	s.mean /= n;
+
+	s.stddev = 0.0;
+	for(size_t i = 0; i < n; ++i)
+		s.stddev += (samples[i] - s.mean) * (samples[i] - s.mean);
+	s.stddev = (n > 1) ? sqrt(s.stddev / (n - 1)) : 0.0;
+
+	return s;
+}
+
+static std::vector<std::string> split(const char* str)
+{
+	std::vector<std::string> out;
+	std::string s(str);
+	size_t start = 0, end;
+	do
+	{
+		end = s.find(',', start);
+		out.push_back(s.substr(start, end - start));
+		start = end + 1;
+	} while(end != std::string::npos);
+	return out;
+}
+
+void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -b names   comma-separated benchmarks to run (default: all)\n"
+		"  -r count   measured runs of each benchmark (default 5)\n"
+		"  -w count   discarded warm-up runs of each benchmark (default 1)\n"
+		"  -s factor  scale the iterations of every benchmark (default 1.0)\n"
+		"  -u         do not pin threads to CPUs\n"
+		"  -o file    write JSON results to 'file' (default: stdout)\n"
+		"  -l         list the benchmarks and exit\n",
+		prog);
+	exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const bench_case*> cases;
+	std::vector<std::string> names;
+	int runs = 5;
+	int warmups = 1;
+	const char* outfile = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "b:r:w:s:uo:lh")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b':
+				names = split(optarg);
+				for(size_t i = 0; i < names.size(); ++i)
+				{
+					size_t k;
+					for(k = 0; k < NR_CASES; ++k)
+						if(names[i] == CASES[k].name)
+							break;
+					if(k == NR_CASES)
+						usage(argv[0]);
+					cases.push_back(&CASES[k]);
+				}
+				break;
+			case 'r': runs = atoi(optarg); break;
+			case 'w': warmups = atoi(optarg); break;
+			case 's': SCALE = atof(optarg); break;
+			case 'u': PIN = false; break;
+			case 'o': outfile = optarg; break;
+			case 'l':
+				for(size_t k = 0; k < NR_CASES; ++k)
+					fprintf(stdout, "%-12s %s\n", CASES[k].name, CASES[k].description);
+				return 0;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc || runs <= 0 || warmups < 0 || SCALE <= 0.0)
+		usage(argv[0]);
+
+	if(cases.empty())
+		for(size_t k = 0; k < NR_CASES; ++k)
+			cases.push_back(&CASES[k]);
+
+	FILE* out = stdout;
+	if(outfile && !(out = fopen(outfile, "w")))
+	{
+		fprintf(stderr, "Could not open %s.\n", outfile);
+		return -1;
+	}
+
+	// a peer that goes away first must not kill us
+	signal(SIGPIPE, SIG_IGN);
+
+	CheckError(pgm_init2(GRAPH_DIR, 1));
+
+	char host[64] = {0};
+	gethostname(host, sizeof(host) - 1);
+	fprintf(out, "{\n  \"tool\": \"pgmbench\",\n  \"host\": \"%s\",\n"
+		"  \"cpus\": %ld,\n  \"pinned\": %s,\n  \"runs\": %d,\n  \"warmups\": %d,\n"
+		"  \"results\": [",
+		host, sysconf(_SC_NPROCESSORS_ONLN), (PIN) ? "true" : "false", runs, warmups);
+
+	for(size_t k = 0; k < cases.size() && !errors; ++k)
+	{
+		const bench_case& c = *cases[k];
+		int iterations = std::max(1, (int)(c.iterations * SCALE));
+		std::vector<double> samples;
+
+		for(int i = 0; i < warmups + runs && !errors; ++i)
+		{
+			double ns = c.fn(iterations);
+			if(i >= warmups && ns >= 0.0)
+				samples.push_back(ns);
+		}
+		if(errors)
+		{
+			fprintf(stderr, "%s failed.\n", c.name);
+			break;
+		}
+
+		summary s = summarize(samples);
+		fprintf(stderr, "%-12s median %10.1f ns/op  (min %.1f, max %.1f, stddev %.1f)\n",
+			c.name, s.median, s.min, s.max, s.stddev);
+
+		fprintf(out, "%s\n    {\"name\": \"%s\", \"unit\": \"ns/op\", \"iterations\": %d,\n"
+			"     \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f,\n"
+			"     \"samples\": [",
+			(k) ? "," : "", c.name, iterations, s.median, s.mean, s.stddev, s.min, s.max);
+		for(size_t i = 0; i < samples.size(); ++i)
+			fprintf(out, "%s%.3f", (i) ? ", " : "", samples[i]);
+		fprintf(out, "]}");
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	if(out != stdout)
+		fclose(out);
+
+	CheckError(pgm_destroy());
+	return (errors) ? -1 : 0;
+}
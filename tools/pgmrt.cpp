@@ -4,11 +4,13 @@
 /* A program for running a complex PGM application. */
 
 #include <iostream>
+#include <fstream>
 #include <thread>
 #include <exception>
 #include <stdexcept>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 
@@ -43,11 +45,32 @@
 #define ms2s(ms)  ((ms)/1000LL)
 #include <linux/unistd.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <unistd.h>
 inline pid_t gettid(void)
 {
 	return syscall(__NR_gettid);
 }
+
+// glibc has no wrapper for sched_setattr()
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+struct dl_sched_attr
+{
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t  sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+inline int sched_setattr_dl(pid_t pid, const struct dl_sched_attr* attr)
+{
+	return syscall(__NR_sched_setattr, pid, attr, 0);
+}
 #endif
 
 //#define VERBOSE
@@ -113,10 +136,22 @@ struct edge_compare
 	}
 };
 
+// Scheduling of nodes without LITMUS
+enum sched_mode
+{
+	SCHED_MODE_OTHER,     // CFS
+	SCHED_MODE_FIFO,      // SCHED_FIFO, rate-monotonic priorities
+	SCHED_MODE_DEADLINE,  // SCHED_DEADLINE, implicit deadlines
+};
+
 struct rt_config
 {
 	bool syncRelease;
+	sched_mode mode;
+	int priority;  // of SCHED_MODE_FIFO
 	int cluster;
+	int clusterSize;
+	bool pin;  // keep to the cluster's CPUs without LITMUS
 	int budget;
 
 	uint64_t phase_ns;
@@ -130,6 +165,8 @@ struct rt_config
 
 	uint64_t duration_ns;
 
+	bool latency;
+
 	node_t node;
 };
 
@@ -186,6 +223,14 @@ uint64_t wctime_ns(void)
 	return (s2ns((uint64_t)tv.tv_sec) + us2ns((uint64_t)tv.tv_usec));
 }
 
+// Clock of PGM's latency tracking
+uint64_t monotime_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (s2ns((uint64_t)ts.tv_sec) + (uint64_t)ts.tv_nsec);
+}
+
 void sleep_ns(uint64_t ns)
 {
 	int64_t seconds = ns / s2ns(1);
@@ -356,12 +401,12 @@ pthread_barrier_t worker_exit_barrier;
 void work_thread(rt_config cfg)
 {
 	int ret = 0;
-	int degree_in = pgm_get_degree_in(cfg.node);
-	int degree_out = pgm_get_degree_out(cfg.node);
+	int degree_in = pgm_get_degree_in1(cfg.node);
+	int degree_out = pgm_get_degree_out1(cfg.node);
 	bool isSrc = (degree_in == 0);
 
 	// claim the node and open up FIFOs, etc.
-	CheckError(pgm_claim_node(cfg.node));
+	CheckError(pgm_claim_node1(cfg.node));
 
 	// how long should we loop, accounting for time spent reading/writing
 	if (cfg.execution_ns < cfg.discount_ns)
@@ -379,11 +424,9 @@ void work_thread(rt_config cfg)
 	// get pointers to the working sets attached to cfg.node
 	{
 		edge_t* edges = (edge_t*)calloc(degree_in, sizeof(edge_t));
-		int numEdges;
+		int numEdges = degree_in;
 
-		edges = NULL;
-		numEdges = 0;
-		CheckError(pgm_get_edges_in(cfg.node, edges, numEdges));
+		CheckError(pgm_get_edges_in3(cfg.node, edges, numEdges));
 		for(int i = 0; i < numEdges; ++i) {
 			auto edgeWithWs = WorkingSet::edgeToWs.find(edges[i]);
 			if(edgeWithWs != WorkingSet::edgeToWs.end()) {
@@ -395,8 +438,8 @@ void work_thread(rt_config cfg)
 		T("%s has %d in-edges with working sets\n", pgm_get_name(cfg.node), (int)consumeWs.size());
 
 		edges = (edge_t*)calloc(degree_out, sizeof(edge_t));
-		numEdges = 0;
-		CheckError(pgm_get_edges_out(cfg.node, edges, numEdges));
+		numEdges = degree_out;
+		CheckError(pgm_get_edges_out2(cfg.node, edges, numEdges));
 		for(int i = 0; i < numEdges; ++i) {
 			auto edgeWithWs = WorkingSet::edgeToWs.find(edges[i]);
 			if(edgeWithWs != WorkingSet::edgeToWs.end()) {
@@ -410,6 +453,7 @@ void work_thread(rt_config cfg)
 
 #ifdef _USE_LITMUS
 	bool isSink = (degree_out == 0);
+	const bool waits = !isSrc;
 
 	// become a real-time task
 	struct rt_task param;
@@ -459,10 +503,44 @@ void work_thread(rt_config cfg)
 		assert(ret == 0);
 	}
 #else
-	uint64_t release_ns, response_ns;
+	// SCHED_DEADLINE tasks must be allowed to run on every CPU of their
+	// root domain. Partition with cpusets instead.
+	if(cfg.pin && cfg.cluster >= 0 && cfg.mode == SCHED_MODE_DEADLINE) {
+		T("!!!WARNING!!! %s: not pinned under SCHED_DEADLINE.\n", pgm_get_name(cfg.node));
+	}
+	else if(cfg.pin && cfg.cluster >= 0) {
+		// CPUs [cluster*clusterSize, (cluster+1)*clusterSize)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for(int c = cfg.cluster*cfg.clusterSize; c < (cfg.cluster + 1)*cfg.clusterSize; ++c)
+			CPU_SET(c, &cpus);
+		CheckError(sched_setaffinity(0, sizeof(cpus), &cpus));
+	}
 
-	// approximate a phased release
-	sleep_ns(cfg.phase_ns);
+	if(cfg.mode == SCHED_MODE_FIFO) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = cfg.priority;
+		CheckError(sched_setscheduler(0, SCHED_FIFO, &param));
+	}
+	else if(cfg.mode == SCHED_MODE_DEADLINE) {
+		// Sources are released periodically. Others are sporadic: the
+		// kernel gives a job a new deadline if it wakes up late.
+		struct dl_sched_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.sched_policy = SCHED_DEADLINE;
+		attr.sched_runtime = cfg.execution_ns;
+		attr.sched_deadline = cfg.period_ns;
+		attr.sched_period = cfg.period_ns;
+		CheckError(sched_setattr_dl(0, &attr));
+	}
+
+	// Sources are released periodically by pgm_wait() (see main()).
+	// Others approximate a phased release.
+	const bool waits = true;
+	if(!isSrc)
+		sleep_ns(cfg.phase_ns);
 #endif
 
 	uint64_t bailoutTime = (isSrc) ? wctime_ns() + cfg.duration_ns : 0;
@@ -475,16 +553,15 @@ void work_thread(rt_config cfg)
 		//
 		// Note: We can remove this once the waiting mechanism
 		// has been pushed down into the OS kernel.
-		if(!isSrc) {
+		if(waits) {
 			T("(x) %s waits for tokens\n", pgm_get_name(cfg.node));
 			litmus_pgm_wait(ret = pgm_wait(cfg.node););
 		}
 
-#ifndef _USE_LITMUS
-		// Approximate the release time. May slip due to unbounded priority
-		// inversions or scheduler delays.
-		release_ns = wctime_ns();
-#endif
+		// end-to-end latency is measured from the start of source jobs
+		// (pgm_wait() of periodic sources sets it to their release)
+		if(isSrc && !waits && cfg.latency)
+			CheckError(pgm_set_origin(cfg.node, monotime_ns()));
 
 		if(ret != PGM_TERMINATE) {
 			CheckError(ret);
@@ -506,14 +583,6 @@ void work_thread(rt_config cfg)
 
 #ifdef _USE_LITMUS
 				sleep_next_period();
-#else
-				response_ns = wctime_ns() - release_ns;
-
-				// Sources sleep until the next "periodic" release.
-				if(isSrc && (response_ns < cfg.period_ns)) {
-					uint64_t slack = cfg.period_ns - response_ns;
-					sleep_ns(slack);
-				}
 #endif
 			}
 		}
@@ -527,7 +596,7 @@ void work_thread(rt_config cfg)
 
 	pthread_barrier_wait(&worker_exit_barrier);
 
-	CheckError(pgm_release_node(cfg.node));
+	CheckError(pgm_release_node1(cfg.node));
 }
 
 std::string make_edge_name(const std::string& a, const std::string& b)
@@ -536,87 +605,30 @@ std::string make_edge_name(const std::string& a, const std::string& b)
 	return name;
 }
 
+void get_graph_elements(
+				const graph_t& g,
+				std::vector<node_t>& nodes,
+				std::vector<edge_t>& edges)
+{
+	nodes.resize(pgm_get_nr_nodes(g));
+	CheckError(pgm_get_nodes(g, nodes.data(), nodes.size()));
+	edges.resize(pgm_get_nr_edges(g));
+	CheckError(pgm_get_edges(g, edges.data(), edges.size()));
+}
+
 void parse_graph_description(
 				const std::string& desc,
 				const graph_t& g,
 				std::vector<node_t>& nodes,
 				std::vector<edge_t>& edges)
 {
-	// create all the nodes. this must be done before
-	// the edges.
-	// function does not need to be fast!
-
-	// strip token information
-	std::vector<std::string> nodeNameChunks;
-	std::set<std::string> nodeNames; // set to ensure uniqueness
-	boost::split(nodeNameChunks, desc, boost::is_any_of(",") || boost::is_any_of(":"));
-	for(auto nStr(nodeNameChunks.begin()); nStr != nodeNameChunks.end(); ++nStr) {
-		std::vector<std::string> tokenDesc;
-		boost::split(tokenDesc, *nStr, boost::is_any_of("."));
-		nodeNames.insert(tokenDesc[0]);
-	}
-
-	// process each uniquely named node
-	std::map<std::string, node_t> nodeMap;
-	for(auto nStr(nodeNames.begin()); nStr != nodeNames.end(); ++nStr) {
-		node_t n;
-		CheckError(pgm_init_node(&n, g, nStr->c_str()));
-		nodeMap.insert(std::make_pair(*nStr, n));
-		nodes.push_back(n);
-	}
-
-	// create all the edges.
-	std::vector<std::string> edgeDesc;
-	boost::split(edgeDesc, desc, boost::is_any_of(","));
-	for(auto eStr(edgeDesc.begin()); eStr != edgeDesc.end(); ++eStr) {
-		std::vector<std::string> nodePair;
-		boost::split(nodePair, *eStr, boost::is_any_of(":"));
-		if(nodePair.size() > 2) {
-			throw std::runtime_error(std::string("Invalid edge description: ") + *eStr);
-		}
-		else if(nodePair.size() == 1) {
-			// assume single-node graph
-			continue;
-		}
-
-		int nr_produce = 1;
-		int nr_consume = 1;
-		int nr_threshold = 1;
-		std::vector<std::string> tokenDesc;
-		boost::split(tokenDesc, nodePair[0], boost::is_any_of("."));
-		if(tokenDesc.size() > 1) {
-			if(tokenDesc.size() != 2) {
-				throw std::runtime_error(std::string("Invalid produce description: " + nodePair[0]));
-			}
-			nr_produce = boost::lexical_cast<int>(tokenDesc[1]);
-			nodePair[0] = tokenDesc[0];
-		}
-		tokenDesc.clear();
-		boost::split(tokenDesc, nodePair[1], boost::is_any_of("."));
-		if(tokenDesc.size() > 1) {
-			if(tokenDesc.size() > 4) {
-				throw std::runtime_error(std::string("Invalid consume description: " + nodePair[1]));
-			}
-			nr_consume = boost::lexical_cast<int>(tokenDesc[1]);
-			if(tokenDesc.size() == 3) {
-				nr_threshold = boost::lexical_cast<int>(tokenDesc[2]);
-			}
-			nodePair[1] = tokenDesc[0];
-		}
+	// nodes and edges are created by the library, all at once
+	if(pgm_build_graph_str(g, desc.c_str(), NULL) != 0) {
+		throw std::runtime_error(std::string("Invalid graph description: ") + desc);
+	}
+	get_graph_elements(g, nodes, edges);
 
-		edge_t e;
-		edge_attr_t cv_attr;
-		memset(&cv_attr, 0, sizeof(cv_attr));
-		cv_attr.type = pgm_cv_edge;
-		cv_attr.nr_produce = nr_produce;
-		cv_attr.nr_consume = nr_consume;
-		cv_attr.nr_threshold = nr_threshold;
-		CheckError(pgm_init_edge(&e, nodeMap[nodePair[0]], nodeMap[nodePair[1]],
-				make_edge_name(nodePair[0], nodePair[1]).c_str(), &cv_attr));
-		edges.push_back(e);
-	}
-
-	if(!pgm_is_dag(g)) {
+	if(!pgm_is_dag1(g)) {
 		throw std::runtime_error(std::string("graph is not acyclic"));
 	}
 }
@@ -636,9 +648,9 @@ void validate_rate(node_t n, const std::map<std::string, rate>& rates)
 {
 	bool valid = true;
 
-	int nr_preds = pgm_get_degree_in(n);
+	int nr_preds = pgm_get_degree_in1(n);
 	node_t *preds = (node_t*)calloc(nr_preds, sizeof(node_t));
-	CheckError(pgm_get_predecessors(n, preds, nr_preds));
+	CheckError(pgm_get_predecessors2(n, preds, nr_preds));
 
 	uint64_t scale = 1;
 	std::vector<std::pair<node_t, rate> > preds_w_rates;
@@ -656,9 +668,9 @@ void validate_rate(node_t n, const std::map<std::string, rate>& rates)
 		const rate& cur = preds_w_rates[i].second;
 
 		edge_t e_prev, e_cur;
-		CheckError(pgm_find_edge(&e_prev, preds_w_rates[i-1].first, n,
+		CheckError(pgm_find_edge4(&e_prev, preds_w_rates[i-1].first, n,
 			make_edge_name(std::string(pgm_get_name(preds_w_rates[i-1].first)), std::string(pgm_get_name(n))).c_str()));
-		CheckError(pgm_find_edge(&e_cur, preds_w_rates[i].first, n,
+		CheckError(pgm_find_edge4(&e_cur, preds_w_rates[i].first, n,
 			make_edge_name(std::string(pgm_get_name(preds_w_rates[i].first)), std::string(pgm_get_name(n))).c_str()));
 
 		rate a = {pgm_get_nr_produce(e_prev) * prev.x * scale, prev.y * pgm_get_nr_consume(e_prev)};
@@ -732,9 +744,9 @@ void parse_graph_rates(const std::string& rateString, graph_t g, std::map<node_t
 		CheckError(pgm_find_node(&n, g, thisNode->c_str()));
 		tovisit.erase(thisNode);
 
-		int numSuccessors = pgm_get_degree_out(n);
+		int numSuccessors = pgm_get_degree_out1(n);
 		node_t* successors = (node_t*)calloc(numSuccessors, sizeof(node_t));
-		CheckError(pgm_get_successors(n, successors, numSuccessors));
+		CheckError(pgm_get_successors2(n, successors, numSuccessors));
 		if(numSuccessors == 0)
 			continue;
 
@@ -743,7 +755,7 @@ void parse_graph_rates(const std::string& rateString, graph_t g, std::map<node_t
 			assert(!sname.empty());
 
 			edge_t e;
-			CheckError(pgm_find_edge(&e, n, successors[i],
+			CheckError(pgm_find_edge4(&e, n, successors[i],
 				make_edge_name(std::string(pgm_get_name(n)), sname).c_str()));
 
 			int produce, consume;
@@ -831,6 +843,31 @@ void parse_graph_split_factor(const std::string& splits, graph_t g, std::map<nod
 	}
 }
 
+void parse_graph_replicas(const std::string& replicas, graph_t g, std::map<node_t, int, node_compare>& nr_replicas)
+{
+	if (replicas.empty())
+		return;
+
+	std::vector<std::string> nodeNames;
+	boost::split(nodeNames, replicas, boost::is_any_of(","));
+	for(auto nStr(nodeNames.begin()); nStr != nodeNames.end(); ++nStr) {
+		std::vector<std::string> nodeReplicaPair;
+		boost::split(nodeReplicaPair, *nStr, boost::is_any_of(":"));
+		if (nodeReplicaPair.size() != 2)
+			throw std::runtime_error(std::string("Invalid replica count: " + *nStr));
+
+		node_t n;
+		int k;
+
+		CheckError(pgm_find_node(&n, g, nodeReplicaPair[0].c_str()));
+
+		k = boost::lexical_cast<int>(nodeReplicaPair[1]);
+		if (k < 1 || k > PGM_MAX_REPLICAS || (k > 1 && pgm_get_degree_in1(n) == 0))
+			throw std::runtime_error(std::string("Invalid replica count: " + *nStr));
+		nr_replicas[n] = k;
+	}
+}
+
 void parse_graph_wss(const std::string& wss, graph_t g, std::map<edge_t, double, edge_compare>& wss_kb)
 {
 	if (wss.empty())
@@ -850,7 +887,7 @@ void parse_graph_wss(const std::string& wss, graph_t g, std::map<edge_t, double,
 
 		CheckError(pgm_find_node(&p, g, edgeWssDesc[0].c_str()));
 		CheckError(pgm_find_node(&c, g, edgeWssDesc[1].c_str()));
-		CheckError(pgm_find_edge(&e, p, c,
+		CheckError(pgm_find_edge4(&e, p, c,
 			make_edge_name(edgeWssDesc[0], edgeWssDesc[1]).c_str()));
 		wss_kb[e] = boost::lexical_cast<double>(edgeWssDesc[2])*1024;
 	}
@@ -876,13 +913,144 @@ void parse_graph_cluster(const std::string& cluster, graph_t g, std::map<node_t,
 	}
 }
 
+// Check that the nodes' clusters can keep up with their rates, and bound
+// end-to-end response times. Every cluster has 'clusterSize' CPUs.
+// Return: As pgm_analyze_rt().
+int analyze_graph(graph_t g,
+				const std::vector<node_t>& nodes,
+				const std::string& rateString,
+				std::map<node_t, double, node_compare>& exec_ms,
+				std::map<node_t, double, node_compare>& cluster_id,
+				int clusterSize,
+				bool report,
+				double* etoe_ms)
+{
+	std::vector<pgm_rt_node_t> rt(nodes.size());
+	int nr_clusters = 1;
+
+	for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+		pgm_rt_node_t& r = rt[n->node];
+		memset(&r, 0, sizeof(r));
+		r.wcet_us = ms2us(exec_ms[*n]);
+		r.cluster = (int)cluster_id[*n];
+		nr_clusters = std::max(nr_clusters, r.cluster + 1);
+	}
+
+	// rates of the sources: "<name>:<#>:<interval>" (interval in ms)
+	std::vector<std::string> nodeTokens;
+	boost::split(nodeTokens, rateString, boost::is_any_of(","));
+	for(auto iter = nodeTokens.begin(); iter != nodeTokens.end(); ++iter) {
+		std::vector<std::string> rateTokens;
+		boost::split(rateTokens, *iter, boost::is_any_of(":"));
+		node_t n;
+		if(rateTokens.size() != 3 || pgm_find_node(&n, g, rateTokens[0].c_str()) != 0)
+			throw std::runtime_error(std::string("Invalid rate: ") + *iter);
+		rt[n.node].nr_releases = boost::lexical_cast<uint64_t>(rateTokens[1]);
+		rt[n.node].interval_us = (uint64_t)round(ms2us(boost::lexical_cast<double>(rateTokens[2])));
+	}
+
+	std::vector<pgm_rt_cluster_t> clusters(nr_clusters);
+	for(auto c(clusters.begin()); c != clusters.end(); ++c) {
+		memset(&*c, 0, sizeof(*c));
+		c->nr_cpus = clusterSize;
+	}
+
+	double etoe_us = 0.0;
+	int ret = pgm_analyze_rt(g, rt.data(), rt.size(), clusters.data(), clusters.size(), &etoe_us);
+	if(ret < 0)
+		return ret;
+	*etoe_ms = us2ms(etoe_us);
+
+	if(report) {
+		printf("%-16s %7s %12s %6s %12s %12s %12s\n",
+			"node", "cluster", "period(ms)", "util", "offset(ms)", "tardy(ms)", "resp(ms)");
+		for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+			const pgm_rt_node_t& r = rt[n->node];
+			printf("%-16s %7d %12.3f %6.3f %12.3f %12.3f %12.3f\n",
+				pgm_get_name(*n), r.cluster, us2ms(r.period_us), r.utilization,
+				us2ms(r.offset_us), us2ms(r.tardiness_us), us2ms(r.response_us));
+		}
+		for(int c = 0; c < nr_clusters; ++c) {
+			printf("cluster %d: %d CPUs, utilization %.3f%s\n", c,
+				clusters[c].nr_cpus, clusters[c].utilization,
+				(clusters[c].overloaded) ? " OVERLOADED" : "");
+		}
+		printf("end-to-end response time bound: %.3f ms\n", *etoe_ms);
+	}
+
+	return ret;
+}
+
+// Assign the nodes to clusters with pgm_place_nodes(): utilizations
+// come from execution times and periods, and edges are weighted by
+// their working sets. Cluster k is CPUs [k*clusterSize, (k+1)*clusterSize).
+// Return: As pgm_place_nodes().
+int place_graph(graph_t g,
+				const std::vector<node_t>& nodes,
+				const std::vector<edge_t>& edges,
+				std::map<node_t, double, node_compare>& exec_ms,
+				std::map<node_t, double, node_compare>& period_ms,
+				std::map<edge_t, double, edge_compare>& wss_bytes,
+				int clusterSize,
+				std::map<node_t, double, node_compare>& cluster_id)
+{
+	std::vector<double> load(nodes.size()), volume(edges.size());
+	std::vector<int> cpus(nodes.size());
+
+	for(auto n(nodes.begin()); n != nodes.end(); ++n)
+		load[n->node] = (period_ms[*n] > 0.0) ? exec_ms[*n] / period_ms[*n] : 0.0;
+	for(auto e(edges.begin()); e != edges.end(); ++e) {
+		auto ws = wss_bytes.find(*e);
+		volume[e->edge] = (ws != wss_bytes.end()) ? ws->second : 0.0;
+	}
+
+	int ret = pgm_place_nodes(g, load.data(), (wss_bytes.empty()) ? NULL : volume.data(),
+		NULL, 0, cpus.data());
+	if(ret < 0)
+		return ret;
+
+	for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+		cluster_id[*n] = cpus[n->node] / clusterSize;
+		printf("placed %s on CPU %d (cluster %d)\n", pgm_get_name(*n),
+			cpus[n->node], cpus[n->node] / clusterSize);
+	}
+	return ret;
+}
+
+// Rate-monotonic SCHED_FIFO priorities: nodes with shorter periods get
+// higher priorities. The highest priority is left to the system.
+void rm_priorities(const std::vector<node_t>& nodes,
+				std::map<node_t, double, node_compare>& period_ms,
+				std::map<node_t, int, node_compare>& priorities)
+{
+	std::vector<double> periods;
+	for(auto n(nodes.begin()); n != nodes.end(); ++n)
+		periods.push_back(period_ms[*n]);
+	std::sort(periods.begin(), periods.end());
+	periods.erase(std::unique(periods.begin(), periods.end()), periods.end());
+
+	int hi = sched_get_priority_max(SCHED_FIFO) - 1;
+	int lo = sched_get_priority_min(SCHED_FIFO);
+	for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+		int rank = std::lower_bound(periods.begin(), periods.end(), period_ms[*n]) - periods.begin();
+		priorities[*n] = std::max(lo, hi - rank);
+	}
+}
+
+// A graph file holds options in "name = value" form, one per line,
+// using the long option names (e.g., "graph = a:b,b:c"). Options given
+// on the command line take precedence over those in the file.
 void parse_graph_file(
 				const std::string& filename,
-				graph_t& g,
-				std::vector<node_t>& nodes,
-				std::vector<edge_t>& edges)
+				const program_options::options_description& opts,
+				program_options::variables_map& vm)
 {
-	throw std::runtime_error("Graph files not yet implemented.");
+	std::ifstream file(filename.c_str());
+	if(!file) {
+		throw std::runtime_error(std::string("Could not open graph file: ") + filename);
+	}
+	program_options::store(program_options::parse_config_file(file, opts), vm);
+	program_options::notify(vm);
 }
 
 double producer_period(edge_t edge, void* user)
@@ -904,9 +1072,12 @@ int main(int argc, char** argv)
 	opts.add_options()
 		("wait,w", "Wait for release")
 		("cluster,c", program_options::value<std::string>()->default_value(""), "CPU assignment for each node [<name>:<cluster or CPU ID>,]")
-		("clusterSize,z", program_options::value<int>()->default_value(1), "Cluster size (ignored)")
+		("clusterSize,z", program_options::value<int>()->default_value(1), "Number of CPUs in each cluster")
+		("policy", program_options::value<std::string>()->default_value("other"),
+			"Scheduling policy without LITMUS: other, fifo (rate-monotonic priorities), or deadline (runtime = execution time, deadline = period). Real-time policies also lock memory.")
+		("place", "Assign nodes to clusters by their utilizations, working sets, and the CPU topology (overrides --cluster)")
 		("enforce,e", "Enable budget enforcement")
-		("graphfile", program_options::value<std::string>(), "File that describes PGM graph")
+		("graphfile", program_options::value<std::string>(), "File that describes PGM graph (\"<option> = <value>\" lines, e.g., from graphgen)")
 		("name,n", program_options::value<std::string>()->default_value(""), "Graph name")
 		("graph,g", program_options::value<std::string>(),
 		 	"Graph edge description: [<name>[.produce]:<name>[.consume[.threshld]],]+ (do '<name>:' for single-node graph)")
@@ -921,12 +1092,21 @@ int main(int argc, char** argv)
 			"Working set size requirements for edges. [<name>:<name>:<size>,]+ (size in kilobytes)")
 		("split,v", program_options::value<std::string>()->default_value(""),
 		 	"Job split factor of task for split-supporting schedulers [<name>:<split_factor>,]+. (default: 1)")
+		("replicas", program_options::value<std::string>()->default_value(""),
+			"Run successive jobs of non-source nodes on several threads, with outputs kept in order [<name>:<count>,]+. (default: 1)")
+		("roundRobin", "Hand out jobs of replicated nodes to their replicas in turn, rather than to whichever is idle")
 		("wsCycle", program_options::value<int>()->default_value(1),
 			"Number of working sets allocated to each node, which are cycled through on produce/consume.")
 		("graphDir,d", program_options::value<std::string>()->default_value("/dev/shm/graphs"),
 			"Directory to hold PGM FIFOs")
 		("duration", program_options::value<double>()->default_value(-1), "Time to run (seconds).")
 		("continuation", "Graph depends on a sub-graph of another process")
+		("trace", program_options::value<std::string>(), "Record a PGM event trace to file")
+		("latency", "Report end-to-end latency percentiles of each sink")
+		("dot", program_options::value<std::string>(), "Write the graph, annotated with runtime statistics, to file in DOT format")
+		("analyze", "Print the schedulability analysis of the graph and exit (status 1 if a cluster is overloaded)")
+		("snapshot", program_options::value<std::string>(),
+			"Load the graph structure from a snapshot file. If it cannot be loaded, build the graph from --graph and save it to the file.")
 		;
 
 	program_options::positional_options_description pos;
@@ -937,6 +1117,8 @@ int main(int argc, char** argv)
 	try {
 		program_options::store(program_options::command_line_parser(argc, argv).
 						options(opts).positional(pos).run(), vm);
+		if(vm.count("graphfile") != 0)
+			parse_graph_file(vm["graphfile"].as<std::string>(), opts, vm);
 	}
 	catch(program_options::required_option& e) {
 		std::cerr<<"Error: "<<e.what()<<std::endl;
@@ -948,18 +1130,35 @@ int main(int argc, char** argv)
 		opts.print(std::cout);
 		exit(-1);
 	}
+	catch(std::exception& e) {
+		std::cerr<<"Error: "<<e.what()<<std::endl;
+		exit(-1);
+	}
 	catch(...) {
 		std::cerr<<"Unknown error."<<std::endl;
 		opts.print(std::cout);
 		exit(-1);
 	}
 
-	// TODO: If "etoe" was not given, then compute it from the graph structure
+	sched_mode mode = SCHED_MODE_OTHER;
+	std::string policy = vm["policy"].as<std::string>();
+	if(policy == "fifo")
+		mode = SCHED_MODE_FIFO;
+	else if(policy == "deadline")
+		mode = SCHED_MODE_DEADLINE;
+	else if(policy != "other") {
+		std::cerr<<"Error: Unknown scheduling policy: "<<policy<<std::endl;
+		exit(-1);
+	}
 
 	rt_config cfg =
 	{
 		.syncRelease = (vm.count("wait") != 0),
+		.mode = mode,
+		.priority = 0,
 		.cluster = -1,
+		.clusterSize = std::max(1, vm["clusterSize"].as<int>()),
+		.pin = (vm.count("place") != 0 || !vm["cluster"].as<std::string>().empty()),
 		.budget = (vm.count("budget") != 0),
 		.phase_ns = 0,
 		.period_ns = 0,
@@ -968,9 +1167,25 @@ int main(int argc, char** argv)
 		.loop_for_ns = 0,
 		.split_factor = 1,
 		.expected_etoe = (uint64_t)ms2ns(vm["etoe"].as<double>()),
-		.duration_ns = (uint64_t)s2ns(vm["duration"].as<double>())
+		.duration_ns = (uint64_t)s2ns(vm["duration"].as<double>()),
+		.latency = (vm.count("latency") != 0)
 	};
 
+#if !defined(PGM_STATS)
+	if(vm.count("dot") != 0) {
+		std::cerr<<"Error: --dot requires PGM to be built with statistics "
+			"(PGM_STATS_METHOD)."<<std::endl;
+		exit(-1);
+	}
+#endif
+#if !defined(PGM_LATENCY)
+	if(cfg.latency) {
+		std::cerr<<"Error: --latency requires PGM to be built with latency tracking "
+			"(PGM_LATENCY_METHOD)."<<std::endl;
+		exit(-1);
+	}
+#endif
+
 	int wsCycle = vm["wsCycle"].as<int>();
 	std::string name = vm["name"].as<std::string>();
 	std::string graphDir = vm["graphDir"].as<std::string>();
@@ -985,7 +1200,12 @@ int main(int argc, char** argv)
 		graphDir += std::string("_") + std::string(pidStr);
 	}
 
-	CheckError(pgm_init(graphDir.c_str(), master));
+#ifdef PGM_SHARED
+	// let other processes (continuations, pgmtop) attach to the graph
+	CheckError(pgm_init3(graphDir.c_str(), master, 1));
+#else
+	CheckError(pgm_init2(graphDir.c_str(), master));
+#endif
 
 	graph_t g;
 	std::vector<node_t> nodes;
@@ -994,16 +1214,38 @@ int main(int argc, char** argv)
 	std::map<node_t, double, node_compare> executions;
 	std::map<node_t, double, node_compare> discounts;
 	std::map<node_t, int,    node_compare> split_factors;
+	std::map<node_t, int,    node_compare> replicas;
 	std::map<edge_t, double, edge_compare> wss;
 	std::map<node_t, double, node_compare> clusters;
 
 	try {
-		if(vm.count("graph") != 0) {
+		bool loaded = false;
+		if(master && vm.count("snapshot") != 0 &&
+		   access(vm["snapshot"].as<std::string>().c_str(), R_OK) == 0) {
+			char pidStr[PGM_GRAPH_NAME_LEN];
+			snprintf(pidStr, PGM_GRAPH_NAME_LEN, "%x", getpid());
+			std::string graphName = (name != "") ? name : std::string(pidStr);
+			if(pgm_load_graph(&g, vm["snapshot"].as<std::string>().c_str(), graphName.c_str()) == 0) {
+				get_graph_elements(g, nodes, edges);
+				loaded = true;
+			}
+		}
+
+		if(loaded) {
+			parse_graph_rates(vm["rates"].as<std::string>(), g, periods);
+			parse_graph_exec(vm["execution"].as<std::string>(), g, executions);
+			parse_graph_exec(vm["discount"].as<std::string>(), g, discounts);
+			parse_graph_split_factor(vm["split"].as<std::string>(), g, split_factors);
+			parse_graph_replicas(vm["replicas"].as<std::string>(), g, replicas);
+			parse_graph_wss(vm["wss"].as<std::string>(), g, wss);
+			parse_graph_cluster(vm["cluster"].as<std::string>(), g, clusters);
+		}
+		else if(vm.count("graph") != 0) {
 			if(master)
 				if(name != "")
 					CheckError(pgm_init_graph(&g, name.c_str()));
 				else
-					CheckError(pgm_init_graph(&g, getpid()));
+					CheckError(pgm_init_graph_int(&g, getpid()));
 			else
 				if(name != "")
 					CheckError(pgm_find_graph(&g, name.c_str()));
@@ -1015,11 +1257,12 @@ int main(int argc, char** argv)
 			parse_graph_exec(vm["execution"].as<std::string>(), g, executions);
 			parse_graph_exec(vm["discount"].as<std::string>(), g, discounts);
 			parse_graph_split_factor(vm["split"].as<std::string>(), g, split_factors);
+			parse_graph_replicas(vm["replicas"].as<std::string>(), g, replicas);
 			parse_graph_wss(vm["wss"].as<std::string>(), g, wss);
 			parse_graph_cluster(vm["cluster"].as<std::string>(), g, clusters);
-		}
-		else if(vm.count("graphfile") != 0) {
-			parse_graph_file(vm["graphfile"].as<std::string>(), g, nodes, edges);
+
+			if(master && vm.count("snapshot") != 0)
+				CheckError(pgm_save_graph(g, vm["snapshot"].as<std::string>().c_str()));
 		}
 		else {
 			throw std::runtime_error("Missing graph file or description");
@@ -1031,6 +1274,60 @@ int main(int argc, char** argv)
 		exit(-1);
 	}
 
+	if(vm.count("place") != 0) {
+		int placed = -1;
+		try {
+			placed = place_graph(g, nodes, edges, executions, periods, wss,
+				cfg.clusterSize, clusters);
+		}
+		catch(std::exception& e) {
+			std::cerr<<"Error: "<<e.what()<<std::endl;
+		}
+		if(placed < 0) {
+			std::cerr<<"Error: Could not place the graph's nodes."<<std::endl;
+			exit(-1);
+		}
+		if(placed > 0)
+			std::cerr<<"Warning: Some CPU is over-utilized."<<std::endl;
+	}
+
+	// If "etoe" was not given, then use the analysis' bound
+	if(vm.count("analyze") != 0 || cfg.expected_etoe == 0) {
+		double etoe_ms = 0.0;
+		int schedulable = -1;
+		try {
+			schedulable = analyze_graph(g, nodes, vm["rates"].as<std::string>(),
+				executions, clusters, cfg.clusterSize,
+				vm.count("analyze") != 0, &etoe_ms);
+		}
+		catch(std::exception& e) {
+			std::cerr<<"Error: "<<e.what()<<std::endl;
+		}
+
+		if(vm.count("analyze") != 0) {
+			CheckError(pgm_destroy_graph(g));
+			return (schedulable == 0) ? 0 : 1;
+		}
+		if(schedulable == 0)
+			cfg.expected_etoe = (uint64_t)ms2ns(etoe_ms);
+	}
+
+	std::map<node_t, int, node_compare> priorities;
+	if(cfg.mode == SCHED_MODE_FIFO)
+		rm_priorities(nodes, periods, priorities);
+	if(cfg.mode == SCHED_MODE_DEADLINE) {
+		for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+			// the kernel refuses runtimes under 1us. (each replica runs
+			// every k-th job.)
+			int k = (replicas.count(*n)) ? replicas[*n] : 1;
+			if(executions[*n] < 0.001 || executions[*n] > k*periods[*n]) {
+				std::cerr<<"Error: SCHED_DEADLINE requires an execution time of "
+					<<pgm_get_name(*n)<<" within its period."<<std::endl;
+				exit(-1);
+			}
+		}
+	}
+
 #ifdef _USE_LITMUS
 	init_litmus(); // prepare litmus
 #endif
@@ -1040,28 +1337,59 @@ int main(int argc, char** argv)
 		WorkingSet::edgeToWs[ws->first] = new WorkingSet(ws->second, wsCycle);
 	}
 
-	pthread_barrier_init(&worker_exit_barrier, NULL, nodes.size());
-	// spawn of a thread for each node in graph
+	if(vm.count("trace") != 0)
+		CheckError(pgm_trace_start(vm["trace"].as<std::string>().c_str()));
+
+#ifndef _USE_LITMUS
+	// keep page faults out of the measurements of real-time nodes
+	if(cfg.mode != SCHED_MODE_OTHER && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		perror("mlockall");
+
+	// PGM releases the sources
+	for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+		if(pgm_get_degree_in1(*n) == 0)
+			CheckError(pgm_set_periodic(*n, (uint64_t)ms2ns(periods[*n]), 0));
+	}
+#endif
+
+	int nr_threads = 0;
+	for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+		int k = (replicas.count(*n)) ? replicas[*n] : 1;
+		if(k > 1)
+			CheckError(pgm_set_replicas(*n, k, (vm.count("roundRobin") != 0) ?
+				PGM_REPLICA_ROUND_ROBIN : PGM_REPLICA_DYNAMIC));
+		nr_threads += k;
+	}
+
+	pthread_barrier_init(&worker_exit_barrier, NULL, nr_threads);
+	// spawn of a thread for each node (replica) in graph
 	std::vector<std::thread> threads;
-	for(auto iter(nodes.begin() + 1); iter != nodes.end(); ++iter) {
+	for(auto iter(nodes.begin()); iter != nodes.end(); ++iter) {
+		int k = (replicas.count(*iter)) ? replicas[*iter] : 1;
+
 		rt_config nodeCfg = cfg;
 		nodeCfg.cluster = clusters[*iter];
+		nodeCfg.priority = priorities[*iter];
 		nodeCfg.node = *iter;
-		nodeCfg.phase_ns = ms2ns(pgm_get_max_depth(*iter, producer_period, &periods));
-		nodeCfg.period_ns = ms2ns(periods[*iter]);
+		nodeCfg.phase_ns = ms2ns(pgm_get_max_depth3(*iter, producer_period, &periods));
+		// each replica runs every k-th job
+		nodeCfg.period_ns = ms2ns(k*periods[*iter]);
 		nodeCfg.execution_ns = ms2ns(executions[*iter]);
 		nodeCfg.discount_ns = ms2ns(discounts[*iter]);
 
 		if(split_factors.find(*iter) != split_factors.end())
 			nodeCfg.split_factor = split_factors[*iter];
 
-		threads.push_back(std::thread(work_thread, nodeCfg));
+		// main thread handles (a replica of) the first node
+		for(int i = (iter == nodes.begin()) ? 1 : 0; i < k; ++i)
+			threads.push_back(std::thread(work_thread, nodeCfg));
 	}
 
 	// main thread handles first node
 	cfg.cluster = clusters[nodes[0]];
+	cfg.priority = priorities[nodes[0]];
 	cfg.node = nodes[0];
-	cfg.phase_ns = ms2ns(pgm_get_max_depth(nodes[0], producer_period, &periods));
+	cfg.phase_ns = ms2ns(pgm_get_max_depth3(nodes[0], producer_period, &periods));
 	cfg.period_ns = ms2ns(periods[nodes[0]]);
 	cfg.execution_ns = ms2ns(executions[nodes[0]]);
 	cfg.discount_ns = ms2ns(discounts[nodes[0]]);
@@ -1071,12 +1399,55 @@ int main(int argc, char** argv)
 		t->join();
 	}
 
+	if(vm.count("trace") != 0)
+		CheckError(pgm_trace_stop());
+
+	if(cfg.latency) {
+		for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+			pgm_latency_stats_t lat;
+			if(pgm_get_degree_out1(*n) != 0)
+				continue;
+			int ret = pgm_get_latency_stats(*n, &lat);
+			CheckError(ret);
+			if(ret != 0)
+				continue;
+			printf("latency %s: %lu jobs (%lu lost), p50 %.3f ms, p99 %.3f ms, p99.99 %.3f ms, max %.3f ms\n",
+				pgm_get_name(*n), lat.count, lat.nr_lost, lat.p50_ns / 1e6, lat.p99_ns / 1e6,
+				lat.p9999_ns / 1e6, lat.max_ns / 1e6);
+		}
+#ifndef _USE_LITMUS
+		for(auto n(nodes.begin()); n != nodes.end(); ++n) {
+			pgm_release_stats_t rel;
+			if(pgm_get_degree_in1(*n) != 0)
+				continue;
+			CheckError(pgm_get_release_stats(*n, &rel));
+			printf("releases %s: %lu jobs, %lu overruns, %lu missed, max lateness %.3f ms\n",
+				pgm_get_name(*n), rel.nr_releases, rel.nr_overruns, rel.nr_missed,
+				rel.max_lateness_ns / 1e6);
+		}
+#endif
+	}
+
 	for(auto ws(WorkingSet::edgeToWs.begin()), theEnd(WorkingSet::edgeToWs.end());
 		ws != theEnd;
 		++ws) {
 		delete ws->second;
 	}
 
+	if(vm.count("dot") != 0) {
+		FILE* dot = fopen(vm["dot"].as<std::string>().c_str(), "w");
+		if(dot) {
+			int ret = pgm_print_graph_stats(g, dot);
+			CheckError(ret);
+			fclose(dot);
+			if(ret != 0)
+				unlink(vm["dot"].as<std::string>().c_str());
+		}
+		else {
+			perror(vm["dot"].as<std::string>().c_str());
+		}
+	}
+
 	CheckError(pgm_destroy_graph(g));
 	return 0;
 }
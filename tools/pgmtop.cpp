@@ -0,0 +1,294 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* Monitors a running graph. pgmtop attaches to the shared memory of a
+   graph created by another process (PGM must be built with
+   PGM_SYNC_SCOPE=1 and PGM_STATS_METHOD=1) and periodically prints
+   per-node firing rates and blocked time, and per-edge backlog and
+   throughput. Nothing is written to the graph. */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+enum sort_key
+{
+	SORT_BOTTLENECK,
+	SORT_RATE,
+	SORT_BLOCKED,
+	SORT_BACKLOG,
+	SORT_THROUGHPUT,
+	SORT_NAME,
+};
+
+struct node_row
+{
+	node_t node;
+	std::string name;
+	bool is_src;
+	double rate;       // completions per second
+	double blocked;    // percent of the interval spent in pgm_wait()
+	double avg_wait;   // per invocation (us)
+	int64_t backlog;   // tokens queued on in-edges
+};
+
+struct edge_row
+{
+	edge_t edge;
+	std::string name;
+	std::string producer;
+	std::string consumer;
+	int64_t backlog;   // tokens queued
+	uint64_t max_pending;
+	double rate;       // tokens per second
+	double kbps;       // kilobytes per second
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <graph name>\n"
+		"  -d dir    Directory given to pgm_init() by the graph's creator (default: /tmp/graphs)\n"
+		"  -i secs   Refresh interval (default: 1)\n"
+		"  -n count  Exit after 'count' refreshes (default: run until the graph is destroyed)\n"
+		"  -s key    Sort nodes and edges by: bottleneck (default), rate, blocked,\n"
+		"            backlog, throughput, or name\n"
+		"  -b        Batch mode: do not clear the screen between refreshes\n",
+		prog);
+	exit(-1);
+}
+
+static bool sample(graph_t g, std::vector<node_t>& nodes, std::vector<edge_t>& edges,
+				std::vector<pgm_node_stats_t>& nstats, std::vector<pgm_edge_stats_t>& estats)
+{
+	int nr_nodes = pgm_get_nr_nodes(g);
+	int nr_edges = pgm_get_nr_edges(g);
+	if(nr_nodes < 0 || nr_edges < 0)
+		return false;
+
+	nodes.resize(nr_nodes);
+	edges.resize(nr_edges);
+	if(pgm_get_nodes(g, nodes.data(), nr_nodes) != nr_nodes ||
+	   pgm_get_edges(g, edges.data(), nr_edges) != nr_edges)
+		return false;
+
+	nstats.resize(nr_nodes);
+	estats.resize(nr_edges);
+	for(int i = 0; i < nr_nodes; ++i)
+		if(pgm_get_node_stats(nodes[i], &nstats[i]) != 0)
+			return false;
+	for(int i = 0; i < nr_edges; ++i)
+		if(pgm_get_edge_stats(edges[i], &estats[i]) != 0)
+			return false;
+	return true;
+}
+
+static int64_t queued_tokens(edge_t e, const pgm_edge_stats_t& s)
+{
+	edge_attr_t attr;
+	if(pgm_get_edge_attrs(e, &attr) != 0)
+		return 0;
+	return (int64_t)attr.nr_init + (int64_t)s.nr_produced - (int64_t)s.nr_consumed;
+}
+
+int main(int argc, char** argv)
+{
+	const char* dir = "/tmp/graphs";
+	double interval = 1.0;
+	int count = 0;
+	sort_key key = SORT_BOTTLENECK;
+	bool batch = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "d:i:n:s:bh")) != -1)
+	{
+		switch(opt)
+		{
+			case 'd': dir = optarg; break;
+			case 'i': interval = atof(optarg); break;
+			case 'n': count = atoi(optarg); break;
+			case 'b': batch = true; break;
+			case 's':
+				if(!strcmp(optarg, "bottleneck")) key = SORT_BOTTLENECK;
+				else if(!strcmp(optarg, "rate")) key = SORT_RATE;
+				else if(!strcmp(optarg, "blocked")) key = SORT_BLOCKED;
+				else if(!strcmp(optarg, "backlog")) key = SORT_BACKLOG;
+				else if(!strcmp(optarg, "throughput")) key = SORT_THROUGHPUT;
+				else if(!strcmp(optarg, "name")) key = SORT_NAME;
+				else usage(argv[0]);
+				break;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc - 1 || interval <= 0.0)
+		usage(argv[0]);
+
+	const char* graphName = argv[optind];
+	graph_t g;
+
+	// attach without creating anything
+	if(pgm_init3(dir, 0, 1) != 0)
+	{
+		fprintf(stderr, "Could not attach to graphs in %s.\n", dir);
+		return -1;
+	}
+	if(pgm_find_graph(&g, graphName) != 0)
+	{
+		fprintf(stderr, "Could not find graph %s.\n", graphName);
+		pgm_destroy();
+		return -1;
+	}
+
+	std::vector<node_t> nodes;
+	std::vector<edge_t> edges;
+	std::vector<pgm_node_stats_t> nstats, prev_nstats;
+	std::vector<pgm_edge_stats_t> estats, prev_estats;
+
+	if(!sample(g, nodes, edges, prev_nstats, prev_estats))
+	{
+		fprintf(stderr, "Could not read statistics. Is PGM built with PGM_STATS_METHOD=1?\n");
+		pgm_destroy();
+		return -1;
+	}
+	uint64_t prev_time = now_ns();
+
+	for(int iter = 0; count == 0 || iter < count; ++iter)
+	{
+		usleep((useconds_t)(interval * 1000000));
+
+		if(!sample(g, nodes, edges, nstats, estats))
+		{
+			fprintf(stdout, "Graph %s is gone.\n", graphName);
+			break;
+		}
+		uint64_t t = now_ns();
+		double dt = (t - prev_time) / 1e9;
+
+		// nodes and edges may have been added since the last sample
+		prev_nstats.resize(nstats.size());
+		prev_estats.resize(estats.size());
+
+		std::vector<node_row> nrows(nodes.size());
+		for(size_t i = 0; i < nodes.size(); ++i)
+		{
+			node_row& r = nrows[i];
+			const pgm_node_stats_t& s = nstats[i];
+			const pgm_node_stats_t& p = prev_nstats[i];
+			uint64_t invocations = s.nr_invocations - p.nr_invocations;
+
+			r.node = nodes[i];
+			r.name = pgm_get_name(nodes[i]);
+			r.is_src = (pgm_get_degree_in1(nodes[i]) == 0);
+			r.rate = (s.nr_completions - p.nr_completions) / dt;
+			r.blocked = std::min(100.0, (s.wait_ns - p.wait_ns) / (dt * 1e9) * 100.0);
+			r.avg_wait = (invocations) ? (s.wait_ns - p.wait_ns) / 1e3 / invocations : 0.0;
+			r.backlog = 0;
+		}
+
+		std::vector<edge_row> erows(edges.size());
+		for(size_t i = 0; i < edges.size(); ++i)
+		{
+			edge_row& r = erows[i];
+			const pgm_edge_stats_t& s = estats[i];
+			const pgm_edge_stats_t& p = prev_estats[i];
+			node_t producer = pgm_get_producer(edges[i]);
+			node_t consumer = pgm_get_consumer(edges[i]);
+
+			r.edge = edges[i];
+			r.name = pgm_get_edge_name(edges[i]);
+			r.producer = pgm_get_name(producer);
+			r.consumer = pgm_get_name(consumer);
+			r.backlog = queued_tokens(edges[i], s);
+			r.max_pending = s.max_pending;
+			r.rate = (s.nr_produced - p.nr_produced) / dt;
+			r.kbps = (s.bytes_sent - p.bytes_sent) / dt / 1024.0;
+
+			if(consumer.node >= 0 && consumer.node < (int)nrows.size())
+				nrows[consumer.node].backlog += r.backlog;
+		}
+
+		// A saturated stage never blocks and has work queued up. Sources
+		// block outside of PGM, so they are never the bottleneck here.
+		std::stable_sort(nrows.begin(), nrows.end(),
+			[key](const node_row& a, const node_row& b) {
+				switch(key)
+				{
+					case SORT_RATE:
+					case SORT_THROUGHPUT: return a.rate > b.rate;
+					case SORT_BLOCKED: return a.blocked > b.blocked;
+					case SORT_BACKLOG: return a.backlog > b.backlog;
+					case SORT_NAME: return a.name < b.name;
+					default:
+						if(a.is_src != b.is_src)
+							return b.is_src;
+						if(a.blocked != b.blocked)
+							return a.blocked < b.blocked;
+						return a.backlog > b.backlog;
+				}
+			});
+		std::stable_sort(erows.begin(), erows.end(),
+			[key](const edge_row& a, const edge_row& b) {
+				switch(key)
+				{
+					case SORT_RATE: return a.rate > b.rate;
+					case SORT_THROUGHPUT: return a.kbps > b.kbps;
+					case SORT_NAME: return a.name < b.name;
+					default: return a.backlog > b.backlog;
+				}
+			});
+
+		if(!batch)
+			fprintf(stdout, "\033[H\033[2J");
+		fprintf(stdout, "pgmtop: graph %s, %d nodes, %d edges, %.2fs interval\n\n",
+			graphName, (int)nodes.size(), (int)edges.size(), dt);
+
+		fprintf(stdout, "%-24s %12s %9s %9s %14s %12s\n",
+			"NODE", "RATE(/s)", "BUSY%", "BLOCKED%", "AVG WAIT(us)", "IN BACKLOG");
+		for(size_t i = 0; i < nrows.size(); ++i)
+		{
+			const node_row& r = nrows[i];
+			if(r.is_src)
+				fprintf(stdout, "%-24.24s %12.1f %9s %9s %14s %12s\n",
+					r.name.c_str(), r.rate, "src", "-", "-", "-");
+			else
+				fprintf(stdout, "%-24.24s %12.1f %9.1f %9.1f %14.1f %12ld\n",
+					r.name.c_str(), r.rate, 100.0 - r.blocked, r.blocked,
+					r.avg_wait, r.backlog);
+		}
+
+		fprintf(stdout, "\n%-24s %-27s %10s %10s %12s %10s\n",
+			"EDGE", "PRODUCER -> CONSUMER", "BACKLOG", "MAX", "TOKENS(/s)", "KB/s");
+		for(size_t i = 0; i < erows.size(); ++i)
+		{
+			const edge_row& r = erows[i];
+			std::string ends = r.producer + " -> " + r.consumer;
+			fprintf(stdout, "%-24.24s %-27.27s %10ld %10lu %12.1f %10.1f\n",
+				r.name.c_str(), ends.c_str(), r.backlog, r.max_pending, r.rate, r.kbps);
+		}
+		fflush(stdout);
+
+		prev_nstats.swap(nstats);
+		prev_estats.swap(estats);
+		prev_time = t;
+	}
+
+	pgm_destroy();
+	return 0;
+}
@@ -0,0 +1,256 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* Converts a trace recorded with pgm_trace_start() to the Chrome trace
+   event format (JSON), which may be opened with chrome://tracing or
+   https://ui.perfetto.dev. Each graph is shown as a process, and each
+   node as a thread. Node invocations are slices (with the time blocked
+   in pgm_wait() as separate slices), and tokens passed over edges are
+   flow arrows from producer to consumer. */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "pgm.h"
+#include "pgmtrace.h"
+
+struct node_state
+{
+	uint64_t wait_start;
+	uint64_t job_start;
+	bool in_wait;
+	bool in_job;
+	bool ever_waited;
+	uint64_t nr_jobs;
+
+	node_state(): wait_start(0), job_start(0), in_wait(false), in_job(false),
+		ever_waited(false), nr_jobs(0) {}
+};
+
+typedef std::pair<int, int> id_t2;
+
+static std::map<int, std::string> graph_names;
+static std::map<id_t2, std::string> node_names;
+static std::map<id_t2, std::string> edge_names;
+static std::map<id_t2, node_state> nodes;
+
+static uint64_t t0 = 0;
+static bool first = true;
+
+static std::string escape(const std::string& in)
+{
+	std::string out;
+	for(size_t i = 0; i < in.size(); ++i)
+	{
+		char c = in[i];
+		if(c == '"' || c == '\\')
+			out += '\\';
+		if((unsigned char)c < 0x20)
+			continue;
+		out += c;
+	}
+	return out;
+}
+
+static void emit(FILE* out, const char* fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void emit(FILE* out, const char* fmt, ...)
+{
+	va_list args;
+	fprintf(out, "%s\n\t\t", (first) ? "" : ",");
+	first = false;
+	va_start(args, fmt);
+	vfprintf(out, fmt, args);
+	va_end(args);
+}
+
+static double us(uint64_t ts)
+{
+	return (ts - t0) / 1000.0;
+}
+
+static std::string edge_name(int g, int e)
+{
+	std::map<id_t2, std::string>::iterator it = edge_names.find(id_t2(g, e));
+	if(it != edge_names.end())
+		return escape(it->second);
+	char buf[32];
+	snprintf(buf, sizeof(buf), "edge %d", e);
+	return buf;
+}
+
+static void flow(FILE* out, const char* ph, const pgm_trace_event_t& ev, uint64_t seq)
+{
+	uint64_t id = ((uint64_t)ev.graph << 48) | ((uint64_t)(uint32_t)ev.edge << 32) | (seq & 0xffffffffull);
+	emit(out, "{\"ph\":\"%s\",%s\"cat\":\"edge\",\"name\":\"%s\",\"id\":\"0x%" PRIx64 "\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+		ph, (ph[0] == 'f') ? "\"bp\":\"e\"," : "",
+		edge_name(ev.graph, ev.edge).c_str(), id, ev.graph, ev.node, us(ev.ts));
+}
+
+static void convert(const pgm_trace_event_t& ev, FILE* out)
+{
+	node_state& n = nodes[id_t2(ev.graph, ev.node)];
+
+	switch(ev.type)
+	{
+		case PGM_TRACE_WAIT_BEGIN:
+			n.wait_start = ev.ts;
+			n.in_wait = true;
+			n.ever_waited = true;
+			break;
+
+		case PGM_TRACE_WAIT_END:
+			if(n.in_wait)
+			{
+				emit(out, "{\"ph\":\"X\",\"cat\":\"wait\",\"name\":\"wait\","
+					"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"ret\":%d}}",
+					ev.graph, ev.node, us(n.wait_start), (ev.ts - n.wait_start) / 1000.0,
+					(int)(int64_t)ev.arg);
+			}
+			n.in_wait = false;
+			if(ev.arg == 0)
+			{
+				n.job_start = ev.ts;
+				n.in_job = true;
+			}
+			break;
+
+		case PGM_TRACE_COMPLETE:
+			if(n.in_job)
+			{
+				emit(out, "{\"ph\":\"X\",\"cat\":\"job\",\"name\":\"job %" PRIu64 "\","
+					"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					n.nr_jobs, ev.graph, ev.node, us(n.job_start),
+					(ev.ts - n.job_start) / 1000.0);
+			}
+			++n.nr_jobs;
+			// nodes that never wait (sources) start their next job right away
+			n.in_job = !n.ever_waited;
+			n.job_start = ev.ts;
+			break;
+
+		case PGM_TRACE_TERMINATE:
+			emit(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"terminate\","
+				"\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+				ev.graph, ev.node, us(ev.ts));
+			n.in_job = false;
+			break;
+
+		case PGM_TRACE_SEND:
+			flow(out, "s", ev, ev.arg);
+			break;
+
+		case PGM_TRACE_RECV:
+			if(ev.arg != 0)  // (initial tokens have no producer)
+				flow(out, "f", ev, ev.arg);
+			break;
+
+		default:
+			break;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	FILE* in;
+	FILE* out = stdout;
+	char magic[PGM_TRACE_MAGIC_LEN];
+	char name[PGM_TRACE_NAME_LEN];
+	pgm_trace_event_t ev;
+	std::vector<pgm_trace_event_t> events;
+
+	if(argc < 2 || argc > 3)
+	{
+		fprintf(stderr, "Usage: %s <trace file> [<json file>]\n", argv[0]);
+		return -1;
+	}
+
+	in = fopen(argv[1], "r");
+	if(!in)
+	{
+		perror(argv[1]);
+		return -1;
+	}
+	if(fread(magic, sizeof(magic), 1, in) != 1 ||
+	   memcmp(magic, PGM_TRACE_MAGIC, PGM_TRACE_MAGIC_LEN) != 0)
+	{
+		fprintf(stderr, "%s is not a PGM trace.\n", argv[1]);
+		return -1;
+	}
+
+	while(fread(&ev, sizeof(ev), 1, in) == 1)
+	{
+		switch(ev.type)
+		{
+			case PGM_TRACE_NAME_GRAPH:
+			case PGM_TRACE_NAME_NODE:
+			case PGM_TRACE_NAME_EDGE:
+				if(fread(name, sizeof(name), 1, in) != 1)
+					break;
+				name[sizeof(name) - 1] = '\0';
+				if(ev.type == PGM_TRACE_NAME_GRAPH)
+					graph_names[ev.graph] = name;
+				else if(ev.type == PGM_TRACE_NAME_NODE)
+					node_names[id_t2(ev.graph, ev.node)] = name;
+				else
+					edge_names[id_t2(ev.graph, ev.edge)] = name;
+				break;
+			case PGM_TRACE_DROPPED:
+				fprintf(stderr, "Warning: thread %u dropped %" PRIu64 " events.\n",
+					ev.tid, ev.arg);
+				break;
+			default:
+				events.push_back(ev);
+				break;
+		}
+	}
+	fclose(in);
+
+	if(argc == 3)
+	{
+		out = fopen(argv[2], "w");
+		if(!out)
+		{
+			perror(argv[2]);
+			return -1;
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(),
+		[](const pgm_trace_event_t& a, const pgm_trace_event_t& b) { return a.ts < b.ts; });
+	if(!events.empty())
+		t0 = events.front().ts;
+
+	fprintf(out, "{\n\t\"displayTimeUnit\": \"ns\",\n\t\"traceEvents\": [");
+
+	for(std::map<int, std::string>::iterator it = graph_names.begin(); it != graph_names.end(); ++it)
+	{
+		emit(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+			it->first, escape(it->second).c_str());
+	}
+	for(std::map<id_t2, std::string>::iterator it = node_names.begin(); it != node_names.end(); ++it)
+	{
+		emit(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			it->first.first, it->first.second, escape(it->second).c_str());
+	}
+
+	for(size_t i = 0; i < events.size(); ++i)
+		convert(events[i], out);
+
+	fprintf(out, "\n\t]\n}\n");
+	if(out != stdout)
+		fclose(out);
+
+	fprintf(stderr, "%lu events from %lu nodes.\n", events.size(), nodes.size());
+	return 0;
+}
@@ -0,0 +1,215 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing replicated nodes. In the chain a:b:c, b has
+   three replicas whose jobs take different amounts of time. c must still
+   see every value that a sends, in order, and then terminate. The test
+   runs once per replica policy. */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+#define Expect(cond) \
+do { if(!(cond)) { \
+	errors++; \
+	fprintf(stderr, "Failed: %s @ %s:%d\n", #cond, __FILE__, __LINE__); \
+}}while(0)
+
+// not a multiple of NR_REPLICAS, so the replicas are signaled to
+// terminate at different points in the rotation
+int TOTAL_ITERATIONS = 2*1000 + 1;
+const int NR_REPLICAS = 3;
+
+node_t a, b, c;
+edge_t ab, bc;
+pthread_barrier_t init_barrier;
+int jobs_of_b = 0;
+
+void* thread_a(void*)
+{
+	CheckError(pgm_claim_node1(a));
+	pthread_barrier_wait(&init_barrier);
+
+	uint32_t* out = (uint32_t*)pgm_get_edge_buf_p(ab);
+	for(int i = 0; i < TOTAL_ITERATIONS && !errors; ++i)
+	{
+		*out = i;
+		CheckError(pgm_complete(a));
+	}
+	CheckError(pgm_terminate(a));
+
+	pthread_barrier_wait(&init_barrier);
+	CheckError(pgm_release_node1(a));
+	return 0;
+}
+
+void* thread_b(void*)
+{
+	int ret;
+
+	CheckError(pgm_claim_node1(b));
+	pthread_barrier_wait(&init_barrier);
+
+	uint32_t* in = (uint32_t*)pgm_get_edge_buf_c(ab);
+	uint32_t* out = (uint32_t*)pgm_get_edge_buf_p(bc);
+	while((ret = pgm_wait(b)) == 0)
+	{
+		// make later jobs finish before earlier ones
+		if(*in % NR_REPLICAS == 0)
+			usleep(50);
+		*out = *in * 3;
+		__sync_fetch_and_add(&jobs_of_b, 1);
+		CheckError(pgm_complete(b));
+		if(errors)
+			break;
+	}
+	Expect(ret == PGM_TERMINATE || errors);
+
+	pthread_barrier_wait(&init_barrier);
+	CheckError(pgm_release_node1(b));
+	return 0;
+}
+
+void* thread_c(void*)
+{
+	uint32_t expected = 0;
+	int ret;
+
+	CheckError(pgm_claim_node1(c));
+	pthread_barrier_wait(&init_barrier);
+
+	uint32_t* in = (uint32_t*)pgm_get_edge_buf_c(bc);
+	while((ret = pgm_wait(c)) == 0)
+	{
+		if(*in != expected * 3)
+		{
+			fprintf(stderr, "Bad value: %u, expected %u\n", *in, expected * 3);
+			errors++;
+			break;
+		}
+		++expected;
+		CheckError(pgm_complete(c));
+	}
+	Expect(ret == PGM_TERMINATE);
+	Expect(expected == (uint32_t)TOTAL_ITERATIONS);
+
+	pthread_barrier_wait(&init_barrier);
+	CheckError(pgm_release_node1(c));
+	return 0;
+}
+
+void run(pgm_replica_policy_t policy)
+{
+	graph_t g;
+	edge_attr_t attr;
+	pthread_t t0, t1[NR_REPLICAS], t2;
+
+	jobs_of_b = 0;
+
+	CheckError(pgm_init_graph(&g, "replicatest"));
+
+	CheckError(pgm_init_node(&a, g, "a"));
+	CheckError(pgm_init_node(&b, g, "b"));
+	CheckError(pgm_init_node(&c, g, "c"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_ring_edge;
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+	attr.nmemb = 64;
+	CheckError(pgm_init_edge5(&ab, a, b, "a_b", &attr));
+	CheckError(pgm_init_edge5(&bc, b, c, "b_c", &attr));
+
+	Expect(pgm_set_replicas(a, NR_REPLICAS, policy) == -1);  // a source
+	CheckError(pgm_set_replicas(b, NR_REPLICAS, policy));
+	Expect(pgm_set_concurrency(b, 2) == -1);
+
+	pthread_barrier_init(&init_barrier, 0, 2 + NR_REPLICAS);
+	pthread_create(&t0, 0, thread_a, 0);
+	for(int i = 0; i < NR_REPLICAS; ++i)
+		pthread_create(&t1[i], 0, thread_b, 0);
+	pthread_create(&t2, 0, thread_c, 0);
+
+	pthread_join(t0, 0);
+	for(int i = 0; i < NR_REPLICAS; ++i)
+		pthread_join(t1[i], 0);
+	pthread_join(t2, 0);
+	pthread_barrier_destroy(&init_barrier);
+
+	Expect(jobs_of_b == TOTAL_ITERATIONS);
+
+	CheckError(pgm_destroy_graph(g));
+}
+
+// a replicated node may not get a coalesced out-edge: its replicas would
+// share the staging buffer.
+void coalesced_edge(void)
+{
+	graph_t g;
+	node_t x, y, z;
+	edge_t xy, yz;
+	edge_attr_t attr, tcp_attr;
+
+	CheckError(pgm_init_graph(&g, "replicatest_coalesced"));
+
+	CheckError(pgm_init_node(&x, g, "x"));
+	CheckError(pgm_init_node(&y, g, "y"));
+	CheckError(pgm_init_node(&z, g, "z"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_ring_edge;
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+	attr.nmemb = 64;
+	CheckError(pgm_init_edge5(&xy, x, y, "x_y", &attr));
+
+	CheckError(pgm_set_replicas(y, NR_REPLICAS, PGM_REPLICA_DYNAMIC));
+
+	memset(&tcp_attr, 0, sizeof(tcp_attr));
+	tcp_attr.type = pgm_sock_stream_edge;
+	tcp_attr.nr_produce = sizeof(uint32_t);
+	tcp_attr.nr_consume = sizeof(uint32_t);
+	tcp_attr.nr_threshold = sizeof(uint32_t);
+	tcp_attr.port = 10103;
+	tcp_attr.node = "localhost";
+	tcp_attr.coalesce_us = 100;
+	Expect(pgm_init_edge5(&yz, y, z, "y_z", &tcp_attr) == -1);
+
+	CheckError(pgm_destroy_graph(g));
+}
+
+int main(void)
+{
+	CheckError(pgm_init_process_local());
+
+	run(PGM_REPLICA_DYNAMIC);
+	if(!errors)
+		run(PGM_REPLICA_ROUND_ROBIN);
+	coalesced_edge();
+
+	CheckError(pgm_destroy());
+
+	fprintf(stdout, "%s\n", (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing SDF rate analysis and static schedules. A
+   multirate chain (a.2:b.3, b.3:c.1) with a back-edge from c to a is
+   checked for its repetition vector and buffer sizes, and then run as a
+   static schedule. Every byte that a produces must reach c in order. */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+#define Expect(cond) \
+do { if(!(cond)) { \
+	errors++; \
+	fprintf(stderr, "Failed: %s @ %s:%d\n", #cond, __FILE__, __LINE__); \
+}}while(0)
+
+int TOTAL_PERIODS = 100*1000;
+
+node_t a, b, c;
+
+struct state
+{
+	unsigned char next_out;
+	unsigned char next_in;
+	uint64_t nr_fired[3];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static int fire(node_t node, void* const* in, void* const* out, void* user)
+{
+	state* s = (state*)user;
+
+	if(node.node == a.node)
+	{
+		// out[0]: to b. in[0]: the back-edge from c, which carries no data
+		Expect(in[0] == 0);
+		unsigned char* o = (unsigned char*)out[0];
+		o[0] = s->next_out++;
+		o[1] = s->next_out++;
+		++s->nr_fired[0];
+	}
+	else if(node.node == b.node)
+	{
+		memcpy(out[0], in[0], 3);
+		++s->nr_fired[1];
+	}
+	else if(node.node == c.node)
+	{
+		unsigned char* i = (unsigned char*)in[0];
+		if(*i != s->next_in)
+		{
+			fprintf(stderr, "Bad byte: %u, expected %u\n", *i, s->next_in);
+			errors++;
+		}
+		++s->next_in;
+		++s->nr_fired[2];
+	}
+	return (errors) ? 1 : 0;
+}
+
+int main(void)
+{
+	graph_t g;
+	edge_t e;
+	edge_attr_t attr;
+	pgm_schedule_t sched;
+	uint64_t reps[3];
+	size_t nr_tokens, nr_msgs;
+	node_t seq[32];
+	state s;
+	uint64_t start;
+
+	CheckError(pgm_init2("/tmp/graphs", 1));
+	CheckError(pgm_init_graph(&g, "schedtest"));
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_fifo_edge;
+	CheckError(pgm_build_graph_str(g, "a.2:b.3,b.3:c.1", &attr));
+	CheckError(pgm_find_node(&a, g, "a"));
+	CheckError(pgm_find_node(&b, g, "b"));
+	CheckError(pgm_find_node(&c, g, "c"));
+
+	// c lets a run ahead by at most 6 invocations (one period)
+	memset(&attr, 0, sizeof(attr));
+	attr.type = pgm_cv_edge;
+	attr.nr_produce = 1;
+	attr.nr_consume = 2;
+	attr.nr_threshold = 2;
+	CheckError(pgm_init_backedge6(&e, 3, c, a, "c_a", &attr));
+
+	CheckError(pgm_get_repetition_vector(g, reps, 3));
+	Expect(reps[a.node] == 3 && reps[b.node] == 2 && reps[c.node] == 6);
+
+	// p + c - gcd(p, c)
+	CheckError(pgm_find_edge4(&e, a, b, "edge_a_b"));
+	CheckError(pgm_get_min_buffer_size(e, &nr_tokens, &nr_msgs));
+	Expect(nr_tokens == 4 && nr_msgs == 0);
+	// initial tokens of the back-edge: 3 skips of 2
+	CheckError(pgm_find_edge4(&e, c, a, "c_a"));
+	CheckError(pgm_get_min_buffer_size(e, &nr_tokens, &nr_msgs));
+	Expect(nr_tokens == 6);
+
+	CheckError(pgm_init_static_schedule(&sched, g, 0, 0));
+	Expect(pgm_get_static_schedule(sched, seq, 32) == 11);
+	Expect(pgm_claim_node1(a) == -1);
+
+	memset(&s, 0, sizeof(s));
+	start = now_ns();
+	Expect(pgm_run_static_schedule(sched, fire, &s, TOTAL_PERIODS) == TOTAL_PERIODS);
+	double ns = (double)(now_ns() - start) / (11.0 * TOTAL_PERIODS);
+
+	Expect(s.nr_fired[0] == 3ull * TOTAL_PERIODS);
+	Expect(s.nr_fired[1] == 2ull * TOTAL_PERIODS);
+	Expect(s.nr_fired[2] == 6ull * TOTAL_PERIODS);
+
+	CheckError(pgm_destroy_static_schedule(sched));
+
+	// without initial tokens, the cycle deadlocks
+	CheckError(pgm_init_graph(&g, "schedtest_deadlock"));
+	CheckError(pgm_build_graph_str(g, "x:y", 0));
+	CheckError(pgm_find_node(&a, g, "x"));
+	CheckError(pgm_find_node(&b, g, "y"));
+	attr.nr_consume = 1;
+	attr.nr_threshold = 1;
+	CheckError(pgm_init_backedge6(&e, 0, b, a, "y_x", &attr));
+	Expect(pgm_init_static_schedule(&sched, g, 0, 0) == -1);
+
+	// inconsistent rates
+	CheckError(pgm_init_graph(&g, "schedtest_inconsistent"));
+	CheckError(pgm_build_graph_str(g, "x.2:y,y:z,x:z", 0));
+	Expect(pgm_get_repetition_vector(g, reps, 3) == -1);
+
+	CheckError(pgm_destroy());
+
+	fprintf(stdout, "%.1f ns per invocation. %s\n", ns, (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}
@@ -0,0 +1,287 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing graph snapshots. A small graph is saved and
+   loaded back, and its structure, edge attributes, node settings and
+   cached analysis are compared with the original. Corrupt, truncated and
+   foreign snapshots must be rejected. Finally, loading a large chain is
+   timed against building it call by call. */
+
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+#define Expect(cond) \
+do { if(!(cond)) { \
+	errors++; \
+	fprintf(stderr, "Failed: %s @ %s:%d\n", #cond, __FILE__, __LINE__); \
+}}while(0)
+
+const char* SNAPSHOT = "/tmp/snapshottest.snap";
+const char* BAD_SNAPSHOT = "/tmp/snapshottest.bad";
+
+const int CHAIN_LENGTH = 1000;
+const int TIMING_ROUNDS = 10;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static std::vector<char> read_file(const char* filename)
+{
+	std::vector<char> buf;
+	FILE* f = fopen(filename, "rb");
+	if(!f)
+		return buf;
+	fseek(f, 0, SEEK_END);
+	buf.resize(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	if(fread(&buf[0], 1, buf.size(), f) != buf.size())
+		buf.clear();
+	fclose(f);
+	return buf;
+}
+
+static void write_file(const char* filename, const char* data, size_t len)
+{
+	FILE* f = fopen(filename, "wb");
+	Expect(f != 0);
+	if(!f)
+		return;
+	Expect(fwrite(data, 1, len, f) == len);
+	fclose(f);
+}
+
+// Load a damaged copy of the snapshot. It must be rejected.
+static void expect_rejected(const std::vector<char>& buf, size_t len, const char* what)
+{
+	graph_t g;
+
+	write_file(BAD_SNAPSHOT, &buf[0], len);
+	if(pgm_load_graph(&g, BAD_SNAPSHOT, "snapshottest_bad") == 0)
+	{
+		fprintf(stderr, "A %s snapshot was loaded\n", what);
+		errors++;
+		CheckError(pgm_destroy_graph(g));
+	}
+	unlink(BAD_SNAPSHOT);
+}
+
+/*
+   src -> b -> c -> sink, where b is replicated, c has several jobs in
+   flight and src is periodic. A back-edge runs from sink to src.
+ */
+static void round_trip(void)
+{
+	graph_t g, h;
+	node_t src, b, c, sink;
+	node_t nodes[4];
+	edge_t e, be;
+	edge_attr_t ring_attr, cv_attr, attr;
+
+	CheckError(pgm_init_graph(&g, "snapshottest"));
+
+	CheckError(pgm_init_node(&src, g, "src"));
+	CheckError(pgm_init_node(&b, g, "b"));
+	CheckError(pgm_init_node(&c, g, "c"));
+	CheckError(pgm_init_node(&sink, g, "sink"));
+
+	memset(&ring_attr, 0, sizeof(ring_attr));
+	ring_attr.type = pgm_ring_edge;
+	ring_attr.nr_produce = sizeof(uint32_t);
+	ring_attr.nr_consume = sizeof(uint32_t);
+	ring_attr.nr_threshold = sizeof(uint32_t);
+	ring_attr.nmemb = 32;
+
+	memset(&cv_attr, 0, sizeof(cv_attr));
+	cv_attr.type = pgm_cv_edge;
+	cv_attr.nr_produce = 1;
+	cv_attr.nr_consume = 1;
+	cv_attr.nr_threshold = 1;
+
+	CheckError(pgm_init_edge5(&e, src, b, "src_b", &ring_attr));
+	CheckError(pgm_init_edge5(&e, b, c, "b_c", &cv_attr));
+	CheckError(pgm_init_edge5(&e, c, sink, "c_sink", &cv_attr));
+	CheckError(pgm_init_backedge6(&be, 1, sink, src, "sink_src", &cv_attr));
+
+	CheckError(pgm_set_periodic(src, 1000000, 250000));
+	CheckError(pgm_set_replicas(b, 3, PGM_REPLICA_ROUND_ROBIN));
+	CheckError(pgm_set_concurrency(c, 4));
+
+	CheckError(pgm_save_graph(g, SNAPSHOT));
+	CheckError(pgm_load_graph(&h, SNAPSHOT, "snapshottest_copy"));
+	if(errors)
+	{
+		CheckError(pgm_destroy_graph(g));
+		return;
+	}
+
+	Expect(pgm_get_nr_nodes(h) == 4);
+	Expect(pgm_get_nr_edges(h) == 4);
+	Expect(pgm_get_nodes(h, nodes, 4) == 4);
+	Expect(strcmp(pgm_get_name(nodes[0]), "src") == 0);
+	Expect(strcmp(pgm_get_name(nodes[3]), "sink") == 0);
+	Expect(pgm_get_degree_in2(nodes[0], 0) == 1);
+	Expect(pgm_get_degree_in2(nodes[0], 1) == 0);
+	Expect(pgm_get_degree_out2(nodes[3], 0) == 1);
+	Expect(pgm_get_degree_out2(nodes[3], 1) == 0);
+
+	memset(&attr, 0, sizeof(attr));
+	CheckError(pgm_find_edge5(&e, nodes[0], nodes[1], "src_b", &attr));
+	Expect(attr.type == pgm_ring_edge);
+	Expect(attr.nr_produce == sizeof(uint32_t));
+	Expect(attr.nmemb == 32);
+	CheckError(pgm_find_edge4(&be, nodes[3], nodes[0], "sink_src"));
+	Expect(pgm_is_backedge(be));
+
+	// answered from the saved analysis
+	Expect(pgm_is_dag2(h, 1));
+	Expect(pgm_get_min_depth1(nodes[3]) == 3.0);
+	Expect(pgm_get_max_depth1(nodes[3]) == 3.0);
+
+	// the settings came along: b is still replicated, c still has
+	// jobs in flight, and neither may take on the other mode
+	Expect(pgm_set_concurrency(nodes[1], 2) == -1);
+	Expect(pgm_set_replicas(nodes[2], 2, PGM_REPLICA_DYNAMIC) == -1);
+
+	CheckError(pgm_destroy_graph(h));
+	CheckError(pgm_destroy_graph(g));
+}
+
+static void damaged(void)
+{
+	std::vector<char> buf = read_file(SNAPSHOT);
+	std::vector<char> bad;
+
+	Expect(buf.size() > 64);
+	if(buf.size() <= 64)
+		return;
+
+	// a byte of the last edge record
+	bad = buf;
+	bad[bad.size() - 100] ^= 0x5a;
+	expect_rejected(bad, bad.size(), "corrupt");
+
+	expect_rejected(buf, buf.size() - 1, "truncated");
+	expect_rejected(buf, 32, "truncated");
+
+	// the header's limits follow the magic, version and three record
+	// sizes (see struct pgm_snapshot_hdr)
+	bad = buf;
+	uint32_t max_nodes;
+	memcpy(&max_nodes, &bad[24], sizeof(max_nodes));
+	Expect(max_nodes == PGM_MAX_NODES);
+	max_nodes *= 2;
+	memcpy(&bad[24], &max_nodes, sizeof(max_nodes));
+	expect_rejected(bad, bad.size(), "foreign");
+
+	bad = buf;
+	bad[0] = 'X';
+	expect_rejected(bad, bad.size(), "non-snapshot");
+
+	unlink(SNAPSHOT);
+}
+
+static void build_chain(graph_t* g, const char* name)
+{
+	node_t prev, n;
+	edge_t e;
+	edge_attr_t cv_attr;
+	char buf[PGM_NODE_NAME_LEN];
+
+	memset(&cv_attr, 0, sizeof(cv_attr));
+	cv_attr.type = pgm_cv_edge;
+	cv_attr.nr_produce = 1;
+	cv_attr.nr_consume = 1;
+	cv_attr.nr_threshold = 1;
+
+	CheckError(pgm_init_graph(g, name));
+	for(int i = 0; i < CHAIN_LENGTH; ++i)
+	{
+		snprintf(buf, sizeof(buf), "n%d", i);
+		CheckError(pgm_init_node(&n, *g, buf));
+		if(i > 0)
+		{
+			snprintf(buf, sizeof(buf), "e%d", i);
+			CheckError(pgm_init_edge5(&e, prev, n, buf, &cv_attr));
+		}
+		prev = n;
+	}
+}
+
+static void timing(void)
+{
+	graph_t g;
+	uint64_t build_ns = 0, analysis_ns = 0, load_ns = 0;
+
+	build_chain(&g, "snapshottest_chain");
+	CheckError(pgm_save_graph(g, SNAPSHOT));
+	CheckError(pgm_destroy_graph(g));
+
+	for(int i = 0; i < TIMING_ROUNDS && !errors; ++i)
+	{
+		uint64_t start = now_ns();
+		build_chain(&g, "snapshottest_chain");
+		build_ns += now_ns() - start;
+
+		node_t last;
+		CheckError(pgm_find_node(&last, g, "n999"));
+		start = now_ns();
+		Expect(pgm_is_dag2(g, 1));
+		Expect(pgm_get_max_depth1(last) == CHAIN_LENGTH - 1);
+		analysis_ns += now_ns() - start;
+		CheckError(pgm_destroy_graph(g));
+
+		start = now_ns();
+		CheckError(pgm_load_graph(&g, SNAPSHOT, 0));
+		load_ns += now_ns() - start;
+		CheckError(pgm_destroy_graph(g));
+	}
+	unlink(SNAPSHOT);
+
+	fprintf(stdout, "%d nodes: build %.1f us (+%.1f us analysis), load %.1f us. ",
+		CHAIN_LENGTH,
+		build_ns / 1e3 / TIMING_ROUNDS,
+		analysis_ns / 1e3 / TIMING_ROUNDS,
+		load_ns / 1e3 / TIMING_ROUNDS);
+}
+
+int main(void)
+{
+	CheckError(pgm_init_process_local());
+
+	round_trip();
+	if(!errors)
+		damaged();
+	if(!errors)
+		timing();
+
+	CheckError(pgm_destroy());
+
+	fprintf(stdout, "%s\n", (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}
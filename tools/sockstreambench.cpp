@@ -0,0 +1,275 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for measuring the latency and throughput of
+   sock_stream (TCP) edges over loopback, with and without the
+   sock_stream tuning attributes. */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+size_t MSG_SIZE = 64;
+int ITERATIONS = 100000;
+int PORT = 10101;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/*
+   Latency: n0 and n1 bounce a message back and forth over a
+   sock_stream edge and a sock_stream back-edge.
+ */
+
+node_t lat_n0, lat_n1;
+edge_t lat_fwd, lat_back;
+std::vector<uint64_t> rtts;
+
+void* lat_initiator(void*)
+{
+	CheckError(pgm_claim_node1(lat_n0));
+	char* out = (char*)pgm_get_edge_buf_p(lat_fwd);
+
+	CheckError(pgm_wait(lat_n0)); // skip the back-edge
+	for(int i = 0; i < ITERATIONS && !errors; ++i)
+	{
+		memset(out, i, MSG_SIZE);
+		uint64_t start = now_ns();
+		CheckError(pgm_complete(lat_n0));
+		CheckError(pgm_wait(lat_n0));
+		rtts.push_back(now_ns() - start);
+	}
+	CheckError(pgm_terminate(lat_n0));
+
+	CheckError(pgm_release_node1(lat_n0));
+	pthread_exit(0);
+}
+
+void* lat_responder(void*)
+{
+	int ret;
+	CheckError(pgm_claim_node1(lat_n1));
+	while((ret = pgm_wait(lat_n1)) != PGM_TERMINATE)
+	{
+		CheckError(ret);
+		CheckError(pgm_complete(lat_n1));
+	}
+	CheckError(pgm_release_node1(lat_n1));
+	pthread_exit(0);
+}
+
+/*
+   Throughput: src drives relay as fast as it can over a CV edge.
+   relay forwards each token to sink over a sock_stream edge.
+   (The relay, not the source, produces to the socket so that
+   message coalescing may take effect.)
+ */
+
+node_t tp_src, tp_relay, tp_sink;
+edge_t tp_cv, tp_sock;
+double tp_msgs_per_sec = 0;
+
+void* tp_source(void*)
+{
+	CheckError(pgm_claim_node1(tp_src));
+	for(int i = 0; i < ITERATIONS && !errors; ++i)
+		CheckError(pgm_complete(tp_src));
+	CheckError(pgm_terminate(tp_src));
+	CheckError(pgm_release_node1(tp_src));
+	pthread_exit(0);
+}
+
+void* tp_forwarder(void*)
+{
+	int ret;
+	uint32_t seq = 0;
+	CheckError(pgm_claim_node1(tp_relay));
+	char* out = (char*)pgm_get_edge_buf_p(tp_sock);
+	while((ret = pgm_wait(tp_relay)) != PGM_TERMINATE)
+	{
+		CheckError(ret);
+		memcpy(out, &seq, std::min(sizeof(seq), MSG_SIZE));
+		++seq;
+		CheckError(pgm_complete(tp_relay));
+	}
+	CheckError(pgm_release_node1(tp_relay));
+	pthread_exit(0);
+}
+
+void* tp_receiver(void*)
+{
+	int ret;
+	int count = 0;
+	uint32_t seq;
+	uint64_t start = 0;
+	CheckError(pgm_claim_node1(tp_sink));
+	const char* in = (const char*)pgm_get_edge_buf_c(tp_sock);
+	while((ret = pgm_wait(tp_sink)) != PGM_TERMINATE)
+	{
+		CheckError(ret);
+		if(count == 0)
+			start = now_ns();
+		seq = 0;
+		memcpy(&seq, in, std::min(sizeof(seq), MSG_SIZE));
+		if(MSG_SIZE >= sizeof(seq) && seq != (uint32_t)count)
+		{
+			fprintf(stderr, "Out of order message: %u (expected %d)\n", seq, count);
+			errors++;
+		}
+		++count;
+	}
+	if(count > 1)
+		tp_msgs_per_sec = (count - 1) / ((now_ns() - start) / 1e9);
+	CheckError(pgm_release_node1(tp_sink));
+	pthread_exit(0);
+}
+
+void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -s bytes   message size (default %lu)\n"
+		"  -n count   number of messages (default %d)\n"
+		"  -p port    first TCP port to use (default %d)\n"
+		"  -D         set TCP_NODELAY\n"
+		"  -S bytes   SO_SNDBUF of producers\n"
+		"  -R bytes   SO_RCVBUF of consumers\n"
+		"  -B usecs   SO_BUSY_POLL of consumers\n"
+		"  -Z bytes   send messages of at least this size with MSG_ZEROCOPY\n"
+		"  -C usecs   coalesce messages produced within this window\n",
+		prog, MSG_SIZE, ITERATIONS, PORT);
+	exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+	graph_t g;
+	pthread_t t0, t1, t2;
+	edge_attr_t tcp_attr, cv_attr;
+	int opt;
+
+	memset(&tcp_attr, 0, sizeof(tcp_attr));
+	tcp_attr.type = pgm_sock_stream_edge;
+	tcp_attr.node = "localhost";
+
+	while((opt = getopt(argc, argv, "s:n:p:DS:R:B:Z:C:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 's': MSG_SIZE = strtoul(optarg, 0, 10); break;
+			case 'n': ITERATIONS = atoi(optarg); break;
+			case 'p': PORT = atoi(optarg); break;
+			case 'D': tcp_attr.nodelay = 1; break;
+			case 'S': tcp_attr.sndbuf = atoi(optarg); break;
+			case 'R': tcp_attr.rcvbuf = atoi(optarg); break;
+			case 'B': tcp_attr.busy_poll = atoi(optarg); break;
+			case 'Z': tcp_attr.zerocopy_min = strtoul(optarg, 0, 10); break;
+			case 'C': tcp_attr.coalesce_us = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if(MSG_SIZE == 0 || ITERATIONS <= 0)
+		usage(argv[0]);
+
+	tcp_attr.nr_produce = MSG_SIZE;
+	tcp_attr.nr_consume = MSG_SIZE;
+	tcp_attr.nr_threshold = MSG_SIZE;
+
+	memset(&cv_attr, 0, sizeof(cv_attr));
+	cv_attr.type = pgm_cv_edge;
+	cv_attr.nr_produce = 1;
+	cv_attr.nr_consume = 1;
+	cv_attr.nr_threshold = 1;
+
+	CheckError(pgm_init2("/tmp/graphs", 1));
+
+	// latency
+	CheckError(pgm_init_graph(&g, "sockstreambench_lat"));
+	CheckError(pgm_init_node(&lat_n0, g, "n0"));
+	CheckError(pgm_init_node(&lat_n1, g, "n1"));
+	tcp_attr.port = PORT;
+	CheckError(pgm_init_edge5(&lat_fwd, lat_n0, lat_n1, "fwd", &tcp_attr));
+	tcp_attr.port = PORT + 1;
+	CheckError(pgm_init_backedge6(&lat_back, 1, lat_n1, lat_n0, "back", &tcp_attr));
+
+	if(!errors)
+	{
+		rtts.reserve(ITERATIONS);
+		pthread_create(&t0, 0, lat_initiator, 0);
+		pthread_create(&t1, 0, lat_responder, 0);
+		pthread_join(t0, 0);
+		pthread_join(t1, 0);
+	}
+	CheckError(pgm_destroy_graph(g));
+
+	// throughput
+	CheckError(pgm_init_graph(&g, "sockstreambench_tp"));
+	CheckError(pgm_init_node(&tp_src, g, "src"));
+	CheckError(pgm_init_node(&tp_relay, g, "relay"));
+	CheckError(pgm_init_node(&tp_sink, g, "sink"));
+	CheckError(pgm_init_edge5(&tp_cv, tp_src, tp_relay, "cv", &cv_attr));
+	tcp_attr.port = PORT + 2;
+	CheckError(pgm_init_edge5(&tp_sock, tp_relay, tp_sink, "sock", &tcp_attr));
+
+	if(!errors)
+	{
+		pthread_create(&t0, 0, tp_source, 0);
+		pthread_create(&t1, 0, tp_forwarder, 0);
+		pthread_create(&t2, 0, tp_receiver, 0);
+		pthread_join(t0, 0);
+		pthread_join(t1, 0);
+		pthread_join(t2, 0);
+	}
+	CheckError(pgm_destroy_graph(g));
+
+	CheckError(pgm_destroy());
+
+	if(errors || rtts.empty())
+		return -1;
+
+	std::sort(rtts.begin(), rtts.end());
+	double sum = 0;
+	for(size_t i = 0; i < rtts.size(); ++i)
+		sum += rtts[i];
+
+	fprintf(stdout,
+		"size=%lu nodelay=%d sndbuf=%d rcvbuf=%d busy_poll=%d zerocopy_min=%lu coalesce_us=%d\n"
+		"latency (one-way, us): avg %.2f  p50 %.2f  p99 %.2f  max %.2f\n"
+		"throughput: %.0f msgs/s  %.2f MB/s\n",
+		MSG_SIZE, tcp_attr.nodelay, tcp_attr.sndbuf, tcp_attr.rcvbuf,
+		tcp_attr.busy_poll, tcp_attr.zerocopy_min, tcp_attr.coalesce_us,
+		sum / rtts.size() / 2e3,
+		rtts[rtts.size()/2] / 2e3,
+		rtts[(size_t)(rtts.size()*0.99)] / 2e3,
+		rtts.back() / 2e3,
+		tp_msgs_per_sec,
+		tp_msgs_per_sec * MSG_SIZE / (1024.0*1024.0));
+
+	return 0;
+}
@@ -0,0 +1,315 @@
+// Copyright (c) 2014, Glenn Elliott
+// All rights reserved.
+
+/* A program for testing custom edge transports. Two transports are
+   registered: a signaled in-process byte ring that also allocates
+   edge buffers, and a pipe that consumers wait on with select().
+   Runtime statistics and end-to-end latency are checked against
+   the traffic. */
+
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pgm.h"
+
+int errors = 0;
+
+__thread char __errstr[80] = {0};
+
+#define CheckError(e) \
+do { int __ret = (e); \
+if(__ret < 0) { \
+	errors++; \
+	char* errstr = strerror_r(errno, __errstr, sizeof(errstr)); \
+	fprintf(stderr, "%lu: Error %d (%s (%d)) @ %s:%s:%d\n",  \
+		pthread_self(), __ret, errstr, errno, __FILE__, __FUNCTION__, __LINE__); \
+}}while(0)
+
+int TOTAL_ITERATIONS = 10*1000;
+
+/*
+   Ring transport: single-producer/single-consumer byte ring.
+   The per-edge state area holds a pointer to the ring.
+ */
+
+#define RING_SIZE 4096
+
+struct ring
+{
+	volatile size_t head; // next byte to read
+	volatile size_t tail; // next byte to write
+	char data[RING_SIZE];
+};
+
+int ring_nr_alloc = 0;
+int ring_nr_free = 0;
+
+int ring_init(edge_t, void* state)
+{
+	*(ring**)state = (ring*)calloc(1, sizeof(ring));
+	return (*(ring**)state) ? 0 : -1;
+}
+
+int ring_destroy(edge_t, void* state)
+{
+	free(*(ring**)state);
+	*(ring**)state = 0;
+	return 0;
+}
+
+ssize_t ring_read(void* state, void* buf, size_t nbytes)
+{
+	ring* r = *(ring**)state;
+	size_t head = r->head;
+	size_t avail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - head;
+	if(avail == 0)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	if(nbytes > avail)
+		nbytes = avail;
+	for(size_t i = 0; i < nbytes; ++i)
+		((char*)buf)[i] = r->data[(head + i) % RING_SIZE];
+	__atomic_store_n(&r->head, head + nbytes, __ATOMIC_RELEASE);
+	return nbytes;
+}
+
+ssize_t ring_write(void* state, const void* buf, size_t nbytes)
+{
+	ring* r = *(ring**)state;
+	size_t tail = r->tail;
+	size_t space = RING_SIZE - (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE));
+	if(space == 0)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	if(nbytes > space)
+		nbytes = space;
+	for(size_t i = 0; i < nbytes; ++i)
+		r->data[(tail + i) % RING_SIZE] = ((const char*)buf)[i];
+	__atomic_store_n(&r->tail, tail + nbytes, __ATOMIC_RELEASE);
+	return nbytes;
+}
+
+void* ring_alloc_buf(void*, size_t nbytes, int)
+{
+	void* buf = 0;
+	if(posix_memalign(&buf, 16, nbytes) != 0)
+		return 0;
+	__sync_fetch_and_add(&ring_nr_alloc, 1);
+	return buf;
+}
+
+void ring_free_buf(void* buf)
+{
+	__sync_fetch_and_add(&ring_nr_free, 1);
+	free(buf);
+}
+
+/*
+   Pipe transport: the pipe is created with the edge. The consumer
+   blocks on the read end.
+ */
+
+int pipe_init(edge_t, void* state)
+{
+	int* fds = (int*)state;
+	if(pipe2(fds, O_NONBLOCK) != 0)
+		return -1;
+	return 0;
+}
+
+int pipe_destroy(edge_t, void* state)
+{
+	int* fds = (int*)state;
+	close(fds[0]);
+	close(fds[1]);
+	return 0;
+}
+
+ssize_t pipe_read(void* state, void* buf, size_t nbytes)
+{
+	return read(((int*)state)[0], buf, nbytes);
+}
+
+ssize_t pipe_write(void* state, const void* buf, size_t nbytes)
+{
+	return write(((int*)state)[1], buf, nbytes);
+}
+
+int pipe_read_fd(void* state)
+{
+	return ((int*)state)[0];
+}
+
+/*
+   src produces a counter on both edges. sink checks that both
+   edges deliver the same sequence.
+ */
+
+node_t src, sink;
+edge_t ring_edge, pipe_edge;
+int nr_received = 0;
+
+void* source(void*)
+{
+	CheckError(pgm_claim_node1(src));
+	uint32_t* a = (uint32_t*)pgm_get_edge_buf_p(ring_edge);
+	uint32_t* b = (uint32_t*)pgm_get_edge_buf_p(pipe_edge);
+	if(!a || !b)
+		errors++;
+	for(uint32_t i = 0; i < (uint32_t)TOTAL_ITERATIONS && !errors; ++i)
+	{
+#if defined(PGM_LATENCY)
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		CheckError(pgm_set_origin(src, now.tv_sec*1000000000ull + now.tv_nsec));
+#endif
+		*a = i;
+		*b = ~i;
+		CheckError(pgm_complete(src));
+	}
+	CheckError(pgm_terminate(src));
+	CheckError(pgm_release_node1(src));
+	pthread_exit(0);
+}
+
+void* consumer(void*)
+{
+	int ret;
+	CheckError(pgm_claim_node1(sink));
+	const uint32_t* a = (const uint32_t*)pgm_get_edge_buf_c(ring_edge);
+	const uint32_t* b = (const uint32_t*)pgm_get_edge_buf_c(pipe_edge);
+	if(!a || !b)
+		errors++;
+	while(!errors && (ret = pgm_wait(sink)) != PGM_TERMINATE)
+	{
+		CheckError(ret);
+		if(*a != (uint32_t)nr_received || *b != ~(uint32_t)nr_received)
+		{
+			fprintf(stderr, "Bad message %d: %u %u\n", nr_received, *a, ~*b);
+			errors++;
+		}
+		++nr_received;
+		CheckError(pgm_complete(sink));  // records latency
+	}
+	CheckError(pgm_release_node1(sink));
+	pthread_exit(0);
+}
+
+int main(void)
+{
+	graph_t g;
+	pthread_t t0, t1;
+	edge_attr_t attr;
+	pgm_edge_transport_t transport;
+
+	CheckError(pgm_init_process_local());
+
+	memset(&attr, 0, sizeof(attr));
+	attr.nr_produce = sizeof(uint32_t);
+	attr.nr_consume = sizeof(uint32_t);
+	attr.nr_threshold = sizeof(uint32_t);
+
+	CheckError(pgm_init_graph(&g, "transporttest"));
+	CheckError(pgm_init_node(&src, g, "src"));
+	CheckError(pgm_init_node(&sink, g, "sink"));
+
+	memset(&transport, 0, sizeof(transport));
+	transport.name = "ring";
+	transport.signaled = 1;
+	transport.init = ring_init;
+	transport.destroy = ring_destroy;
+	transport.read = ring_read;
+	transport.write = ring_write;
+	transport.alloc_buf = ring_alloc_buf;
+	transport.free_buf = ring_free_buf;
+	CheckError(pgm_register_transport(&transport, &attr.type));
+	CheckError(pgm_init_edge5(&ring_edge, src, sink, "ring", &attr));
+
+	memset(&transport, 0, sizeof(transport));
+	transport.name = "pipe";
+	transport.init = pipe_init;
+	transport.destroy = pipe_destroy;
+	transport.read = pipe_read;
+	transport.write = pipe_write;
+	transport.read_fd = pipe_read_fd;
+	CheckError(pgm_register_transport(&transport, &attr.type));
+	CheckError(pgm_init_edge5(&pipe_edge, src, sink, "pipe", &attr));
+
+	// a transport without read() must be rejected
+	transport.read = 0;
+	if(pgm_register_transport(&transport, &attr.type) != -1)
+	{
+		fprintf(stderr, "Incomplete transport was accepted\n");
+		errors++;
+	}
+
+	if(!errors)
+	{
+		pthread_create(&t0, 0, source, 0);
+		pthread_create(&t1, 0, consumer, 0);
+		pthread_join(t0, 0);
+		pthread_join(t1, 0);
+	}
+
+#if defined(PGM_STATS)
+	// every message should show up in the runtime statistics
+	pgm_node_stats_t nstats;
+	pgm_edge_stats_t estats;
+	CheckError(pgm_get_node_stats(sink, &nstats));
+	CheckError(pgm_get_edge_stats(ring_edge, &estats));
+	if(nstats.nr_invocations != (uint64_t)TOTAL_ITERATIONS ||
+	   estats.nr_produced != TOTAL_ITERATIONS*sizeof(uint32_t) ||
+	   estats.nr_consumed != estats.nr_produced ||
+	   estats.bytes_received != estats.bytes_sent ||
+	   estats.max_pending < sizeof(uint32_t))
+	{
+		fprintf(stderr, "Bad statistics: %lu invocations, %lu/%lu tokens, %lu/%lu bytes\n",
+			nstats.nr_invocations, estats.nr_produced, estats.nr_consumed,
+			estats.bytes_sent, estats.bytes_received);
+		errors++;
+	}
+#endif
+
+#if defined(PGM_LATENCY)
+	// the sink should have seen the origin of every message
+	pgm_latency_stats_t lat;
+	CheckError(pgm_get_latency_stats(sink, &lat));
+	if(lat.count + lat.nr_lost != (uint64_t)TOTAL_ITERATIONS || lat.count == 0 ||
+	   lat.min_ns > lat.p50_ns ||
+	   lat.p50_ns > lat.p99_ns || lat.p99_ns > lat.max_ns)
+	{
+		fprintf(stderr, "Bad latency: %lu+%lu jobs, min %lu, p50 %lu, p99 %lu, max %lu\n",
+			lat.count, lat.nr_lost, lat.min_ns, lat.p50_ns, lat.p99_ns, lat.max_ns);
+		errors++;
+	}
+#endif
+
+	CheckError(pgm_print_graph(g, stdout));
+	CheckError(pgm_destroy_graph(g));
+	CheckError(pgm_destroy());
+
+	if(nr_received != TOTAL_ITERATIONS)
+	{
+		fprintf(stderr, "Received %d of %d messages\n", nr_received, TOTAL_ITERATIONS);
+		errors++;
+	}
+	if(ring_nr_alloc != 2 || ring_nr_free != ring_nr_alloc)
+	{
+		fprintf(stderr, "Ring buffers: %d allocated, %d freed\n", ring_nr_alloc, ring_nr_free);
+		errors++;
+	}
+
+	fprintf(stdout, "%s\n", (errors) ? "FAILED" : "PASSED");
+	return (errors) ? -1 : 0;
+}